@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtpp_ssrc.h"
+#include "rtpa_stats.h"
+#include "rtpp_monotime.h"
+#include "rtpp_types.h"
+#include "rtpp_pcount.h"
+#include "rtpp_pcnt_strm.h"
+#include "rtpp_acct_pipe.h"
+#include "rtpp_acct.h"
+#include "rtpp_module.h"
+#include "rtpp_netaddr.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_log.h"
+#include "rtpp_log_obj.h"
+
+#include "rtpp_acct_rbin.h"
+
+struct rtpp_module_priv {
+   int fd;
+   pid_t pid;
+   char fname[MAXPATHLEN + 1];
+   struct rtpp_acct_rbin_hdr *hdr;
+   struct rtpp_acct_rbin_rec *recs;
+   size_t mlen;
+   double next_hupd_ts;
+   double next_owarn_ts;
+   unsigned long nowarn;
+   char node_id[RTPP_ACCT_RBIN_NIDLEN];
+};
+
+#define HNAME_REFRESH_IVAL	1.0
+#define OVERWR_WARN_IVAL	60.0
+
+static struct rtpp_module_priv *rtpp_acct_rbin_ctor(struct rtpp_cfg_stable *);
+static void rtpp_acct_rbin_dtor(struct rtpp_module_priv *);
+static void rtpp_acct_rbin_do(struct rtpp_module_priv *, struct rtpp_acct *);
+
+#define API_FUNC(fname, asize) {.func = (fname), .argsize = (asize)}
+
+struct rtpp_minfo rtpp_module = {
+    .name = "acct_rbin",
+    .ver = MI_VER_INIT(),
+    .ctor = rtpp_acct_rbin_ctor,
+    .dtor = rtpp_acct_rbin_dtor,
+    .on_session_end = API_FUNC(rtpp_acct_rbin_do, rtpp_acct_OSIZE())
+};
+
+static int
+rtpp_acct_rbin_lockf(int fd, int type)
+{
+    struct flock l;
+    int rval;
+
+    memset(&l, '\0', sizeof(l));
+    l.l_whence = SEEK_SET;
+    l.l_type = type;
+    do {
+        rval = fcntl(fd, F_SETLKW, &l);
+    } while (rval == -1 && errno == EINTR);
+    return (rval);
+}
+
+/*
+ * Open the ring file, creating and formatting it if it's new. The lock is
+ * only held here, so that concurrent instances don't race on formatting,
+ * records are appended lock-free.
+ */
+static int
+rtpp_acct_rbin_open(struct rtpp_module_priv *pvt)
+{
+    struct stat stt;
+    struct rtpp_acct_rbin_hdr *hdr;
+    void *mp;
+
+    pvt->fd = open(pvt->fname, O_RDWR | O_CREAT, DEFFILEMODE);
+    if (pvt->fd == -1) {
+        mod_elog(RTPP_LOG_ERR, "can't open '%s' for writing", pvt->fname);
+        goto e0;
+    }
+    if (rtpp_acct_rbin_lockf(pvt->fd, F_WRLCK) == -1) {
+        mod_elog(RTPP_LOG_ERR, "can't lock '%s'", pvt->fname);
+        goto e1;
+    }
+    if (fstat(pvt->fd, &stt) < 0) {
+        mod_elog(RTPP_LOG_ERR, "can't get stats for '%s'", pvt->fname);
+        goto e2;
+    }
+    pvt->mlen = RTPP_ACCT_RBIN_FSIZE(RTPP_ACCT_RBIN_NSLOTS);
+    if (stt.st_size == 0 && ftruncate(pvt->fd, pvt->mlen) == -1) {
+        mod_elog(RTPP_LOG_ERR, "can't resize '%s'", pvt->fname);
+        goto e2;
+    }
+    if (stt.st_size != 0 && stt.st_size != pvt->mlen) {
+        mod_log(RTPP_LOG_ERR, "'%s' has unexpected size, remove or rename "
+          "it", pvt->fname);
+        goto e2;
+    }
+    mp = mmap(NULL, pvt->mlen, PROT_READ | PROT_WRITE, MAP_SHARED, pvt->fd, 0);
+    if (mp == MAP_FAILED) {
+        mod_elog(RTPP_LOG_ERR, "can't mmap '%s'", pvt->fname);
+        goto e2;
+    }
+    hdr = (struct rtpp_acct_rbin_hdr *)mp;
+    if (stt.st_size == 0) {
+        hdr->version = RTPP_ACCT_RBIN_VERSION;
+        hdr->hdr_size = RTPP_ACCT_RBIN_HDRSIZE;
+        hdr->rec_size = RTPP_ACCT_RBIN_RECSIZE;
+        hdr->nslots = RTPP_ACCT_RBIN_NSLOTS;
+        hdr->wseq = 0;
+        hdr->rseq = 0;
+        hdr->noverwr = 0;
+        __sync_synchronize();
+        memcpy(hdr->magic, RTPP_ACCT_RBIN_MAGIC, sizeof(hdr->magic));
+    } else if (memcmp(hdr->magic, RTPP_ACCT_RBIN_MAGIC, sizeof(hdr->magic)) != 0 ||
+      hdr->version != RTPP_ACCT_RBIN_VERSION ||
+      hdr->hdr_size != RTPP_ACCT_RBIN_HDRSIZE ||
+      hdr->rec_size != RTPP_ACCT_RBIN_RECSIZE ||
+      hdr->nslots != RTPP_ACCT_RBIN_NSLOTS) {
+        mod_log(RTPP_LOG_ERR, "'%s' has incompatible format, remove or "
+          "rename it", pvt->fname);
+        goto e3;
+    }
+    rtpp_acct_rbin_lockf(pvt->fd, F_UNLCK);
+    pvt->hdr = hdr;
+    pvt->recs = (struct rtpp_acct_rbin_rec *)((char *)mp + hdr->hdr_size);
+    return (0);
+
+e3:
+    munmap(mp, pvt->mlen);
+e2:
+    rtpp_acct_rbin_lockf(pvt->fd, F_UNLCK);
+e1:
+    close(pvt->fd);
+e0:
+    return (-1);
+}
+
+static struct rtpp_module_priv *
+rtpp_acct_rbin_ctor(struct rtpp_cfg_stable *cfsp)
+{
+    struct rtpp_module_priv *pvt;
+
+    pvt = mod_zmalloc(sizeof(struct rtpp_module_priv));
+    if (pvt == NULL) {
+        goto e0;
+    }
+    pvt->pid = getpid();
+    if (cfsp->cwd_orig == NULL) {
+        snprintf(pvt->fname, sizeof(pvt->fname), "%s", "rtpproxy_acct.rbin");
+    } else {
+        snprintf(pvt->fname, sizeof(pvt->fname), "%s/%s", cfsp->cwd_orig,
+          "rtpproxy_acct.rbin");
+    }
+    if (gethostname(pvt->node_id, sizeof(pvt->node_id)) != 0) {
+        strcpy(pvt->node_id, "UNKNOWN");
+    }
+    if (rtpp_acct_rbin_open(pvt) == -1) {
+        goto e1;
+    }
+    return (pvt);
+
+e1:
+    mod_free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_acct_rbin_dtor(struct rtpp_module_priv *pvt)
+{
+
+    munmap(pvt->hdr, pvt->mlen);
+    close(pvt->fd);
+    mod_free(pvt);
+    return;
+}
+
+static const char *
+rtpp_acct_get_nid(struct rtpp_module_priv *pvt, struct rtpp_acct *ap)
+{
+
+    if (pvt->next_hupd_ts == 0.0 || pvt->next_hupd_ts < ap->destroy_ts) {
+        if (gethostname(pvt->node_id, sizeof(pvt->node_id)) == 0) {
+            pvt->next_hupd_ts = ap->destroy_ts + HNAME_REFRESH_IVAL;
+        }
+    }
+    return (pvt->node_id);
+}
+
+#define MT2RT_NZ(mt) ((mt) == 0.0 ? 0.0 : dtime2rtime(mt))
+
+static void
+fill_addr(struct rtpp_netaddr *nap, struct rtpp_acct_rbin_addr *rap)
+{
+    struct sockaddr_storage sa;
+
+    if (CALL_SMETHOD(nap, isempty)) {
+        return;
+    }
+    CALL_SMETHOD(nap, get, (struct sockaddr *)&sa, sizeof(sa));
+    rap->family = sa.ss_family;
+    switch (sa.ss_family) {
+    case AF_INET:
+        rap->port = ntohs(((struct sockaddr_in *)&sa)->sin_port);
+        memcpy(rap->addr, &((struct sockaddr_in *)&sa)->sin_addr, 4);
+        break;
+
+    case AF_INET6:
+        rap->port = ntohs(((struct sockaddr_in6 *)&sa)->sin6_port);
+        memcpy(rap->addr, &((struct sockaddr_in6 *)&sa)->sin6_addr, 16);
+        break;
+    }
+}
+
+static void
+fill_face(struct rtpp_acct_face *rtp_fp,
+  struct rtpp_acct_face *rtcp_fp, struct rtpa_stats *rsp,
+  struct rtpa_stats_jitter *jrsp, struct rtpp_acct_rbin_face *bfp)
+{
+
+    bfp->first_rtp_ts = MT2RT_NZ(rtp_fp->ps->first_pkt_rcv);
+    bfp->last_rtp_ts = MT2RT_NZ(rtp_fp->ps->last_pkt_rcv);
+    bfp->rtp_npkts = rtp_fp->ps->npkts_in;
+    bfp->rtcp_npkts = rtcp_fp->ps->npkts_in;
+    fill_addr(rtp_fp->rem_addr, &bfp->rtp_addr);
+    fill_addr(rtcp_fp->rem_addr, &bfp->rtcp_addr);
+    bfp->psent = rsp->psent;
+    bfp->precvd = rsp->precvd;
+    bfp->pdups = rsp->pdups;
+    bfp->plost = rsp->plost;
+    bfp->pecount = rsp->pecount;
+    bfp->ssrc_changes = rsp->ssrc_changes;
+    bfp->last_ssrc = rsp->last_ssrc.val;
+    bfp->ssrc_inited = rsp->last_ssrc.inited;
+    bfp->last_pt = rsp->last_pt;
+    bfp->jlast = jrsp->jlast;
+    bfp->jmax = jrsp->jmax;
+    bfp->javg = jrsp->javg;
+    bfp->hld_status = rtp_fp->hld_stat.status;
+    bfp->hld_cnt = rtp_fp->hld_stat.cnt;
+}
+
+static uint16_t
+fill_str(char *dst, size_t dlen, const char *src)
+{
+    size_t slen;
+
+    if (src == NULL) {
+        return (0);
+    }
+    slen = MIN(strlen(src), dlen - 1);
+    memcpy(dst, src, slen);
+    return (slen);
+}
+
+static void
+rtpp_acct_rbin_do(struct rtpp_module_priv *pvt, struct rtpp_acct *acct)
+{
+    uint64_t wseq;
+    struct rtpp_acct_rbin_rdata *rdp;
+
+    wseq = __sync_fetch_and_add(&pvt->hdr->wseq, 1);
+    if (wseq >= pvt->hdr->nslots &&
+      wseq - pvt->hdr->nslots >= pvt->hdr->rseq) {
+        __sync_fetch_and_add(&pvt->hdr->noverwr, 1);
+        /*
+         * Once the reader has fallen behind every record overwrites one,
+         * don't flood the log, the header keeps the total count.
+         */
+        pvt->nowarn++;
+        if (pvt->next_owarn_ts == 0.0 ||
+          pvt->next_owarn_ts < acct->destroy_ts) {
+            mod_log(RTPP_LOG_WARN, "'%s' is full, %lu record(s) that have "
+              "not been read yet overwritten", pvt->fname, pvt->nowarn);
+            pvt->next_owarn_ts = acct->destroy_ts + OVERWR_WARN_IVAL;
+            pvt->nowarn = 0;
+        }
+    }
+    rdp = &pvt->recs[wseq % pvt->hdr->nslots].d;
+    /* Invalidate the slot before we start overwriting it */
+    rdp->seq = 0;
+    __sync_synchronize();
+    memset((char *)rdp + sizeof(rdp->seq), '\0', RTPP_ACCT_RBIN_RECSIZE -
+      sizeof(rdp->seq));
+    rdp->seuid = acct->seuid;
+    rdp->pid = pvt->pid;
+    rdp->call_id_len = fill_str(rdp->call_id, sizeof(rdp->call_id),
+      acct->call_id);
+    rdp->from_tag_len = fill_str(rdp->from_tag, sizeof(rdp->from_tag),
+      acct->from_tag);
+    fill_str(rdp->node_id, sizeof(rdp->node_id), rtpp_acct_get_nid(pvt, acct));
+    rdp->setup_ts = MT2RT_NZ(acct->init_ts);
+    rdp->teardown_ts = MT2RT_NZ(acct->destroy_ts);
+    rdp->rtp_nrelayed = acct->rtp.pcnts->nrelayed;
+    rdp->rtp_ndropped = acct->rtp.pcnts->ndropped;
+    rdp->rtcp_nrelayed = acct->rtcp.pcnts->nrelayed;
+    rdp->rtcp_ndropped = acct->rtcp.pcnts->ndropped;
+    fill_face(&acct->rtp.o, &acct->rtcp.o, acct->rasto, acct->jrasto,
+      &rdp->o);
+    fill_face(&acct->rtp.a, &acct->rtcp.a, acct->rasta, acct->jrasta,
+      &rdp->a);
+    __sync_synchronize();
+    rdp->seq = wseq + 1;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * On-disk layout of the binary accounting ring shared between the
+ * acct_rbin module and the rtpp_acct_rbin2csv reader. The file consists
+ * of a header page followed by nslots fixed-size record slots. Writers
+ * claim slots by atomically incrementing wseq in the mapped header, so
+ * several rtpproxy instances can share one file without locking. Once
+ * a record is complete its seq is set to the claimed sequence number
+ * plus one, readers skip slots where it doesn't match.
+ *
+ * The ring is not rotated, once it's full the oldest records get
+ * overwritten. Readers exporting incrementally can advance rseq after
+ * they are done with the records, writers then count records overwritten
+ * before anyone has read them in noverwr, so that the reader can tell
+ * it's falling behind and by how much.
+ */
+
+#ifndef _RTPP_ACCT_RBIN_H_
+#define _RTPP_ACCT_RBIN_H_
+
+#define RTPP_ACCT_RBIN_MAGIC    "RTPPACRB"
+#define RTPP_ACCT_RBIN_VERSION  2
+#define RTPP_ACCT_RBIN_HDRSIZE  4096
+#define RTPP_ACCT_RBIN_RECSIZE  1024
+#define RTPP_ACCT_RBIN_NSLOTS   65536
+
+#define RTPP_ACCT_RBIN_FSIZE(nslots) (RTPP_ACCT_RBIN_HDRSIZE + \
+  ((off_t)(nslots) * RTPP_ACCT_RBIN_RECSIZE))
+
+struct rtpp_acct_rbin_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t hdr_size;
+    uint32_t rec_size;
+    uint32_t nslots;
+    /* Number of slots ever claimed, next record goes to wseq % nslots */
+    volatile uint64_t wseq;
+    /* Records before this one have been consumed by the reader */
+    volatile uint64_t rseq;
+    /* Number of records overwritten while still unread */
+    volatile uint64_t noverwr;
+};
+
+struct rtpp_acct_rbin_addr {
+    /* AF_UNSPEC when there was no remote address */
+    uint16_t family;
+    uint16_t port;
+    uint8_t addr[16];
+};
+
+struct rtpp_acct_rbin_face {
+    double first_rtp_ts;
+    double last_rtp_ts;
+    uint64_t rtp_npkts;
+    uint64_t rtcp_npkts;
+    struct rtpp_acct_rbin_addr rtp_addr;
+    struct rtpp_acct_rbin_addr rtcp_addr;
+    /* RTP analyzer */
+    uint64_t psent;
+    uint64_t precvd;
+    uint64_t pdups;
+    uint64_t plost;
+    uint64_t pecount;
+    uint64_t ssrc_changes;
+    uint32_t last_ssrc;
+    uint8_t ssrc_inited;
+    int8_t last_pt;
+    double jlast;
+    double jmax;
+    double javg;
+    /* Hold tracking */
+    int32_t hld_status;
+    int32_t hld_cnt;
+};
+
+#define RTPP_ACCT_RBIN_NIDLEN   64
+#define RTPP_ACCT_RBIN_CIDLEN   256
+#define RTPP_ACCT_RBIN_TAGLEN   128
+
+struct rtpp_acct_rbin_rdata {
+    volatile uint64_t seq;
+    uint64_t seuid;
+    int32_t pid;
+    /* Lengths of the strings as stored, after truncation if any */
+    uint16_t call_id_len;
+    uint16_t from_tag_len;
+    double setup_ts;
+    double teardown_ts;
+    uint64_t rtp_nrelayed;
+    uint64_t rtp_ndropped;
+    uint64_t rtcp_nrelayed;
+    uint64_t rtcp_ndropped;
+    struct rtpp_acct_rbin_face o;
+    struct rtpp_acct_rbin_face a;
+    char node_id[RTPP_ACCT_RBIN_NIDLEN];
+    char call_id[RTPP_ACCT_RBIN_CIDLEN];
+    char from_tag[RTPP_ACCT_RBIN_TAGLEN];
+};
+
+struct rtpp_acct_rbin_rec {
+    union {
+        struct rtpp_acct_rbin_rdata d;
+        char _pad[RTPP_ACCT_RBIN_RECSIZE];
+    };
+};
+
+/* Make sure the record fits into the slot */
+typedef char rtpp_acct_rbin_rec_szchk[(sizeof(struct rtpp_acct_rbin_rdata) <=
+  RTPP_ACCT_RBIN_RECSIZE) ? 1 : -1];
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Convert binary accounting ring written by the acct_rbin module into
+ * the same CSV format as produced by the acct_csv module.
+ */
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtpp_acct_rbin.h"
+
+/* Keep in sync with the acct_csv module */
+#define RTPP_METRICS_VERSION	"1.2"
+
+#define CSV_HEADER "rec_ver,rtpp_node_id,rtpp_pid,sess_uid,call_id," \
+  "from_tag,setup_ts,teardown_ts,first_rtp_ts_ino,last_rtp_ts_ino," \
+  "first_rtp_ts_ina,last_rtp_ts_ina,rtp_npkts_ina,rtp_npkts_ino," \
+  "rtp_nrelayed,rtp_ndropped,rtcp_npkts_ina,rtcp_npkts_ino," \
+  "rtcp_nrelayed,rtcp_ndropped,rtpa_nsent_ino,rtpa_nrcvd_ino," \
+  "rtpa_ndups_ino,rtpa_nlost_ino,rtpa_perrs_ino," \
+  "rtpa_ssrc_last_ino,rtpa_ssrc_cnt_ino,rtpa_pt_last_ino," \
+  "rtpa_nsent_ina,rtpa_nrcvd_ina,rtpa_ndups_ina,rtpa_nlost_ina," \
+  "rtpa_perrs_ina,rtpa_ssrc_last_ina,rtpa_ssrc_cnt_ina,rtpa_pt_last_ina," \
+  "rtpa_jitter_last_ino,rtpa_jitter_max_ino,rtpa_jitter_avg_ino," \
+  "rtpa_jitter_last_ina,rtpa_jitter_max_ina,rtpa_jitter_avg_ina," \
+  "rtpp_rtp_rmt_ip_o,rtpp_rtp_rmt_pt_o,rtpp_rtp_rmt_ip_a,rtpp_rtp_rmt_pt_a," \
+  "rtpp_rtcp_rmt_ip_o,rtpp_rtcp_rmt_pt_o,rtpp_rtcp_rmt_ip_a," \
+  "rtpp_rtcp_rmt_pt_a,rtpp_hld_sts_o,rtpp_hld_sts_a,rtpp_hld_cnt_o," \
+  "rtpp_hld_cnt_a\n"
+
+#define FMT_BOOL(x) ((x == 0) ? "f" : "t")
+
+static void
+usage(void)
+{
+
+    fprintf(stderr, "usage: rtpp_acct_rbin2csv [-Hcv] [-s first_seq] "
+      "[-o outfile] infile\n");
+    exit(1);
+}
+
+static const char *
+format_addr(const struct rtpp_acct_rbin_addr *rap, char *buf, size_t blen)
+{
+    char abuf[INET6_ADDRSTRLEN];
+
+    switch (rap->family) {
+    case AF_INET:
+        inet_ntop(AF_INET, rap->addr, abuf, sizeof(abuf));
+        snprintf(buf, blen, "%s,%u", abuf, rap->port);
+        break;
+
+    case AF_INET6:
+        inet_ntop(AF_INET6, rap->addr, abuf, sizeof(abuf));
+        snprintf(buf, blen, "[%s],%u", abuf, rap->port);
+        break;
+
+    default:
+        snprintf(buf, blen, ",");
+        break;
+    }
+    return (buf);
+}
+
+static const char *
+format_ssrc(const struct rtpp_acct_rbin_face *fp, char *buf, size_t blen)
+{
+
+    if (fp->ssrc_inited) {
+        snprintf(buf, blen, "0x%.8X", fp->last_ssrc);
+    } else {
+        buf[0] = '\0';
+    }
+    return (buf);
+}
+
+static void
+print_rec(FILE *f, const struct rtpp_acct_rbin_rdata *rdp)
+{
+    char oradr[64], aradr[64], ocadr[64], acadr[64];
+    char ossrc[11], assrc[11];
+    const struct rtpp_acct_rbin_face *o, *a;
+
+    o = &rdp->o;
+    a = &rdp->a;
+    fprintf(f, "%s,%.*s,%d,%" PRId64 ",%.*s,%.*s,%f,%f,%f,%f,%f,%f,"
+      "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ","
+      "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ","
+      "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%s,%" PRIu64 ",%d,"
+      "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ","
+      "%s,%" PRIu64 ",%d,%f,%f,%f,%f,%f,%f,%s,%s,%s,%s,%s,%s,%d,%d\n",
+      RTPP_METRICS_VERSION, (int)sizeof(rdp->node_id), rdp->node_id,
+      rdp->pid, rdp->seuid, (int)sizeof(rdp->call_id), rdp->call_id,
+      (int)sizeof(rdp->from_tag), rdp->from_tag, rdp->setup_ts,
+      rdp->teardown_ts, o->first_rtp_ts, o->last_rtp_ts, a->first_rtp_ts,
+      a->last_rtp_ts, a->rtp_npkts, o->rtp_npkts, rdp->rtp_nrelayed,
+      rdp->rtp_ndropped, a->rtcp_npkts, o->rtcp_npkts, rdp->rtcp_nrelayed,
+      rdp->rtcp_ndropped, o->psent, o->precvd, o->pdups, o->plost,
+      o->pecount, format_ssrc(o, ossrc, sizeof(ossrc)), o->ssrc_changes,
+      o->last_pt, a->psent, a->precvd, a->pdups, a->plost, a->pecount,
+      format_ssrc(a, assrc, sizeof(assrc)), a->ssrc_changes, a->last_pt,
+      o->jlast, o->jmax, o->javg, a->jlast, a->jmax, a->javg,
+      format_addr(&o->rtp_addr, oradr, sizeof(oradr)),
+      format_addr(&a->rtp_addr, aradr, sizeof(aradr)),
+      format_addr(&o->rtcp_addr, ocadr, sizeof(ocadr)),
+      format_addr(&a->rtcp_addr, acadr, sizeof(acadr)),
+      FMT_BOOL(o->hld_status), FMT_BOOL(a->hld_status), o->hld_cnt,
+      a->hld_cnt);
+}
+
+int
+main(int argc, char **argv)
+{
+    int ch, fd, noheader, verbose, commit;
+    uint64_t sseq, wseq, rseq, seq, nskipped, nlost;
+    const char *ofname;
+    FILE *of;
+    struct stat stt;
+    void *mp;
+    struct rtpp_acct_rbin_hdr *hdr;
+    const struct rtpp_acct_rbin_rec *recs, *rp;
+    struct rtpp_acct_rbin_rdata rd;
+    char *ep;
+
+    noheader = verbose = commit = 0;
+    sseq = 0;
+    ofname = NULL;
+    while ((ch = getopt(argc, argv, "Hcvs:o:")) != -1)
+        switch (ch) {
+        case 'H':
+            noheader = 1;
+            break;
+
+        case 'c':
+            commit = 1;
+            break;
+
+        case 'v':
+            verbose = 1;
+            break;
+
+        case 's':
+            sseq = strtoull(optarg, &ep, 10);
+            if (*optarg == '\0' || *ep != '\0')
+                errx(1, "%s: invalid sequence number", optarg);
+            break;
+
+        case 'o':
+            ofname = optarg;
+            break;
+
+        case '?':
+        default:
+            usage();
+        }
+    argc -= optind;
+    argv += optind;
+    if (argc != 1)
+        usage();
+
+    fd = open(argv[0], commit ? O_RDWR : O_RDONLY);
+    if (fd == -1)
+        err(1, "can't open %s for reading", argv[0]);
+    if (fstat(fd, &stt) == -1)
+        err(1, "can't stat %s", argv[0]);
+    if (stt.st_size < RTPP_ACCT_RBIN_HDRSIZE)
+        errx(1, "%s: file is too short", argv[0]);
+    mp = mmap(NULL, stt.st_size, PROT_READ | (commit ? PROT_WRITE : 0),
+      MAP_SHARED, fd, 0);
+    if (mp == MAP_FAILED)
+        err(1, "can't mmap %s", argv[0]);
+    hdr = (struct rtpp_acct_rbin_hdr *)mp;
+    if (memcmp(hdr->magic, RTPP_ACCT_RBIN_MAGIC, sizeof(hdr->magic)) != 0 ||
+      hdr->version != RTPP_ACCT_RBIN_VERSION ||
+      hdr->rec_size != RTPP_ACCT_RBIN_RECSIZE || hdr->nslots == 0 ||
+      stt.st_size != RTPP_ACCT_RBIN_FSIZE(hdr->nslots) -
+      RTPP_ACCT_RBIN_HDRSIZE + hdr->hdr_size)
+        errx(1, "%s: unsupported file format", argv[0]);
+    recs = (const struct rtpp_acct_rbin_rec *)((const char *)mp +
+      hdr->hdr_size);
+
+    if (ofname == NULL || strcmp(ofname, "-") == 0) {
+        of = stdout;
+    } else {
+        of = fopen(ofname, "w");
+        if (of == NULL)
+            err(1, "can't open %s for writing", ofname);
+    }
+    if (!noheader)
+        fputs(CSV_HEADER, of);
+
+    wseq = hdr->wseq;
+    nlost = 0;
+    if (wseq > hdr->nslots && sseq < wseq - hdr->nslots) {
+        nlost = wseq - hdr->nslots - sseq;
+        sseq = wseq - hdr->nslots;
+    }
+    nskipped = 0;
+    for (seq = sseq; seq < wseq; seq++) {
+        rp = &recs[seq % hdr->nslots];
+        if (rp->d.seq != seq + 1) {
+            /* Still being written or already overwritten */
+            nskipped++;
+            continue;
+        }
+        __sync_synchronize();
+        memcpy(&rd, &rp->d, sizeof(rd));
+        __sync_synchronize();
+        if (rp->d.seq != seq + 1) {
+            nskipped++;
+            continue;
+        }
+        print_rec(of, &rd);
+    }
+    if (fflush(of) != 0)
+        err(1, "can't write output");
+    if (commit) {
+        /* Let the writers know we are done with everything up to wseq */
+        do {
+            rseq = hdr->rseq;
+        } while (rseq < wseq &&
+          !__sync_bool_compare_and_swap(&hdr->rseq, rseq, wseq));
+    }
+    if (verbose) {
+        fprintf(stderr, "next_seq=%" PRIu64 " skipped=%" PRIu64 " lost=%"
+          PRIu64 " overwritten_unread=%" PRIu64 "\n", wseq, nskipped, nlost,
+          hdr->noverwr);
+    }
+    if (nlost > 0) {
+        warnx("%" PRIu64 " records have been overwritten before they could "
+          "be read", nlost);
+    }
+    if (of != stdout)
+        fclose(of);
+    munmap(mp, stt.st_size);
+    close(fd);
+    return (0);
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Example module for the packet and stream event hooks. Counts packets
+ * and bytes seen by rtpproxy per stream type and reports them when the
+ * streams go away and once more when the module is unloaded.
+ *
+ * on_packets is called inline from the RTP and RTCP threads while
+ * on_stream_event is called from the module's own thread, so the two
+ * share the counters under a lock. The core makes sure on_packets itself
+ * is never entered concurrently.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rtpp_types.h"
+#include "rtpp_module.h"
+#include "rtpp_pipe.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_log.h"
+#include "rtpp_log_obj.h"
+
+#define PKTSTAT_RTP	0
+#define PKTSTAT_RTCP	1
+
+struct rtpp_pktstat_cnts {
+    uint64_t npkts;
+    uint64_t nbytes;
+};
+
+struct rtpp_module_priv {
+    pthread_mutex_t lock;
+    /* Updated by on_packets, indexed by PKTSTAT_RTP/PKTSTAT_RTCP */
+    struct rtpp_pktstat_cnts cnts[2];
+    uint64_t nbatches;
+    /* Only touched from the module's thread, no locking */
+    unsigned long nstreams;
+    unsigned long nlatches;
+};
+
+static struct rtpp_module_priv *rtpp_pktstat_ctor(struct rtpp_cfg_stable *);
+static void rtpp_pktstat_dtor(struct rtpp_module_priv *);
+static void rtpp_pktstat_sev(struct rtpp_module_priv *,
+  const struct rtpp_mod_sev *);
+static void rtpp_pktstat_pkts(struct rtpp_module_priv *,
+  const struct rtpp_mod_pktview *, int);
+
+#define API_FUNC(fname, asize) {.func = (fname), .argsize = (asize)}
+
+struct rtpp_minfo rtpp_module = {
+    .name = "pktstat",
+    .ver = MI_VER_INIT(),
+    .ctor = rtpp_pktstat_ctor,
+    .dtor = rtpp_pktstat_dtor,
+    .on_stream_event = API_FUNC(rtpp_pktstat_sev, sizeof(struct rtpp_mod_sev)),
+    .on_packets = API_FUNC(rtpp_pktstat_pkts, sizeof(struct rtpp_mod_pktview))
+};
+
+static struct rtpp_module_priv *
+rtpp_pktstat_ctor(struct rtpp_cfg_stable *cfsp)
+{
+    struct rtpp_module_priv *pvt;
+
+    pvt = mod_zmalloc(sizeof(struct rtpp_module_priv));
+    if (pvt == NULL) {
+        goto e0;
+    }
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        goto e1;
+    }
+    return (pvt);
+
+e1:
+    mod_free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_pktstat_report(struct rtpp_module_priv *pvt, int level, const char *when)
+{
+    struct rtpp_pktstat_cnts cnts[2];
+    uint64_t nbatches;
+
+    pthread_mutex_lock(&pvt->lock);
+    cnts[0] = pvt->cnts[0];
+    cnts[1] = pvt->cnts[1];
+    nbatches = pvt->nbatches;
+    pthread_mutex_unlock(&pvt->lock);
+    mod_log(level, "%s: RTP %llu packets/%llu bytes, RTCP %llu "
+      "packets/%llu bytes in %llu batches, %lu streams, %lu latches", when,
+      (unsigned long long)cnts[PKTSTAT_RTP].npkts,
+      (unsigned long long)cnts[PKTSTAT_RTP].nbytes,
+      (unsigned long long)cnts[PKTSTAT_RTCP].npkts,
+      (unsigned long long)cnts[PKTSTAT_RTCP].nbytes,
+      (unsigned long long)nbatches, pvt->nstreams, pvt->nlatches);
+}
+
+static void
+rtpp_pktstat_dtor(struct rtpp_module_priv *pvt)
+{
+
+    rtpp_pktstat_report(pvt, RTPP_LOG_INFO, "total");
+    pthread_mutex_destroy(&pvt->lock);
+    mod_free(pvt);
+}
+
+static void
+rtpp_pktstat_sev(struct rtpp_module_priv *pvt, const struct rtpp_mod_sev *sevp)
+{
+
+    switch (sevp->type) {
+    case RTPP_MOD_SEV_CREATE:
+        pvt->nstreams++;
+        break;
+
+    case RTPP_MOD_SEV_LATCH:
+        pvt->nlatches++;
+        break;
+
+    case RTPP_MOD_SEV_DESTROY:
+        rtpp_pktstat_report(pvt, RTPP_LOG_DBUG, "stream destroyed");
+        break;
+    }
+}
+
+static void
+rtpp_pktstat_pkts(struct rtpp_module_priv *pvt,
+  const struct rtpp_mod_pktview *pvs, int n)
+{
+    struct rtpp_pktstat_cnts cnts[2] = {{0}};
+    int i, pidx;
+
+    for (i = 0; i < n; i++) {
+        pidx = (pvs[i].pipe_type == PIPE_RTCP) ? PKTSTAT_RTCP : PKTSTAT_RTP;
+        cnts[pidx].npkts++;
+        cnts[pidx].nbytes += pvs[i].size;
+    }
+    pthread_mutex_lock(&pvt->lock);
+    for (i = 0; i < 2; i++) {
+        pvt->cnts[i].npkts += cnts[i].npkts;
+        pvt->cnts[i].nbytes += cnts[i].nbytes;
+    }
+    pvt->nbatches++;
+    pthread_mutex_unlock(&pvt->lock);
+}
@@ -0,0 +1,829 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Loopback load generator. Sets up N sessions in rtpproxy over the Unix
+ * control socket (optionally spawning rtpproxy itself), then plays RTP
+ * in both directions of each session and checks what comes out of the
+ * other end:
+ *
+ *  o payload is filled with a pattern derived from the sample index, so
+ *    that corruption is detected even when rtpproxy re-packetizes the
+ *    stream (the z modifier);
+ *  o forwarding latency is measured from the moment the last input packet
+ *    contributing to an output packet was sent until that output packet
+ *    was received;
+ *  o loss is accounted in samples, jitter as in RFC 3550.
+ *
+ * The report is printed as space-separated key=value pairs, one line per
+ * direction plus one summary line. Once the sessions are torn down, one
+ * more line gives the number of control commands processed during the run
+ * and the heap allocations they made (ncmds_allocs), i.e. the
+ * allocations-per-command figure. By default each command goes over a new
+ * control connection, -k sends them all over one persistent connection.
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rtpp_histogram.h"
+
+#define LG_RING       256
+#define LG_MAXPKT     1500
+#define LG_RTPHLEN    12
+#define LG_NDIRS      2
+
+#define NSEC_MAX      1000000000ULL
+
+struct lg_codec {
+    int pt;
+    const char *name;
+    int bytes_per_10ms;
+};
+
+static const struct lg_codec lg_codecs[] = {
+    {.pt = 0,  .name = "PCMU", .bytes_per_10ms = 80},
+    {.pt = 8,  .name = "PCMA", .bytes_per_10ms = 80},
+    {.pt = 18, .name = "G729", .bytes_per_10ms = 10},
+    {.pt = -1}
+};
+
+/* One direction of a session */
+struct lg_stream {
+    const struct lg_codec *codec;
+    int dir;
+    int fd_out;
+    int fd_in;
+    struct sockaddr_in dst;
+    uint32_t ssrc;
+    uint32_t ts0;
+    uint16_t seq0;
+    uint8_t pseed;
+    int nsamples;
+    int nbytes;
+    uint64_t next_send;
+    uint64_t nsent;
+    struct {
+        uint64_t pktno;
+        uint64_t stime;
+    } sent[LG_RING];
+    /* Receive side */
+    uint64_t nrcvd;
+    uint64_t samples_rcvd;
+    uint64_t ncorrupt;
+    uint64_t nlate;
+    uint64_t nalien;
+    int have_end;
+    uint32_t max_end;
+    int have_transit;
+    double last_transit;
+    double jitter;
+};
+
+struct lg_session {
+    int fds[2];
+    struct sockaddr_in laddr[2];
+    int rports[2];
+    char call_id[32];
+    struct lg_stream streams[LG_NDIRS];
+};
+
+struct lg_dstats {
+    uint64_t nsent;
+    uint64_t samples_sent;
+    uint64_t nrcvd;
+    uint64_t samples_rcvd;
+    uint64_t ncorrupt;
+    uint64_t nlate;
+    uint64_t nalien;
+    double jitter_sum;
+    double jitter_max;
+    struct rtpp_histogram lat;
+};
+
+struct lg_cfg {
+    int nsessions;
+    int ptime;
+    int resize;
+    int record;
+    int keepconn;
+    double duration;
+    const char *sock;
+    const char *rtpp_path;
+    int port_min;
+    char **rtpp_argv;
+    int rtpp_argc;
+    const struct lg_codec *codecs[8];
+    int ncodecs;
+};
+
+static const char *dirnames[LG_NDIRS] = {"fwd", "rev"};
+
+static uint64_t
+lg_nsec(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return ((uint64_t)tp.tv_sec * NSEC_MAX + tp.tv_nsec);
+}
+
+static uint8_t
+lg_pattern(const struct lg_stream *sp, uint32_t bidx)
+{
+
+    return ((uint8_t)(bidx * 7 + (bidx >> 8) + sp->pseed));
+}
+
+static void
+usage(void)
+{
+
+    fprintf(stderr, "usage: rtpp_loadgen [-Rk] [-n nsessions] [-p ptime] "
+      "[-c pt[,pt...]] [-z resize_ptime]\n"
+      "         [-d duration] [-m port_min] -s control_socket "
+      "[-e rtpproxy [-- rtpproxy_args]]\n");
+    exit(1);
+}
+
+static int
+lg_ctl_connect(const char *path, double timeout)
+{
+    struct sockaddr_un sun;
+    uint64_t deadline;
+    int fd;
+
+    memset(&sun, '\0', sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+    deadline = lg_nsec() + (uint64_t)(timeout * NSEC_MAX);
+    for (;;) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return (-1);
+        if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == 0)
+            return (fd);
+        close(fd);
+        if (lg_nsec() > deadline)
+            return (-1);
+        usleep(50000);
+    }
+}
+
+/*
+ * Connection kept open for all commands with -k, which needs rtpproxy to
+ * listen on a "cunix:" socket.
+ */
+static int lg_ctl_fd = -1;
+
+/*
+ * The "unix:" control socket only takes one command per connection, so
+ * unless -k is given connect anew every time, which works for "cunix:"
+ * just as well.
+ */
+static int
+lg_ctl_command(const char *path, char *rbuf, size_t rlen, const char *fmt, ...)
+{
+    char cbuf[512];
+    va_list ap;
+    size_t len, off;
+    ssize_t r;
+    int fd;
+
+    va_start(ap, fmt);
+    len = vsnprintf(cbuf, sizeof(cbuf), fmt, ap);
+    va_end(ap);
+    if (len >= sizeof(cbuf) - 1)
+        return (-1);
+    cbuf[len] = '\n';
+    fd = (lg_ctl_fd >= 0) ? lg_ctl_fd : lg_ctl_connect(path, 0);
+    if (fd < 0)
+        return (-1);
+    if (write(fd, cbuf, len + 1) != (ssize_t)len + 1) {
+        goto e0;
+    }
+    for (off = 0; off < rlen - 1;) {
+        r = read(fd, rbuf + off, 1);
+        if (r <= 0) {
+            goto e0;
+        }
+        if (rbuf[off] == '\n')
+            break;
+        off++;
+    }
+    if (fd != lg_ctl_fd)
+        close(fd);
+    rbuf[off] = '\0';
+    if (rbuf[0] == 'E') {
+        cbuf[len] = '\0';
+        fprintf(stderr, "rtpproxy: \"%s\" -> %s\n", cbuf, rbuf);
+        return (-1);
+    }
+    return (0);
+
+e0:
+    if (fd != lg_ctl_fd)
+        close(fd);
+    return (-1);
+}
+
+/*
+ * Fetch rtpproxy's command counters, used to report how many heap
+ * allocations the control plane makes per command.
+ */
+static int
+lg_ctl_cstats(const char *path, unsigned long long *ncmds,
+  unsigned long long *nallocs)
+{
+    char rbuf[128];
+
+    if (lg_ctl_command(path, rbuf, sizeof(rbuf),
+      "G ncmds_rcvd ncmds_allocs") != 0)
+        return (-1);
+    if (sscanf(rbuf, "%llu %llu", ncmds, nallocs) != 2)
+        return (-1);
+    return (0);
+}
+
+static pid_t
+lg_spawn(const struct lg_cfg *cfp, const char *recdir)
+{
+    char **argv;
+    char mbuf[16], Mbuf[16], sbuf[sizeof(((struct sockaddr_un *)0)->sun_path) + 8];
+    int i, j;
+    pid_t pid;
+
+    argv = calloc(cfp->rtpp_argc + 16, sizeof(char *));
+    if (argv == NULL)
+        return (-1);
+    snprintf(mbuf, sizeof(mbuf), "%d", cfp->port_min);
+    snprintf(Mbuf, sizeof(Mbuf), "%d", cfp->port_min +
+      cfp->nsessions * 8 + 15);
+    snprintf(sbuf, sizeof(sbuf), "%s:%s", cfp->keepconn ? "cunix" : "unix",
+      cfp->sock);
+    j = 0;
+    argv[j++] = (char *)cfp->rtpp_path;
+    argv[j++] = "-f";
+    argv[j++] = "-F";
+    argv[j++] = "-l";
+    argv[j++] = "127.0.0.1";
+    argv[j++] = "-s";
+    argv[j++] = sbuf;
+    argv[j++] = "-m";
+    argv[j++] = mbuf;
+    argv[j++] = "-M";
+    argv[j++] = Mbuf;
+    argv[j++] = "-d";
+    argv[j++] = "err";
+    if (recdir != NULL) {
+        argv[j++] = "-r";
+        argv[j++] = (char *)recdir;
+    }
+    for (i = 0; i < cfp->rtpp_argc; i++)
+        argv[j++] = cfp->rtpp_argv[i];
+    argv[j] = NULL;
+
+    unlink(cfp->sock);
+    pid = fork();
+    if (pid == 0) {
+        execv(cfp->rtpp_path, argv);
+        fprintf(stderr, "execv(%s): %s\n", cfp->rtpp_path, strerror(errno));
+        _exit(127);
+    }
+    free(argv);
+    return (pid);
+}
+
+static int
+lg_udp_socket(struct sockaddr_in *sinp)
+{
+    socklen_t slen;
+    int fd, flags, bsize;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return (-1);
+    memset(sinp, '\0', sizeof(*sinp));
+    sinp->sin_family = AF_INET;
+    sinp->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    slen = sizeof(*sinp);
+    if (bind(fd, (struct sockaddr *)sinp, slen) != 0 ||
+      getsockname(fd, (struct sockaddr *)sinp, &slen) != 0) {
+        close(fd);
+        return (-1);
+    }
+    bsize = 256 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bsize, sizeof(bsize));
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    return (fd);
+}
+
+static int
+lg_session_setup(const struct lg_cfg *cfp, struct lg_session *ssp,
+  int snum)
+{
+    const struct lg_codec *cdp;
+    char rbuf[128], mods[64];
+    int i;
+
+    cdp = cfp->codecs[snum % cfp->ncodecs];
+    snprintf(ssp->call_id, sizeof(ssp->call_id), "lg%d_%ld", snum,
+      (long)getpid());
+    for (i = 0; i < 2; i++) {
+        ssp->fds[i] = lg_udp_socket(&ssp->laddr[i]);
+        if (ssp->fds[i] < 0)
+            return (-1);
+    }
+    if (cfp->resize > 0) {
+        snprintf(mods, sizeof(mods), "c%dz%d", cdp->pt, cfp->resize);
+    } else {
+        snprintf(mods, sizeof(mods), "c%d", cdp->pt);
+    }
+    if (lg_ctl_command(cfp->sock, rbuf, sizeof(rbuf), "U%s %s 127.0.0.1 %d lga",
+      mods, ssp->call_id, ntohs(ssp->laddr[0].sin_port)) != 0)
+        return (-1);
+    ssp->rports[0] = atoi(rbuf);
+    if (lg_ctl_command(cfp->sock, rbuf, sizeof(rbuf), "L%s %s 127.0.0.1 %d lga lgb",
+      mods, ssp->call_id, ntohs(ssp->laddr[1].sin_port)) != 0)
+        return (-1);
+    ssp->rports[1] = atoi(rbuf);
+    if (ssp->rports[0] <= 0 || ssp->rports[1] <= 0)
+        return (-1);
+    if (cfp->record && lg_ctl_command(cfp->sock, rbuf, sizeof(rbuf),
+      "R %s lga lgb", ssp->call_id) != 0)
+        return (-1);
+
+    for (i = 0; i < LG_NDIRS; i++) {
+        struct lg_stream *sp = &ssp->streams[i];
+
+        sp->codec = cdp;
+        sp->dir = i;
+        /*
+         * Forward: caller (U) socket sends to the port allocated by L,
+         * callee socket receives. Reverse is the mirror image.
+         */
+        sp->fd_out = ssp->fds[i];
+        sp->fd_in = ssp->fds[1 - i];
+        sp->dst.sin_family = AF_INET;
+        sp->dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sp->dst.sin_port = htons(ssp->rports[1 - i]);
+        sp->ssrc = random();
+        sp->ts0 = random();
+        sp->seq0 = random();
+        sp->pseed = random();
+        sp->nsamples = cfp->ptime * 8;
+        sp->nbytes = cfp->ptime * cdp->bytes_per_10ms / 10;
+    }
+    return (0);
+}
+
+static void
+lg_stream_send(struct lg_stream *sp, uint64_t now)
+{
+    uint8_t buf[LG_MAXPKT];
+    uint32_t ts, bidx;
+    uint16_t seq;
+    int i;
+
+    ts = sp->ts0 + (uint32_t)(sp->nsent * sp->nsamples);
+    seq = sp->seq0 + (uint16_t)sp->nsent;
+    buf[0] = 0x80;
+    buf[1] = sp->codec->pt;
+    buf[2] = seq >> 8;
+    buf[3] = seq & 0xff;
+    buf[4] = ts >> 24;
+    buf[5] = (ts >> 16) & 0xff;
+    buf[6] = (ts >> 8) & 0xff;
+    buf[7] = ts & 0xff;
+    buf[8] = sp->ssrc >> 24;
+    buf[9] = (sp->ssrc >> 16) & 0xff;
+    buf[10] = (sp->ssrc >> 8) & 0xff;
+    buf[11] = sp->ssrc & 0xff;
+    bidx = (uint32_t)(sp->nsent * sp->nbytes);
+    for (i = 0; i < sp->nbytes; i++)
+        buf[LG_RTPHLEN + i] = lg_pattern(sp, bidx + i);
+    sp->sent[sp->nsent % LG_RING].pktno = sp->nsent;
+    sp->sent[sp->nsent % LG_RING].stime = now;
+    if (sendto(sp->fd_out, buf, LG_RTPHLEN + sp->nbytes, 0,
+      (struct sockaddr *)&sp->dst, sizeof(sp->dst)) < 0) {
+        /* Count it as sent anyway, it will show up as loss */
+    }
+    sp->nsent++;
+}
+
+static void
+lg_stream_recv(struct lg_stream *sp, const uint8_t *buf, int len,
+  uint64_t now, struct rtpp_histogram *lat)
+{
+    uint32_t ts, off, end, bidx, pktno;
+    int i, nbytes, nsamples, plen, hlen;
+    double transit, d;
+
+    if (len < LG_RTPHLEN || (buf[0] & 0xc0) != 0x80 ||
+      (buf[1] & 0x7f) != sp->codec->pt) {
+        sp->nalien++;
+        return;
+    }
+    hlen = LG_RTPHLEN + (buf[0] & 0x0f) * 4;
+    if (len < hlen) {
+        sp->nalien++;
+        return;
+    }
+    ts = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) |
+      ((uint32_t)buf[6] << 8) | buf[7];
+    plen = len - hlen;
+    nbytes = plen;
+    nsamples = nbytes * 80 / sp->codec->bytes_per_10ms;
+    off = ts - sp->ts0;
+    if (nsamples == 0 || off >= sp->nsent * sp->nsamples) {
+        sp->nalien++;
+        return;
+    }
+    sp->nrcvd++;
+    bidx = (uint64_t)off * sp->codec->bytes_per_10ms / 80;
+    for (i = 0; i < nbytes; i++) {
+        if (buf[hlen + i] != lg_pattern(sp, bidx + i)) {
+            sp->ncorrupt++;
+            break;
+        }
+    }
+    end = off + nsamples;
+    if (sp->have_end && (int32_t)(end - sp->max_end) <= 0) {
+        sp->nlate++;
+    } else {
+        if (sp->have_end && (int32_t)(off - sp->max_end) < 0) {
+            /* Partial overlap, only count the new part */
+            nsamples = end - sp->max_end;
+        }
+        sp->samples_rcvd += nsamples;
+        sp->max_end = end;
+        sp->have_end = 1;
+    }
+
+    /* The output can't leave before the last sample in it came in */
+    pktno = (end - 1) / sp->nsamples;
+    if (sp->sent[pktno % LG_RING].pktno == pktno && pktno < sp->nsent)
+        rtpp_histogram_record_us(lat,
+          (now - sp->sent[pktno % LG_RING].stime) / 1000);
+
+    transit = (double)now / NSEC_MAX - (double)off / 8000.0;
+    if (sp->have_transit) {
+        d = transit - sp->last_transit;
+        if (d < 0)
+            d = -d;
+        sp->jitter += (d - sp->jitter) / 16.0;
+    }
+    sp->last_transit = transit;
+    sp->have_transit = 1;
+}
+
+static void
+lg_drain(struct lg_session *sessions, int nsessions, struct pollfd *pfds,
+  int timeout, struct lg_dstats *dsp)
+{
+    uint8_t buf[LG_MAXPKT];
+    struct lg_session *ssp;
+    struct lg_stream *sp;
+    uint64_t now;
+    int i, n, len;
+
+    n = poll(pfds, nsessions * 2, timeout);
+    if (n <= 0)
+        return;
+    now = lg_nsec();
+    for (i = 0; i < nsessions * 2; i++) {
+        if ((pfds[i].revents & POLLIN) == 0)
+            continue;
+        ssp = &sessions[i / 2];
+        /* Socket 0 (caller) receives reverse stream, 1 - forward */
+        sp = &ssp->streams[1 - (i % 2)];
+        while ((len = recv(pfds[i].fd, buf, sizeof(buf), 0)) > 0)
+            lg_stream_recv(sp, buf, len, now, &dsp[sp->dir].lat);
+    }
+}
+
+static void
+lg_report(const struct lg_cfg *cfp, struct lg_session *sessions,
+  struct lg_dstats *dsp, double elapsed)
+{
+    struct lg_dstats *dp;
+    struct lg_stream *sp;
+    double loss;
+    int i, d;
+
+    for (d = 0; d < LG_NDIRS; d++) {
+        dp = &dsp[d];
+        for (i = 0; i < cfp->nsessions; i++) {
+            sp = &sessions[i].streams[d];
+            dp->nsent += sp->nsent;
+            dp->samples_sent += sp->nsent * sp->nsamples;
+            dp->nrcvd += sp->nrcvd;
+            dp->samples_rcvd += sp->samples_rcvd;
+            dp->ncorrupt += sp->ncorrupt;
+            dp->nlate += sp->nlate;
+            dp->nalien += sp->nalien;
+            dp->jitter_sum += sp->jitter;
+            if (sp->jitter > dp->jitter_max)
+                dp->jitter_max = sp->jitter;
+        }
+        loss = 0.0;
+        if (dp->samples_sent > 0 && dp->samples_rcvd < dp->samples_sent)
+            loss = 100.0 * (dp->samples_sent - dp->samples_rcvd) /
+              dp->samples_sent;
+        printf("dir=%s streams=%d pkts_sent=%llu pkts_rcvd=%llu "
+          "pps_sent=%.0f pps_rcvd=%.0f loss_pct=%.3f corrupt=%llu "
+          "late=%llu alien=%llu lat_p50_us=%llu lat_p90_us=%llu "
+          "lat_p99_us=%llu lat_p999_us=%llu lat_max_us=%llu "
+          "jitter_avg_us=%.0f jitter_max_us=%.0f\n", dirnames[d],
+          cfp->nsessions, (unsigned long long)dp->nsent,
+          (unsigned long long)dp->nrcvd, dp->nsent / elapsed,
+          dp->nrcvd / elapsed, loss, (unsigned long long)dp->ncorrupt,
+          (unsigned long long)dp->nlate, (unsigned long long)dp->nalien,
+          (unsigned long long)rtpp_histogram_pctl(&dp->lat, 50.0),
+          (unsigned long long)rtpp_histogram_pctl(&dp->lat, 90.0),
+          (unsigned long long)rtpp_histogram_pctl(&dp->lat, 99.0),
+          (unsigned long long)rtpp_histogram_pctl(&dp->lat, 99.9),
+          (unsigned long long)dp->lat.max,
+          dp->jitter_sum * 1e6 / cfp->nsessions, dp->jitter_max * 1e6);
+    }
+}
+
+static int
+lg_parse_codecs(struct lg_cfg *cfp, char *arg)
+{
+    const struct lg_codec *cdp;
+    char *cp;
+    int pt;
+
+    cfp->ncodecs = 0;
+    for (cp = strtok(arg, ","); cp != NULL; cp = strtok(NULL, ",")) {
+        pt = atoi(cp);
+        for (cdp = lg_codecs; cdp->pt >= 0 && cdp->pt != pt; cdp++)
+            continue;
+        if (cdp->pt < 0 || cfp->ncodecs == 8)
+            return (-1);
+        cfp->codecs[cfp->ncodecs++] = cdp;
+    }
+    return (cfp->ncodecs > 0 ? 0 : -1);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct lg_cfg cf;
+    struct lg_session *sessions;
+    struct lg_stream *sp;
+    struct lg_dstats dstats[LG_NDIRS];
+    struct pollfd *pfds;
+    struct rlimit rlim;
+    char rbuf[128], recdir[] = "/tmp/rtpp_loadgen.XXXXXX";
+    uint64_t t0, tstop, now, next_due;
+    double elapsed;
+    pid_t rtpp_pid;
+    int ch, i, d, timeout, status, have_cstats;
+    unsigned long long ncmds[2], nallocs[2];
+
+    memset(&cf, '\0', sizeof(cf));
+    cf.nsessions = 10;
+    cf.ptime = 20;
+    cf.duration = 10.0;
+    cf.port_min = 20000;
+    cf.codecs[0] = &lg_codecs[0];
+    cf.ncodecs = 1;
+    while ((ch = getopt(argc, argv, "n:p:c:z:d:m:s:e:Rk")) != -1) {
+        switch (ch) {
+        case 'n':
+            cf.nsessions = atoi(optarg);
+            if (cf.nsessions < 1)
+                usage();
+            break;
+
+        case 'p':
+            cf.ptime = atoi(optarg);
+            if (cf.ptime < 10 || cf.ptime % 10 != 0)
+                usage();
+            break;
+
+        case 'c':
+            if (lg_parse_codecs(&cf, optarg) != 0)
+                usage();
+            break;
+
+        case 'z':
+            cf.resize = atoi(optarg);
+            if (cf.resize < 0)
+                usage();
+            break;
+
+        case 'd':
+            cf.duration = atof(optarg);
+            if (cf.duration <= 0)
+                usage();
+            break;
+
+        case 'm':
+            cf.port_min = atoi(optarg);
+            break;
+
+        case 's':
+            cf.sock = optarg;
+            break;
+
+        case 'e':
+            cf.rtpp_path = optarg;
+            break;
+
+        case 'R':
+            cf.record = 1;
+            break;
+
+        case 'k':
+            cf.keepconn = 1;
+            break;
+
+        case '?':
+        default:
+            usage();
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (cf.sock == NULL || (argc > 0 && cf.rtpp_path == NULL))
+        usage();
+    cf.rtpp_argv = argv;
+    cf.rtpp_argc = argc;
+
+    signal(SIGPIPE, SIG_IGN);
+    srandom(getpid() ^ time(NULL));
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+      rlim.rlim_cur < (rlim_t)cf.nsessions * 2 + 64) {
+        rlim.rlim_cur = cf.nsessions * 2 + 64;
+        if (rlim.rlim_max < rlim.rlim_cur)
+            rlim.rlim_max = rlim.rlim_cur;
+        if (setrlimit(RLIMIT_NOFILE, &rlim) != 0) {
+            fprintf(stderr, "setrlimit: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+
+    rtpp_pid = -1;
+    if (cf.rtpp_path != NULL) {
+        if (cf.record && mkdtemp(recdir) == NULL) {
+            fprintf(stderr, "mkdtemp: %s\n", strerror(errno));
+            exit(1);
+        }
+        rtpp_pid = lg_spawn(&cf, cf.record ? recdir : NULL);
+        if (rtpp_pid < 0) {
+            fprintf(stderr, "can't start %s\n", cf.rtpp_path);
+            exit(1);
+        }
+    }
+    i = lg_ctl_connect(cf.sock, 5.0);
+    if (i < 0) {
+        fprintf(stderr, "can't connect to %s\n", cf.sock);
+        goto e0;
+    }
+    if (cf.keepconn)
+        lg_ctl_fd = i;
+    else
+        close(i);
+    have_cstats = (lg_ctl_cstats(cf.sock, &ncmds[0], &nallocs[0]) == 0);
+
+    sessions = calloc(cf.nsessions, sizeof(struct lg_session));
+    pfds = calloc(cf.nsessions * 2, sizeof(struct pollfd));
+    if (sessions == NULL || pfds == NULL) {
+        fprintf(stderr, "out of memory\n");
+        goto e0;
+    }
+    for (i = 0; i < cf.nsessions; i++) {
+        if (lg_session_setup(&cf, &sessions[i], i) != 0) {
+            fprintf(stderr, "session %d setup failed\n", i);
+            goto e0;
+        }
+        pfds[i * 2].fd = sessions[i].fds[0];
+        pfds[i * 2].events = POLLIN;
+        pfds[i * 2 + 1].fd = sessions[i].fds[1];
+        pfds[i * 2 + 1].events = POLLIN;
+    }
+
+    memset(dstats, '\0', sizeof(dstats));
+    for (d = 0; d < LG_NDIRS; d++)
+        rtpp_histogram_init(&dstats[d].lat);
+
+    /* Spread streams evenly over one ptime interval to avoid bursts */
+    t0 = lg_nsec();
+    for (i = 0; i < cf.nsessions; i++) {
+        for (d = 0; d < LG_NDIRS; d++) {
+            sessions[i].streams[d].next_send = t0 +
+              (uint64_t)cf.ptime * 1000000 * (i * LG_NDIRS + d) /
+              (cf.nsessions * LG_NDIRS);
+        }
+    }
+    tstop = t0 + (uint64_t)(cf.duration * NSEC_MAX);
+    for (now = t0; now < tstop; now = lg_nsec()) {
+        next_due = tstop;
+        for (i = 0; i < cf.nsessions; i++) {
+            for (d = 0; d < LG_NDIRS; d++) {
+                sp = &sessions[i].streams[d];
+                while (sp->next_send <= now) {
+                    lg_stream_send(sp, now);
+                    sp->next_send += (uint64_t)cf.ptime * 1000000;
+                }
+                if (sp->next_send < next_due)
+                    next_due = sp->next_send;
+            }
+        }
+        now = lg_nsec();
+        timeout = (next_due > now) ? (next_due - now) / 1000000 : 0;
+        lg_drain(sessions, cf.nsessions, pfds, timeout, dstats);
+    }
+    elapsed = (double)(lg_nsec() - t0) / NSEC_MAX;
+    /* Let whatever is still in flight (or in the resizer) arrive */
+    tstop = lg_nsec() + NSEC_MAX / 2;
+    while ((now = lg_nsec()) < tstop)
+        lg_drain(sessions, cf.nsessions, pfds, (tstop - now) / 1000000 + 1,
+          dstats);
+
+    printf("sessions=%d ptime=%d resize=%d record=%d duration=%.3f",
+      cf.nsessions, cf.ptime, cf.resize, cf.record, elapsed);
+    if (cf.record && rtpp_pid > 0)
+        printf(" recdir=%s", recdir);
+    printf("\n");
+    lg_report(&cf, sessions, dstats, elapsed);
+    fflush(stdout);
+
+    for (i = 0; i < cf.nsessions; i++)
+        lg_ctl_command(cf.sock, rbuf, sizeof(rbuf), "D %s lga lgb",
+          sessions[i].call_id);
+    if (have_cstats && lg_ctl_cstats(cf.sock, &ncmds[1], &nallocs[1]) == 0 &&
+      ncmds[1] > ncmds[0]) {
+        printf("cmds=%llu cmd_allocs=%llu allocs_per_cmd=%.3f\n",
+          ncmds[1] - ncmds[0], nallocs[1] - nallocs[0],
+          (double)(nallocs[1] - nallocs[0]) / (ncmds[1] - ncmds[0]));
+        fflush(stdout);
+    }
+    status = 0;
+    for (d = 0; d < LG_NDIRS; d++) {
+        if (dstats[d].ncorrupt > 0)
+            status = 1;
+    }
+    for (i = 0; i < cf.nsessions; i++) {
+        close(sessions[i].fds[0]);
+        close(sessions[i].fds[1]);
+    }
+    free(pfds);
+    free(sessions);
+    if (rtpp_pid > 0) {
+        kill(rtpp_pid, SIGTERM);
+        waitpid(rtpp_pid, NULL, 0);
+    }
+    return (status);
+e0:
+    if (rtpp_pid > 0) {
+        kill(rtpp_pid, SIGTERM);
+        waitpid(rtpp_pid, NULL, 0);
+    }
+    return (1);
+}
@@ -0,0 +1,1117 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Microbenchmarks for the core data structures and hot-path primitives.
+ * Every benchmark is run once with a single thread and then again with
+ * N threads hammering the same object, results are printed one line per
+ * run as space-separated key=value pairs, e.g.:
+ *
+ * bench=hash_table.find threads=4 ops=... elapsed=... ops_per_sec=... \
+ *   batch=64 p50_ns=... p90_ns=... p99_ns=... p999_ns=... max_ns=...
+ *
+ * Latency percentiles are per-operation averages over a batch of "batch"
+ * operations, since timing each individual call would cost more than most
+ * of the calls being measured.
+ *
+ * With -r, the resizer replay is run instead, see mb_replay().
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rtpp_types.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_mallocs.h"
+#include "rtpp_arena.h"
+#include "rtpp_hash_table.h"
+#include "rtpp_weakref.h"
+#include "rtpp_queue.h"
+#include "rtpp_wi.h"
+#include "rtpp_ringbuf.h"
+#include "rtpp_stats.h"
+#include "rtpp_histogram.h"
+#include "rtpp_time.h"
+#include "rtp.h"
+#include "rtp_info.h"
+#include "rtp_packet.h"
+#include "rtp_resizer.h"
+#include "rtpp_ssrc.h"
+#include "rtpa_stats.h"
+#include "rtp_analyze.h"
+#include "rtpp_proc.h"
+
+#define MB_MAX_THREADS 64
+#define MB_NOBJS       1024
+#define MB_RB_NELEM    10
+#define MB_PKT_RING    64
+#define MB_NPKTS       4096
+
+struct mb_obj {
+    struct rtpp_refcnt *rcnt;
+    uint64_t key;
+};
+
+struct mb_shared {
+    struct rtpp_hash_table *ht;
+    struct rtpp_weakref_obj *wr;
+    struct rtpp_queue *queue;
+    struct rtpp_ringbuf *rb;
+    struct rtpp_stats *stats;
+    struct mb_obj *objs[MB_NOBJS];
+    struct rtp_packet **pkts;
+};
+
+struct mb_thread {
+    pthread_t thread_id;
+    int tnum;
+    struct mb_shared *shp;
+    const struct mb_bench *bp;
+    pthread_barrier_t *start;
+    volatile int *stop;
+    int batch;
+    uint32_t rnd;
+    uint64_t nops;
+    struct rtpp_histogram lat;
+    /* Per-thread state of the benchmarks that are not thread-safe by design */
+    struct rtpp_wi *wi;
+    struct rtp_resizer *resizer;
+    double rtime;
+    uint16_t seq;
+    uint32_t ts;
+    struct rtpp_session_stat rstat;
+    struct rtp_packet *pkt;
+    struct rtp_packet *pring[MB_PKT_RING];
+    int pring_i;
+    uint32_t sink;
+};
+
+struct mb_bench {
+    const char *name;
+    int (*setup)(struct mb_shared *);
+    void (*teardown)(struct mb_shared *);
+    int (*thr_init)(struct mb_thread *);
+    void (*thr_fini)(struct mb_thread *);
+    void (*run)(struct mb_thread *, int);
+};
+
+static uint32_t
+mb_random(struct mb_thread *tp)
+{
+
+    /* xorshift32, cheap enough to not skew the numbers */
+    tp->rnd ^= tp->rnd << 13;
+    tp->rnd ^= tp->rnd >> 17;
+    tp->rnd ^= tp->rnd << 5;
+    return (tp->rnd);
+}
+
+static uint64_t
+mb_nsec(void)
+{
+    struct timespec tp;
+
+    clock_gettime(RTPP_CLOCK_MONO, &tp);
+    return ((uint64_t)SEC(&tp) * NSEC_MAX + NSEC(&tp));
+}
+
+static void
+mb_obj_dtor(struct mb_obj *op)
+{
+
+    free(op);
+}
+
+static struct mb_obj *
+mb_obj_ctor(uint64_t key)
+{
+    struct mb_obj *op;
+    struct rtpp_refcnt *rcnt;
+
+    op = rtpp_rzmalloc(sizeof(struct mb_obj), &rcnt);
+    if (op == NULL)
+        return (NULL);
+    op->rcnt = rcnt;
+    op->key = key;
+    CALL_SMETHOD(op->rcnt, attach, (rtpp_refcnt_dtor_t)&mb_obj_dtor, op);
+    return (op);
+}
+
+static int
+mb_objs_setup(struct mb_shared *shp)
+{
+    int i;
+
+    for (i = 0; i < MB_NOBJS; i++) {
+        shp->objs[i] = mb_obj_ctor((uint64_t)i << 8);
+        if (shp->objs[i] == NULL)
+            return (-1);
+    }
+    return (0);
+}
+
+static void
+mb_objs_teardown(struct mb_shared *shp)
+{
+    int i;
+
+    for (i = 0; i < MB_NOBJS; i++) {
+        if (shp->objs[i] != NULL)
+            CALL_SMETHOD(shp->objs[i]->rcnt, decref);
+        shp->objs[i] = NULL;
+    }
+}
+
+static int
+ht_setup(struct mb_shared *shp)
+{
+    int i;
+
+    if (mb_objs_setup(shp) != 0)
+        return (-1);
+    shp->ht = rtpp_hash_table_ctor(rtpp_ht_key_u64_t, RTPP_HT_NODUPS);
+    if (shp->ht == NULL)
+        return (-1);
+    for (i = 0; i < MB_NOBJS; i++) {
+        if (CALL_METHOD(shp->ht, append_refcnt, &shp->objs[i]->key,
+          shp->objs[i]->rcnt) == NULL)
+            return (-1);
+    }
+    return (0);
+}
+
+static void
+ht_teardown(struct mb_shared *shp)
+{
+
+    if (shp->ht != NULL) {
+        CALL_METHOD(shp->ht, dtor);
+        shp->ht = NULL;
+    }
+    mb_objs_teardown(shp);
+}
+
+static void
+ht_find_run(struct mb_thread *tp, int nops)
+{
+    struct rtpp_refcnt *rco;
+    uint64_t key;
+    int i;
+
+    for (i = 0; i < nops; i++) {
+        key = (uint64_t)(mb_random(tp) % MB_NOBJS) << 8;
+        rco = CALL_METHOD(tp->shp->ht, find, &key);
+        assert(rco != NULL);
+        CALL_SMETHOD(rco, decref);
+    }
+}
+
+static void
+ht_append_remove_run(struct mb_thread *tp, int nops)
+{
+    struct rtpp_hash_table_entry *hte;
+    uint64_t key;
+    int i;
+
+    for (i = 0; i < nops; i++) {
+        /* Keys of the pre-populated objects all have low 8 bits clear */
+        key = ((uint64_t)mb_random(tp) << 8) | (tp->tnum + 1);
+        hte = CALL_METHOD(tp->shp->ht, append, &key, tp);
+        assert(hte != NULL);
+        CALL_METHOD(tp->shp->ht, remove, &key, hte);
+    }
+}
+
+static int
+wr_setup(struct mb_shared *shp)
+{
+    int i;
+
+    if (mb_objs_setup(shp) != 0)
+        return (-1);
+    shp->wr = rtpp_weakref_ctor();
+    if (shp->wr == NULL)
+        return (-1);
+    for (i = 0; i < MB_NOBJS; i++) {
+        if (CALL_METHOD(shp->wr, reg, shp->objs[i]->rcnt,
+          shp->objs[i]->key) != 0)
+            return (-1);
+    }
+    return (0);
+}
+
+static void
+wr_teardown(struct mb_shared *shp)
+{
+
+    if (shp->wr != NULL) {
+        CALL_METHOD(shp->wr, purge);
+        CALL_METHOD(shp->wr, dtor);
+        shp->wr = NULL;
+    }
+    mb_objs_teardown(shp);
+}
+
+static void
+wr_get_by_idx_run(struct mb_thread *tp, int nops)
+{
+    struct mb_obj *op;
+    uint64_t key;
+    int i;
+
+    for (i = 0; i < nops; i++) {
+        key = (uint64_t)(mb_random(tp) % MB_NOBJS) << 8;
+        op = CALL_METHOD(tp->shp->wr, get_by_idx, key);
+        assert(op != NULL && op->key == key);
+        CALL_SMETHOD(op->rcnt, decref);
+    }
+}
+
+static int
+queue_setup(struct mb_shared *shp)
+{
+
+    shp->queue = rtpp_queue_init(1, "microbench");
+    return (shp->queue != NULL ? 0 : -1);
+}
+
+static void
+queue_teardown(struct mb_shared *shp)
+{
+    struct rtpp_wi *wi;
+
+    if (shp->queue == NULL)
+        return;
+    while (rtpp_queue_get_length(shp->queue) > 0) {
+        wi = rtpp_queue_get_item(shp->queue, 0);
+        rtpp_wi_free(wi);
+    }
+    rtpp_queue_destroy(shp->queue);
+    shp->queue = NULL;
+}
+
+static int
+queue_thr_init(struct mb_thread *tp)
+{
+    void *dp;
+
+    tp->wi = rtpp_wi_malloc_udata(&dp, sizeof(uint64_t));
+    return (tp->wi != NULL ? 0 : -1);
+}
+
+static void
+queue_thr_fini(struct mb_thread *tp)
+{
+
+    if (tp->wi != NULL)
+        rtpp_wi_free(tp->wi);
+    tp->wi = NULL;
+}
+
+static void
+queue_put_get_run(struct mb_thread *tp, int nops)
+{
+    int i;
+
+    /*
+     * Every thread puts before it gets, so the queue can never be
+     * empty when get_item() is called. The item taken out could be
+     * the one put by some other thread, which is fine since they are
+     * all alike.
+     */
+    for (i = 0; i < nops; i++) {
+        rtpp_queue_put_item(tp->wi, tp->shp->queue);
+        tp->wi = rtpp_queue_get_item(tp->shp->queue, 0);
+    }
+}
+
+static int
+resizer_setup(struct mb_shared *shp)
+{
+
+    shp->stats = rtpp_stats_ctor();
+    return (shp->stats != NULL ? 0 : -1);
+}
+
+static void
+resizer_teardown(struct mb_shared *shp)
+{
+
+    if (shp->stats != NULL) {
+        CALL_METHOD(shp->stats, dtor);
+        shp->stats = NULL;
+    }
+}
+
+static int
+resizer_thr_init(struct mb_thread *tp)
+{
+
+    /* 20ms PCMU in, 30ms out: exercises both merging and splitting */
+    tp->resizer = rtp_resizer_new(30);
+    tp->rtime = 1000.0;
+    tp->seq = mb_random(tp);
+    tp->ts = mb_random(tp);
+    return (tp->resizer != NULL ? 0 : -1);
+}
+
+static void
+resizer_thr_fini(struct mb_thread *tp)
+{
+
+    if (tp->resizer != NULL)
+        rtp_resizer_free(tp->shp->stats, tp->resizer);
+    tp->resizer = NULL;
+}
+
+static struct rtp_packet *
+mb_pkt_next(struct mb_thread *tp)
+{
+    struct rtp_packet *pkt;
+
+    pkt = rtp_packet_alloc();
+    if (pkt == NULL)
+        return (NULL);
+    memset(&pkt->data.header, '\0', sizeof(pkt->data.header));
+    pkt->data.header.version = 2;
+    pkt->data.header.pt = RTP_PCMU;
+    pkt->data.header.seq = htons(tp->seq);
+    pkt->data.header.ts = htonl(tp->ts);
+    pkt->data.header.ssrc = htonl(tp->tnum + 1);
+    pkt->size = sizeof(rtp_hdr_t) + 160;
+    pkt->rtime = tp->rtime;
+    tp->seq++;
+    tp->ts += 160;
+    tp->rtime += 0.02;
+    return (pkt);
+}
+
+static void
+resizer_enqueue_get_run(struct mb_thread *tp, int nops)
+{
+    struct rtpp_proc_rstats rstats;
+    struct rtp_packet *pkt;
+    int i;
+
+    memset(&rstats, '\0', sizeof(rstats));
+    for (i = 0; i < nops; i++) {
+        pkt = mb_pkt_next(tp);
+        assert(pkt != NULL);
+        rtp_resizer_enqueue(tp->resizer, &pkt, &rstats);
+        if (pkt != NULL)
+            rtp_packet_free(pkt);
+        while ((pkt = rtp_resizer_get(tp->resizer, tp->rtime)) != NULL)
+            rtp_packet_free(pkt);
+    }
+}
+
+static void
+resizer_enqueue1(struct mb_thread *tp, struct rtp_packet *pkt)
+{
+    struct rtpp_proc_rstats rstats;
+
+    memset(&rstats, '\0', sizeof(rstats));
+    rtp_resizer_enqueue(tp->resizer, &pkt, &rstats);
+    if (pkt != NULL)
+        rtp_packet_free(pkt);
+    while ((pkt = rtp_resizer_get(tp->resizer, tp->rtime)) != NULL)
+        rtp_packet_free(pkt);
+}
+
+static void
+resizer_reorder_thr_fini(struct mb_thread *tp)
+{
+
+    if (tp->pkt != NULL)
+        rtp_packet_free(tp->pkt);
+    tp->pkt = NULL;
+    resizer_thr_fini(tp);
+}
+
+static void
+resizer_reorder_run(struct mb_thread *tp, int nops)
+{
+    struct rtp_packet *pkt;
+    int i;
+
+    /*
+     * Same as above, but every 4th packet on average is held back and
+     * delivered after the next one.
+     */
+    for (i = 0; i < nops; i++) {
+        pkt = mb_pkt_next(tp);
+        assert(pkt != NULL);
+        if (tp->pkt == NULL && (mb_random(tp) & 3) == 0) {
+            tp->pkt = pkt;
+            continue;
+        }
+        resizer_enqueue1(tp, pkt);
+        if (tp->pkt != NULL) {
+            resizer_enqueue1(tp, tp->pkt);
+            tp->pkt = NULL;
+        }
+    }
+}
+
+static int
+analyze_thr_init(struct mb_thread *tp)
+{
+
+    if (rtpp_stats_init(&tp->rstat) != 0)
+        return (-1);
+    tp->rtime = 1000.0;
+    tp->seq = mb_random(tp);
+    tp->ts = mb_random(tp);
+    tp->pkt = mb_pkt_next(tp);
+    if (tp->pkt == NULL || rtp_packet_parse(tp->pkt) != RTP_PARSER_OK)
+        return (-1);
+    return (0);
+}
+
+static void
+analyze_thr_fini(struct mb_thread *tp)
+{
+
+    if (tp->pkt != NULL)
+        rtp_packet_free(tp->pkt);
+    tp->pkt = NULL;
+    rtpp_stats_destroy(&tp->rstat);
+}
+
+static void
+analyze_update_run(struct mb_thread *tp, int nops)
+{
+    struct rtp_packet *pkt;
+    enum update_rtpp_stats_rval rval;
+    int i;
+
+    pkt = tp->pkt;
+    for (i = 0; i < nops; i++) {
+        /* Same as what rtp_packet_parse() would fill in for the next one */
+        pkt->data.header.seq = htons(tp->seq);
+        pkt->data.header.ts = htonl(tp->ts);
+        pkt->parsed->seq = tp->seq;
+        pkt->parsed->ts = tp->ts;
+        pkt->rtime = tp->rtime;
+        tp->seq++;
+        tp->ts += 160;
+        tp->rtime += 0.02;
+        rval = update_rtpp_stats(NULL, &tp->rstat, &pkt->data.header,
+          pkt->parsed, pkt->rtime);
+        assert(rval != UPDATE_ERR);
+    }
+}
+
+static int
+rb_setup(struct mb_shared *shp)
+{
+    uint32_t ts;
+    int i;
+
+    /* Same shape as the timestamp de-duplication buffer in rtp_analyze.c */
+    shp->rb = rtpp_ringbuf_ctor(sizeof(ts), MB_RB_NELEM);
+    if (shp->rb == NULL)
+        return (-1);
+    for (i = 0; i < MB_RB_NELEM; i++) {
+        ts = i * 160;
+        CALL_METHOD(shp->rb, push, &ts);
+    }
+    return (0);
+}
+
+static void
+rb_teardown(struct mb_shared *shp)
+{
+
+    if (shp->rb != NULL)
+        CALL_SMETHOD(shp->rb->rcnt, decref);
+    shp->rb = NULL;
+}
+
+static void
+rb_locate_run(struct mb_thread *tp, int nops)
+{
+    uint32_t ts;
+    int i;
+
+    /* Half hits, half misses (full scan) */
+    for (i = 0; i < nops; i++) {
+        ts = (mb_random(tp) % (MB_RB_NELEM * 2)) * 160;
+        (void)CALL_METHOD(tp->shp->rb, locate, &ts);
+    }
+}
+
+static int
+refcnt_setup(struct mb_shared *shp)
+{
+
+    shp->objs[0] = mb_obj_ctor(0);
+    return (shp->objs[0] != NULL ? 0 : -1);
+}
+
+static void
+refcnt_teardown(struct mb_shared *shp)
+{
+
+    if (shp->objs[0] != NULL)
+        CALL_SMETHOD(shp->objs[0]->rcnt, decref);
+    shp->objs[0] = NULL;
+}
+
+static void
+refcnt_incref_decref_run(struct mb_thread *tp, int nops)
+{
+    struct rtpp_refcnt *rcnt;
+    int i;
+
+    rcnt = tp->shp->objs[0]->rcnt;
+    for (i = 0; i < nops; i++) {
+        CALL_SMETHOD(rcnt, incref);
+        CALL_SMETHOD(rcnt, decref);
+    }
+}
+
+static int
+pkt_alloc_thr_init(struct mb_thread *tp)
+{
+    int i;
+
+    for (i = 0; i < MB_PKT_RING; i++) {
+        tp->pring[i] = mb_pkt_next(tp);
+        if (tp->pring[i] == NULL)
+            return (-1);
+    }
+    return (0);
+}
+
+static void
+pkt_alloc_thr_fini(struct mb_thread *tp)
+{
+    int i;
+
+    for (i = 0; i < MB_PKT_RING; i++) {
+        if (tp->pring[i] != NULL)
+            rtp_packet_free(tp->pring[i]);
+        tp->pring[i] = NULL;
+    }
+}
+
+static void
+pkt_alloc_free_run(struct mb_thread *tp, int nops)
+{
+    int i;
+
+    /*
+     * Keep a window of packets in flight, so that the allocator has to
+     * deal with some fragmentation, like it does in the relay path.
+     */
+    for (i = 0; i < nops; i++) {
+        rtp_packet_free(tp->pring[tp->pring_i]);
+        tp->pring[tp->pring_i] = mb_pkt_next(tp);
+        assert(tp->pring[tp->pring_i] != NULL);
+        tp->pring_i = (tp->pring_i + 1) % MB_PKT_RING;
+    }
+}
+
+static void
+pkt_xfree_run(struct mb_thread *tp, int nops)
+{
+    struct rtp_packet *pkt;
+    int i;
+
+    /*
+     * Swap a fresh packet into a random shared slot and free the one that
+     * was there, which has most likely been allocated by another thread,
+     * like the packets received by the I/O thread and freed by the RTP one.
+     */
+    for (i = 0; i < nops; i++) {
+        pkt = mb_pkt_next(tp);
+        assert(pkt != NULL);
+        pkt = __sync_lock_test_and_set(&tp->shp->pkts[mb_random(tp) %
+          MB_NPKTS], pkt);
+        rtp_packet_free(pkt);
+    }
+}
+
+static int
+pkt_touch_setup(struct mb_shared *shp)
+{
+    struct mb_thread t;
+    int i;
+
+    shp->pkts = calloc(MB_NPKTS, sizeof(shp->pkts[0]));
+    if (shp->pkts == NULL)
+        return (-1);
+    memset(&t, '\0', sizeof(t));
+    for (i = 0; i < MB_NPKTS; i++) {
+        t.tnum = i;
+        shp->pkts[i] = mb_pkt_next(&t);
+        if (shp->pkts[i] == NULL)
+            return (-1);
+        /* Fault in the whole buffer, as recvfrom() would */
+        memset(shp->pkts[i]->data.buf + sizeof(rtp_hdr_t), 0xff, 160);
+    }
+    return (0);
+}
+
+static void
+pkt_touch_teardown(struct mb_shared *shp)
+{
+    int i;
+
+    if (shp->pkts == NULL)
+        return;
+    for (i = 0; i < MB_NPKTS; i++) {
+        if (shp->pkts[i] != NULL)
+            rtp_packet_free(shp->pkts[i]);
+    }
+    free(shp->pkts);
+    shp->pkts = NULL;
+}
+
+static void
+pkt_touch_run(struct mb_thread *tp, int nops)
+{
+    struct rtp_packet *pkt;
+    int i;
+
+    /*
+     * Random reads of the header and metadata over a working set that
+     * is well beyond what 4K-page TLB entries can cover.
+     */
+    for (i = 0; i < nops; i++) {
+        pkt = tp->shp->pkts[mb_random(tp) % MB_NPKTS];
+        tp->sink += pkt->data.header.ssrc + pkt->size +
+          pkt->data.buf[sizeof(rtp_hdr_t) + 159];
+    }
+}
+
+static const struct mb_bench benches[] = {
+    {.name = "hash_table.find", .setup = ht_setup, .teardown = ht_teardown,
+     .run = ht_find_run},
+    {.name = "hash_table.append_remove", .setup = ht_setup,
+     .teardown = ht_teardown, .run = ht_append_remove_run},
+    {.name = "weakref.get_by_idx", .setup = wr_setup, .teardown = wr_teardown,
+     .run = wr_get_by_idx_run},
+    {.name = "queue.put_get", .setup = queue_setup,
+     .teardown = queue_teardown, .thr_init = queue_thr_init,
+     .thr_fini = queue_thr_fini, .run = queue_put_get_run},
+    {.name = "resizer.enqueue_get", .setup = resizer_setup,
+     .teardown = resizer_teardown, .thr_init = resizer_thr_init,
+     .thr_fini = resizer_thr_fini, .run = resizer_enqueue_get_run},
+    {.name = "resizer.reorder", .setup = resizer_setup,
+     .teardown = resizer_teardown, .thr_init = resizer_thr_init,
+     .thr_fini = resizer_reorder_thr_fini, .run = resizer_reorder_run},
+    {.name = "analyze.update_rtpp_stats", .thr_init = analyze_thr_init,
+     .thr_fini = analyze_thr_fini, .run = analyze_update_run},
+    {.name = "ringbuf.locate", .setup = rb_setup, .teardown = rb_teardown,
+     .run = rb_locate_run},
+    {.name = "refcnt.incref_decref", .setup = refcnt_setup,
+     .teardown = refcnt_teardown, .run = refcnt_incref_decref_run},
+    {.name = "rtp_packet.alloc_free", .thr_init = pkt_alloc_thr_init,
+     .thr_fini = pkt_alloc_thr_fini, .run = pkt_alloc_free_run},
+    {.name = "rtp_packet.xthread_free", .setup = pkt_touch_setup,
+     .teardown = pkt_touch_teardown, .run = pkt_xfree_run},
+    {.name = "rtp_packet.touch", .setup = pkt_touch_setup,
+     .teardown = pkt_touch_teardown, .run = pkt_touch_run},
+    {.name = NULL}
+};
+
+static void *
+mb_thread_run(void *arg)
+{
+    struct mb_thread *tp;
+    uint64_t t0, t1;
+
+    tp = (struct mb_thread *)arg;
+    pthread_barrier_wait(tp->start);
+    do {
+        t0 = mb_nsec();
+        tp->bp->run(tp, tp->batch);
+        t1 = mb_nsec();
+        /* The histogram is unit-agnostic, feed it nanoseconds per op */
+        rtpp_histogram_record_us(&tp->lat, (t1 - t0) / tp->batch);
+        tp->nops += tp->batch;
+    } while (*tp->stop == 0);
+    return (NULL);
+}
+
+static int
+mb_run(const struct mb_bench *bp, int nthreads, double duration, int batch)
+{
+    struct mb_shared shared;
+    struct mb_thread *threads, *tp;
+    struct rtpp_histogram lat;
+    pthread_barrier_t start;
+    volatile int stop;
+    struct timespec sleep;
+    uint64_t t0, t1, nops;
+    double elapsed;
+    int i, ninit, rval;
+
+    rval = -1;
+    ninit = 0;
+    memset(&shared, '\0', sizeof(shared));
+    threads = calloc(nthreads, sizeof(struct mb_thread));
+    if (threads == NULL)
+        return (-1);
+    if (bp->setup != NULL && bp->setup(&shared) != 0)
+        goto e0;
+    if (pthread_barrier_init(&start, NULL, nthreads + 1) != 0)
+        goto e0;
+    stop = 0;
+    for (i = 0; i < nthreads; i++) {
+        tp = &threads[i];
+        tp->tnum = i;
+        tp->shp = &shared;
+        tp->bp = bp;
+        tp->start = &start;
+        tp->stop = &stop;
+        tp->batch = batch;
+        tp->rnd = 0x9e3779b9 * (i + 1);
+        rtpp_histogram_init(&tp->lat);
+        if (bp->thr_init != NULL && bp->thr_init(tp) != 0)
+            goto e1;
+        ninit++;
+    }
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&threads[i].thread_id, NULL, mb_thread_run,
+          &threads[i]) != 0) {
+            /* Can't unwind the barrier, let the caller exit */
+            fprintf(stderr, "pthread_create() failed\n");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&start);
+    t0 = mb_nsec();
+    dtime2mtimespec(duration, &sleep);
+    nanosleep(&sleep, NULL);
+    stop = 1;
+    rtpp_histogram_init(&lat);
+    nops = 0;
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i].thread_id, NULL);
+        rtpp_histogram_merge(&lat, &threads[i].lat);
+        nops += threads[i].nops;
+    }
+    t1 = mb_nsec();
+    elapsed = (double)(t1 - t0) / NSEC_MAX;
+    printf("bench=%s threads=%d ops=%llu elapsed=%.6f ops_per_sec=%.0f "
+      "batch=%d p50_ns=%llu p90_ns=%llu p99_ns=%llu p999_ns=%llu "
+      "max_ns=%llu\n", bp->name, nthreads, (unsigned long long)nops, elapsed,
+      (double)nops / elapsed, batch,
+      (unsigned long long)rtpp_histogram_pctl(&lat, 50.0),
+      (unsigned long long)rtpp_histogram_pctl(&lat, 90.0),
+      (unsigned long long)rtpp_histogram_pctl(&lat, 99.0),
+      (unsigned long long)rtpp_histogram_pctl(&lat, 99.9),
+      (unsigned long long)lat.max);
+    fflush(stdout);
+    rval = 0;
+e1:
+    for (i = 0; i < ninit; i++) {
+        if (bp->thr_fini != NULL)
+            bp->thr_fini(&threads[i]);
+    }
+    pthread_barrier_destroy(&start);
+e0:
+    if (bp->teardown != NULL)
+        bp->teardown(&shared);
+    free(threads);
+    return (rval);
+}
+
+/*
+ * Resizer replay (-r): push a number of pseudo-random streams, each with
+ * its own codec, packetization and output ptime, with reordering,
+ * duplicates, losses, TS jumps and SSRC changes thrown in, through the
+ * resizer and print one line per stream with a digest of the packets
+ * that came out of it. Nothing in there depends on the timing or the
+ * platform, so the output can be compared across the resizer
+ * implementations, see tests/resizer_replay.
+ */
+#define MB_REPLAY_NPKTS 256
+
+static const struct mb_codec {
+    int pt;
+    int frame_nsamples;
+    int frame_bytes;
+} mb_codecs[] = {
+    {RTP_PCMU, 80, 80}, {RTP_PCMA, 80, 80}, {RTP_G729, 80, 10},
+    {RTP_GSM, 160, 33}, {RTP_G722, 80, 80}
+};
+
+static struct rtp_packet *
+mb_replay_pkt(const struct mb_codec *cp, int nframes, uint16_t seq,
+  uint32_t ts, uint32_t ssrc)
+{
+    struct rtp_packet *pkt;
+    int i, plen;
+
+    pkt = rtp_packet_alloc();
+    if (pkt == NULL)
+        return (NULL);
+    plen = cp->frame_bytes * nframes;
+    memset(&pkt->data.header, '\0', sizeof(pkt->data.header));
+    pkt->data.header.version = 2;
+    pkt->data.header.pt = cp->pt;
+    pkt->data.header.seq = htons(seq);
+    pkt->data.header.ts = htonl(ts);
+    pkt->data.header.ssrc = htonl(ssrc);
+    for (i = 0; i < plen; i++)
+        pkt->data.buf[sizeof(rtp_hdr_t) + i] = (ts + i) & 0xff;
+    pkt->size = sizeof(rtp_hdr_t) + plen;
+    return (pkt);
+}
+
+static uint32_t
+mb_fnv1a(uint32_t h, const void *p, size_t len)
+{
+    const unsigned char *cp;
+
+    for (cp = p; len > 0; cp++, len--) {
+        h ^= *cp;
+        h *= 16777619;
+    }
+    return (h);
+}
+
+static int
+mb_replay(struct rtpp_stats *stats, int scen)
+{
+    struct mb_thread t;
+    const struct mb_codec *cp;
+    struct rtp_packet *pkts[MB_REPLAY_NPKTS * 2], *pkt, *tpkt;
+    struct rtpp_proc_rstats rstats;
+    struct rtp_resizer *resizer;
+    int nframes, optime, reorder, dup, loss, jump, nssrc, npkts, i, j;
+    int nout, nsamples;
+    uint32_t ts, ssrc, h, v[5];
+    uint16_t seq;
+    double ptime, dtime;
+
+    memset(&t, '\0', sizeof(t));
+    t.rnd = 0x9e3779b9 * (scen + 1);
+    cp = &mb_codecs[mb_random(&t) % (sizeof(mb_codecs) / sizeof(mb_codecs[0]))];
+    nframes = 1 + mb_random(&t) % 6;
+    optime = 10 * (1 + mb_random(&t) % 6);
+    reorder = mb_random(&t) % 40;
+    dup = mb_random(&t) % 10;
+    loss = mb_random(&t) % 10;
+    jump = mb_random(&t) % 3;
+    nssrc = mb_random(&t) % 4;
+    resizer = rtp_resizer_new(optime);
+    if (resizer == NULL)
+        return (-1);
+
+    seq = mb_random(&t);
+    ts = mb_random(&t);
+    ssrc = mb_random(&t);
+    npkts = 0;
+    for (i = 0; i < MB_REPLAY_NPKTS; i++) {
+        if (mb_random(&t) % 100 < jump)
+            ts += mb_random(&t) % 100000;
+        if (mb_random(&t) % 100 < nssrc) {
+            /* New source, with TS not far from the old one on purpose */
+            ssrc = mb_random(&t);
+            ts += (mb_random(&t) % 4000) - 2000;
+            seq = mb_random(&t);
+        }
+        if (mb_random(&t) % 100 >= loss) {
+            pkt = mb_replay_pkt(cp, nframes, seq, ts, ssrc);
+            if (pkt == NULL)
+                return (-1);
+            pkts[npkts++] = pkt;
+            if (mb_random(&t) % 100 < dup) {
+                pkts[npkts] = rtp_packet_alloc();
+                if (pkts[npkts] == NULL)
+                    return (-1);
+                rtp_packet_dup(pkts[npkts++], pkt, 0);
+            }
+        }
+        seq++;
+        ts += cp->frame_nsamples * nframes;
+    }
+    for (i = 0; i < npkts - 1; i++) {
+        if (mb_random(&t) % 100 >= reorder)
+            continue;
+        j = i + 1 + mb_random(&t) % 3;
+        if (j >= npkts)
+            j = npkts - 1;
+        tpkt = pkts[i];
+        pkts[i] = pkts[j];
+        pkts[j] = tpkt;
+    }
+
+    h = 2166136261;
+    nout = nsamples = 0;
+    memset(&rstats, '\0', sizeof(rstats));
+    ptime = (double)(cp->frame_nsamples * nframes) / 8000.0;
+    dtime = 1000.0;
+    for (i = 0; i <= npkts; i++) {
+        if (i < npkts) {
+            pkt = pkts[i];
+            pkt->rtime = 1000.0 + i * ptime + (mb_random(&t) % 200) / 10000.0;
+            if (pkt->rtime > dtime)
+                dtime = pkt->rtime;
+            rtp_resizer_enqueue(resizer, &pkt, &rstats);
+            if (pkt != NULL)
+                rtp_packet_free(pkt);
+        } else {
+            /* Flush whatever is left */
+            dtime += 60.0;
+        }
+        while ((pkt = rtp_resizer_get(resizer, dtime)) != NULL) {
+            v[0] = pkt->parsed->ts;
+            v[1] = pkt->parsed->seq;
+            v[2] = pkt->parsed->ssrc;
+            v[3] = pkt->parsed->nsamples;
+            v[4] = pkt->parsed->data_size;
+            h = mb_fnv1a(h, v, sizeof(v));
+            h = mb_fnv1a(h, &pkt->data.buf[pkt->parsed->data_offset],
+              pkt->parsed->data_size);
+            nout++;
+            nsamples += pkt->parsed->nsamples;
+            rtp_packet_free(pkt);
+        }
+    }
+    rtp_resizer_free(stats, resizer);
+    printf("scenario=%d pt=%d in_nsamples=%d out_ptime=%d npkts=%d "
+      "discarded=%llu out=%d out_nsamples=%d digest=%08x\n", scen, cp->pt,
+      cp->frame_nsamples * nframes, optime, npkts,
+      (unsigned long long)rstats.npkts_resizer_discard.cnt, nout, nsamples, h);
+    return (0);
+}
+
+static void
+usage(void)
+{
+
+    fprintf(stderr, "usage: rtpp_microbench [-lH] [-t nthreads] "
+      "[-d duration] [-b batch] [bench ...]\n"
+      "       rtpp_microbench -r nstreams\n");
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct mb_bench *bp;
+    struct rtpp_stats *stats;
+    int ch, i, nthreads, batch, lflag, selected, nreplay;
+    double duration;
+
+    nthreads = 4;
+    batch = 64;
+    duration = 1.0;
+    lflag = 0;
+    nreplay = 0;
+    while ((ch = getopt(argc, argv, "lHt:d:b:r:")) != -1) {
+        switch (ch) {
+        case 'l':
+            lflag = 1;
+            break;
+
+        case 'H':
+            if (rtpp_arena_init() != 0)
+                usage();
+            break;
+
+        case 't':
+            nthreads = atoi(optarg);
+            if (nthreads < 1 || nthreads > MB_MAX_THREADS)
+                usage();
+            break;
+
+        case 'd':
+            duration = atof(optarg);
+            if (duration <= 0)
+                usage();
+            break;
+
+        case 'b':
+            batch = atoi(optarg);
+            if (batch < 1)
+                usage();
+            break;
+
+        case 'r':
+            nreplay = atoi(optarg);
+            if (nreplay < 1)
+                usage();
+            break;
+
+        case '?':
+        default:
+            usage();
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    if (nreplay > 0) {
+        stats = rtpp_stats_ctor();
+        if (stats == NULL)
+            exit(1);
+        for (i = 0; i < nreplay; i++) {
+            if (mb_replay(stats, i) != 0) {
+                fprintf(stderr, "replay %d failed\n", i);
+                exit(1);
+            }
+        }
+        CALL_METHOD(stats, dtor);
+        return (0);
+    }
+
+    for (bp = benches; bp->name != NULL; bp++) {
+        if (lflag) {
+            printf("%s\n", bp->name);
+            continue;
+        }
+        selected = (argc == 0);
+        for (i = 0; i < argc && !selected; i++) {
+            if (strcmp(argv[i], bp->name) == 0)
+                selected = 1;
+        }
+        if (!selected)
+            continue;
+        if (mb_run(bp, 1, duration, batch) != 0 ||
+          (nthreads > 1 && mb_run(bp, nthreads, duration, batch) != 0)) {
+            fprintf(stderr, "%s: setup failed\n", bp->name);
+            exit(1);
+        }
+    }
+    return (0);
+}
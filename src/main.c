@@ -41,6 +41,7 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <grp.h>
+#include <limits.h>
 #include <math.h>
 #include <pthread.h>
 #include <pwd.h>
@@ -73,15 +74,20 @@
 #include "rtpp_controlfd.h"
 #include "rtpp_genuid_singlet.h"
 #include "rtpp_hash_table.h"
+#include "rtpp_kfwd.h"
 #include "rtpp_command_ver.h"
 #include "rtpp_command_async.h"
 #include "rtpp_port_table.h"
+#include "rtpp_histogram.h"
 #include "rtpp_proc_async.h"
 #include "rtpp_bindaddrs.h"
 #include "rtpp_network.h"
 #include "rtpp_notify.h"
 #include "rtpp_math.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_arena.h"
+#include "rtpp_cpuset.h"
+#include "rtpp_stream.h"
 #if ENABLE_MODULE_IF
 #include "rtpp_module_if.h"
 #endif
@@ -202,10 +208,26 @@ rtpp_rlim_max(struct cfg *cf)
 
 #define LOPT_DSO     256
 #define LOPT_BRSYM   257
+#define LOPT_EVLOOP  258
+#define LOPT_WORKER  259
+#define LOPT_CONNLTCH 260
+#define LOPT_KFWD    261
+#define LOPT_LOGRL   262
+#define LOPT_HUGEPAGES 263
+#define LOPT_CPUAFF  264
+#define LOPT_ULRL    265
 
 const static struct option longopts[] = {
     { "dso", required_argument, NULL, LOPT_DSO },
     { "bridge_symmetric", no_argument, NULL, LOPT_BRSYM },
+    { "evloop", no_argument, NULL, LOPT_EVLOOP },
+    { "worker", required_argument, NULL, LOPT_WORKER },
+    { "connect_latched", no_argument, NULL, LOPT_CONNLTCH },
+    { "kfwd", required_argument, NULL, LOPT_KFWD },
+    { "log_ratelimit", required_argument, NULL, LOPT_LOGRL },
+    { "hugepages", no_argument, NULL, LOPT_HUGEPAGES },
+    { "cpu_affinity", required_argument, NULL, LOPT_CPUAFF },
+    { "unlatched_ratelimit", required_argument, NULL, LOPT_ULRL },
     { NULL,  0,                 NULL, 0 }
 };
 
@@ -230,7 +252,8 @@ init_config(struct cfg *cf, int argc, char **argv)
     struct group *gp;
     double x, y;
     struct rtpp_ctrl_sock *ctrl_sock;
-    int option_index, brsym;
+    int option_index, brsym, npairs;
+    static char wpid_file[PATH_MAX + 1];
     struct proto_cap *pcp;
 
     bh[0] = bh[1] = bh6[0] = bh6[1] = NULL;
@@ -253,6 +276,8 @@ init_config(struct cfg *cf, int argc, char **argv)
     cf->stable->ttl_mode = TTL_UNIFIED;
     cf->stable->log_level = -1;
     cf->stable->log_facility = -1;
+    cf->stable->log_rl_rate = LOG_RL_RATE;
+    cf->stable->log_rl_burst = LOG_RL_BURST;
     cf->stable->sched_offset = 0.0;
     cf->stable->sched_hz = rtpp_get_sched_hz();
     cf->stable->sched_policy = SCHED_OTHER;
@@ -294,6 +319,97 @@ init_config(struct cfg *cf, int argc, char **argv)
             brsym = 1;
             break;
 
+        case LOPT_EVLOOP:
+            cf->stable->evloop = 1;
+            break;
+
+        case LOPT_CONNLTCH:
+            cf->stable->connect_latched = 1;
+            break;
+
+        case LOPT_KFWD:
+            cf->stable->kfwd_ifnames = optarg;
+            break;
+
+        case LOPT_LOGRL:
+            cf->stable->log_rl_rate = strtod(optarg, &cp);
+            if (cp == optarg || cf->stable->log_rl_rate < 0) {
+                errx(1, "%s: --log_ratelimit should be in the format "
+                  "RATE[/BURST]", optarg);
+            }
+            if (*cp == '/') {
+                tp[0] = cp + 1;
+                cf->stable->log_rl_burst = strtol(tp[0], &cp, 10);
+                if (*tp[0] == '\0' || cf->stable->log_rl_burst < 1) {
+                    errx(1, "%s: invalid log burst size", tp[0]);
+                }
+            }
+            if (*cp != '\0') {
+                errx(1, "%s: --log_ratelimit should be in the format "
+                  "RATE[/BURST]", optarg);
+            }
+            break;
+
+        case LOPT_HUGEPAGES:
+            if (rtpp_arena_init() != 0) {
+                errx(1, "can't initialize huge page arena allocator");
+            }
+            break;
+
+        case LOPT_CPUAFF:
+            if (rtpp_cpuset_parse(optarg) != 0) {
+                errx(1, "%s: --cpu_affinity should be in the format "
+                  "CLASS:CPULIST, where CLASS is one of rtp, net, cmd, "
+                  "timed, notify, syslog, module or all and CPULIST "
+                  "includes at least one usable CPU", optarg);
+            }
+            break;
+
+        case LOPT_ULRL:
+            tp[0] = optarg;
+            x = strtod(tp[0], &cp);
+            if (cp == tp[0] || (x != 0 && x < 1)) {
+                errx(1, "%s: --unlatched_ratelimit should be in the format "
+                  "STREAM_PPS[/GLOBAL_PPS]", optarg);
+            }
+            if (*cp == '/') {
+                tp[1] = cp + 1;
+                y = strtod(tp[1], &cp);
+                if (cp == tp[1] || (y != 0 && y < 1)) {
+                    errx(1, "%s: invalid global packet rate", tp[1]);
+                }
+            } else {
+                y = 0;
+            }
+            if (*cp != '\0' || rtpp_stream_ulrl_init(x, y) != 0) {
+                errx(1, "%s: --unlatched_ratelimit should be in the format "
+                  "STREAM_PPS[/GLOBAL_PPS]", optarg);
+            }
+            break;
+
+        case LOPT_WORKER:
+            tp[0] = optarg;
+            tp[1] = strchr(tp[0], '/');
+            if (tp[1] == NULL) {
+                errx(1, "%s: --worker should be in the format I/N", optarg);
+            }
+            *tp[1] = '\0';
+            tp[1]++;
+            cf->stable->worker_id = strtol(tp[0], &cp, 10);
+            if (*tp[0] == '\0' || *cp != '\0') {
+                errx(1, "%s: invalid worker index", tp[0]);
+            }
+            cf->stable->nworkers = strtol(tp[1], &cp, 10);
+            if (*tp[1] == '\0' || *cp != '\0' || cf->stable->nworkers < 1) {
+                errx(1, "%s: invalid number of workers", tp[1]);
+            }
+            if (cf->stable->worker_id < 0 ||
+              cf->stable->worker_id >= cf->stable->nworkers) {
+                errx(1, "worker index should be in the range 0-%d",
+                  cf->stable->nworkers - 1);
+            }
+            break;
+
         case 'c':
             if (strcmp(optarg, "fifo") == 0) {
                  cf->stable->sched_policy = SCHED_FIFO;
@@ -564,6 +680,35 @@ init_config(struct cfg *cf, int argc, char **argv)
         rtpp_list_append(cf->stable->ctrl_socks, ctrl_sock);
     }
 
+    if (cf->stable->nworkers > 1) {
+        /*
+         * Pair each UDP control socket with a loopback one on which the
+         * other workers pass us commands for the call-ids we own.
+         */
+        for (ctrl_sock = RTPP_LIST_HEAD(cf->stable->ctrl_socks);
+          ctrl_sock != NULL; ctrl_sock = RTPP_ITER_NEXT(ctrl_sock)) {
+            if (ctrl_sock->type == RTPC_WFWD)
+                continue;
+            if (ctrl_sock->type != RTPC_UDP4 && ctrl_sock->type != RTPC_UDP6) {
+                errx(1, "%s: only udp and udp6 control sockets can be shared "
+                  "between the workers", ctrl_sock->cmd_sock);
+            }
+            ctrl_sock->wfwd_pair = rtpp_zmalloc(sizeof(struct rtpp_ctrl_sock));
+            if (ctrl_sock->wfwd_pair == NULL) {
+                err(1, "can't allocate memory");
+            }
+            ctrl_sock->wfwd_pair->type = RTPC_WFWD;
+            ctrl_sock->wfwd_pair->cmd_sock = ctrl_sock->cmd_sock;
+            ctrl_sock->wfwd_pair->wfwd_pair = ctrl_sock;
+            rtpp_list_append(cf->stable->ctrl_socks, ctrl_sock->wfwd_pair);
+        }
+        if (strcmp(cf->stable->pid_file, PID_FILE) == 0) {
+            snprintf(wpid_file, sizeof(wpid_file), "%s.%d", PID_FILE,
+              cf->stable->worker_id);
+            cf->stable->pid_file = wpid_file;
+        }
+    }
+
     if (cf->stable->rdir == NULL && cf->stable->sdir != NULL)
 	errx(1, "-S switch requires -r switch");
 
@@ -606,6 +751,19 @@ init_config(struct cfg *cf, int argc, char **argv)
     if (cf->stable->port_min > cf->stable->port_max)
 	errx(1, "port_min should be less than port_max");
 
+    if (cf->stable->nworkers > 1) {
+        /* Each worker gets its own slice of the RTP/RTCP port pairs */
+        npairs = (cf->stable->port_max - cf->stable->port_min) / 2 + 1;
+        if (npairs < cf->stable->nworkers)
+            errx(1, "port range is too small to be shared by %d workers",
+              cf->stable->nworkers);
+        i = cf->stable->port_min;
+        cf->stable->port_min = i + 2 * (npairs * cf->stable->worker_id /
+          cf->stable->nworkers);
+        cf->stable->port_max = i + 2 * (npairs * (cf->stable->worker_id + 1) /
+          cf->stable->nworkers) - 2;
+    }
+
     if (bh[0] == NULL && bh[1] == NULL && bh6[0] == NULL && bh6[1] == NULL) {
 	bh[0] = "*";
     }
@@ -663,10 +821,30 @@ update_derived_stats(double dtime, void *argp)
     struct rtpp_stats *rtpp_stats;
 
     rtpp_stats = (struct rtpp_stats *)argp;
+    rtpp_arena_stats_flush(rtpp_stats);
     CALL_METHOD(rtpp_stats, update_derived, dtime);
     return (CB_MORE);
 }
 
+/* How often to check for the shutdown in the --evloop mode, usec */
+#define EVLOOP_SHUTDOWN_CHECK 100000
+
+static int
+rtpp_shutdown_due(struct cfg *cfp)
+{
+
+    if (cfp->stable->fastshutdown != 0) {
+        return (1);
+    }
+    if (cfp->stable->slowshutdown != 0 &&
+      CALL_METHOD(cfp->stable->sessions_wrt, get_length) == 0) {
+        RTPP_LOG(cfp->stable->glog, RTPP_LOG_INFO,
+          "deorbiting-burn sequence completed, exiting");
+        return (1);
+    }
+    return (0);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -806,6 +984,11 @@ main(int argc, char **argv)
     _sig_cf = &cf;
     atexit(ehandler);
     RTPP_LOG(cf.stable->glog, RTPP_LOG_INFO, "rtpproxy started, pid %d", getpid());
+    if (cf.stable->nworkers > 1) {
+        RTPP_LOG(cf.stable->glog, RTPP_LOG_INFO, "running as worker %d of %d, "
+          "ports %d-%d", cf.stable->worker_id, cf.stable->nworkers,
+          cf.stable->port_min, cf.stable->port_max + 1);
+    }
 
 #ifdef RTPP_CHECK_LEAKS
     rtpp_memdeb_setbaseln(_rtpproxy_memdeb);
@@ -828,6 +1011,17 @@ main(int argc, char **argv)
         }
     }
 
+    /* Loading and attaching BPF programs requires privileges */
+    if (cf.stable->kfwd_ifnames != NULL) {
+        cf.stable->rtpp_kfwd_cf = rtpp_kfwd_ctor(cf.stable,
+          cf.stable->kfwd_ifnames);
+        if (cf.stable->rtpp_kfwd_cf == NULL) {
+            RTPP_LOG(cf.stable->glog, RTPP_LOG_ERR,
+              "can't init in-kernel forwarding subsystem");
+            exit(1);
+        }
+    }
+
     if (cf.stable->run_uname != NULL || cf.stable->run_gname != NULL) {
 	if (drop_privileges(&cf) != 0) {
 	    RTPP_ELOG(cf.stable->glog, RTPP_LOG_ERR,
@@ -861,7 +1055,15 @@ main(int argc, char **argv)
           "can't schedule notification to derive stats");
     }
 
-    cf.stable->rtpp_notify_cf = rtpp_notify_ctor(cf.stable->glog);
+    if (cf.stable->rtpp_kfwd_cf != NULL &&
+      CALL_METHOD(cf.stable->rtpp_kfwd_cf, start, cf.stable->rtpp_timed_cf) != 0) {
+        RTPP_ELOG(cf.stable->glog, RTPP_LOG_ERR,
+          "can't schedule in-kernel forwarding counters sync");
+        exit(1);
+    }
+
+    cf.stable->rtpp_notify_cf = rtpp_notify_ctor(cf.stable->glog,
+      cf.stable->rtpp_stats);
     if (cf.stable->rtpp_notify_cf == NULL) {
         RTPP_ELOG(cf.stable->glog, RTPP_LOG_ERR,
           "can't init timeout notification subsystem");
@@ -915,7 +1117,14 @@ main(int argc, char **argv)
 #ifdef HAVE_SYSTEMD_DAEMON
     sd_notify(0, "READY=1");
 #endif
-    for (;;) {
+    /*
+     * In the --evloop mode the RTP thread keeps time on its own, so there
+     * is no clock to drive from here, just watch for the shutdown.
+     */
+    while (cf.stable->evloop != 0 && !rtpp_shutdown_due(&cf)) {
+        usleep(EVLOOP_SHUTDOWN_CHECK);
+    }
+    while (cf.stable->evloop == 0) {
 	eptime = getdtime();
 
         clk = (eptime + cf.stable->sched_offset) * cf.stable->target_pfreq;
@@ -958,18 +1167,17 @@ main(int argc, char **argv)
         }
 #endif
         counter += 1;
-        if (cf.stable->fastshutdown != 0) {
-            break;
-        }
-        if (cf.stable->slowshutdown != 0 &&
-          CALL_METHOD(cf.stable->sessions_wrt, get_length) == 0) {
-            RTPP_LOG(cf.stable->glog, RTPP_LOG_INFO,
-              "deorbiting-burn sequence completed, exiting");
+        if (rtpp_shutdown_due(&cf)) {
             break;
         }
     }
 
     CALL_METHOD(cf.stable->rtpp_cmd_cf, dtor);
+    CALL_METHOD(cf.stable->rtpp_proc_cf, dtor);
+    if (cf.stable->rtpp_kfwd_cf != NULL) {
+        CALL_METHOD(cf.stable->rtpp_kfwd_cf, shutdown);
+        CALL_SMETHOD(cf.stable->rtpp_kfwd_cf->rcnt, decref);
+    }
 #if ENABLE_MODULE_IF
     if (cf.stable->modules_cf != NULL) {
         CALL_SMETHOD(cf.stable->modules_cf->rcnt, decref);
@@ -978,7 +1186,6 @@ main(int argc, char **argv)
     CALL_METHOD(cf.stable->rtpp_notify_cf, dtor);
     CALL_METHOD(cf.stable->rtpp_tnset_cf, dtor);
     CALL_SMETHOD(cf.stable->rtpp_timed_cf->rcnt, decref);
-    CALL_METHOD(cf.stable->rtpp_proc_cf, dtor);
     CALL_SMETHOD(cf.stable->sessinfo->rcnt, decref);
     for (i = 0; i <= RTPP_PT_MAX; i++) {
         CALL_SMETHOD(cf.stable->port_table[i]->rcnt, decref);
@@ -30,12 +30,14 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <assert.h>
+#include <pthread.h>
 #include <stddef.h>
 
 #include "rtp.h"
 #include "rtp_info.h"
 #include "rtp_packet.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_arena.h"
 
 #include "rtpp_wi.h"
 #include "rtpp_wi_private.h"
@@ -406,12 +408,17 @@ rtp_packet_dup(struct rtp_packet *dpkt, struct rtp_packet *spkt, int flags)
     }
 }
 
+static struct rtpp_arena_pool rtp_packet_pool =
+  RTPP_ARENA_POOL_INITIALIZER("rtp_packet");
+
 struct rtp_packet *
 rtp_packet_alloc()
 {
     struct rtp_packet_full *pkt;
 
-    pkt = rtpp_zmalloc(sizeof(*pkt));
+    pkt = rtpp_arena_zalloc(&rtp_packet_pool, sizeof(*pkt));
+    if (pkt == NULL)
+        return (NULL);
     pkt->pub.wi = &pkt->pvt.wi;
 
     return &(pkt->pub);
@@ -421,7 +428,7 @@ void
 rtp_packet_free(struct rtp_packet *pkt)
 {
 
-    free(pkt);
+    rtpp_arena_free(&rtp_packet_pool, pkt);
 }
 
 void 
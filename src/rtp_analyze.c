@@ -26,6 +26,7 @@
  */
 
 #include <sys/types.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,6 +36,7 @@
 #include "rtpa_stats.h"
 #include "rtpp_debug.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_arena.h"
 #include "rtpp_types.h"
 #include "rtpp_log.h"
 #include "rtpp_log_obj.h"
@@ -56,6 +58,9 @@ struct rtp_analyze_jitter {
     struct rtp_analyze_jdata *first;
 };
 
+static struct rtpp_arena_pool rtpa_seen_pool =
+  RTPP_ARENA_POOL_INITIALIZER("rtpa_seen");
+
 struct rtp_analyze_jdata_ssrc {
     uint64_t prev_rtime_ts;
     uint32_t prev_ts;
@@ -197,6 +202,17 @@ rtpp_stats_init(struct rtpp_session_stat *stat)
     return (0);
 }
 
+static int
+rtp_analyze_jdata_init(struct rtp_analyze_jdata *jdp)
+{
+
+    jdp->ts_dedup = rtpp_ringbuf_ctor(sizeof(jdp->jss.prev_ts), 10);
+    if (jdp->ts_dedup == NULL) {
+        return (-1);
+    }
+    return (0);
+}
+
 static struct rtp_analyze_jdata *
 rtp_analyze_jdata_ctor()
 {
@@ -206,8 +222,7 @@ rtp_analyze_jdata_ctor()
     if (jdp == NULL) {
         goto e0;
     }
-    jdp->ts_dedup = rtpp_ringbuf_ctor(sizeof(jdp->jss.prev_ts), 10);
-    if (jdp->ts_dedup == NULL) {
+    if (rtp_analyze_jdata_init(jdp) != 0) {
         goto e1;
     }
     return (jdp);
@@ -218,17 +233,24 @@ e0:
     return (NULL);
 }
 
+/*
+ * The per-ssrc data for the first ssrc is allocated together with the
+ * tracker, it is never freed on its own since jdata_by_ssrc() recycles
+ * the existing entries once RTPC_JDATA_MAX is reached.
+ */
+#define JT_JDATA0(jp) ((struct rtp_analyze_jdata *)((jp) + 1))
+
 static struct rtp_analyze_jitter *
 rtp_analyze_jt_ctor()
 {
     struct rtp_analyze_jitter *jp;
 
-    jp = rtpp_zmalloc(sizeof(*jp));
+    jp = rtpp_zmalloc(sizeof(*jp) + sizeof(struct rtp_analyze_jdata));
     if (jp == NULL) {
         goto e0;
     }
-    jp->first = rtp_analyze_jdata_ctor();
-    if (jp->first == NULL) {
+    jp->first = JT_JDATA0(jp);
+    if (rtp_analyze_jdata_init(jp->first) != 0) {
         goto e1;
     }
     jp->jdlen = 1;
@@ -248,6 +270,8 @@ rtpp_stats_destroy(struct rtpp_session_stat *stat)
 {
 
     rtp_analyze_jt_destroy(stat->jdata);
+    if (stat->last.seen != NULL)
+        rtpp_arena_free(&rtpa_seen_pool, stat->last.seen);
 }
 
 static void
@@ -258,7 +282,8 @@ rtp_analyze_jt_destroy(struct rtp_analyze_jitter *jp)
     for (jdp = jp->first; jdp != NULL; jdp = jdp_next) {
         jdp_next = jdp->next;
         CALL_SMETHOD(jdp->ts_dedup->rcnt, decref);
-        free(jdp);
+        if (jdp != JT_JDATA0(jp))
+            free(jdp);
         jp->jdlen -= 1;
     }
     RTPP_DBG_ASSERT(jp->jdlen == 0);
@@ -336,6 +361,12 @@ update_rtpp_stats(struct rtpp_log *rlog, struct rtpp_session_stat *stat, rtp_hdr
         RTPP_DBG_ASSERT(stat->last.pcount == 0);
         RTPP_DBG_ASSERT(stat->psent == 0);
         RTPP_DBG_ASSERT(stat->precvd == 0);
+        if (stat->last.seen == NULL) {
+            stat->last.seen = rtpp_arena_zalloc(&rtpa_seen_pool,
+              RTPA_SEEN_SIZE);
+            if (stat->last.seen == NULL)
+                return (UPDATE_ERR);
+        }
         stat->last.ssrc.val = rinfo->ssrc;
         stat->last.ssrc.inited = 1;
         stat->last.max_seq = stat->last.min_seq = rinfo->seq;
@@ -355,7 +386,7 @@ update_rtpp_stats(struct rtpp_log *rlog, struct rtpp_session_stat *stat, rtp_hdr
     if (stat->last.ssrc.val != rinfo->ssrc) {
         update_rtpp_totals(stat, stat);
         stat->last.duplicates = 0;
-        memset(stat->last.seen, '\0', sizeof(stat->last.seen));
+        memset(stat->last.seen, '\0', RTPA_SEEN_SIZE);
         LOGI_IF_NOT_NULL(rlog, "SSRC changed from " SSRC_FMT "/%d to "
           SSRC_FMT "/%d", stat->last.ssrc.val, stat->last.seq, rinfo->ssrc,
           rinfo->seq); 
@@ -377,6 +408,20 @@ update_rtpp_stats(struct rtpp_log *rlog, struct rtpp_session_stat *stat, rtp_hdr
         }
         return (UPDATE_SSRC_CHG);
     }
+    if (stat->last.pcount == 0) {
+        /* First packet after update_rtpp_resync(), start a new run */
+        stat->last.max_seq = stat->last.min_seq = rinfo->seq;
+        stat->last.base_ts = rinfo->ts;
+        stat->last.base_rtime = rtime;
+        stat->last.pcount = 1;
+        idx = (rinfo->seq % 131072) >> 5;
+        stat->last.seen[idx] |= 1 << (rinfo->seq & 31);
+        stat->last.seq = rinfo->seq;
+        if (rpp->ts_rate > 0 && jdp != NULL) {
+            update_jitter_stats(jdp, rinfo, rtime, RTP_SEQ_RESET);
+        }
+        return (UPDATE_OK);
+    }
     seq = rinfo->seq + stat->last.seq_offset;
     if (header->mbt && (seq < stat->last.max_seq && (stat->last.max_seq & 0xffff) != 65535)) {
         LOGD_IF_NOT_NULL(rlog, SSRC_FMT "/%d: seq reset last->max_seq=%u, seq=%u, m=%u",
@@ -384,7 +429,7 @@ update_rtpp_stats(struct rtpp_log *rlog, struct rtpp_session_stat *stat, rtp_hdr
         /* Seq reset has happened. Treat it as a ssrc change */
         update_rtpp_totals(stat, stat);
         stat->last.duplicates = 0;
-        memset(stat->last.seen, '\0', sizeof(stat->last.seen));
+        memset(stat->last.seen, '\0', RTPA_SEEN_SIZE);
         stat->last.max_seq = stat->last.min_seq = seq;
         stat->last.base_ts = rinfo->ts;
         stat->last.base_rtime = rtime;
@@ -423,9 +468,9 @@ update_rtpp_stats(struct rtpp_log *rlog, struct rtpp_session_stat *stat, rtp_hdr
         stat->last.seq_offset += 65536;
         seq += 65536;
         if (stat->last.seq_offset % 131072 == 65536) {
-            memset(stat->last.seen + 2048, '\0', sizeof(stat->last.seen) / 2);
+            memset(stat->last.seen + (RTPA_SEEN_LEN / 2), '\0', RTPA_SEEN_SIZE / 2);
         } else {
-            memset(stat->last.seen, '\0', sizeof(stat->last.seen) / 2);
+            memset(stat->last.seen, '\0', RTPA_SEEN_SIZE / 2);
         }
     } else if (seq + 536 < stat->last.max_seq || seq > stat->last.max_seq + 536) {
         LOGD_IF_NOT_NULL(rlog, SSRC_FMT "/%d: desync last->max_seq=%u, seq=%u, m=%u",
@@ -433,7 +478,7 @@ update_rtpp_stats(struct rtpp_log *rlog, struct rtpp_session_stat *stat, rtp_hdr
         /* Desynchronization has happened. Treat it as a ssrc change */
         update_rtpp_totals(stat, stat);
         stat->last.duplicates = 0;
-        memset(stat->last.seen, '\0', sizeof(stat->last.seen));
+        memset(stat->last.seen, '\0', RTPA_SEEN_SIZE);
         stat->last.max_seq = stat->last.min_seq = seq;
         stat->last.pcount = 1;
         stat->desync_count += 1;
@@ -496,6 +541,24 @@ update_rtpp_totals(struct rtpp_session_stat *wstat, struct rtpp_session_stat *os
     ostat->duplicates += wstat->last.duplicates;
 }
 
+/*
+ * Fold the current run of packets into the totals, so that the next packet
+ * starts a new one as if nothing has been missing in between. For when the
+ * packets have been flowing where the analyzer could not see them.
+ */
+void
+update_rtpp_resync(struct rtpp_session_stat *stat)
+{
+
+    if (stat->last.pcount == 0)
+        return;
+    update_rtpp_totals(stat, stat);
+    stat->last.pcount = 0;
+    stat->last.duplicates = 0;
+    stat->last.seq_offset = 0;
+    memset(stat->last.seen, '\0', RTPA_SEEN_SIZE);
+}
+
 int
 get_jitter_stats(struct rtp_analyze_jitter *jp, struct rtpa_stats_jitter *jst)
 {
@@ -34,13 +34,18 @@ struct rtpa_stats_jitter;
 
 #define PT_UNKN 128
 
+/* Size of the seen packets bitmap, covers 2 full cycles of seq numbers */
+#define RTPA_SEEN_LEN 4096
+#define RTPA_SEEN_SIZE (sizeof(uint32_t) * RTPA_SEEN_LEN)
+
 struct rtpp_session_stat_last {
     long long pcount;
     uint32_t min_seq;
     uint32_t max_seq;
     uint32_t seq_offset;
     struct rtpp_ssrc ssrc;
-    uint32_t seen[4096];
+    /* Allocated upon the first packet */
+    uint32_t *seen;
     uint32_t duplicates;
     uint32_t base_ts;
     uint16_t seq;
@@ -68,6 +73,7 @@ void rtpp_stats_destroy(struct rtpp_session_stat *);
 enum update_rtpp_stats_rval update_rtpp_stats(struct rtpp_log *,
   struct rtpp_session_stat *, rtp_hdr_t *, struct rtp_info *, double);
 void update_rtpp_totals(struct rtpp_session_stat *, struct rtpp_session_stat *);
+void update_rtpp_resync(struct rtpp_session_stat *);
 int get_jitter_stats(struct rtp_analyze_jitter *, struct rtpa_stats_jitter *);
 
 #endif
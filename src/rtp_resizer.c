@@ -41,6 +41,20 @@
 #include "rtpp_mallocs.h"
 #include "rtpp_ssrc.h"
 
+/*
+ * Packets waiting to be re-packetized are kept in a ring of slots indexed
+ * by the RTP timestamp, each slot covering RTP_RESIZER_SLOT_NSAMPLES worth
+ * of samples, so that insertion is O(1) regardless of the reordering. The
+ * packets that land into the same slot (i.e. duplicates or very short
+ * frames) are chained in the timestamp order. If a packet does not fit into
+ * the ring (SSRC change, large TS jump), the queue falls back to the plain
+ * sorted list until it's drained.
+ */
+#define RTP_RESIZER_NSLOTS        256
+#define RTP_RESIZER_SLOT_NSAMPLES 80
+#define RTP_RESIZER_SLOT(rp, idx) (((rp)->ring.head + (idx)) & \
+  (RTP_RESIZER_NSLOTS - 1))
+
 struct rtp_resizer {
     int         nsamples_total;
 
@@ -58,12 +72,161 @@ struct rtp_resizer {
     int         output_nsamples;
     int         max_buf_nsamples;
 
+    int         qlist_mode;
     struct {
         struct rtp_packet *first;
         struct rtp_packet *last;
     } queue;
+    struct {
+        struct rtp_packet *slots[RTP_RESIZER_NSLOTS];
+        /* Slot holding the head of the queue and TS it starts at */
+        unsigned int head;
+        uint32_t base_ts;
+        /* Number of slots from the head to the last occupied one */
+        unsigned int span;
+        int npkts;
+    } ring;
 };
 
+static void detach_queue_head(struct rtp_resizer *);
+
+static struct rtp_packet *
+queue_first(struct rtp_resizer *this)
+{
+
+    if (this->qlist_mode)
+        return (this->queue.first);
+    if (this->ring.npkts == 0)
+        return (NULL);
+    return (this->ring.slots[this->ring.head]);
+}
+
+static int
+ring_insert(struct rtp_resizer *this, struct rtp_packet *pkt)
+{
+    struct rtp_packet *p, **pp;
+    uint32_t ts, d;
+    unsigned int idx, k;
+
+    ts = pkt->parsed->ts;
+    if (this->ring.npkts == 0) {
+        this->ring.head = 0;
+        this->ring.base_ts = ts;
+        this->ring.span = 0;
+        idx = 0;
+    } else if (!ts_less(ts, this->ring.base_ts)) {
+        d = ts - this->ring.base_ts;
+        if (d >= RTP_RESIZER_NSLOTS * RTP_RESIZER_SLOT_NSAMPLES)
+            return (-1);
+        idx = d / RTP_RESIZER_SLOT_NSAMPLES;
+    } else {
+        /* Packet is older than the head, extend the ring backwards */
+        d = this->ring.base_ts - ts;
+        k = (d + RTP_RESIZER_SLOT_NSAMPLES - 1) / RTP_RESIZER_SLOT_NSAMPLES;
+        if (k > RTP_RESIZER_NSLOTS - this->ring.span)
+            return (-1);
+        this->ring.head = (this->ring.head - k) & (RTP_RESIZER_NSLOTS - 1);
+        this->ring.base_ts -= k * RTP_RESIZER_SLOT_NSAMPLES;
+        this->ring.span += k;
+        idx = 0;
+    }
+    if (idx >= this->ring.span)
+        this->ring.span = idx + 1;
+
+    /* Keep the chain sorted, equal timestamps go in the arrival order */
+    pp = &this->ring.slots[RTP_RESIZER_SLOT(this, idx)];
+    p = NULL;
+    while (*pp != NULL && !ts_less(ts, (*pp)->parsed->ts)) {
+        p = *pp;
+        pp = &p->next;
+    }
+    pkt->prev = p;
+    pkt->next = *pp;
+    if (*pp != NULL)
+        (*pp)->prev = pkt;
+    *pp = pkt;
+    this->ring.npkts++;
+    return (0);
+}
+
+static void
+ring_to_list(struct rtp_resizer *this)
+{
+    struct rtp_packet *p;
+    unsigned int i, slot;
+
+    this->queue.first = this->queue.last = NULL;
+    for (i = 0; i < this->ring.span; i++) {
+        slot = RTP_RESIZER_SLOT(this, i);
+        p = this->ring.slots[slot];
+        if (p == NULL)
+            continue;
+        this->ring.slots[slot] = NULL;
+        if (this->queue.last == NULL) {
+            this->queue.first = p;
+        } else {
+            this->queue.last->next = p;
+            p->prev = this->queue.last;
+        }
+        while (p->next != NULL)
+            p = p->next;
+        this->queue.last = p;
+    }
+    this->ring.npkts = 0;
+    this->ring.span = 0;
+    this->qlist_mode = 1;
+}
+
+static void
+list_insert(struct rtp_resizer *this, struct rtp_packet *pkt)
+{
+    struct rtp_packet *p;
+
+    if (this->queue.last != NULL) 
+    {
+        p = this->queue.last; 
+        while (p != NULL && ts_less(pkt->parsed->ts, p->parsed->ts))
+             p = p->prev;
+
+        if (p == NULL) /* head reached */
+        {
+            pkt->next = this->queue.first;
+            pkt->prev = NULL;
+            this->queue.first->prev = pkt;
+            this->queue.first = pkt;
+        }
+        else if (p == this->queue.last) /* tail of the queue */
+        {
+            pkt->prev = this->queue.last;
+            pkt->next = NULL;
+            this->queue.last->next = pkt;
+            this->queue.last = pkt;
+        }
+        else { /* middle of the queue */
+            pkt->next = p->next;
+            pkt->prev = p;
+            pkt->next->prev = pkt->prev->next = pkt;
+        }
+    }
+    else {
+        this->queue.first = this->queue.last = pkt;
+        pkt->prev = NULL;
+	pkt->next = NULL;
+    }
+}
+
+static void
+queue_insert(struct rtp_resizer *this, struct rtp_packet *pkt)
+{
+
+    if (!this->qlist_mode) {
+        if (ring_insert(this, pkt) == 0)
+            return;
+        ring_to_list(this);
+    }
+    list_insert(this, pkt);
+}
+
 static int
 min_nsamples(int codec_id)
 {
@@ -95,15 +258,12 @@ void
 rtp_resizer_free(struct rtpp_stats *rtpp_stats, struct rtp_resizer *this)
 {
     struct rtp_packet *p;
-    struct rtp_packet *p1;
     int nfree;
 
     nfree = 0;
-    p = this->queue.first;
-    while (p != NULL) {
-        p1 = p;
-        p = p->next;
-        rtp_packet_free(p1);
+    while ((p = queue_first(this)) != NULL) {
+        detach_queue_head(this);
+        rtp_packet_free(p);
         nfree++;
     }
     free(this);
@@ -184,50 +344,98 @@ rtp_resizer_enqueue(struct rtp_resizer *this, struct rtp_packet **pkt,
 /*            printf("Sync backward\n"); */
         }
     }
-    if (this->queue.last != NULL) 
-    {
-        p = this->queue.last; 
-        while (p != NULL && ts_less((*pkt)->parsed->ts, p->parsed->ts))
-             p = p->prev;
+    queue_insert(this, *pkt);
+    this->nsamples_total += (*pkt)->parsed->nsamples;
+    *pkt = NULL; /* take control over the packet */
+}
 
-        if (p == NULL) /* head reached */
-        {
-            (*pkt)->next = this->queue.first;
-            (*pkt)->prev = NULL;
-            this->queue.first->prev = *pkt;
-            this->queue.first = *pkt;
-        }
-        else if (p == this->queue.last) /* tail of the queue */
-        {
-            (*pkt)->prev = this->queue.last;
-            (*pkt)->next = NULL;
-            this->queue.last->next = *pkt;
-            this->queue.last = *pkt;
-        }
-        else { /* middle of the queue */
-            (*pkt)->next = p->next;
-            (*pkt)->prev = p;
-            (*pkt)->next->prev = (*pkt)->prev->next = *pkt;
+static void
+detach_queue_head(struct rtp_resizer *this)
+{
+    struct rtp_packet **pp;
+
+    if (this->qlist_mode) {
+        this->queue.first = this->queue.first->next;
+        if (this->queue.first == NULL) {
+	    this->queue.last = NULL;
+            /* Drained, go back to the ring */
+            this->qlist_mode = 0;
+        } else {
+	    this->queue.first->prev = NULL;
         }
+        return;
     }
-    else {
-        this->queue.first = this->queue.last = *pkt;
-        (*pkt)->prev = NULL;
-	(*pkt)->next = NULL;
+    pp = &this->ring.slots[this->ring.head];
+    *pp = (*pp)->next;
+    if (*pp != NULL)
+        (*pp)->prev = NULL;
+    this->ring.npkts--;
+    if (this->ring.npkts == 0) {
+        this->ring.span = 0;
+        return;
+    }
+    while (this->ring.slots[this->ring.head] == NULL) {
+        this->ring.head = (this->ring.head + 1) & (RTP_RESIZER_NSLOTS - 1);
+        this->ring.base_ts += RTP_RESIZER_SLOT_NSAMPLES;
+        this->ring.span--;
     }
-    this->nsamples_total += (*pkt)->parsed->nsamples;
-    *pkt = NULL; /* take control over the packet */
 }
 
+/*
+ * Replace head of the queue with another packet, keeping its position.
+ */
 static void
-detach_queue_head(struct rtp_resizer *this)
+replace_queue_head(struct rtp_resizer *this, struct rtp_packet *p,
+  struct rtp_packet *np)
+{
+
+    np->prev = NULL;
+    np->next = p->next;
+    if (np->next != NULL)
+        np->next->prev = np;
+    if (this->qlist_mode) {
+        this->queue.first = np;
+        if (this->queue.last == p)
+            this->queue.last = np;
+    } else {
+        this->ring.slots[this->ring.head] = np;
+    }
+}
+
+/*
+ * The head of the queue has had a chunk taken off and its TS moved forward.
+ * The sorted list used to leave it in front regardless, so the ring has to
+ * do the same: if it has overtaken other queued packets, switch to the
+ * list, and if its TS now belongs to a later slot, move it there so that
+ * packets queued afterwards are ordered against it the same way.
+ */
+static void
+requeue_head(struct rtp_resizer *this)
 {
+    struct rtp_packet *p, *np;
 
-    this->queue.first = this->queue.first->next;
-    if (this->queue.first == NULL)
-	this->queue.last = NULL;
-    else
-	this->queue.first->prev = NULL;
+    if (this->qlist_mode)
+        return;
+    p = this->ring.slots[this->ring.head];
+    if (p->next != NULL) {
+        /* Slot-mates are in the TS order, so p is still within the slot */
+        if (ts_less(p->next->parsed->ts, p->parsed->ts))
+            ring_to_list(this);
+        return;
+    }
+    if (p->parsed->ts - this->ring.base_ts < RTP_RESIZER_SLOT_NSAMPLES)
+        return;
+    detach_queue_head(this);
+    np = queue_first(this);
+    if (np == NULL || ts_less(p->parsed->ts, np->parsed->ts)) {
+        queue_insert(this, p);
+        return;
+    }
+    ring_to_list(this);
+    p->prev = NULL;
+    p->next = this->queue.first;
+    this->queue.first->prev = p;
+    this->queue.first = p;
 }
 
 static void
@@ -262,30 +470,34 @@ append_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_pa
       &src->data.buf[src->parsed->data_offset + chunk->bytes], src->parsed->data_size);
 }
 
+/*
+ * Split the chunk off the head of the source packet in place: the source
+ * packet is truncated to the chunk and the remainder is moved into the
+ * destination packet, so that only the remainder has to be copied.
+ */
 static void 
-move_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_packet_chunk *chunk)
+split_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_packet_chunk *chunk)
 {
-    /* Copy chunk */
+
+    /* Copy the remainder */
+    dst->parsed->data_size = src->parsed->data_size - chunk->bytes;
     memcpy(&dst->data.buf[dst->parsed->data_offset],
-      &src->data.buf[src->parsed->data_offset], chunk->bytes);
-    dst->parsed->nsamples = chunk->nsamples;
-    dst->parsed->data_size = chunk->bytes;
+      &src->data.buf[src->parsed->data_offset + chunk->bytes], dst->parsed->data_size);
+    dst->parsed->nsamples = src->parsed->nsamples - chunk->nsamples;
     dst->size = dst->parsed->data_size + dst->parsed->data_offset;
+    rtp_packet_set_ts(dst, src->parsed->ts + chunk->nsamples);
 
     /* Truncate the source packet */
-    src->parsed->nsamples -= chunk->nsamples;
-    rtp_packet_set_ts(src, src->parsed->ts + chunk->nsamples);
-    src->parsed->data_size -= chunk->bytes;
-    src->size -= chunk->bytes;
-    memmove(&src->data.buf[src->parsed->data_offset],
-      &src->data.buf[src->parsed->data_offset + chunk->bytes], src->parsed->data_size);
+    src->parsed->nsamples = chunk->nsamples;
+    src->parsed->data_size = chunk->bytes;
+    src->size = src->parsed->data_size + src->parsed->data_offset;
 }
 
 struct rtp_packet *
 rtp_resizer_get(struct rtp_resizer *this, double dtime)
 {
     struct rtp_packet *ret = NULL;
-    struct rtp_packet *p;
+    struct rtp_packet *p, *np;
     uint32_t    ref_ts;
     int         count = 0;
     int         split = 0;
@@ -294,20 +506,21 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
     int         min;
     struct      rtp_packet_chunk chunk;
 
-    if (this->queue.first == NULL)
+    p = queue_first(this);
+    if (p == NULL)
         return NULL;
 
     ref_ts = (dtime * 8000.0) + this->tsdelta;
 
     /* Wait untill enough data has arrived or timeout occured */
     if (this->nsamples_total < this->output_nsamples &&
-        ts_less(ref_ts, this->queue.first->parsed->ts + this->max_buf_nsamples))
+        ts_less(ref_ts, p->parsed->ts + this->max_buf_nsamples))
     {
         return NULL;
     }
 
     output_nsamples = this->output_nsamples;
-    min = min_nsamples(this->queue.first->data.header.pt);
+    min = min_nsamples(p->data.header.pt);
     if (output_nsamples < min) {
         output_nsamples = min;
     } else if (output_nsamples % min != 0) {
@@ -315,9 +528,9 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
     }
 
     /* Aggregate the output packet */
-    while ((ret == NULL || ret->parsed->nsamples < output_nsamples) && this->queue.first != NULL)
+    while ((ret == NULL || ret->parsed->nsamples < output_nsamples) &&
+      (p = queue_first(this)) != NULL)
     {
-        p = this->queue.first;
         if (ret == NULL) 
         {
             /* Look if the first packet is to be split */
@@ -327,11 +540,14 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
 		    ret = p;
 		    detach_queue_head(this);
 		} else {
-		    ret = rtp_packet_alloc();
-		    if (ret == NULL)
+		    np = rtp_packet_alloc();
+		    if (np == NULL)
 			break;
-		    rtp_packet_dup(ret, p, RTPP_DUP_HDRONLY);
-		    move_chunk(ret, p, &chunk);
+		    rtp_packet_dup(np, p, RTPP_DUP_HDRONLY);
+		    split_chunk(np, p, &chunk);
+		    replace_queue_head(this, p, np);
+		    requeue_head(this);
+		    ret = p;
 		    ++split;
 		}
 		if (!this->seq_initialized) {
@@ -370,6 +586,7 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
 			break;
 		    /* Append chunk to output */
 		    append_chunk(ret, p, &chunk);
+		    requeue_head(this);
 		    ++split;
 		}
 		++count;
@@ -28,6 +28,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "rtpp_ssrc.h"
 #include "rtpa_stats.h"
@@ -66,17 +67,48 @@ static void rtpp_acct_dtor(struct rtpp_acct_priv *);
 #define PUB2PVT(pubp) \
   ((struct rtpp_acct_priv *)((char *)(pubp) - offsetof(struct rtpp_acct_priv, pub)))
 
+/*
+ * Remote addresses, call-id and from tag are stored at the end of the same
+ * allocation. The addresses are copies, so that the record does not pin
+ * the streams (and their sockets) for as long as it is around, the session
+ * points into the strings for as long as it holds its reference to the
+ * record.
+ */
 struct rtpp_acct *
-rtpp_acct_ctor(uint64_t seuid)
+rtpp_acct_ctor(uint64_t seuid, const char *call_id, const char *from_tag)
 {
     struct rtpp_acct_priv *pvt;
     struct rtpp_refcnt *rcnt;
+    struct rtpp_netaddr **rapp[4];
+    size_t cidlen, taglen, asize;
+    char *cp;
+    int i;
 
-    pvt = rtpp_rzmalloc(sizeof(struct rtpp_acct_priv), &rcnt);
+    cidlen = strlen(call_id) + 1;
+    taglen = strlen(from_tag) + 1;
+    asize = RTPP_MALIGN(sizeof(struct rtpp_acct_priv)) +
+      4 * RTPP_MALIGN(rtpp_netaddr_osize());
+    pvt = rtpp_rzmalloc(asize + cidlen + taglen, &rcnt);
     if (pvt == NULL) {
         goto e0;
     }
+    rapp[0] = &pvt->pub.rtp.o.rem_addr;
+    rapp[1] = &pvt->pub.rtp.a.rem_addr;
+    rapp[2] = &pvt->pub.rtcp.o.rem_addr;
+    rapp[3] = &pvt->pub.rtcp.a.rem_addr;
+    cp = (char *)pvt + RTPP_MALIGN(sizeof(struct rtpp_acct_priv));
+    for (i = 0; i < 4; i++) {
+        *rapp[i] = rtpp_netaddr_ctor_pa(cp, rcnt);
+        if (*rapp[i] == NULL) {
+            goto e1;
+        }
+        cp += RTPP_MALIGN(rtpp_netaddr_osize());
+    }
     pvt->pub.seuid = seuid;
+    pvt->pub.call_id = (char *)pvt + asize;
+    memcpy(pvt->pub.call_id, call_id, cidlen);
+    pvt->pub.from_tag = pvt->pub.call_id + cidlen;
+    memcpy(pvt->pub.from_tag, from_tag, taglen);
     pvt->pub.rcnt = rcnt;
     pvt->pub.rtp.pcnts = &pvt->_rtp.pcnts;
     pvt->pub.rtcp.pcnts = &pvt->_rtcp.pcnts;
@@ -92,6 +124,12 @@ rtpp_acct_ctor(uint64_t seuid)
       pvt);
     return ((&pvt->pub));
 
+e1:
+    while (i-- > 0) {
+        rtpp_netaddr_dtor_pa(*rapp[i]);
+    }
+    CALL_SMETHOD(rcnt, decref);
+    free(pvt);
 e0:
     return (NULL);
 }
@@ -101,18 +139,10 @@ rtpp_acct_dtor(struct rtpp_acct_priv *pvt)
 {
 
     /*rtpp_acct_fin(&(pvt->pub));*/
-    if (pvt->pub.call_id != NULL)
-        free(pvt->pub.call_id);
-    if (pvt->pub.from_tag != NULL)
-        free(pvt->pub.from_tag);
-    if (pvt->pub.rtp.a.rem_addr != NULL)
-        CALL_SMETHOD(pvt->pub.rtp.a.rem_addr->rcnt, decref);
-    if (pvt->pub.rtp.o.rem_addr != NULL)
-        CALL_SMETHOD(pvt->pub.rtp.o.rem_addr->rcnt, decref);
-    if (pvt->pub.rtcp.a.rem_addr != NULL)
-        CALL_SMETHOD(pvt->pub.rtcp.a.rem_addr->rcnt, decref);
-    if (pvt->pub.rtcp.o.rem_addr != NULL)
-        CALL_SMETHOD(pvt->pub.rtcp.o.rem_addr->rcnt, decref);
+    rtpp_netaddr_dtor_pa(pvt->pub.rtp.o.rem_addr);
+    rtpp_netaddr_dtor_pa(pvt->pub.rtp.a.rem_addr);
+    rtpp_netaddr_dtor_pa(pvt->pub.rtcp.o.rem_addr);
+    rtpp_netaddr_dtor_pa(pvt->pub.rtcp.a.rem_addr);
     free(pvt);
 }
 
@@ -55,7 +55,7 @@ struct rtpp_acct {
     struct rtpp_refcnt *rcnt;
 };
 
-struct rtpp_acct *rtpp_acct_ctor(uint64_t);
+struct rtpp_acct *rtpp_acct_ctor(uint64_t, const char *, const char *);
 
 #define rtpp_acct_OSIZE() (sizeof(struct rtpp_acct) + sizeof(struct rtpps_pcount) + \
   sizeof(struct rtpps_pcount) + sizeof(struct rtpp_pcnts_strm) + \
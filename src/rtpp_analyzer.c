@@ -27,6 +27,7 @@
 
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +49,10 @@ struct rtpp_analyzer_priv {
     uint32_t pecount;
     uint32_t aecount;
     struct rtpp_log *log;
+    /* Packets forwarded in kernel, see rtpp_analyzer_reg_kfwd() */
+    pthread_mutex_t kfwd_lock;
+    unsigned long kfwd_npkts;
+    int kfwd_resync;
 };
 
 static enum update_rtpp_stats_rval rtpp_analyzer_update(struct rtpp_analyzer *,
@@ -56,41 +61,93 @@ static void rtpp_analyzer_get_stats(struct rtpp_analyzer *,
   struct rtpa_stats *);
 static int rtpp_analyzer_get_jstats(struct rtpp_analyzer *,
   struct rtpa_stats_jitter *);
+static void rtpp_analyzer_reg_kfwd(struct rtpp_analyzer *, unsigned long);
 static void rtpp_analyzer_dtor(struct rtpp_analyzer_priv *);
 
 #define PUB2PVT(pubp) \
   ((struct rtpp_analyzer_priv *)((char *)(pubp) - offsetof(struct rtpp_analyzer_priv, pub)))
 
-struct rtpp_analyzer *
-rtpp_analyzer_ctor(struct rtpp_log *log)
+static int
+rtpp_analyzer_init(struct rtpp_analyzer_priv *pvt, struct rtpp_refcnt *rcnt,
+  struct rtpp_log *log)
 {
-    struct rtpp_analyzer_priv *pvt;
     struct rtpp_analyzer *rap;
-    struct rtpp_refcnt *rcnt;
 
-    pvt = rtpp_rzmalloc(sizeof(struct rtpp_analyzer_priv), &rcnt);
-    if (pvt == NULL) {
-        return (NULL);
-    }
     pvt->pub.rcnt = rcnt;
     rap = &pvt->pub;
     if (rtpp_stats_init(&pvt->rstat) != 0) {
-        goto e0;
+        return (-1);
+    }
+    if (pthread_mutex_init(&pvt->kfwd_lock, NULL) != 0) {
+        rtpp_stats_destroy(&pvt->rstat);
+        return (-1);
     }
     pvt->log = log;
     rap->update = &rtpp_analyzer_update;
     rap->get_stats = &rtpp_analyzer_get_stats;
     rap->get_jstats = &rtpp_analyzer_get_jstats;
+    rap->reg_kfwd = &rtpp_analyzer_reg_kfwd;
     CALL_SMETHOD(log->rcnt, incref);
+    return (0);
+}
+
+struct rtpp_analyzer *
+rtpp_analyzer_ctor(struct rtpp_log *log)
+{
+    struct rtpp_analyzer_priv *pvt;
+    struct rtpp_refcnt *rcnt;
+
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_analyzer_priv), &rcnt);
+    if (pvt == NULL) {
+        return (NULL);
+    }
+    if (rtpp_analyzer_init(pvt, rcnt, log) != 0) {
+        goto e0;
+    }
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_analyzer_dtor,
       pvt);
-    return (rap);
+    return (&pvt->pub);
 e0:
-    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    CALL_SMETHOD(rcnt, decref);
     free(pvt);
     return (NULL);
 }
 
+size_t
+rtpp_analyzer_osize(void)
+{
+
+    return (sizeof(struct rtpp_analyzer_priv));
+}
+
+/*
+ * Construct analyzer in the memory provided by the owner and sharing its
+ * refcounter, see rtpp_netaddr_ctor_pa().
+ */
+struct rtpp_analyzer *
+rtpp_analyzer_ctor_pa(void *pap, struct rtpp_refcnt *rcnt,
+  struct rtpp_log *log)
+{
+    struct rtpp_analyzer_priv *pvt;
+
+    pvt = (struct rtpp_analyzer_priv *)pap;
+    if (rtpp_analyzer_init(pvt, rcnt, log) != 0) {
+        return (NULL);
+    }
+    return (&pvt->pub);
+}
+
+void
+rtpp_analyzer_dtor_pa(struct rtpp_analyzer *self)
+{
+    struct rtpp_analyzer_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    pthread_mutex_destroy(&pvt->kfwd_lock);
+    rtpp_stats_destroy(&pvt->rstat);
+    CALL_SMETHOD(pvt->log->rcnt, decref);
+}
+
 static enum update_rtpp_stats_rval
 rtpp_analyzer_update(struct rtpp_analyzer *rap, struct rtp_packet *pkt)
 {
@@ -102,6 +159,12 @@ rtpp_analyzer_update(struct rtpp_analyzer *rap, struct rtp_packet *pkt)
         pvt->pecount++;
         return (UPDATE_ERR);
     }
+    if (pvt->kfwd_resync) {
+        pthread_mutex_lock(&pvt->kfwd_lock);
+        pvt->kfwd_resync = 0;
+        pthread_mutex_unlock(&pvt->kfwd_lock);
+        update_rtpp_resync(&pvt->rstat);
+    }
     rval = update_rtpp_stats(pvt->log, &(pvt->rstat), &(pkt->data.header), pkt->parsed, pkt->rtime);
     if (rval == UPDATE_ERR) {
         pvt->aecount++;
@@ -121,8 +184,10 @@ rtpp_analyzer_get_stats(struct rtpp_analyzer *rap, struct rtpa_stats *rsp)
     rsp->aecount = pvt->aecount;
     memset(&ostat, '\0', sizeof(ostat));
     update_rtpp_totals(&(pvt->rstat), &ostat);
-    rsp->psent = ostat.psent;
-    rsp->precvd = ostat.precvd;
+    pthread_mutex_lock(&pvt->kfwd_lock);
+    rsp->psent = ostat.psent + pvt->kfwd_npkts;
+    rsp->precvd = ostat.precvd + pvt->kfwd_npkts;
+    pthread_mutex_unlock(&pvt->kfwd_lock);
     rsp->pdups = ostat.duplicates;
     rsp->ssrc_changes = pvt->rstat.ssrc_changes;
     rsp->last_ssrc = pvt->rstat.last.ssrc;
@@ -146,11 +211,29 @@ rtpp_analyzer_get_jstats(struct rtpp_analyzer *rap,
     return (rval);
 }
 
+/*
+ * Account packets that have been forwarded in kernel and never seen by
+ * the analyzer. They count as both sent and received, and the run of
+ * packets seen before them is closed, so that the gap in the sequence
+ * numbers is not taken for a loss once the stream is back to userland.
+ * Jitter is only measured over the packets seen.
+ */
+static void
+rtpp_analyzer_reg_kfwd(struct rtpp_analyzer *rap, unsigned long npkts)
+{
+    struct rtpp_analyzer_priv *pvt;
+
+    pvt = PUB2PVT(rap);
+    pthread_mutex_lock(&pvt->kfwd_lock);
+    pvt->kfwd_npkts += npkts;
+    pvt->kfwd_resync = 1;
+    pthread_mutex_unlock(&pvt->kfwd_lock);
+}
+
 static void
 rtpp_analyzer_dtor(struct rtpp_analyzer_priv *pvt)
 {
 
-    rtpp_stats_destroy(&pvt->rstat);
-    CALL_SMETHOD(pvt->log->rcnt, decref);
+    rtpp_analyzer_dtor_pa(&(pvt->pub));
     free(pvt);
 }
@@ -43,14 +43,20 @@ DEFINE_METHOD(rtpp_analyzer, rtpp_analyzer_get_stats, void,
   struct rtpa_stats *);
 DEFINE_METHOD(rtpp_analyzer, rtpp_analyzer_get_jstats, int,
   struct rtpa_stats_jitter *);
+DEFINE_METHOD(rtpp_analyzer, rtpp_analyzer_reg_kfwd, void, unsigned long);
 
 struct rtpp_analyzer {
     METHOD_ENTRY(rtpp_analyzer_update, update);
     METHOD_ENTRY(rtpp_analyzer_get_stats, get_stats);
     METHOD_ENTRY(rtpp_analyzer_get_jstats, get_jstats);
+    METHOD_ENTRY(rtpp_analyzer_reg_kfwd, reg_kfwd);
     struct rtpp_refcnt *rcnt;
 };
 
 struct rtpp_analyzer * rtpp_analyzer_ctor(struct rtpp_log *);
+size_t rtpp_analyzer_osize(void);
+struct rtpp_analyzer *rtpp_analyzer_ctor_pa(void *, struct rtpp_refcnt *,
+  struct rtpp_log *);
+void rtpp_analyzer_dtor_pa(struct rtpp_analyzer *);
 
 #endif
@@ -0,0 +1,518 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtpp_types.h"
+#include "rtpp_mallocs.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_stats.h"
+#include "rtpp_arena.h"
+
+#define RTPP_ARENA_CHUNK   (2 * 1024 * 1024)
+#define RTPP_ARENA_OALIGN  64
+#define RTPP_ARENA_MAXTC   16
+/*
+ * Objects are moved between the thread cache and the pool this many at a
+ * time, the cache is flushed once it holds twice as many.
+ */
+#define RTPP_ARENA_TCBATCH 32
+
+/*
+ * Node the chunk has been mapped for is stored in its first RTPP_ARENA_OALIGN
+ * bytes, chunks are always RTPP_ARENA_CHUNK aligned.
+ */
+#define RTPP_ARENA_ONODE(p) \
+  (*(int *)((uintptr_t)(p) & ~(uintptr_t)(RTPP_ARENA_CHUNK - 1)))
+
+struct rtpp_arena_tcent {
+    /* Free objects of the thread's node */
+    void *head;
+    int nfree;
+    /* Objects freed here that belong to other nodes */
+    void *rhead;
+    int nremote;
+    unsigned long nallocs;
+    unsigned long nfrees;
+};
+
+struct rtpp_arena_tcache {
+    int node;
+    struct rtpp_arena_tcent ents[RTPP_ARENA_MAXTC];
+};
+
+struct rtpp_arena_glob {
+    pthread_mutex_t lock;
+    int enabled;
+    struct rtpp_arena_pool *pools;
+    struct rtpp_arena_pool *tcpools[RTPP_ARENA_MAXTC];
+    int ntcpools;
+    pthread_once_t tckey_once;
+    pthread_key_t tckey;
+    int tckey_ok;
+    unsigned long nchunks;
+    unsigned long nchunks_htlb;
+};
+
+static struct rtpp_arena_glob rtpp_arena = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .tckey_once = PTHREAD_ONCE_INIT
+};
+
+static __thread struct rtpp_arena_tcache rtpp_arena_tc;
+static __thread int rtpp_arena_tc_active;
+
+int
+rtpp_arena_init(void)
+{
+
+    pthread_mutex_lock(&rtpp_arena.lock);
+    rtpp_arena.enabled = 1;
+    pthread_mutex_unlock(&rtpp_arena.lock);
+    return (0);
+}
+
+int
+rtpp_arena_enabled(void)
+{
+
+    return (rtpp_arena.enabled);
+}
+
+/*
+ * Map one 2MB chunk, preferring explicitly reserved huge pages and falling
+ * back to a 2MB-aligned anonymous mapping that is eligible for transparent
+ * huge pages.
+ */
+static char *
+rtpp_arena_chunk_map(int *htlbp)
+{
+    char *cp;
+#if !defined(MAP_ALIGNED_SUPER)
+    char *ap;
+    size_t hlen;
+#endif
+
+#if defined(MAP_HUGETLB)
+    cp = mmap(NULL, RTPP_ARENA_CHUNK, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0);
+    if (cp != MAP_FAILED) {
+        *htlbp = 1;
+        return (cp);
+    }
+#endif
+    *htlbp = 0;
+#if defined(MAP_ALIGNED_SUPER)
+    cp = mmap(NULL, RTPP_ARENA_CHUNK, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANON | MAP_ALIGNED_SUPER, -1, 0);
+    if (cp == MAP_FAILED)
+        return (NULL);
+#else
+    cp = mmap(NULL, 2 * RTPP_ARENA_CHUNK, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (cp == MAP_FAILED)
+        return (NULL);
+    ap = (char *)(((uintptr_t)cp + RTPP_ARENA_CHUNK - 1) &
+      ~(uintptr_t)(RTPP_ARENA_CHUNK - 1));
+    hlen = ap - cp;
+    if (hlen > 0)
+        munmap(cp, hlen);
+    munmap(ap + RTPP_ARENA_CHUNK, RTPP_ARENA_CHUNK - hlen);
+    cp = ap;
+#if defined(MADV_HUGEPAGE)
+    madvise(cp, RTPP_ARENA_CHUNK, MADV_HUGEPAGE);
+#endif
+#endif
+    return (cp);
+}
+
+static void
+rtpp_arena_pool_reg(struct rtpp_arena_pool *pool)
+{
+
+    pthread_mutex_lock(&rtpp_arena.lock);
+    if (pool->registered == 0) {
+        pool->next = rtpp_arena.pools;
+        rtpp_arena.pools = pool;
+        if (rtpp_arena.ntcpools < RTPP_ARENA_MAXTC) {
+            pool->tcidx = rtpp_arena.ntcpools;
+            rtpp_arena.tcpools[rtpp_arena.ntcpools++] = pool;
+        } else {
+            pool->tcidx = -1;
+        }
+        __sync_synchronize();
+        pool->registered = 1;
+    }
+    pthread_mutex_unlock(&rtpp_arena.lock);
+}
+
+static int
+rtpp_arena_curnode(void)
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned int cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+        return (node % RTPP_ARENA_MAXNODES);
+#endif
+    return (0);
+}
+
+/*
+ * Map a new chunk for the given node. The caller is running on that node,
+ * so tagging the chunk faults it in locally under the default first-touch
+ * policy, fully so for the explicit huge pages.
+ */
+static int
+rtpp_arena_pool_grow(struct rtpp_arena_pool *pool, int node)
+{
+    char *cp;
+    int htlb;
+
+    cp = rtpp_arena_chunk_map(&htlb);
+    if (cp == NULL)
+        return (-1);
+    *(int *)cp = node;
+    pool->nodes[node].bump_p = cp + RTPP_ARENA_OALIGN;
+    pool->nodes[node].bump_e = cp + RTPP_ARENA_CHUNK;
+    pthread_mutex_lock(&rtpp_arena.lock);
+    rtpp_arena.nchunks += 1;
+    rtpp_arena.nchunks_htlb += htlb;
+    pthread_mutex_unlock(&rtpp_arena.lock);
+    return (0);
+}
+
+/*
+ * Takes one object off the node's free list or its chunk, pool is locked.
+ */
+static void *
+rtpp_arena_pool_get(struct rtpp_arena_pool *pool, int node)
+{
+    struct rtpp_arena_node *np;
+    void *rval;
+
+    np = &pool->nodes[node];
+    if (np->freelist != NULL) {
+        rval = np->freelist;
+        np->freelist = *(void **)rval;
+        return (rval);
+    }
+    if (np->bump_e - np->bump_p < (ptrdiff_t)pool->osize &&
+      rtpp_arena_pool_grow(pool, node) != 0)
+        return (NULL);
+    rval = np->bump_p;
+    np->bump_p += pool->osize;
+    return (rval);
+}
+
+/*
+ * Puts a NULL-terminated list of objects onto the free lists of the nodes
+ * they belong to, pool is locked.
+ */
+static void
+rtpp_arena_pool_put(struct rtpp_arena_pool *pool, void *p)
+{
+    struct rtpp_arena_node *np;
+    void *p_next;
+
+    for (; p != NULL; p = p_next) {
+        p_next = *(void **)p;
+        np = &pool->nodes[RTPP_ARENA_ONODE(p)];
+        *(void **)p = np->freelist;
+        np->freelist = p;
+    }
+}
+
+/*
+ * Gives up to nobjs local objects and all of the remote ones from the
+ * thread cache back to the pool, along with the counters accumulated by
+ * this thread.
+ */
+static void
+rtpp_arena_tc_flush(struct rtpp_arena_pool *pool, struct rtpp_arena_tcent *tcp,
+  int nobjs)
+{
+    void *first, *last, *rfirst;
+    int i, nremote;
+
+    first = last = tcp->head;
+    for (i = 1; i < nobjs && *(void **)last != NULL; i++)
+        last = *(void **)last;
+    if (first != NULL && nobjs > 0) {
+        tcp->head = *(void **)last;
+        *(void **)last = NULL;
+        tcp->nfree -= i;
+    } else {
+        first = NULL;
+    }
+    rfirst = tcp->rhead;
+    nremote = tcp->nremote;
+    tcp->rhead = NULL;
+    tcp->nremote = 0;
+    pthread_mutex_lock(&pool->lock);
+    rtpp_arena_pool_put(pool, first);
+    rtpp_arena_pool_put(pool, rfirst);
+    pool->nallocs += tcp->nallocs;
+    pool->nfrees += tcp->nfrees;
+    pool->nfrees_xnode += nremote;
+    pthread_mutex_unlock(&pool->lock);
+    tcp->nallocs = tcp->nfrees = 0;
+}
+
+static void
+rtpp_arena_tc_dtor(void *p)
+{
+    struct rtpp_arena_tcache *tcp;
+    int i;
+
+    tcp = (struct rtpp_arena_tcache *)p;
+    for (i = 0; i < RTPP_ARENA_MAXTC && rtpp_arena.tcpools[i] != NULL; i++) {
+        rtpp_arena_tc_flush(rtpp_arena.tcpools[i], &tcp->ents[i],
+          tcp->ents[i].nfree);
+    }
+}
+
+static void
+rtpp_arena_tckey_init(void)
+{
+
+    if (pthread_key_create(&rtpp_arena.tckey, rtpp_arena_tc_dtor) == 0)
+        rtpp_arena.tckey_ok = 1;
+}
+
+/*
+ * Returns the calling thread's cache for the pool, making sure that it is
+ * going to be given back to the pools when the thread exits, or NULL if
+ * the pool is not cached.
+ */
+static struct rtpp_arena_tcent *
+rtpp_arena_tc_get(struct rtpp_arena_pool *pool)
+{
+
+    if (pool->tcidx < 0)
+        return (NULL);
+    if (rtpp_arena_tc_active == 0) {
+        pthread_once(&rtpp_arena.tckey_once, rtpp_arena_tckey_init);
+        if (rtpp_arena.tckey_ok == 0 ||
+          pthread_setspecific(rtpp_arena.tckey, &rtpp_arena_tc) != 0)
+            return (NULL);
+        rtpp_arena_tc.node = rtpp_arena_curnode();
+        rtpp_arena_tc_active = 1;
+    }
+    return (&rtpp_arena_tc.ents[pool->tcidx]);
+}
+
+void *
+rtpp_arena_zalloc(struct rtpp_arena_pool *pool, size_t msize)
+{
+    struct rtpp_arena_tcent *tcp;
+    void *rval;
+    size_t osize;
+    int i, node;
+
+    if (rtpp_arena.enabled == 0)
+        return (rtpp_zmalloc(msize));
+    if (pool->registered == 0)
+        rtpp_arena_pool_reg(pool);
+    osize = (msize + RTPP_ARENA_OALIGN - 1) & ~(size_t)(RTPP_ARENA_OALIGN - 1);
+    if (osize > RTPP_ARENA_CHUNK)
+        return (NULL);
+
+    tcp = rtpp_arena_tc_get(pool);
+    if (tcp != NULL && tcp->head != NULL) {
+        /* Object size is set once, by the first allocation */
+        if (osize > pool->osize)
+            return (NULL);
+        goto done;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->osize == 0)
+        pool->osize = osize;
+    if (osize > pool->osize)
+        goto e0;
+    if (tcp == NULL) {
+        rval = rtpp_arena_pool_get(pool, rtpp_arena_curnode());
+        if (rval == NULL)
+            goto e0;
+        pool->nallocs += 1;
+        pthread_mutex_unlock(&pool->lock);
+        goto zero;
+    }
+    /*
+     * Refill the cache with a batch of objects of the node the thread is
+     * on now, which only changes for the threads that are not pinned.
+     */
+    node = rtpp_arena_tc.node = rtpp_arena_curnode();
+    for (i = 0; i < RTPP_ARENA_TCBATCH; i++) {
+        if (pool->nodes[node].freelist == NULL && i > 0 &&
+          pool->nodes[node].bump_e - pool->nodes[node].bump_p <
+          (ptrdiff_t)pool->osize)
+            break;
+        rval = rtpp_arena_pool_get(pool, node);
+        if (rval == NULL)
+            break;
+        *(void **)rval = tcp->head;
+        tcp->head = rval;
+        tcp->nfree += 1;
+    }
+    pool->nallocs += tcp->nallocs;
+    pool->nfrees += tcp->nfrees;
+    pthread_mutex_unlock(&pool->lock);
+    tcp->nallocs = tcp->nfrees = 0;
+    if (tcp->head == NULL)
+        return (NULL);
+done:
+    rval = tcp->head;
+    tcp->head = *(void **)rval;
+    tcp->nfree -= 1;
+    tcp->nallocs += 1;
+zero:
+    memset(rval, '\0', msize);
+    return (rval);
+e0:
+    pthread_mutex_unlock(&pool->lock);
+    return (NULL);
+}
+
+void *
+rtpp_arena_rzalloc(struct rtpp_arena_pool *pool, size_t msize,
+  struct rtpp_refcnt **rcntp)
+{
+    char *rval;
+    struct rtpp_refcnt *rcnt;
+
+    if (rtpp_arena.enabled == 0)
+        return (rtpp_rzmalloc(msize, rcntp));
+    rval = rtpp_arena_zalloc(pool, RTPP_MALIGN(msize) + rtpp_refcnt_osize());
+    if (rval == NULL)
+        return (NULL);
+    rcnt = rtpp_refcnt_ctor_pa(rval + RTPP_MALIGN(msize));
+    if (rcnt == NULL) {
+        rtpp_arena_free(pool, rval);
+        return (NULL);
+    }
+    *rcntp = rcnt;
+    return (rval);
+}
+
+void
+rtpp_arena_free(struct rtpp_arena_pool *pool, void *p)
+{
+    struct rtpp_arena_tcent *tcp;
+
+    if (rtpp_arena.enabled == 0) {
+        free(p);
+        return;
+    }
+    /*
+     * Objects freed by a thread other than the one that has allocated
+     * them (e.g. packets received by the I/O thread and sent out by the
+     * RTP one) go into the freeing thread's cache and flow back through
+     * the pool once the cache overflows.
+     */
+    tcp = rtpp_arena_tc_get(pool);
+    if (tcp != NULL) {
+        tcp->nfrees += 1;
+        if (RTPP_ARENA_ONODE(p) != rtpp_arena_tc.node) {
+            *(void **)p = tcp->rhead;
+            tcp->rhead = p;
+            tcp->nremote += 1;
+            if (tcp->nremote >= RTPP_ARENA_TCBATCH)
+                rtpp_arena_tc_flush(pool, tcp, 0);
+            return;
+        }
+        *(void **)p = tcp->head;
+        tcp->head = p;
+        tcp->nfree += 1;
+        if (tcp->nfree >= RTPP_ARENA_TCBATCH * 2)
+            rtpp_arena_tc_flush(pool, tcp, RTPP_ARENA_TCBATCH);
+        return;
+    }
+    *(void **)p = NULL;
+    pthread_mutex_lock(&pool->lock);
+    rtpp_arena_pool_put(pool, p);
+    pool->nfrees += 1;
+    if (RTPP_ARENA_ONODE(p) != rtpp_arena_curnode())
+        pool->nfrees_xnode += 1;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void
+rtpp_arena_stats_flush(struct rtpp_stats *rtpp_stats)
+{
+    struct rtpp_arena_pool *pool;
+    unsigned long nallocs, nfrees, nfrees_xnode;
+
+    if (rtpp_arena.enabled == 0)
+        return;
+    /*
+     * Pools are only ever prepended to the list, so it can be walked
+     * without the global lock, which must not be held while taking the
+     * pool lock. Counts kept in the thread caches are only added to the
+     * pools once per batch, so these lag a little behind.
+     */
+    pthread_mutex_lock(&rtpp_arena.lock);
+    pool = rtpp_arena.pools;
+    pthread_mutex_unlock(&rtpp_arena.lock);
+    for (; pool != NULL; pool = pool->next) {
+        pthread_mutex_lock(&pool->lock);
+        nallocs = pool->nallocs;
+        nfrees = pool->nfrees;
+        nfrees_xnode = pool->nfrees_xnode;
+        pool->nallocs = pool->nfrees = pool->nfrees_xnode = 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (nallocs > 0)
+            CALL_METHOD(rtpp_stats, updatebyname, "arena_nallocs", nallocs);
+        if (nfrees > 0)
+            CALL_METHOD(rtpp_stats, updatebyname, "arena_nfrees", nfrees);
+        if (nfrees_xnode > 0)
+            CALL_METHOD(rtpp_stats, updatebyname, "arena_nfrees_xnode",
+              nfrees_xnode);
+    }
+    pthread_mutex_lock(&rtpp_arena.lock);
+    if (rtpp_arena.nchunks > 0) {
+        CALL_METHOD(rtpp_stats, updatebyname, "arena_nchunks",
+          rtpp_arena.nchunks);
+        rtpp_arena.nchunks = 0;
+    }
+    if (rtpp_arena.nchunks_htlb > 0) {
+        CALL_METHOD(rtpp_stats, updatebyname, "arena_nchunks_htlb",
+          rtpp_arena.nchunks_htlb);
+        rtpp_arena.nchunks_htlb = 0;
+    }
+    pthread_mutex_unlock(&rtpp_arena.lock);
+}
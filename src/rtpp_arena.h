@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_ARENA_H_
+#define _RTPP_ARENA_H_
+
+/*
+ * Optional allocator backend for the fixed-size objects that are touched
+ * on every packet (packet buffers, streams, analyzer state). When enabled
+ * with rtpp_arena_init(), objects are carved out of 2MB huge-page backed
+ * chunks, one set of chunks per pool, and recycled through a per-pool free
+ * list. Each thread keeps a small cache of free objects per pool in front
+ * of the shared free list, so that the pool lock is only taken once per
+ * batch of allocations or frees. Chunks are never returned to the OS.
+ * When not enabled, all calls fall through to the regular heap allocator.
+ *
+ * Chunks and free lists are kept per NUMA node: threads are handed objects
+ * from the chunks of the node they run on, chunks are first touched by
+ * such a thread, and objects freed on another node (e.g. a packet received
+ * by a net thread and sent out by the RTP thread running elsewhere) are
+ * sent back to the free list of their own node.
+ */
+
+struct rtpp_refcnt;
+struct rtpp_stats;
+
+/* Nodes above this share the free lists of the lower ones */
+#define RTPP_ARENA_MAXNODES 8
+
+struct rtpp_arena_node {
+    void *freelist;
+    char *bump_p;
+    char *bump_e;
+};
+
+struct rtpp_arena_pool {
+    const char *name;
+    size_t osize;
+    pthread_mutex_t lock;
+    struct rtpp_arena_node nodes[RTPP_ARENA_MAXNODES];
+    unsigned long nallocs;
+    unsigned long nfrees;
+    unsigned long nfrees_xnode;
+    int registered;
+    /* Slot in the per-thread caches, -1 if the pool is not cached */
+    int tcidx;
+    struct rtpp_arena_pool *next;
+};
+
+#define RTPP_ARENA_POOL_INITIALIZER(pname) {.name = (pname), \
+  .lock = PTHREAD_MUTEX_INITIALIZER}
+
+int rtpp_arena_init(void);
+int rtpp_arena_enabled(void);
+void *rtpp_arena_zalloc(struct rtpp_arena_pool *, size_t);
+void *rtpp_arena_rzalloc(struct rtpp_arena_pool *, size_t,
+  struct rtpp_refcnt **);
+void rtpp_arena_free(struct rtpp_arena_pool *, void *);
+void rtpp_arena_stats_flush(struct rtpp_stats *);
+
+#endif
@@ -65,6 +65,8 @@ struct rtpp_cfg_stable {
     int port_max;               /* Highest UDP port number for RTP */
     int seq_ports;              /* Allocate ports in sequential manner rather than randomly */
     int port_ctl;               /* Port number for UDP control, 0 for Unix domain */
+    int nworkers;               /* Processes sharing the UDP control port, 0 if not */
+    int worker_id;              /* Index of this process among them */
     int max_ttl;
     int max_setup_ttl;
     /*
@@ -97,6 +99,9 @@ struct rtpp_cfg_stable {
 
     int log_level;
     int log_facility;
+    /* Per call site rate limit of each log object, 0 to disable */
+    double log_rl_rate;
+    int log_rl_burst;
 
     struct rtpp_port_table *port_table[RTPP_PT_LEN];
 
@@ -110,6 +115,8 @@ struct rtpp_cfg_stable {
     int sched_policy;
     int sched_hz;
     double target_pfreq;
+    int evloop;                 /* Block in poll(2) instead of ticking at target_pfreq */
+    int connect_latched;        /* Switch settled streams to connected sockets */
     struct rtpp_cmd_async *rtpp_cmd_cf;
     struct rtpp_proc_async *rtpp_proc_cf;
     struct rtpp_anetio_cf *rtpp_netio_cf;
@@ -130,6 +137,9 @@ struct rtpp_cfg_stable {
 
     char *mpath;
     struct rtpp_module_if *modules_cf;
+
+    const char *kfwd_ifnames;
+    struct rtpp_kfwd *rtpp_kfwd_cf;
 };
 
 #endif
@@ -34,6 +34,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <poll.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,27 +52,49 @@
 #include "rtpp_command_async.h"
 #include "rtpp_command_copy.h"
 #include "rtpp_command_delete.h"
+#include "rtpp_command_dump.h"
 #include "rtpp_command_parse.h"
 #include "rtpp_command_play.h"
 #include "rtpp_command_private.h"
 #include "rtpp_command_record.h"
 #include "rtpp_command_rcache.h"
 #include "rtpp_command_query.h"
+#include "rtpp_histogram.h"
 #include "rtpp_command_stats.h"
 #include "rtpp_command_ul.h"
 #include "rtpp_command_ver.h"
+#include "rtpp_command_stream.h"
+#include "rtpp_command_wfwd.h"
+#include "rtpp_controlfd.h"
 #include "rtpp_hash_table.h"
+#include "rtpp_kfwd.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_netio_async.h"
 #include "rtpp_network.h"
 #include "rtpp_pipe.h"
 #include "rtpp_port_table.h"
+#include "rtpp_proc_async.h"
 #include "rtpp_stream.h"
 #include "rtpp_session.h"
 #include "rtpp_socket.h"
+#include "rtpp_time.h"
 #include "rtpp_util.h"
 #include "rtpp_stats.h"
 #include "rtpp_weakref.h"
+#include "rtpp_cpuset.h"
+
+#define RTPC_ARENA_SIZE 2048
+
+struct rtpp_cmd_arena_ovf {
+    struct rtpp_cmd_arena_ovf *next;
+    double data[0];
+};
+
+struct rtpp_cmd_arena {
+    size_t used;
+    struct rtpp_cmd_arena_ovf *ovf;
+    double data[RTPC_ARENA_SIZE / sizeof(double)];
+};
 
 struct rtpp_command_priv {
     struct rtpp_command pub;
@@ -79,8 +102,13 @@ struct rtpp_command_priv {
     int controlfd;
     char *cookie;
     int umode;
-    char buf_r[256];
+    int noreply;
+    /* Time by which the reply has to be out, 0 until the first write */
+    double wdeadline;
+    char buf_r[1024 * 8 + 128];
     struct rtpp_cmd_rcache *rcache_obj;
+    struct rtpp_cmd_arena arena;
+    struct rtpp_command **spare;
 };
 
 #define PUB2PVT(pubp) \
@@ -137,6 +165,8 @@ create_twinlistener(uint16_t port, void *ap)
 	    RTPP_ELOG(ctap->cfs->glog, RTPP_LOG_ERR, "unable to set 256K receive buffer size");
         CALL_METHOD(ctap->fds[i], setnonblock);
         CALL_METHOD(ctap->fds[i], settimestamp);
+        /* Best effort, not every kernel can do UDP GRO */
+        CALL_METHOD(ctap->fds[i], setgro);
     }
     *ctap->port = port - 2;
     return RTPP_PTU_OK;
@@ -172,6 +202,67 @@ rtpp_create_listener(struct cfg *cf, struct sockaddr *ia, int *port,
       &cta));
 }
 
+/*
+ * Write the whole buffer out to the stream socket, retrying on short
+ * writes. Replies can be large enough (e.g. the J command) to fill up
+ * the socket buffer, in which case wait for the client to drain it, but
+ * for no longer than RTPC_WRITE_TOUT in total for all the parts of the
+ * reply, so that a slow reader can't hold up the command thread. Stream
+ * sockets may be in the blocking mode, hence the MSG_DONTWAIT; stdio
+ * descriptors are not sockets and are written to as they are.
+ */
+#define RTPC_WRITE_TOUT	1.0	/* in seconds */
+
+static int
+rtpc_write(struct rtpp_command_priv *pvt, const char *buf, int len)
+{
+    struct pollfd pfd;
+    ssize_t r;
+    double tleft;
+    int n, issock;
+
+    if (pvt->wdeadline < 0)
+        return (-1);
+    if (pvt->wdeadline == 0)
+        pvt->wdeadline = getdtime() + RTPC_WRITE_TOUT;
+    issock = 1;
+    while (len > 0) {
+        if (issock) {
+            r = send(pvt->controlfd, buf, len, MSG_DONTWAIT);
+            if (r < 0 && errno == ENOTSOCK) {
+                issock = 0;
+                continue;
+            }
+        } else {
+            r = write(pvt->controlfd, buf, len);
+        }
+        if (r > 0) {
+            buf += r;
+            len -= r;
+            continue;
+        }
+        if (r == 0)
+            goto e0;
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            goto e0;
+        tleft = pvt->wdeadline - getdtime();
+        if (tleft <= 0)
+            goto e0;
+        pfd.fd = pvt->controlfd;
+        pfd.events = POLLOUT;
+        n = poll(&pfd, 1, (int)(tleft * 1000) + 1);
+        if (n == 0 || (n < 0 && errno != EINTR))
+            goto e0;
+    }
+    return (0);
+e0:
+    /* Don't let the rest of the reply wait for the same client again */
+    pvt->wdeadline = -1;
+    return (-1);
+}
+
 void
 rtpc_doreply(struct rtpp_command *cmd, char *buf, int len, int errd)
 {
@@ -186,12 +277,18 @@ rtpc_doreply(struct rtpp_command *cmd, char *buf, int len, int errd)
     } else {
         RTPP_LOG(pvt->cfs->glog, RTPP_LOG_DBUG, "sending reply \"%s\"", buf);
     }
-    if (pvt->umode == 0) {
-	write(pvt->controlfd, buf, len);
+    if (pvt->noreply != 0) {
+        /* Copy of a command broadcast by another worker, which has replied */
+    } else if (pvt->umode == 0) {
+        if (rtpc_write(pvt, buf, len) != 0) {
+            RTPP_LOG(pvt->cfs->glog, RTPP_LOG_ERR, "can't send reply");
+        }
     } else {
         if (pvt->cookie != NULL) {
             len = snprintf(pvt->buf_r, sizeof(pvt->buf_r), "%s %s", pvt->cookie,
               buf);
+            if (len >= sizeof(pvt->buf_r))
+                len = sizeof(pvt->buf_r) - 1;
             buf = pvt->buf_r;
             CALL_METHOD(pvt->rcache_obj, insert, pvt->cookie, pvt->buf_r, cmd->dtime);
         }
@@ -206,6 +303,47 @@ rtpc_doreply(struct rtpp_command *cmd, char *buf, int len, int errd)
     }
 }
 
+/*
+ * Write out part of a multi-part reply, to be completed later with the
+ * rtpc_doreply(). Only possible over stream sockets, since datagram replies
+ * carry a cookie and go into the reply cache.
+ */
+int
+rtpc_doreply_part(struct rtpp_command *cmd, const char *buf, int len)
+{
+    struct rtpp_command_priv *pvt;
+
+    pvt = PUB2PVT(cmd);
+
+    if (pvt->umode != 0) {
+        return (-1);
+    }
+    return (rtpc_write(pvt, buf, len));
+}
+
+/*
+ * Largest reply that the rtpc_doreply() can send in one go over a datagram
+ * socket once the cookie is prepended, or -1 for stream sockets, which
+ * have no such limit as long as the reply is written out in parts.
+ */
+int
+rtpc_doreply_maxlen(struct rtpp_command *cmd)
+{
+    struct rtpp_command_priv *pvt;
+    int len;
+
+    pvt = PUB2PVT(cmd);
+
+    if (pvt->umode == 0) {
+        return (-1);
+    }
+    len = sizeof(pvt->buf_r) - 1;
+    if (pvt->cookie != NULL) {
+        len -= strlen(pvt->cookie) + 1;
+    }
+    return (len > 0 ? len : 0);
+}
+
 void
 reply_number(struct rtpp_command *cmd, int number)
 {
@@ -232,36 +370,109 @@ reply_error(struct rtpp_command *cmd,
     rtpc_doreply(cmd, cmd->buf_t, len, 1);
 }
 
-void
-free_command(struct rtpp_command *cmd)
+void *
+rtpp_command_alloc(struct rtpp_command *cmd, size_t len)
 {
     struct rtpp_command_priv *pvt;
+    struct rtpp_cmd_arena_ovf *ovf;
+    void *rp;
 
     pvt = PUB2PVT(cmd);
+    len = (len + sizeof(double) - 1) & ~(sizeof(double) - 1);
+    if (len <= sizeof(pvt->arena.data) - pvt->arena.used) {
+        rp = (char *)pvt->arena.data + pvt->arena.used;
+        pvt->arena.used += len;
+        memset(rp, '\0', len);
+        return (rp);
+    }
+    ovf = rtpp_zmalloc(sizeof(struct rtpp_cmd_arena_ovf) + len);
+    if (ovf == NULL) {
+        return (NULL);
+    }
+    RTPC_CNT_ALLOC(cmd->csp);
+    ovf->next = pvt->arena.ovf;
+    pvt->arena.ovf = ovf;
+    return (ovf->data);
+}
+
+static void
+rtpp_command_release(struct rtpp_command_priv *pvt)
+{
+    struct rtpp_cmd_arena_ovf *ovf, *ovf_next;
+
     if (pvt->rcache_obj != NULL) {
         CALL_SMETHOD(pvt->rcache_obj->rcnt, decref);
+        pvt->rcache_obj = NULL;
+    }
+    if (pvt->pub.sp != NULL) {
+        CALL_SMETHOD(pvt->pub.sp->rcnt, decref);
+        pvt->pub.sp = NULL;
     }
-    if (cmd->sp != NULL) {
-        CALL_SMETHOD(cmd->sp->rcnt, decref);
+    for (ovf = pvt->arena.ovf; ovf != NULL; ovf = ovf_next) {
+        ovf_next = ovf->next;
+        free(ovf);
+    }
+    pvt->arena.ovf = NULL;
+    pvt->arena.used = 0;
+}
+
+void
+free_command(struct rtpp_command *cmd)
+{
+    struct rtpp_command_priv *pvt;
+
+    pvt = PUB2PVT(cmd);
+    rtpp_command_release(pvt);
+    if (pvt->spare != NULL && *pvt->spare == NULL) {
+        /* Park it for the next command on the same connection */
+        *pvt->spare = cmd;
+        return;
     }
     free(pvt);
 }
 
+void
+rtpp_command_spare_free(struct rtpp_command **spare)
+{
+
+    if (*spare != NULL) {
+        free(PUB2PVT(*spare));
+        *spare = NULL;
+    }
+}
+
 struct rtpp_command *
 rtpp_command_ctor(struct cfg *cf, int controlfd, double dtime, int *rval,
- struct rtpp_command_stats *csp, int umode)
+ struct rtpp_command_stats *csp, int umode, struct rtpp_command **spare)
 {
     struct rtpp_command_priv *pvt;
     struct rtpp_command *cmd;
 
-    pvt = rtpp_zmalloc(sizeof(struct rtpp_command_priv));
-    if (pvt == NULL) {
-        *rval = ENOMEM;
-        return (NULL);
+    if (spare != NULL && *spare != NULL) {
+        cmd = *spare;
+        *spare = NULL;
+        pvt = PUB2PVT(cmd);
+        /*
+         * Large I/O buffers are left as they are, everything past them
+         * has to look as if it has just come out of rtpp_zmalloc().
+         */
+        memset(&cmd->argv, '\0', sizeof(struct rtpp_command) -
+          offsetof(struct rtpp_command, argv));
+        pvt->cookie = NULL;
+        pvt->noreply = 0;
+        pvt->wdeadline = 0;
+    } else {
+        pvt = rtpp_zmalloc(sizeof(struct rtpp_command_priv));
+        if (pvt == NULL) {
+            *rval = ENOMEM;
+            return (NULL);
+        }
+        RTPC_CNT_ALLOC(csp);
+        cmd = &(pvt->pub);
     }
-    cmd = &(pvt->pub);
     pvt->controlfd = controlfd;
     pvt->cfs = cf->stable;
+    pvt->spare = spare;
     cmd->dtime = dtime;
     cmd->csp = csp;
     cmd->glog = cf->stable->glog;
@@ -270,30 +481,38 @@ rtpp_command_ctor(struct cfg *cf, int controlfd, double dtime, int *rval,
 }
 
 struct rtpp_command *
-get_command(struct cfg *cf, int controlfd, int *rval, double dtime,
-  struct rtpp_command_stats *csp, int umode,
+get_command(struct cfg *cf, struct rtpp_cmd_connection *rcc, int *rval,
+  double dtime, struct rtpp_command_stats *csp, int umode,
   struct rtpp_cmd_rcache *rcache_obj)
 {
     char **ap;
     char *cp;
-    int len, i;
+    int len, i, controlfd, wflags, wrefuse;
     struct rtpp_command *cmd;
     struct rtpp_command_priv *pvt;
 
-    cmd = rtpp_command_ctor(cf, controlfd, dtime, rval, csp, umode);
+    controlfd = rcc->controlfd_out;
+    cmd = rtpp_command_ctor(cf, controlfd, dtime, rval, csp, umode,
+      &rcc->spare_cmd);
     if (cmd == NULL) {
         return (NULL);
     }
     pvt = PUB2PVT(cmd);
     if (umode == 0) {
         for (;;) {
-            len = read(controlfd, cmd->buf, sizeof(cmd->buf) - 1);
+            len = read(rcc->controlfd_in, cmd->buf, sizeof(cmd->buf) - 1);
             if (len != -1 || (errno != EAGAIN && errno != EINTR))
                 break;
         }
+    } else if (rcc->csock->type == RTPC_WFWD) {
+        cmd->rlen = sizeof(cmd->raddr);
+        len = rtpp_wfwd_recv(cf->stable, rcc->csock, rcc->controlfd_in,
+          cmd->buf, sizeof(cmd->buf) - 1, &cmd->raddr, &cmd->rlen, &wflags);
+        if (len >= 0 && (wflags & RTPP_WFWD_F_NOREPLY) != 0)
+            pvt->noreply = 1;
     } else {
         cmd->rlen = sizeof(cmd->raddr);
-        len = recvfrom(controlfd, cmd->buf, sizeof(cmd->buf) - 1, 0,
+        len = recvfrom(rcc->controlfd_in, cmd->buf, sizeof(cmd->buf) - 1, 0,
           sstosa(&cmd->raddr), &cmd->rlen);
     }
     if (len == -1) {
@@ -305,6 +524,36 @@ get_command(struct cfg *cf, int controlfd, int *rval, double dtime,
     }
     cmd->buf[len] = '\0';
 
+    wrefuse = 0;
+    if (rcc->csock->type != RTPC_WFWD && rcc->csock->wfwd_pair != NULL) {
+        i = rtpp_wfwd_owner(cf->stable, cmd->buf, len);
+        if (i == RTPP_WFWD_BCAST) {
+            /* Have everyone else execute it, we'll do it and reply below */
+            for (i = 0; i < cf->stable->nworkers; i++) {
+                if (i == cf->stable->worker_id)
+                    continue;
+                if (rtpp_wfwd_send(cf->stable, rcc->csock, i, cmd->buf, len,
+                  sstosa(&cmd->raddr), cmd->rlen, RTPP_WFWD_F_NOREPLY) != 0) {
+                    RTPP_ELOG(cf->stable->glog, RTPP_LOG_ERR, "can't forward "
+                      "command to worker %d", i);
+                }
+                csp->ncmds_fwdd.cnt++;
+            }
+        } else if (i == RTPP_WFWD_REFUSE) {
+            wrefuse = 1;
+        } else if (i >= 0) {
+            if (rtpp_wfwd_send(cf->stable, rcc->csock, i, cmd->buf, len,
+              sstosa(&cmd->raddr), cmd->rlen, 0) != 0) {
+                RTPP_ELOG(cf->stable->glog, RTPP_LOG_ERR, "can't forward "
+                  "command to worker %d", i);
+            }
+            csp->ncmds_fwdd.cnt++;
+            free_command(cmd);
+            *rval = 0;
+            return (NULL);
+        }
+    }
+
     if (len > 0 && cmd->buf[len - 1] == '\n') {
         RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "received command \"%.*s\\n\"",
           len - 1, cmd->buf);
@@ -333,7 +582,8 @@ get_command(struct cfg *cf, int controlfd, int *rval, double dtime,
     /* Stream communication mode doesn't use cookie */
     if (umode != 0) {
         pvt->cookie = cmd->argv[0];
-        if (CALL_METHOD(rcache_obj, lookup, pvt->cookie, pvt->buf_r, sizeof(pvt->buf_r)) == 1) {
+        if (pvt->noreply == 0 && CALL_METHOD(rcache_obj, lookup, pvt->cookie,
+          pvt->buf_r, sizeof(pvt->buf_r)) == 1) {
             len = strlen(pvt->buf_r);
             rtpp_anetio_sendto(cf->stable->rtpp_netio_cf, controlfd, pvt->buf_r, len, 0,
               sstosa(&cmd->raddr), cmd->rlen);
@@ -351,6 +601,15 @@ get_command(struct cfg *cf, int controlfd, int *rval, double dtime,
         cmd->argv[cmd->argc] = NULL;
     }
 
+    if (wrefuse != 0) {
+        RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR, "command \"%s\" can't be "
+          "served by a single worker", cmd->argv[0]);
+        reply_error(cmd, ECODE_WORKERS);
+        *rval = 0;
+        free_command(cmd);
+        return (NULL);
+    }
+
     /* Step I: parse parameters that are common to all ops */
     if (rtpp_command_pre_parse(cf, cmd) != 0) {
         /* Error reply is handled by the rtpp_command_pre_parse() */
@@ -365,7 +624,7 @@ get_command(struct cfg *cf, int controlfd, int *rval, double dtime,
 int
 handle_command(struct cfg *cf, struct rtpp_command *cmd)
 {
-    int i, verbose, rval;
+    int i, verbose, reset, rval;
     char *cp;
     char *recording_name;
     struct rtpp_session *spa;
@@ -473,6 +732,35 @@ handle_command(struct cfg *cf, struct rtpp_command *cmd)
         }
         return 0;
 
+    case GET_TIMING:
+        reset = 0;
+        for (cp = cmd->argv[0] + 1; *cp != '\0'; cp++) {
+            switch (*cp) {
+            case 'r':
+            case 'R':
+                reset = 1;
+                break;
+
+            default:
+                RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR,
+                  "TIMING: unknown command modifier `%c'", *cp);
+                reply_error(cmd, ECODE_PARSE_5);
+                return 0;
+            }
+        }
+        i = handle_get_timing(cmd, reset);
+        if (i != 0) {
+            reply_error(cmd, i);
+        }
+        return 0;
+
+    case DUMP_SESSIONS:
+        i = handle_dump(cf, cmd);
+        if (i != 0) {
+            reply_error(cmd, i);
+        }
+        return 0;
+
     default:
         break;
     }
@@ -506,19 +794,9 @@ handle_command(struct cfg *cf, struct rtpp_command *cmd)
 	RTPP_LOG(cf->stable->glog, RTPP_LOG_INFO,
 	  "%s request failed: session %s, tags %s/%s not found", cmd->cca.rname,
 	  cmd->cca.call_id, cmd->cca.from_tag, cmd->cca.to_tag != NULL ? cmd->cca.to_tag : "NONE");
-	switch (cmd->cca.op) {
-	case LOOKUP:
-	    rtpp_command_ul_opts_free(cmd->cca.opts.ul);
+	if (cmd->cca.op == LOOKUP) {
 	    ul_reply_port(cmd, NULL);
 	    return 0;
-
-	case PLAY:
-	    rtpp_command_play_opts_free(cmd->cca.opts.play);
-	    break;
-
-	default:
-	    RTPP_DBG_ASSERT(cmd->cca.opts.ptr == NULL);
-	    break;
 	}
 	reply_error(cmd, ECODE_SESUNKN);
 	return 0;
@@ -564,9 +842,37 @@ handle_command(struct cfg *cf, struct rtpp_command *cmd)
 	abort();
     }
 
+    /*
+     * Anything but a query may change how the session is to be handled,
+     * so bring its streams back from the kernel and let them be
+     * re-offloaded once they settle again.
+     */
+    if (cf->stable->rtpp_kfwd_cf != NULL && cmd->sp != NULL &&
+      cmd->cca.op != QUERY) {
+	CALL_METHOD(cf->stable->rtpp_kfwd_cf, unload_sess, cmd->sp);
+    }
+
     return 0;
 }
 
+static int
+info_lstat(char *buf, int len, const char *hname,
+  const struct rtpp_histogram *hp)
+{
+    int rlen;
+
+    rlen = snprintf(buf, len, "%s: ", hname);
+    if (rlen >= len)
+        return (len - 1);
+    rlen += rtpp_histogram_nstr(hp, buf + rlen, len - rlen);
+    if (rlen >= len - 1)
+        return (len - 1);
+    buf[rlen++] = '\n';
+    return (rlen);
+}
+
+#define RTPC_INFO_BLEN	(1024 * 8)
+
 static void
 handle_info(struct cfg *cf, struct rtpp_command *cmd)
 {
@@ -576,17 +882,21 @@ handle_info(struct cfg *cf, struct rtpp_command *cmd)
     int brief;
 #endif
     int len, i, load;
-    char buf[1024 * 8];
+    char *buf;
     unsigned long long packets_in, packets_out;
     unsigned long long sessions_created;
     int sessions_active, rtp_streams_active;
     const char *opts;
+    struct rtpp_proc_lstats *lsp;
+    int ltimes, affinity;
 
     opts = &cmd->argv[0][1];
 #if 0
     brief = 0;
 #endif
     load = 0;
+    ltimes = 0;
+    affinity = 0;
     for (i = 0; opts[i] != '\0'; i++) {
         switch (opts[i]) {
         case 'b':
@@ -601,6 +911,16 @@ handle_info(struct cfg *cf, struct rtpp_command *cmd)
             load = 1;
             break;
 
+        case 't':
+        case 'T':
+            ltimes = 1;
+            break;
+
+        case 'a':
+        case 'A':
+            affinity = 1;
+            break;
+
         default:
             RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR, "command syntax error");
             reply_error(cmd, ECODE_PARSE_7);
@@ -608,6 +928,14 @@ handle_info(struct cfg *cf, struct rtpp_command *cmd)
         }
     }
 
+    /* Too large for the command thread's stack, freed with the command */
+    buf = rtpp_command_alloc(cmd, RTPC_INFO_BLEN);
+    lsp = (ltimes != 0) ? rtpp_command_alloc(cmd, sizeof(*lsp)) : NULL;
+    if (buf == NULL || (ltimes != 0 && lsp == NULL)) {
+        reply_error(cmd, ECODE_NOMEM_1);
+        return;
+    }
+
     packets_in = CALL_METHOD(cf->stable->rtpp_stats, getlvalbyname, "npkts_rcvd");
     packets_out = CALL_METHOD(cf->stable->rtpp_stats, getlvalbyname, "npkts_relayed") +
       CALL_METHOD(cf->stable->rtpp_stats, getlvalbyname, "npkts_played");
@@ -616,13 +944,29 @@ handle_info(struct cfg *cf, struct rtpp_command *cmd)
     sessions_active = sessions_created - CALL_METHOD(cf->stable->rtpp_stats,
       getlvalbyname, "nsess_destroyed");
     rtp_streams_active = CALL_METHOD(cf->stable->rtp_streams_wrt, get_length);
-    len = snprintf(buf, sizeof(buf), "sessions created: %llu\nactive sessions: %d\n"
+    len = snprintf(buf, RTPC_INFO_BLEN, "sessions created: %llu\nactive sessions: %d\n"
       "active streams: %d\npackets received: %llu\npackets transmitted: %llu\n",
       sessions_created, sessions_active, rtp_streams_active, packets_in, packets_out);
     if (load != 0) {
-          len += snprintf(buf + len, sizeof(buf) - len, "average load: %f\n",
+          len += snprintf(buf + len, RTPC_INFO_BLEN - len, "average load: %f\n",
             CALL_METHOD(cf->stable->rtpp_cmd_cf, get_aload));
     }
+    if (ltimes != 0) {
+        CALL_METHOD(cf->stable->rtpp_proc_cf, get_lstats, lsp, 0);
+        len += info_lstat(buf + len, RTPC_INFO_BLEN - len,
+          "rtp loop tick overrun (us)", &lsp->tick_ovr);
+        len += info_lstat(buf + len, RTPC_INFO_BLEN - len,
+          "rtp loop ticks drained", &lsp->ndrain);
+        len += info_lstat(buf + len, RTPC_INFO_BLEN - len,
+          "rtp loop poll time (us)", &lsp->poll_time);
+        len += info_lstat(buf + len, RTPC_INFO_BLEN - len,
+          "rtp loop proc time (us)", &lsp->proc_time);
+        len += info_lstat(buf + len, RTPC_INFO_BLEN - len,
+          "rtp sender batch time (us)", &lsp->send_time);
+        len += info_lstat(buf + len, RTPC_INFO_BLEN - len,
+          "rtp forwarding latency (us)", &lsp->fwd_lat);
+    }
+    len += rtpp_cpuset_info(buf + len, RTPC_INFO_BLEN - len, affinity);
 #if 0
 XXX this needs work to fix it after rtp/rtcp split 
     for (i = 0; i < cf->sessinfo->nsessions && brief == 0; i++) {
@@ -655,13 +999,13 @@ XXX this needs work to fix it after rtp/rtcp split
               addr2port(spb->addr[0]));
         }
 
-        len += snprintf(buf + len, sizeof(buf) - len,
+        len += snprintf(buf + len, RTPC_INFO_BLEN - len,
           "%s/%s: caller = %s:%d/%s, callee = %s:%d/%s, "
           "stats = %lu/%lu/%lu/%lu, ttl = %d/%d\n",
           spb->call_id, spb->tag, addrs[0], spb->stream[1]->port, addrs[1],
           addrs[2], spb->stream[0]->port, addrs[3], spa->pcount[0], spa->pcount[1],
           spa->pcount[2], spa->pcount[3], spb->ttl[0], spb->ttl[1]);
-        if (len + 512 > sizeof(buf)) {
+        if (len + 512 > RTPC_INFO_BLEN) {
             rtpc_doreply(cmd, buf, len);
             len = 0;
         }
@@ -36,11 +36,13 @@ struct cfg_stable;
 struct sockaddr;
 struct rtpp_cmd_rcache;
 struct rtpp_socket;
+struct rtpp_cmd_connection;
 
 int handle_command(struct cfg *, struct rtpp_command *);
 void free_command(struct rtpp_command *);
-struct rtpp_command *get_command(struct cfg *, int, int *, double,
-  struct rtpp_command_stats *csp, int umode, struct rtpp_cmd_rcache *);
+struct rtpp_command *get_command(struct cfg *, struct rtpp_cmd_connection *,
+  int *, double, struct rtpp_command_stats *csp, int umode,
+  struct rtpp_cmd_rcache *);
 void reply_error(struct rtpp_command *cmd, int ecode);
 void reply_ok(struct rtpp_command *cmd);
 void reply_port(struct rtpp_command *cmd, int lport,
@@ -49,8 +51,12 @@ void reply_number(struct rtpp_command *cmd, int number);
 int rtpp_create_listener(struct cfg *, struct sockaddr *, int *,
   struct rtpp_socket **);
 struct rtpp_command *rtpp_command_ctor(struct cfg *, int, double, int *,
-  struct rtpp_command_stats *, int);
+  struct rtpp_command_stats *, int, struct rtpp_command **);
+void rtpp_command_spare_free(struct rtpp_command **);
+void *rtpp_command_alloc(struct rtpp_command *, size_t);
 
 void rtpc_doreply(struct rtpp_command *, char *, int, int);
+int rtpc_doreply_part(struct rtpp_command *, const char *, int);
+int rtpc_doreply_maxlen(struct rtpp_command *);
 
 #endif
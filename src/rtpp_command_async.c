@@ -30,11 +30,13 @@
 #include <netinet/in.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "rtpp_log.h"
@@ -48,6 +50,8 @@
 #include "rtpp_command_private.h"
 #include "rtpp_command_rcache.h"
 #include "rtpp_command_stream.h"
+#include "rtpp_histogram.h"
+#include "rtpp_command_stats.h"
 #if 0
 #include "rtpp_math.h"
 #endif
@@ -58,14 +62,22 @@
 #include "rtpp_list.h"
 #include "rtpp_controlfd.h"
 #include "rtpp_time.h"
+#include "rtpp_util.h"
+#include "rtpp_cpuset.h"
+#if defined(RTPP_CHECK_LEAKS)
+#include "rtpp_memdeb_stats.h"
+#endif
 
 #define RTPC_MAX_CONNECTIONS 100
 
 struct rtpp_cmd_pollset {
+    /* Has a spare slot at the end for the --evloop wakeup pipe */
     struct pollfd *pfds;
     int pfds_used;
     struct rtpp_cmd_connection *rccs[RTPC_MAX_CONNECTIONS];
     pthread_mutex_t pfds_mutex;
+    /* Lent to the connections that have none, e.g. one-shot unix ones */
+    struct rtpp_command *spare_cmd;
 };
 
 struct rtpp_cmd_accptset {
@@ -93,6 +105,13 @@ struct rtpp_cmd_async_cf {
     struct rtpp_cmd_accptset aset;
     struct cfg *cf_save;
     struct rtpp_cmd_rcache *rcache;
+    /*
+     * With --evloop the queue thread blocks in poll(2) until there is
+     * something to do, holding pset.pfds_mutex. The acceptor kicks it out
+     * via the pipe and makes it wait while there are pending updates.
+     */
+    int wakeup_fd[2];
+    int npending_updates;
 };
 
 #define PUB2PVT(pubp)	((struct rtpp_cmd_async_cf *)((char *)(pubp) - offsetof(struct rtpp_cmd_async_cf, pub)))
@@ -100,6 +119,20 @@ struct rtpp_cmd_async_cf {
 #define TSTATE_RUN   0x0
 #define TSTATE_CEASE 0x1
 
+/*
+ * With the memdeb every block allocated by this thread from reading in a
+ * command to disposing of it, session objects included, is counted in
+ * ncmds_allocs. Other builds rely on RTPC_CNT_ALLOC() in the command code.
+ */
+#if defined(RTPP_CHECK_LEAKS)
+#define CSTAT_NALLOC_START(n0)   (n0) = rtpp_memdeb_tnalloc()
+#define CSTAT_NALLOC_END(csp, n0) \
+  (csp)->ncmds_allocs.cnt += rtpp_memdeb_tnalloc() - (n0)
+#else
+#define CSTAT_NALLOC_START(n0)   (n0) = 0
+#define CSTAT_NALLOC_END(csp, n0) (void)(n0)
+#endif
+
 static double rtpp_command_async_get_aload(struct rtpp_cmd_async *);
 static int rtpp_command_async_wakeup(struct rtpp_cmd_async *);
 static void rtpp_command_async_dtor(struct rtpp_cmd_async *);
@@ -113,6 +146,8 @@ init_cstats(struct rtpp_stats *sobj, struct rtpp_command_stats *csp)
     csp->ncmds_succd.cnt_idx = CALL_METHOD(sobj, getidxbyname, "ncmds_succd");
     csp->ncmds_errs.cnt_idx = CALL_METHOD(sobj, getidxbyname, "ncmds_errs");
     csp->ncmds_repld.cnt_idx = CALL_METHOD(sobj, getidxbyname, "ncmds_repld");
+    csp->ncmds_allocs.cnt_idx = CALL_METHOD(sobj, getidxbyname, "ncmds_allocs");
+    csp->ncmds_fwdd.cnt_idx = CALL_METHOD(sobj, getidxbyname, "ncmds_fwdd");
 
     csp->nsess_complete.cnt_idx = CALL_METHOD(sobj, getidxbyname, "nsess_complete");
     csp->nsess_created.cnt_idx = CALL_METHOD(sobj, getidxbyname, "nsess_created");
@@ -137,6 +172,8 @@ flush_cstats(struct rtpp_stats *sobj, struct rtpp_command_stats *csp)
     FLUSH_CSTAT(sobj, csp->ncmds_succd);
     FLUSH_CSTAT(sobj, csp->ncmds_errs);
     FLUSH_CSTAT(sobj, csp->ncmds_repld);
+    FLUSH_CSTAT(sobj, csp->ncmds_allocs);
+    FLUSH_CSTAT(sobj, csp->ncmds_fwdd);
 
     FLUSH_CSTAT(sobj, csp->nsess_complete);
     FLUSH_CSTAT(sobj, csp->nsess_created);
@@ -165,24 +202,61 @@ accept_connection(struct cfg *cf, struct rtpp_ctrl_sock *rcsp, struct sockaddr *
 }
 
 static int
-process_commands(struct rtpp_ctrl_sock *csock, struct cfg *cf, int controlfd, double dtime,
-  struct rtpp_command_stats *csp, struct rtpp_stats *rsc,
+handle_command_timed(struct cfg *cf, struct rtpp_command *cmd, double ptime)
+{
+    struct rtpp_cmd_lstat *lsp;
+    double stime, ltime, etime;
+    int rval;
+
+    lsp = &cmd->csp->lstats->ops[cmd->cca.op];
+    stime = getdtime();
+    if (cmd->no_glock == 0) {
+        pthread_mutex_lock(&cf->glock);
+    }
+    ltime = getdtime();
+    rval = handle_command(cf, cmd);
+    if (cmd->no_glock == 0) {
+        pthread_mutex_unlock(&cf->glock);
+    }
+    etime = getdtime();
+    rtpp_histogram_record(&lsp->parse, ptime);
+    if (cmd->no_glock == 0) {
+        rtpp_histogram_record(&lsp->glock, ltime - stime);
+    }
+    rtpp_histogram_record(&lsp->exec, etime - ltime);
+    return (rval);
+}
+
+static int
+process_commands(struct rtpp_cmd_connection *rcc, struct cfg *cf,
+  double dtime, struct rtpp_command_stats *csp, struct rtpp_stats *rsc,
   struct rtpp_cmd_rcache *rcp)
 {
     int i, rval;
     struct rtpp_command *cmd;
+    struct rtpp_ctrl_sock *csock;
     int umode;
+    double ptime;
+    uint64_t nalloc0;
 
+    csock = rcc->csock;
     umode = RTPP_CTRL_ISDG(csock);
+    if (csock->type == RTPC_WFWD) {
+        /* Forwarded commands are handled as if received on the UDP socket */
+        csock = csock->wfwd_pair;
+    }
     i = 0;
     do {
-        cmd = get_command(cf, controlfd, &rval, dtime, csp, umode, rcp);
+        ptime = getdtime();
+        CSTAT_NALLOC_START(nalloc0);
+        cmd = get_command(cf, rcc, &rval, dtime, csp, umode, rcp);
         if (cmd == NULL && rval == 0) {
             /*
              * get_command() failed with error other than I/O error
              * or something, there might be some good commands in
              * the queue.
              */
+            CSTAT_NALLOC_END(csp, nalloc0);
             continue;
         }
         if (cmd != NULL) {
@@ -190,14 +264,9 @@ process_commands(struct rtpp_ctrl_sock *csock, struct cfg *cf, int controlfd, do
             if (cmd->cca.op == GET_STATS || cmd->cca.op == INFO) {
                 flush_cstats(rsc, csp);
             }
-            if (cmd->no_glock == 0) {
-                pthread_mutex_lock(&cf->glock);
-            }
-            i = handle_command(cf, cmd);
-            if (cmd->no_glock == 0) {
-                pthread_mutex_unlock(&cf->glock);
-            }
+            i = handle_command_timed(cf, cmd, getdtime() - ptime);
             free_command(cmd);
+            CSTAT_NALLOC_END(csp, nalloc0);
         } else {
             i = -1;
         }
@@ -211,14 +280,19 @@ process_commands_stream(struct cfg *cf, struct rtpp_cmd_connection *rcc,
 {
     int rval;
     struct rtpp_command *cmd;
+    double ptime;
+    uint64_t nalloc0;
 
     rval = rtpp_command_stream_doio(cf, rcc);
     if (rval <= 0) {
         return (-1);
     }
     do {
+        ptime = getdtime();
+        CSTAT_NALLOC_START(nalloc0);
         cmd = rtpp_command_stream_get(cf, rcc, &rval, dtime, csp);
         if (cmd == NULL) {
+            CSTAT_NALLOC_END(csp, nalloc0);
             if (rval != 0) {
                 break;
             }
@@ -228,14 +302,9 @@ process_commands_stream(struct cfg *cf, struct rtpp_cmd_connection *rcc,
         if (cmd->cca.op == GET_STATS || cmd->cca.op == INFO) {
             flush_cstats(rsc, csp);
         }
-        if (cmd->no_glock == 0) {
-            pthread_mutex_lock(&cf->glock);
-        }
-        rval = handle_command(cf, cmd);
-        if (cmd->no_glock == 0) {
-            pthread_mutex_unlock(&cf->glock);
-        }
+        rval = handle_command_timed(cf, cmd, getdtime() - ptime);
         free_command(cmd);
+        CSTAT_NALLOC_END(csp, nalloc0);
     } while (rval == 0);
     return (rval);
 }
@@ -264,6 +333,7 @@ void
 rtpp_cmd_connection_dtor(struct rtpp_cmd_connection *rcc)
 {
 
+    rtpp_command_spare_free(&rcc->spare_cmd);
     if (rcc->controlfd_in != rcc->csock->controlfd_in) {
         close(rcc->controlfd_in);
         if (rcc->controlfd_out != rcc->controlfd_in) {
@@ -273,6 +343,53 @@ rtpp_cmd_connection_dtor(struct rtpp_cmd_connection *rcc)
     free(rcc);
 }
 
+static void
+rtpp_cmd_pset_lock(struct rtpp_cmd_async_cf *cmd_cf)
+{
+
+    if (cmd_cf->cf_save->stable->evloop != 0) {
+        pthread_mutex_lock(&cmd_cf->cmd_mutex);
+        cmd_cf->npending_updates++;
+        pthread_mutex_unlock(&cmd_cf->cmd_mutex);
+        (void)write(cmd_cf->wakeup_fd[1], "", 1);
+    }
+    pthread_mutex_lock(&cmd_cf->pset.pfds_mutex);
+}
+
+static void
+rtpp_cmd_pset_unlock(struct rtpp_cmd_async_cf *cmd_cf)
+{
+
+    pthread_mutex_unlock(&cmd_cf->pset.pfds_mutex);
+    if (cmd_cf->cf_save->stable->evloop != 0) {
+        pthread_mutex_lock(&cmd_cf->cmd_mutex);
+        cmd_cf->npending_updates--;
+        pthread_cond_signal(&cmd_cf->cmd_cond);
+        pthread_mutex_unlock(&cmd_cf->cmd_mutex);
+    }
+}
+
+/*
+ * Called by the queue thread in the --evloop mode once it has been kicked
+ * out of poll(2) and has released the pollset.
+ */
+static int
+wait_pset_updates(struct rtpp_cmd_async_cf *cmd_cf)
+{
+    char buf[32];
+    int tstate;
+
+    while (read(cmd_cf->wakeup_fd[0], buf, sizeof(buf)) > 0)
+        continue;
+    pthread_mutex_lock(&cmd_cf->cmd_mutex);
+    while (cmd_cf->npending_updates > 0 && cmd_cf->tstate_queue == TSTATE_RUN) {
+        pthread_cond_wait(&cmd_cf->cmd_cond, &cmd_cf->cmd_mutex);
+    }
+    tstate = cmd_cf->tstate_queue;
+    pthread_mutex_unlock(&cmd_cf->cmd_mutex);
+    return (tstate);
+}
+
 static void
 rtpp_cmd_acceptor_run(void *arg)
 {
@@ -284,6 +401,7 @@ rtpp_cmd_acceptor_run(void *arg)
     int nready, controlfd, i, tstate;
     struct sockaddr_storage raddr;
 
+    rtpp_cpuset_bind(RTPP_THR_CMD);
     cmd_cf = (struct rtpp_cmd_async_cf *)arg;
     psp = &cmd_cf->pset;
     asp = &cmd_cf->aset;
@@ -306,27 +424,27 @@ rtpp_cmd_acceptor_run(void *arg)
             if ((asp->pfds[i].revents & POLLIN) == 0) {
                 continue;
             }
-            pthread_mutex_lock(&psp->pfds_mutex);
+            rtpp_cmd_pset_lock(cmd_cf);
             if (psp->pfds_used >= RTPC_MAX_CONNECTIONS) {
-                pthread_mutex_unlock(&psp->pfds_mutex);
+                rtpp_cmd_pset_unlock(cmd_cf);
                 continue;
             }
             controlfd = accept_connection(cmd_cf->cf_save, asp->csocks[i],
               sstosa(&raddr));
             if (controlfd < 0) {
-                pthread_mutex_unlock(&psp->pfds_mutex);
+                rtpp_cmd_pset_unlock(cmd_cf);
                 continue;
             }
-            tp = realloc(psp->pfds, sizeof(struct pollfd) * (psp->pfds_used + 1));
+            tp = realloc(psp->pfds, sizeof(struct pollfd) * (psp->pfds_used + 2));
             if (tp == NULL) {
-                pthread_mutex_unlock(&psp->pfds_mutex);
+                rtpp_cmd_pset_unlock(cmd_cf);
                 close(controlfd); /* Yeah, sorry, please try later */
                 continue;
             }
             rcc = rtpp_cmd_connection_ctor(controlfd, controlfd, asp->csocks[i],
               sstosa(&raddr));
             if (rcc == NULL) {
-                pthread_mutex_unlock(&psp->pfds_mutex);
+                rtpp_cmd_pset_unlock(cmd_cf);
                 close(controlfd); /* Yeah, sorry, please try later */
                 continue;
             }
@@ -336,7 +454,7 @@ rtpp_cmd_acceptor_run(void *arg)
             psp->pfds[psp->pfds_used].revents = 0;
             psp->rccs[psp->pfds_used] = rcc;
             psp->pfds_used++;
-            pthread_mutex_unlock(&psp->pfds_mutex);
+            rtpp_cmd_pset_unlock(cmd_cf);
             rtpp_command_async_wakeup(&cmd_cf->pub);
         }
     }
@@ -373,10 +491,13 @@ rtpp_cmd_queue_run(void *arg)
 #endif
     struct rtpp_command_stats *csp;
     struct rtpp_stats *rtpp_stats_cf;
+    int evloop, kicked;
 
+    rtpp_cpuset_bind(RTPP_THR_CMD);
     cmd_cf = (struct rtpp_cmd_async_cf *)arg;
     rtpp_stats_cf = cmd_cf->cf_save->stable->rtpp_stats;
     csp = &cmd_cf->cstats;
+    evloop = cmd_cf->cf_save->stable->evloop;
 
     psp = &cmd_cf->pset;
 
@@ -384,20 +505,39 @@ rtpp_cmd_queue_run(void *arg)
         sptime = getdtime();
 
         pthread_mutex_lock(&psp->pfds_mutex);
-        if (psp->pfds_used == 0) {
-            pthread_mutex_unlock(&psp->pfds_mutex);
-            if (wait_next_clock(cmd_cf) == TSTATE_CEASE) {
-                break;
+        if (evloop != 0) {
+            /* Nothing to tick us, sleep until a command or a kick */
+            psp->pfds[psp->pfds_used].fd = cmd_cf->wakeup_fd[0];
+            psp->pfds[psp->pfds_used].events = POLLIN;
+            psp->pfds[psp->pfds_used].revents = 0;
+            nready = poll(psp->pfds, psp->pfds_used + 1, INFTIM);
+            kicked = (nready > 0 && psp->pfds[psp->pfds_used].revents != 0);
+            if (kicked) {
+                nready--;
             }
-            continue;
-        }
-        nready = poll(psp->pfds, psp->pfds_used, 2);
-        if (nready == 0) {
+            if (nready <= 0) {
+                pthread_mutex_unlock(&psp->pfds_mutex);
+                if (kicked && wait_pset_updates(cmd_cf) == TSTATE_CEASE) {
+                    break;
+                }
+                continue;
+            }
+        } else if (psp->pfds_used == 0) {
             pthread_mutex_unlock(&psp->pfds_mutex);
             if (wait_next_clock(cmd_cf) == TSTATE_CEASE) {
                 break;
             }
             continue;
+        } else {
+            kicked = 0;
+            nready = poll(psp->pfds, psp->pfds_used, 2);
+            if (nready == 0) {
+                pthread_mutex_unlock(&psp->pfds_mutex);
+                if (wait_next_clock(cmd_cf) == TSTATE_CEASE) {
+                    break;
+                }
+                continue;
+            }
         }
         if (nready < 0 && errno == EINTR) {
             pthread_mutex_unlock(&psp->pfds_mutex);
@@ -416,10 +556,14 @@ rtpp_cmd_queue_run(void *arg)
                 if ((psp->pfds[i].revents & POLLIN) == 0) {
                     continue;
                 }
+                if (psp->rccs[i]->spare_cmd == NULL) {
+                    psp->rccs[i]->spare_cmd = psp->spare_cmd;
+                    psp->spare_cmd = NULL;
+                }
                 if (RTPP_CTRL_ISSTREAM(psp->rccs[i]->csock)) {
                     rval = process_commands_stream(cmd_cf->cf_save, psp->rccs[i], sptime, csp, rtpp_stats_cf);
                 } else {
-                    rval = process_commands(psp->rccs[i]->csock, cmd_cf->cf_save, psp->pfds[i].fd,
+                    rval = process_commands(psp->rccs[i], cmd_cf->cf_save,
                       sptime, csp, rtpp_stats_cf, cmd_cf->rcache);
                 }
                 /*
@@ -432,6 +576,10 @@ closefd:
                     if (psp->rccs[i]->csock->type == RTPC_STDIO && psp->rccs[i]->csock->exit_on_close != 0) {
                         cmd_cf->cf_save->stable->slowshutdown = 1;
                     }
+                    if (psp->spare_cmd == NULL) {
+                        psp->spare_cmd = psp->rccs[i]->spare_cmd;
+                        psp->rccs[i]->spare_cmd = NULL;
+                    }
                     rtpp_cmd_connection_dtor(psp->rccs[i]);
                     psp->pfds_used--;
                     if (psp->pfds_used > 0 && i < psp->pfds_used) {
@@ -447,6 +595,9 @@ closefd:
         if (nready > 0) {
             rtpp_anetio_pump(cmd_cf->cf_save->stable->rtpp_netio_cf);
         }
+        if (kicked && wait_pset_updates(cmd_cf) == TSTATE_CEASE) {
+            break;
+        }
 #if 0
         eptime = getdtime();
         pthread_mutex_lock(&cmd_cf->cmd_mutex);
@@ -521,7 +672,7 @@ init_pollset(struct cfg *cf, struct rtpp_cmd_pollset *psp)
             continue;
         pfds_used++;
     }
-    msize = pfds_used > 0 ? pfds_used : 1;
+    msize = pfds_used + 1;
     psp->pfds = malloc(sizeof(struct pollfd) * msize);
     if (psp->pfds == NULL) {
         return (-1);
@@ -559,6 +710,7 @@ free_pollset(struct rtpp_cmd_pollset *psp)
     for (i = 0; i < psp->pfds_used; i ++) {
         rtpp_cmd_connection_dtor(psp->rccs[i]);
     }
+    rtpp_command_spare_free(&psp->spare_cmd);
     free(psp->pfds);
 }
 
@@ -630,6 +782,10 @@ rtpp_command_async_ctor(struct cfg *cf)
     }
 
     init_cstats(cf->stable->rtpp_stats, &cmd_cf->cstats);
+    cmd_cf->cstats.lstats = rtpp_zmalloc(sizeof(struct rtpp_cmd_lstats));
+    if (cmd_cf->cstats.lstats == NULL) {
+        goto e3;
+    }
 
     if (pthread_cond_init(&cmd_cf->cmd_cond, NULL) != 0) {
         goto e3;
@@ -637,11 +793,20 @@ rtpp_command_async_ctor(struct cfg *cf)
     if (pthread_mutex_init(&cmd_cf->cmd_mutex, NULL) != 0) {
         goto e4;
     }
+    cmd_cf->wakeup_fd[0] = cmd_cf->wakeup_fd[1] = -1;
+    if (cf->stable->evloop != 0) {
+        if (pipe(cmd_cf->wakeup_fd) != 0) {
+            goto e5;
+        }
+        for (i = 0; i < 2; i++) {
+            fcntl(cmd_cf->wakeup_fd[i], F_SETFL, O_NONBLOCK);
+        }
+    }
     assert(cf->stable->rtpp_timed_cf != NULL);
     cmd_cf->rcache = rtpp_cmd_rcache_ctor(cf->stable->rtpp_timed_cf,
-      32.0 + 3.0);
+      cf->stable->rtpp_stats, 32.0 + 3.0);
     if (cmd_cf->rcache == NULL) {
-        goto e5;
+        goto e5a;
     }
 
 #if 0
@@ -675,11 +840,17 @@ e7:
 e6:
     CALL_METHOD(cmd_cf->rcache, shutdown);
     CALL_SMETHOD(cmd_cf->rcache->rcnt, decref);
+e5a:
+    if (cmd_cf->wakeup_fd[0] != -1) {
+        close(cmd_cf->wakeup_fd[0]);
+        close(cmd_cf->wakeup_fd[1]);
+    }
 e5:
     pthread_mutex_destroy(&cmd_cf->cmd_mutex);
 e4:
     pthread_cond_destroy(&cmd_cf->cmd_cond);
 e3:
+    free(cmd_cf->cstats.lstats);
     free_accptset(&cmd_cf->aset);
 e2:
     free_pollset(&cmd_cf->pset);
@@ -709,6 +880,9 @@ rtpp_command_async_dtor(struct rtpp_cmd_async *pub)
     /* notify worker thread */
     pthread_cond_signal(&cmd_cf->cmd_cond);
     pthread_mutex_unlock(&cmd_cf->cmd_mutex);
+    if (cmd_cf->wakeup_fd[1] != -1) {
+        (void)write(cmd_cf->wakeup_fd[1], "", 1);
+    }
     pthread_join(cmd_cf->thread_id, NULL);        
     if (cmd_cf->acceptor_started != 0) {
         pthread_join(cmd_cf->acpt_thread_id, NULL);
@@ -717,7 +891,12 @@ rtpp_command_async_dtor(struct rtpp_cmd_async *pub)
     CALL_SMETHOD(cmd_cf->rcache->rcnt, decref);
     pthread_cond_destroy(&cmd_cf->cmd_cond);
     pthread_mutex_destroy(&cmd_cf->cmd_mutex);
+    if (cmd_cf->wakeup_fd[0] != -1) {
+        close(cmd_cf->wakeup_fd[0]);
+        close(cmd_cf->wakeup_fd[1]);
+    }
     free_pollset(&cmd_cf->pset);
     free_accptset(&cmd_cf->aset);
+    free(cmd_cf->cstats.lstats);
     free(cmd_cf);
 }
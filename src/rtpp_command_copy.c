@@ -35,6 +35,7 @@
 #include "rtpp_cfg_stable.h"
 #include "rtpp_defines.h"
 #include "rtpp_types.h"
+#include "rtpp_kfwd.h"
 #include "rtpp_refcnt.h"
 #include "rtpp_log_obj.h"
 #include "rtpp_pipe.h"
@@ -43,8 +44,8 @@
 #include "rtpp_session.h"
 #include "rtpp_util.h"
 
-int
-handle_copy(struct cfg *cf, struct rtpp_session *spa, int idx, char *rname,
+static int
+_handle_copy(struct cfg *cf, struct rtpp_session *spa, int idx, char *rname,
   int record_single_file)
 {
     int remote;
@@ -93,3 +94,20 @@ handle_copy(struct cfg *cf, struct rtpp_session *spa, int idx, char *rname,
     }
     return (0);
 }
+
+int
+handle_copy(struct cfg *cf, struct rtpp_session *spa, int idx, char *rname,
+  int record_single_file)
+{
+    int rval;
+
+    rval = _handle_copy(cf, spa, idx, rname, record_single_file);
+    /*
+     * Recorder needs to see every packet, so pull the session out of the
+     * kernel now that rrc is set and it won't be offloaded again.
+     */
+    if (rval == 0 && cf->stable->rtpp_kfwd_cf != NULL) {
+        CALL_METHOD(cf->stable->rtpp_kfwd_cf, unload_sess, spa);
+    }
+    return (rval);
+}
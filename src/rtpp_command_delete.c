@@ -41,7 +41,6 @@
 #include "rtpp_types.h"
 #include "rtpp_hash_table.h"
 #include "rtpp_log_obj.h"
-#include "rtpp_mallocs.h"
 #include "rtpp_pipe.h"
 #include "rtpp_session.h"
 #include "rtpp_stream.h"
@@ -52,6 +51,7 @@ struct delete_ematch_arg {
     const char *from_tag;
     const char *to_tag;
     int weak;
+    int done;
     struct rtpp_weakref_obj *sessions_wrt;
 };
 
@@ -105,6 +105,7 @@ rtpp_cmd_delete_ematch(void *dp, void *ap)
         dep->ndeleted++;
     }
     if (cmpr != 2) {
+        dep->done = 1;
         return (RTPP_HT_MATCH_DEL | RTPP_HT_MATCH_BRK);
     }
     return (RTPP_HT_MATCH_DEL);
@@ -118,16 +119,23 @@ int
 handle_delete(struct cfg *cf, struct common_cmd_args *ccap)
 {
     struct delete_ematch_arg dea;
+    char fkey[RTPP_SESS_HTKEY_LEN], tkey[RTPP_SESS_HTKEY_LEN];
 
     memset(&dea, '\0', sizeof(dea));
     dea.from_tag = ccap->from_tag;
     dea.to_tag = ccap->to_tag;
     dea.weak = ccap->opts.delete->weak;
     dea.sessions_wrt = cf->stable->sessions_wrt;
-    CALL_METHOD(cf->stable->sessions_ht, foreach_key, ccap->call_id,
+    rtpp_session_htkey(fkey, sizeof(fkey), ccap->call_id, ccap->from_tag);
+    CALL_METHOD(cf->stable->sessions_ht, foreach_key, fkey,
       rtpp_cmd_delete_ematch, &dea);
-    rtpp_command_del_opts_free(ccap->opts.delete);
-    ccap->opts.delete = NULL;
+    if (dea.done == 0 && ccap->to_tag != NULL) {
+        rtpp_session_htkey(tkey, sizeof(tkey), ccap->call_id, ccap->to_tag);
+        if (strcmp(fkey, tkey) != 0) {
+            CALL_METHOD(cf->stable->sessions_ht, foreach_key, tkey,
+              rtpp_cmd_delete_ematch, &dea);
+        }
+    }
     return (dea.ndeleted == 0) ? -1 : 0;
 }
 
@@ -137,10 +145,10 @@ rtpp_command_del_opts_parse(struct rtpp_command *cmd)
     struct delete_opts *dlop;
     const char *cp;
 
-    dlop = rtpp_zmalloc(sizeof(struct delete_opts));
+    dlop = rtpp_command_alloc(cmd, sizeof(struct delete_opts));
     if (dlop == NULL) {
         reply_error(cmd, ECODE_NOMEM_1);
-        goto err_undo_0;
+        return (NULL);
     }
     for (cp = cmd->argv[0] + 1; *cp != '\0'; cp++) {
         switch (*cp) {
@@ -153,20 +161,8 @@ rtpp_command_del_opts_parse(struct rtpp_command *cmd)
             RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
               "DELETE: unknown command modifier `%c'", *cp);
             reply_error(cmd, ECODE_PARSE_4);
-            goto err_undo_1;
+            return (NULL);
         }
     }
     return (dlop);
-
-err_undo_1:
-    rtpp_command_del_opts_free(dlop);
-err_undo_0:
-    return (NULL);
-}
-
-void
-rtpp_command_del_opts_free(struct delete_opts *dlop)
-{
-
-    free(dlop);
 }
@@ -31,5 +31,4 @@ struct common_cmd_args;
 struct delete_opts;
 
 struct delete_opts *rtpp_command_del_opts_parse(struct rtpp_command *);
-void rtpp_command_del_opts_free(struct delete_opts *);
 int handle_delete(struct cfg *, struct common_cmd_args *);
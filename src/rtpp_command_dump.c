@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtpp_ssrc.h"
+#include "rtpa_stats.h"
+#include "rtpp_log.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_defines.h"
+#include "rtpp_types.h"
+#include "rtpp_log_obj.h"
+#include "rtpp_analyzer.h"
+#include "rtpp_command.h"
+#include "rtpp_command_private.h"
+#include "rtpp_command_dump.h"
+#include "rtpp_hash_table.h"
+#include "rtpp_netaddr.h"
+#include "rtpp_network.h"
+#include "rtpp_pcount.h"
+#include "rtpp_pcnt_strm.h"
+#include "rtpp_pipe.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_session.h"
+#include "rtpp_stream.h"
+#include "rtpp_weakref.h"
+
+/*
+ * Bulk session dump: one line of space-separated key=value pairs per
+ * active session, terminated by an empty line. The sessions table is only
+ * locked while taking references to the sessions, formatting is done
+ * afterwards. Over stream sockets the output is written out in chunks as
+ * it's being generated, over datagram sockets it has to fit into a single
+ * reply, which is checked before anything is sent.
+ */
+
+struct dump_snapshot {
+    struct rtpp_session **sessions;
+    int nalloc;
+    int nsessions;
+};
+
+static int
+dump_snapshot_f(void *dp, void *ap)
+{
+    struct rtpp_session *sp;
+    struct dump_snapshot *ssp;
+
+    sp = (struct rtpp_session *)dp;
+    ssp = (struct dump_snapshot *)ap;
+    /* Sessions created after we have sized up the snapshot are skipped */
+    if (ssp->nsessions == ssp->nalloc)
+        return (RTPP_WR_MATCH_CONT);
+    CALL_SMETHOD(sp->rcnt, incref);
+    ssp->sessions[ssp->nsessions++] = sp;
+    return (RTPP_WR_MATCH_CONT);
+}
+
+static int
+dump_stream(char *buf, int len, struct rtpp_stream *stp, const char *side)
+{
+    char laddr[MAX_AP_STRBUF], raddr[MAX_AP_STRBUF];
+    struct rtpp_netaddr *rem_addr;
+    struct rtpp_pcnts_strm pst;
+    struct rtpa_stats rst;
+
+    addr2char_r(stp->laddr, laddr, sizeof(laddr));
+    rem_addr = CALL_SMETHOD(stp, get_rem_addr, 0);
+    if (rem_addr != NULL) {
+        CALL_SMETHOD(rem_addr, sip_print, raddr, sizeof(raddr), ':');
+        CALL_SMETHOD(rem_addr->rcnt, decref);
+    } else {
+        strcpy(raddr, "NONE");
+    }
+    CALL_METHOD(stp->pcnt_strm, get_stats, &pst);
+    CALL_METHOD(stp->analyzer, get_stats, &rst);
+    return (snprintf(buf, len, " laddr_%s=%s:%d raddr_%s=%s npkts_in_%s=%lu "
+      "rtpa_nsent_%s=%lu rtpa_nrcvd_%s=%lu rtpa_ndups_%s=%lu "
+      "rtpa_nlost_%s=%lu rtpa_perrs_%s=%lu", side, laddr, stp->port,
+      side, raddr, side, pst.npkts_in, side, rst.psent, side, rst.precvd,
+      side, rst.pdups, side, rst.plost, side, rst.pecount));
+}
+
+static int
+dump_session(char *buf, int blen, struct rtpp_session *sp)
+{
+    struct rtpps_pcount pcnts[2];
+    int len;
+
+    CALL_METHOD(sp->rtp->pcount, get_stats, &pcnts[0]);
+    CALL_METHOD(sp->rtcp->pcount, get_stats, &pcnts[1]);
+    len = snprintf(buf, blen, "seuid=%llu call_id=%s tag=%s complete=%d "
+      "ttl=%d nrelayed=%lu ndropped=%lu rtcp_nrelayed=%lu rtcp_ndropped=%lu",
+      (unsigned long long)sp->seuid, sp->call_id, sp->tag, sp->complete,
+      CALL_METHOD(sp->rtp, get_ttl), pcnts[0].nrelayed, pcnts[0].ndropped,
+      pcnts[1].nrelayed, pcnts[1].ndropped);
+    if (len < blen) {
+        len += dump_stream(buf + len, blen - len, sp->rtp->stream[0], "o");
+    }
+    if (len < blen) {
+        len += dump_stream(buf + len, blen - len, sp->rtp->stream[1], "a");
+    }
+    if (len > blen - 2) {
+        /* Truncated, still keep it on a line of its own */
+        len = blen - 2;
+    }
+    buf[len++] = '\n';
+    buf[len] = '\0';
+    return (len);
+}
+
+int
+handle_dump(struct cfg *cf, struct rtpp_command *cmd)
+{
+    struct dump_snapshot ss;
+    char buf[1024 * 8], line[1024];
+    int len, llen, i, rval, blen, maxlen;
+
+    maxlen = rtpc_doreply_maxlen(cmd);
+    blen = sizeof(buf);
+    if (maxlen >= 0 && maxlen < blen) {
+        blen = maxlen;
+    }
+    memset(&ss, '\0', sizeof(ss));
+    ss.nalloc = CALL_METHOD(cf->stable->sessions_wrt, get_length);
+    if (ss.nalloc > 0) {
+        ss.sessions = rtpp_command_alloc(cmd, ss.nalloc *
+          sizeof(struct rtpp_session *));
+        if (ss.sessions == NULL) {
+            return (ECODE_NOMEM_1);
+        }
+        CALL_METHOD(cf->stable->sessions_wrt, foreach, dump_snapshot_f, &ss);
+    }
+
+    rval = 0;
+    len = 0;
+    for (i = 0; i < ss.nsessions; i++) {
+        if (rval == 0) {
+            llen = dump_session(line, sizeof(line), ss.sessions[i]);
+            if (len + llen + 2 > blen) {
+                if (maxlen >= 0) {
+                    RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR,
+                      "DUMP: output does not fit into a datagram, use a "
+                      "stream control socket");
+                    rval = ECODE_RTOOBIG_2;
+                } else if (rtpc_doreply_part(cmd, buf, len) != 0) {
+                    RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR,
+                      "DUMP: can't send output");
+                    rval = ECODE_RTOOBIG_2;
+                }
+                len = 0;
+            }
+            if (rval == 0) {
+                memcpy(buf + len, line, llen);
+                len += llen;
+            }
+        }
+        CALL_SMETHOD(ss.sessions[i]->rcnt, decref);
+    }
+    if (rval != 0) {
+        return (rval);
+    }
+    buf[len++] = '\n';
+    rtpc_doreply(cmd, buf, len, 0);
+    return (0);
+}
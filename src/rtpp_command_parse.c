@@ -74,6 +74,18 @@ fill_cmd_props(struct cfg *cf, struct rtpp_command *cmd,
         cpp->tpos = 5;
         break;
 
+    case 'j':
+    case 'J':
+        cmd->cca.op = DUMP_SESSIONS;
+        cmd->cca.rname = "dump_sessions";
+        cmd->cca.hint = "J";
+        cmd->no_glock = 1;
+        cpp->max_argc = 1;
+        cpp->min_argc = 1;
+        cpp->has_cmods = 0;
+        cpp->has_call_id = 0;
+        break;
+
     case 'l':
     case 'L':
         cmd->cca.op = LOOKUP;
@@ -178,7 +190,7 @@ fill_cmd_props(struct cfg *cf, struct rtpp_command *cmd,
     case 'I':
         cmd->cca.op = INFO;
         cmd->cca.rname = "get_info";
-        cmd->cca.hint = "I[b]";
+        cmd->cca.hint = "I[blt]";
         cpp->max_argc = 1;
         cpp->min_argc = 1;
         cpp->has_cmods = 1;
@@ -197,6 +209,18 @@ fill_cmd_props(struct cfg *cf, struct rtpp_command *cmd,
         cpp->tpos = 3;
         break;
 
+    case 't':
+    case 'T':
+        cmd->cca.op = GET_TIMING;
+        cmd->cca.rname = "get_timing";
+        cmd->cca.hint = "T[r]";
+        cmd->no_glock = 1;
+        cpp->max_argc = 1;
+        cpp->min_argc = 1;
+        cpp->has_cmods = 1;
+        cpp->has_call_id = 0;
+        break;
+
     case 'x':
     case 'X':
         cmd->cca.op = DELETE_ALL;
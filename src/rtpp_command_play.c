@@ -37,7 +37,6 @@
 #include "rtpp_command.h"
 #include "rtpp_command_play.h"
 #include "rtpp_command_private.h"
-#include "rtpp_mallocs.h"
 #include "rtpp_stream.h"
 
 struct play_opts {
@@ -53,10 +52,10 @@ rtpp_command_play_opts_parse(struct rtpp_command *cmd)
     const char *tcp;
     char *cp;
 
-    plop = rtpp_zmalloc(sizeof(struct play_opts));
+    plop = rtpp_command_alloc(cmd, sizeof(struct play_opts));
     if (plop == NULL) {
         reply_error(cmd, ECODE_NOMEM_1);
-        goto err_undo_0;
+        return (NULL);
     }
     plop->count = 1;
     plop->pname = cmd->argv[2];
@@ -67,22 +66,10 @@ rtpp_command_play_opts_parse(struct rtpp_command *cmd)
         if (cp == tcp || *cp != '\0') {
             RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "command syntax error");
             reply_error(cmd, ECODE_PARSE_6);
-            goto err_undo_1;
+            return (NULL);
         }
     }
     return (plop);
-
-err_undo_1:
-    rtpp_command_play_opts_free(plop);
-err_undo_0:
-    return (NULL);
-}
-
-void
-rtpp_command_play_opts_free(struct play_opts *plop)
-{
-
-    free(plop);
 }
 
 void
@@ -97,7 +84,7 @@ rtpp_command_play_handle(struct rtpp_stream *rsp, struct rtpp_command *cmd)
     if (strcmp(plop->codecs, "session") == 0) {
         if (rsp->codecs == NULL) {
             reply_error(cmd, ECODE_INVLARG_5);
-            goto freeplop;
+            return;
         }
         codecs = rsp->codecs;
         ptime = rsp->ptime;
@@ -108,9 +95,7 @@ rtpp_command_play_handle(struct rtpp_stream *rsp, struct rtpp_command *cmd)
     if (plop->count != 0 && CALL_SMETHOD(rsp, handle_play, codecs,
       plop->pname, plop->count, cmd, ptime) != 0) {
         reply_error(cmd, ECODE_PLRFAIL);
-        goto freeplop;
+        return;
     }
     reply_ok(cmd);
-freeplop:
-    rtpp_command_play_opts_free(plop);
 }
@@ -36,6 +36,5 @@ struct rtpp_stream;
 
 struct play_opts *rtpp_command_play_opts_parse(struct rtpp_command *);
 void rtpp_command_play_handle(struct rtpp_stream *, struct rtpp_command *);
-void rtpp_command_play_opts_free(struct play_opts *);
 
 #endif
@@ -29,6 +29,8 @@
 #ifndef _RTPP_COMMAND_PRIVATE_H_
 #define _RTPP_COMMAND_PRIVATE_H_
 
+struct rtpp_cmd_lstats;
+
 struct rtpp_command_stat {
     uint64_t cnt;
     int cnt_idx;
@@ -40,18 +42,38 @@ struct rtpp_command_stats {
     struct rtpp_command_stat ncmds_succd;
     struct rtpp_command_stat ncmds_errs;
     struct rtpp_command_stat ncmds_repld;
+    struct rtpp_command_stat ncmds_allocs;
+    struct rtpp_command_stat ncmds_fwdd;
 
     struct rtpp_command_stat nsess_complete;
     struct rtpp_command_stat nsess_created;
 
     struct rtpp_command_stat nplrs_created;
     struct rtpp_command_stat nplrs_destroyed;
+
+    /* Per-op latency histograms, only touched from the command thread */
+    struct rtpp_cmd_lstats *lstats;
 };
 
+/*
+ * In the memdeb builds ncmds_allocs is taken from the number of blocks that
+ * the command thread has allocated while processing each command, see
+ * rtpp_command_async.c. Otherwise only the allocations made by the command
+ * code itself are accounted for by hand.
+ */
+#if defined(RTPP_CHECK_LEAKS)
+#define RTPC_CNT_ALLOC(csp) ((void)(csp))
+#else
+#define RTPC_CNT_ALLOC(csp) ((csp)->ncmds_allocs.cnt++)
+#endif
+
 #define RTPC_MAX_ARGC   20
 
 enum rtpp_cmd_op {DELETE, RECORD, PLAY, NOPLAY, COPY, UPDATE, LOOKUP, INFO,
-  QUERY, VER_FEATURE, GET_VER, DELETE_ALL, GET_STATS};
+  QUERY, VER_FEATURE, GET_VER, DELETE_ALL, GET_STATS, GET_TIMING,
+  DUMP_SESSIONS};
+
+#define RTPC_NOPS (DUMP_SESSIONS + 1)
 
 struct common_cmd_args {
     enum rtpp_cmd_op op;
@@ -68,6 +90,10 @@ struct common_cmd_args {
     } opts;
 };
 
+/*
+ * The buf and buf_t have to stay first, rtpp_command_ctor() skips them
+ * when recycling command object.
+ */
 struct rtpp_command
 {
     char buf[1024 * 8];
@@ -135,6 +161,7 @@ struct rtpp_command
 #define ECODE_NOMEM_7     87
 #define ECODE_NOMEM_8     88
 
+#define ECODE_WORKERS     98
 #define ECODE_SLOWSHTDN   99
 
 #endif
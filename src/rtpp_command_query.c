@@ -41,6 +41,7 @@
 #include "rtpp_command_private.h"
 #include "rtpp_pcount.h"
 #include "rtpp_pcnt_strm.h"
+#include "rtpp_histogram.h"
 #include "rtpp_pipe.h"
 #include "rtpp_stream.h"
 #include "rtpp_util.h"
@@ -96,15 +97,71 @@ handle_query_simple(struct cfg *cf, struct rtpp_command *cmd,
         pcnt_strm_pulled = 1; \
     }
 
+#define PULL_FWLAT() \
+    if (fwlat_pulled == 0) { \
+        CALL_METHOD(spp->stream[idx]->pcnt_strm, get_fwlat, &fwl[0]); \
+        CALL_METHOD(spp->stream[NOT(idx)]->pcnt_strm, get_fwlat, &fwl[1]); \
+        fwlat_pulled = 1; \
+    }
+
+#define FWLAT_PFX "fwlat_"
+
+/*
+ * Forwarding latency counters are named fwlat_<stat>_ina and
+ * fwlat_<stat>_ino, where <stat> is one of n, avg, p50, p90, p99 or max.
+ * Everything except the sample count is in microseconds.
+ */
+static int
+query_fwlat(const struct rtpp_histogram *fwl, const char *cname,
+  uint64_t *vp)
+{
+    const struct rtpp_histogram *hp;
+    char stat[8];
+    size_t slen;
+
+    cname += sizeof(FWLAT_PFX) - 1;
+    slen = strlen(cname);
+    if (slen < 5 || slen - 4 >= sizeof(stat))
+        return (-1);
+    if (strcmp(cname + slen - 4, "_ina") == 0) {
+        hp = &fwl[0];
+    } else if (strcmp(cname + slen - 4, "_ino") == 0) {
+        hp = &fwl[1];
+    } else {
+        return (-1);
+    }
+    memcpy(stat, cname, slen - 4);
+    stat[slen - 4] = '\0';
+    if (strcmp(stat, "n") == 0) {
+        *vp = hp->nsamples;
+    } else if (strcmp(stat, "avg") == 0) {
+        *vp = (hp->nsamples > 0) ? (uint64_t)(hp->sum / hp->nsamples) : 0;
+    } else if (strcmp(stat, "p50") == 0) {
+        *vp = rtpp_histogram_pctl(hp, 50.0);
+    } else if (strcmp(stat, "p90") == 0) {
+        *vp = rtpp_histogram_pctl(hp, 90.0);
+    } else if (strcmp(stat, "p99") == 0) {
+        *vp = rtpp_histogram_pctl(hp, 99.0);
+    } else if (strcmp(stat, "max") == 0) {
+        *vp = hp->max;
+    } else {
+        return (-1);
+    }
+    return (0);
+}
+
 int
 handle_query(struct cfg *cf, struct rtpp_command *cmd,
   struct rtpp_pipe *spp, int idx)
 {
     int len, i, verbose, rst_pulled, pcnt_pulled, pcnt_strm_pulled;
+    int fwlat_pulled;
     char *cp;
     struct rtpa_stats rst;
     struct rtpps_pcount pcnts;
     struct rtpp_pcnts_strm pst[2];
+    struct rtpp_histogram fwl[2];
+    uint64_t fwlv;
 
     verbose = 0;
     for (cp = cmd->argv[0] + 1; *cp != '\0'; cp++) {
@@ -124,7 +181,7 @@ handle_query(struct cfg *cf, struct rtpp_command *cmd,
         return (handle_query_simple(cf, cmd, spp, idx, verbose));
     }
     len = 0;
-    rst_pulled = pcnt_pulled = pcnt_strm_pulled = 0;
+    rst_pulled = pcnt_pulled = pcnt_strm_pulled = fwlat_pulled = 0;
     for (i = 4; i < cmd->argc && len < (sizeof(cmd->buf_t) - 2); i++) {
         if (i > 4) {
             CHECK_OVERFLOW();
@@ -166,6 +223,18 @@ handle_query(struct cfg *cf, struct rtpp_command *cmd,
               pcnts.ndropped);
             continue;
         }
+        if (strcmp(cmd->argv[i], "nignored") == 0) {
+            PULL_PCNT();
+            len += snprintf(cmd->buf_t + len, sizeof(cmd->buf_t) - len, "%lu",
+              pcnts.nignored);
+            continue;
+        }
+        if (strcmp(cmd->argv[i], "nrlimited") == 0) {
+            PULL_PCNT();
+            len += snprintf(cmd->buf_t + len, sizeof(cmd->buf_t) - len, "%lu",
+              pcnts.nrlimited);
+            continue;
+        }
         if (strcmp(cmd->argv[i], "rtpa_nsent") == 0) {
             PULL_RST();
             len += snprintf(cmd->buf_t + len, sizeof(cmd->buf_t) - len, "%lu",
@@ -196,6 +265,14 @@ handle_query(struct cfg *cf, struct rtpp_command *cmd,
               rst.pecount);
             continue;
         }
+        if (strncmp(cmd->argv[i], FWLAT_PFX, sizeof(FWLAT_PFX) - 1) == 0) {
+            PULL_FWLAT();
+            if (query_fwlat(fwl, cmd->argv[i], &fwlv) == 0) {
+                len += snprintf(cmd->buf_t + len, sizeof(cmd->buf_t) - len,
+                  "%llu", (unsigned long long)fwlv);
+                continue;
+            }
+        }
         RTPP_LOG(spp->log, RTPP_LOG_ERR,
               "QUERY: unsupported/invalid counter name `%s'", cmd->argv[i]);
         return (ECODE_QRYFAIL);
@@ -25,30 +25,78 @@
  *
  */
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "rtpp_types.h"
 #include "rtpp_command_rcache.h"
 #include "rtpp_command_rcache_fin.h"
-#include "rtpp_hash_table.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_refcnt.h"
+#include "rtpp_stats.h"
 #include "rtpp_timed.h"
 
 #define	RTPP_RCACHE_CPERD	3.0
 
+/*
+ * The cache is split into RTPP_RCACHE_NSHARDS independently locked shards,
+ * each holding its entries in a FIFO ring. Since all entries in the cache
+ * have the same TTL, the ring is also sorted by the expiration time, so
+ * that the cleanup only needs to look at the head of each ring.
+ *
+ * Entries are only dropped once expired: when the ring is full and its
+ * head is still live, the ring is doubled in size, up to
+ * RTPP_RCACHE_SHRDMAX entries per shard. That keeps replies for
+ * about 7500 commands per second for the whole TTL; only above that rate
+ * the oldest live entry gets evicted. Replies that do not fit into the
+ * inline buffer are stored in a separate heap copy.
+ */
+#define	RTPP_RCACHE_NSHARDS	16
+#define	RTPP_RCACHE_SHRDCAP	1024
+#define	RTPP_RCACHE_SHRDMAX	(RTPP_RCACHE_SHRDCAP * 16)
+#define	RTPP_RCACHE_DATASZ	320
+
+#define	RCE_NONE		(-1)
+
+struct rtpp_cmd_rcache_entry {
+    uint32_t hash;
+    int next;
+    double etime;
+    unsigned int klen;
+    unsigned int rlen;
+    /* Heap copy of the data, for replies that do not fit inline */
+    char *xdata;
+    /* cookie, '\0', reply, '\0' */
+    char data[RTPP_RCACHE_DATASZ];
+};
+
+#define	RCE_DATA(rep)	((rep)->xdata != NULL ? (rep)->xdata : (rep)->data)
+
+struct rtpp_cmd_rcache_shard {
+    pthread_mutex_t lock;
+    int head;
+    int count;
+    int cap;
+    uint64_t nhits;
+    uint64_t nmisses;
+    uint64_t nevicts;
+    /* cap * 2 buckets */
+    int *buckets;
+    struct rtpp_cmd_rcache_entry *entries;
+};
+
 struct rtpp_cmd_rcache_pvt {
     struct rtpp_cmd_rcache pub;
     double min_ttl;
-    struct rtpp_hash_table *ht;
     struct rtpp_timed_task *timeout;
     int timeout_rval;
-};
-
-struct rtpp_cmd_rcache_entry {
-    char *reply;
-    double etime;
+    struct rtpp_stats *rtpp_stats;
+    int nhits_idx;
+    int nmisses_idx;
+    int nevicts_idx;
+    struct rtpp_cmd_rcache_shard *shards;
 };
 
 static enum rtpp_timed_cb_rvals rtpp_cmd_rcache_cleanup(double, void *);
@@ -60,29 +108,51 @@ static void rtpp_cmd_rcache_dtor(struct rtpp_cmd_rcache_pvt *);
 static void rtpp_cmd_rcache_shutdown(struct rtpp_cmd_rcache *);
 
 struct rtpp_cmd_rcache *
-rtpp_cmd_rcache_ctor(struct rtpp_timed *rtpp_timed_cf, double min_ttl)
+rtpp_cmd_rcache_ctor(struct rtpp_timed *rtpp_timed_cf,
+  struct rtpp_stats *rtpp_stats, double min_ttl)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
+    struct rtpp_cmd_rcache_shard *shp;
     struct rtpp_refcnt *rcnt;
+    int i, j;
 
     pvt = rtpp_rzmalloc(sizeof(struct rtpp_cmd_rcache_pvt), &rcnt);
     if (pvt == NULL) {
         return (NULL);
     }
     pvt->pub.rcnt = rcnt;
-#if !defined(RTPP_DEBUG)
-    pvt->ht = rtpp_hash_table_ctor(rtpp_ht_key_str_t, RTPP_HT_NODUPS);
-#else
-    pvt->ht = rtpp_hash_table_ctor(rtpp_ht_key_str_t, RTPP_HT_NODUPS |
-      RTPP_HT_DUP_ABRT);
-#endif
-    if (pvt->ht == NULL) {
+    pvt->shards = rtpp_zmalloc(sizeof(struct rtpp_cmd_rcache_shard) *
+      RTPP_RCACHE_NSHARDS);
+    if (pvt->shards == NULL) {
         goto e0;
     }
+    for (i = 0; i < RTPP_RCACHE_NSHARDS; i++) {
+        shp = &pvt->shards[i];
+        shp->cap = RTPP_RCACHE_SHRDCAP;
+        shp->entries = malloc(sizeof(shp->entries[0]) * shp->cap);
+        shp->buckets = malloc(sizeof(shp->buckets[0]) * shp->cap * 2);
+        if (shp->entries == NULL || shp->buckets == NULL) {
+            free(shp->entries);
+            free(shp->buckets);
+            goto e1;
+        }
+        if (pthread_mutex_init(&shp->lock, NULL) != 0) {
+            free(shp->entries);
+            free(shp->buckets);
+            goto e1;
+        }
+        for (j = 0; j < shp->cap * 2; j++) {
+            shp->buckets[j] = RCE_NONE;
+        }
+    }
+    pvt->rtpp_stats = rtpp_stats;
+    pvt->nhits_idx = CALL_METHOD(rtpp_stats, getidxbyname, "rcache_hits");
+    pvt->nmisses_idx = CALL_METHOD(rtpp_stats, getidxbyname, "rcache_misses");
+    pvt->nevicts_idx = CALL_METHOD(rtpp_stats, getidxbyname, "rcache_evicts");
     pvt->timeout = CALL_METHOD(rtpp_timed_cf, schedule_rc, RTPP_RCACHE_CPERD,
       pvt->pub.rcnt, rtpp_cmd_rcache_cleanup, NULL, pvt);
     if (pvt->timeout == NULL) {
-        goto e2;
+        goto e1;
     }
     pvt->min_ttl = min_ttl;
     pvt->timeout_rval = CB_MORE;
@@ -93,22 +163,112 @@ rtpp_cmd_rcache_ctor(struct rtpp_timed *rtpp_timed_cf, double min_ttl)
       pvt);
     return (&pvt->pub);
 
-e2:
-    CALL_METHOD(pvt->ht, dtor);
+e1:
+    while (--i >= 0) {
+        pthread_mutex_destroy(&pvt->shards[i].lock);
+        free(pvt->shards[i].entries);
+        free(pvt->shards[i].buckets);
+    }
+    free(pvt->shards);
 e0:
     CALL_SMETHOD(pvt->pub.rcnt, decref);
     free(pvt);
     return (NULL);
 }
 
+static uint32_t
+rtpp_cmd_rcache_hash(const char *cookie, size_t *klenp)
+{
+    const unsigned char *cp;
+    uint32_t hash;
+
+    /* FNV-1a */
+    hash = 2166136261U;
+    for (cp = (const unsigned char *)cookie; *cp != '\0'; cp++) {
+        hash ^= *cp;
+        hash *= 16777619U;
+    }
+    *klenp = (const char *)cp - cookie;
+    return (hash);
+}
+
+#define RCE_SHARD(pvt, hash)	(&(pvt)->shards[(hash) % RTPP_RCACHE_NSHARDS])
+#define RCE_BUCKET(shp, hash)	(((hash) / RTPP_RCACHE_NSHARDS) % ((shp)->cap * 2))
+
+static struct rtpp_cmd_rcache_entry *
+rtpp_cmd_rcache_find(struct rtpp_cmd_rcache_shard *shp, uint32_t hash,
+  const char *cookie, size_t klen)
+{
+    struct rtpp_cmd_rcache_entry *rep;
+    int i;
+
+    for (i = shp->buckets[RCE_BUCKET(shp, hash)]; i != RCE_NONE; i = rep->next) {
+        rep = &shp->entries[i];
+        if (rep->hash == hash && rep->klen == klen &&
+          memcmp(RCE_DATA(rep), cookie, klen) == 0) {
+            return (rep);
+        }
+    }
+    return (NULL);
+}
+
 static void
-rtpp_cmd_rcache_entry_free(void *p)
+rtpp_cmd_rcache_unlink_head(struct rtpp_cmd_rcache_shard *shp)
 {
     struct rtpp_cmd_rcache_entry *rep;
+    int *ip;
+
+    rep = &shp->entries[shp->head];
+    for (ip = &shp->buckets[RCE_BUCKET(shp, rep->hash)]; *ip != shp->head;
+      ip = &shp->entries[*ip].next) {
+        continue;
+    }
+    *ip = rep->next;
+    if (rep->xdata != NULL) {
+        free(rep->xdata);
+        rep->xdata = NULL;
+    }
+    shp->head = (shp->head + 1) % shp->cap;
+    shp->count--;
+}
 
-    rep = (struct rtpp_cmd_rcache_entry *)p;
-    free(rep->reply);
-    free(rep);
+/*
+ * Double the ring, moving live entries to the start of the new one in
+ * the FIFO order and rehashing them into the new bucket array.
+ */
+static int
+rtpp_cmd_rcache_grow(struct rtpp_cmd_rcache_shard *shp)
+{
+    struct rtpp_cmd_rcache_entry *nentries, *rep;
+    int *nbuckets, ncap, i, *ip;
+
+    ncap = shp->cap * 2;
+    nentries = malloc(sizeof(nentries[0]) * ncap);
+    if (nentries == NULL) {
+        return (-1);
+    }
+    nbuckets = malloc(sizeof(nbuckets[0]) * ncap * 2);
+    if (nbuckets == NULL) {
+        free(nentries);
+        return (-1);
+    }
+    for (i = 0; i < ncap * 2; i++) {
+        nbuckets[i] = RCE_NONE;
+    }
+    for (i = 0; i < shp->count; i++) {
+        rep = &nentries[i];
+        memcpy(rep, &shp->entries[(shp->head + i) % shp->cap], sizeof(*rep));
+        ip = &nbuckets[((rep->hash) / RTPP_RCACHE_NSHARDS) % (ncap * 2)];
+        rep->next = *ip;
+        *ip = i;
+    }
+    free(shp->entries);
+    free(shp->buckets);
+    shp->entries = nentries;
+    shp->buckets = nbuckets;
+    shp->cap = ncap;
+    shp->head = 0;
+    return (0);
 }
 
 static void
@@ -116,31 +276,54 @@ rtpp_cmd_rcache_insert(struct rtpp_cmd_rcache *pub, const char *cookie,
   const char *reply, double ctime)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
+    struct rtpp_cmd_rcache_shard *shp;
     struct rtpp_cmd_rcache_entry *rep;
-    struct rtpp_refcnt *rcnt;
+    size_t klen, rlen;
+    uint32_t hash;
+    char *xdata, *dp;
+    int i, *ip;
 
     pvt = (struct rtpp_cmd_rcache_pvt *)pub;
-    rep = rtpp_rzmalloc(sizeof(struct rtpp_cmd_rcache_entry), &rcnt);
-    if (rep == NULL) {
+    hash = rtpp_cmd_rcache_hash(cookie, &klen);
+    rlen = strlen(reply);
+    xdata = NULL;
+    if (klen + rlen + 2 > RTPP_RCACHE_DATASZ) {
+        xdata = malloc(klen + rlen + 2);
+        if (xdata == NULL) {
+            return;
+        }
+    }
+    shp = RCE_SHARD(pvt, hash);
+    pthread_mutex_lock(&shp->lock);
+    if (rtpp_cmd_rcache_find(shp, hash, cookie, klen) != NULL) {
+        pthread_mutex_unlock(&shp->lock);
+        free(xdata);
         return;
     }
-    rep->reply = strdup(reply);
-    if (rep->reply == NULL) {
-        goto e1;
+    if (shp->count == shp->cap) {
+        if (shp->entries[shp->head].etime < ctime) {
+            rtpp_cmd_rcache_unlink_head(shp);
+        } else if (shp->cap >= RTPP_RCACHE_SHRDMAX ||
+          rtpp_cmd_rcache_grow(shp) != 0) {
+            rtpp_cmd_rcache_unlink_head(shp);
+            shp->nevicts++;
+        }
     }
+    i = (shp->head + shp->count) % shp->cap;
+    rep = &shp->entries[i];
+    rep->hash = hash;
     rep->etime = ctime + pvt->min_ttl;
-    CALL_METHOD(pvt->ht, append_refcnt, cookie, rcnt);
-    CALL_SMETHOD(rcnt, attach, rtpp_cmd_rcache_entry_free, rep);
-    /*
-     * append_refcnt() either takes ownership in which case it incs refcount
-     * or it drops the ball in which it does not, so we release rco and set
-     * it free.
-     */
-    CALL_SMETHOD(rcnt, decref);
-    return;
-e1:
-    CALL_SMETHOD(rcnt, decref);
-    free(rep);
+    rep->klen = klen;
+    rep->rlen = rlen;
+    rep->xdata = xdata;
+    dp = RCE_DATA(rep);
+    memcpy(dp, cookie, klen + 1);
+    memcpy(dp + klen + 1, reply, rlen + 1);
+    ip = &shp->buckets[RCE_BUCKET(shp, hash)];
+    rep->next = *ip;
+    *ip = i;
+    shp->count++;
+    pthread_mutex_unlock(&shp->lock);
 }
 
 int
@@ -148,21 +331,24 @@ rtpp_cmd_rcache_lookup(struct rtpp_cmd_rcache *pub, const char *cookie,
   char *rbuf, int rblen)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
+    struct rtpp_cmd_rcache_shard *shp;
     struct rtpp_cmd_rcache_entry *rep;
-    struct rtpp_refcnt *rco;
+    size_t klen;
+    uint32_t hash;
 
     pvt = (struct rtpp_cmd_rcache_pvt *)pub;
-    rco = CALL_METHOD(pvt->ht, find, cookie);
-    if (rco == NULL) {
+    hash = rtpp_cmd_rcache_hash(cookie, &klen);
+    shp = RCE_SHARD(pvt, hash);
+    pthread_mutex_lock(&shp->lock);
+    rep = rtpp_cmd_rcache_find(shp, hash, cookie, klen);
+    if (rep == NULL) {
+        shp->nmisses++;
+        pthread_mutex_unlock(&shp->lock);
         return (0);
     }
-    /*
-     * "find" method returns object that has been incref'ed, so make sure
-     * to decref when we've done with it.
-     */
-    rep = CALL_SMETHOD(rco, getdata);
-    strncpy(rbuf, rep->reply, rblen);
-    CALL_SMETHOD(rco, decref);
+    shp->nhits++;
+    strncpy(rbuf, RCE_DATA(rep) + rep->klen + 1, rblen);
+    pthread_mutex_unlock(&shp->lock);
     return (1);
 }
 
@@ -181,36 +367,53 @@ rtpp_cmd_rcache_shutdown(struct rtpp_cmd_rcache *pub)
 void
 rtpp_cmd_rcache_dtor(struct rtpp_cmd_rcache_pvt *pvt)
 {
+    struct rtpp_cmd_rcache_shard *shp;
+    int i;
 
     rtpp_cmd_rcache_fin(&pvt->pub);
-    CALL_METHOD(pvt->ht, dtor);
+    for (i = 0; i < RTPP_RCACHE_NSHARDS; i++) {
+        shp = &pvt->shards[i];
+        while (shp->count > 0) {
+            rtpp_cmd_rcache_unlink_head(shp);
+        }
+        pthread_mutex_destroy(&shp->lock);
+        free(shp->entries);
+        free(shp->buckets);
+    }
+    free(pvt->shards);
     free(pvt);
 }
 
-static int
-rtpp_cmd_rcache_ematch(void *dp, void *ap)
-{
-    struct rtpp_cmd_rcache_entry *rep;
-    double *ctimep;
-
-    /*
-     * This method does not need us to bump ref, since we are in the
-     * context of the rtpp_hash_table, which hold its own ref.
-     */
-    ctimep = (double *)ap;
-    rep = (struct rtpp_cmd_rcache_entry *)dp;
-    if (rep->etime < *ctimep) {
-        return (RTPP_HT_MATCH_DEL);
-    }
-    return (RTPP_HT_MATCH_CONT);
+#define FLUSH_RCSTAT(pvt, idx, cnt)    { \
+    if ((cnt) > 0) { \
+        CALL_METHOD((pvt)->rtpp_stats, updatebyidx, (idx), (cnt)); \
+    } \
 }
 
 static enum rtpp_timed_cb_rvals
 rtpp_cmd_rcache_cleanup(double ctime, void *p)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
+    struct rtpp_cmd_rcache_shard *shp;
+    uint64_t nhits, nmisses, nevicts;
+    int i;
 
     pvt = (struct rtpp_cmd_rcache_pvt *)p;
-    CALL_METHOD(pvt->ht, foreach, rtpp_cmd_rcache_ematch, &ctime);
+    nhits = nmisses = nevicts = 0;
+    for (i = 0; i < RTPP_RCACHE_NSHARDS; i++) {
+        shp = &pvt->shards[i];
+        pthread_mutex_lock(&shp->lock);
+        while (shp->count > 0 && shp->entries[shp->head].etime < ctime) {
+            rtpp_cmd_rcache_unlink_head(shp);
+        }
+        nhits += shp->nhits;
+        nmisses += shp->nmisses;
+        nevicts += shp->nevicts;
+        shp->nhits = shp->nmisses = shp->nevicts = 0;
+        pthread_mutex_unlock(&shp->lock);
+    }
+    FLUSH_RCSTAT(pvt, pvt->nhits_idx, nhits);
+    FLUSH_RCSTAT(pvt, pvt->nmisses_idx, nmisses);
+    FLUSH_RCSTAT(pvt, pvt->nevicts_idx, nevicts);
     return (pvt->timeout_rval);
 }
@@ -76,14 +76,23 @@ handle_record(struct cfg *cf, struct common_cmd_args *ccap,
   int record_single_file)
 {
     struct record_ematch_arg rea;
+    char fkey[RTPP_SESS_HTKEY_LEN], tkey[RTPP_SESS_HTKEY_LEN];
 
     memset(&rea, '\0', sizeof(rea));
     rea.from_tag = ccap->from_tag;
     rea.to_tag = ccap->to_tag;
     rea.record_single_file = record_single_file;
     rea.cf = cf;
-    CALL_METHOD(cf->stable->sessions_ht, foreach_key, ccap->call_id,
+    rtpp_session_htkey(fkey, sizeof(fkey), ccap->call_id, ccap->from_tag);
+    CALL_METHOD(cf->stable->sessions_ht, foreach_key, fkey,
       rtpp_cmd_record_ematch, &rea);
+    if (ccap->to_tag != NULL) {
+        rtpp_session_htkey(tkey, sizeof(tkey), ccap->call_id, ccap->to_tag);
+        if (strcmp(fkey, tkey) != 0) {
+            CALL_METHOD(cf->stable->sessions_ht, foreach_key, tkey,
+              rtpp_cmd_record_ematch, &rea);
+        }
+    }
     if (rea.nrecorded == 0) {
         return -1;
     }
@@ -29,13 +29,19 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "rtpp_log.h"
 #include "rtpp_command.h"
 #include "rtpp_command_private.h"
+#include "rtpp_histogram.h"
+#include "rtpp_command_stats.h"
 #include "rtpp_types.h"
 #include "rtpp_stats.h"
 #include "rtpp_log_obj.h"
+#if defined(RTPP_CHECK_LEAKS)
+#include "rtpp_memdeb_stats.h"
+#endif
 
 #define CHECK_OVERFLOW() \
     if (len > sizeof(cmd->buf_t) - 2) { \
@@ -44,6 +50,27 @@
         return (ECODE_RTOOBIG_1); \
     }
 
+#if defined(RTPP_CHECK_LEAKS)
+/*
+ * Number and total size of the memory blocks that are currently allocated,
+ * as tracked by the memdeb. Only available in the leak-checking builds, so
+ * that the tests can measure the memory footprint of sessions.
+ */
+static int
+memdeb_nstr(char *buf, int len, const char *name)
+{
+    struct memdeb_stats mds;
+
+    memset(&mds, '\0', sizeof(mds));
+    if (strcmp(name, "md_nunalloc") != 0 && strcmp(name, "md_bunalloc") != 0)
+        return (-1);
+    rtpp_memdeb_get_stats(_rtpproxy_memdeb, NULL, NULL, &mds);
+    if (name[3] == 'n')
+        return (snprintf(buf, len, "%jd", (intmax_t)(mds.nalloc - mds.nfree)));
+    return (snprintf(buf, len, "%jd", (intmax_t)(mds.balloc - mds.bfree)));
+}
+#endif
+
 int
 handle_get_stats(struct rtpp_stats *rsp, struct rtpp_command *cmd, int verbose)
 {
@@ -61,6 +88,11 @@ handle_get_stats(struct rtpp_stats *rsp, struct rtpp_command *cmd, int verbose)
               cmd->argv[i]);
         }
         CHECK_OVERFLOW();
+#if defined(RTPP_CHECK_LEAKS)
+        rval = memdeb_nstr(cmd->buf_t + len, sizeof(cmd->buf_t) - len,
+          cmd->argv[i]);
+        if (rval < 0)
+#endif
         rval = CALL_METHOD(rsp, nstr, cmd->buf_t + len,
           sizeof(cmd->buf_t) - len, cmd->argv[i]);
         if (rval < 0) {
@@ -73,3 +105,66 @@ handle_get_stats(struct rtpp_stats *rsp, struct rtpp_command *cmd, int verbose)
     rtpc_doreply(cmd, cmd->buf_t, len, 0);
     return (0);
 }
+
+static const char *lstat_opnames[RTPC_NOPS] = {
+    [DELETE] = "D", [RECORD] = "R", [PLAY] = "P", [NOPLAY] = "S",
+    [COPY] = "C", [UPDATE] = "U", [LOOKUP] = "L", [INFO] = "I",
+    [QUERY] = "Q", [VER_FEATURE] = "VF", [GET_VER] = "V",
+    [DELETE_ALL] = "X", [GET_STATS] = "G", [GET_TIMING] = "T",
+    [DUMP_SESSIONS] = "J"
+};
+
+static int
+lstat_nstr(char *buf, int len, const char *opname, const char *hname,
+  const struct rtpp_histogram *hp)
+{
+    int rlen;
+
+    rlen = snprintf(buf, len, "%s %s ", opname, hname);
+    if (rlen >= len)
+        return (len);
+    rlen += rtpp_histogram_nstr(hp, buf + rlen, len - rlen);
+    if (rlen >= len - 1)
+        return (len);
+    buf[rlen++] = '\n';
+    return (rlen);
+}
+
+int
+handle_get_timing(struct rtpp_command *cmd, int reset)
+{
+    char buf[1024 * 8];
+    struct rtpp_cmd_lstat *lsp;
+    int len, i;
+
+    len = 0;
+    for (i = 0; i < RTPC_NOPS; i++) {
+        lsp = &cmd->csp->lstats->ops[i];
+        if (lsp->exec.nsamples == 0)
+            continue;
+        if (len + 3 * 128 > sizeof(buf)) {
+            RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
+              "TIMING: output buffer overflow");
+            return (ECODE_RTOOBIG_2);
+        }
+        len += lstat_nstr(buf + len, sizeof(buf) - len, lstat_opnames[i],
+          "parse", &lsp->parse);
+        len += lstat_nstr(buf + len, sizeof(buf) - len, lstat_opnames[i],
+          "glock", &lsp->glock);
+        len += lstat_nstr(buf + len, sizeof(buf) - len, lstat_opnames[i],
+          "exec", &lsp->exec);
+    }
+    if (reset != 0) {
+        for (i = 0; i < RTPC_NOPS; i++) {
+            lsp = &cmd->csp->lstats->ops[i];
+            rtpp_histogram_init(&lsp->parse);
+            rtpp_histogram_init(&lsp->glock);
+            rtpp_histogram_init(&lsp->exec);
+        }
+    }
+    if (len == 0) {
+        len = snprintf(buf, sizeof(buf), "\n");
+    }
+    rtpc_doreply(cmd, buf, len, 0);
+    return (0);
+}
@@ -25,4 +25,18 @@
  *
  */
 
+struct rtpp_stats;
+struct rtpp_command;
+
+struct rtpp_cmd_lstat {
+    struct rtpp_histogram parse;
+    struct rtpp_histogram glock;
+    struct rtpp_histogram exec;
+};
+
+struct rtpp_cmd_lstats {
+    struct rtpp_cmd_lstat ops[RTPC_NOPS];
+};
+
 int handle_get_stats(struct rtpp_stats *, struct rtpp_command *, int);
+int handle_get_timing(struct rtpp_command *, int);
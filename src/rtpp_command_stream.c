@@ -108,7 +108,8 @@ rtpp_command_stream_get(struct cfg *cf, struct rtpp_cmd_connection *rcs,
         return (NULL);
     }
 
-    cmd = rtpp_command_ctor(cf, rcs->controlfd_out, dtime, rval, csp, 0);
+    cmd = rtpp_command_ctor(cf, rcs->controlfd_out, dtime, rval, csp, 0,
+      &rcs->spare_cmd);
     if (cmd == NULL) {
         return (NULL);
     }
@@ -34,6 +34,7 @@ struct rtpp_cmd_connection {
     int inbuf_epos;
     struct sockaddr_storage raddr;
     socklen_t rlen;
+    struct rtpp_command *spare_cmd;
 };
 
 int rtpp_command_stream_doio(struct cfg *cf, struct rtpp_cmd_connection *rcs);
@@ -55,14 +55,11 @@
 #include "rtpp_sessinfo.h"
 #include "rtpp_socket.h"
 #include "rtp_resizer.h"
-#include "rtpp_mallocs.h"
 #include "rtpp_network.h"
 #include "rtpp_tnotify_set.h"
 #include "rtpp_util.h"
 #include "rtpp_ttl.h"
 
-#define FREE_IF_NULL(p)	{if ((p) != NULL) {free(p); (p) = NULL;}}
-
 struct ul_reply {
     struct sockaddr *ia;
     const char *ia_ov;
@@ -79,6 +76,7 @@ struct ul_opts {
     char *addr;
     char *port;
     struct sockaddr *ia[2];
+    struct sockaddr_storage ia_s[2];
     struct sockaddr *lia[2];
 
     struct ul_reply reply;
@@ -129,16 +127,6 @@ ul_opts_init(struct cfg *cf, struct ul_opts *ulop)
     ulop->pf = AF_INET;
 }
 
-void
-rtpp_command_ul_opts_free(struct ul_opts *ulop)
-{
-
-    FREE_IF_NULL(ulop->codecs);
-    FREE_IF_NULL(ulop->ia[0]);
-    FREE_IF_NULL(ulop->ia[1]);
-    free(ulop);
-}
-
 #define	IPSTR_MIN_LENv4	7	/* "1.1.1.1" */
 #define	IPSTR_MAX_LENv4	15	/* "255.255.255.255" */
 #define	IPSTR_MIN_LENv6	2	/* "::" */
@@ -158,10 +146,10 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
     struct sockaddr_storage tia;
     struct ul_opts *ulop;
 
-    ulop = rtpp_zmalloc(sizeof(struct ul_opts));
+    ulop = rtpp_command_alloc(cmd, sizeof(struct ul_opts));
     if (ulop == NULL) {
         reply_error(cmd, ECODE_NOMEM_1);
-        goto err_undo_0;
+        return (NULL);
     }
     ul_opts_init(cf, ulop);
     if (cmd->cca.op == UPDATE && cmd->argc > 6) {
@@ -178,7 +166,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
             RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
               "command syntax error - invalid URL encoding");
             reply_error(cmd, ECODE_PARSE_10);
-            goto err_undo_1;
+            return (NULL);
         }
         ulop->notify_tag[len] = '\0';
     }
@@ -197,7 +185,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
             if (ulop->lidx < 0 || cf->stable->bindaddr[1] == NULL) {
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "command syntax error");
                 reply_error(cmd, ECODE_PARSE_11);
-                goto err_undo_1;
+                return (NULL);
             }
             ulop->lia[ulop->lidx] = cf->stable->bindaddr[1];
             ulop->lidx--;
@@ -208,7 +196,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
             if (ulop->lidx < 0 || cf->stable->bindaddr[1] == NULL) {
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "command syntax error");
                 reply_error(cmd, ECODE_PARSE_12);
-                goto err_undo_1;
+                return (NULL);
             }
             ulop->lia[ulop->lidx] = cf->stable->bindaddr[0];
             ulop->lidx--;
@@ -234,7 +222,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
             if (ulop->requested_ptime <= 0) {
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "command syntax error");
                 reply_error(cmd, ECODE_PARSE_13);
-                goto err_undo_1;
+                return (NULL);
             }
             cp--;
             break;
@@ -249,12 +237,12 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
             if (t == cp) {
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "command syntax error");
                 reply_error(cmd, ECODE_PARSE_14);
-                goto err_undo_1;
+                return (NULL);
             }
-            ulop->codecs = malloc(cp - t + 1);
+            ulop->codecs = rtpp_command_alloc(cmd, cp - t + 1);
             if (ulop->codecs == NULL) {
                 reply_error(cmd, ECODE_NOMEM_2);
-                goto err_undo_1;
+                return (NULL);
             }
             memcpy(ulop->codecs, t, cp - t);
             ulop->codecs[cp - t] = '\0';
@@ -267,7 +255,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
             if (len == -1) {
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "command syntax error");
                 reply_error(cmd, ECODE_PARSE_15);
-                goto err_undo_1;
+                return (NULL);
             }
             c = t[len];
             t[len] = '\0';
@@ -276,7 +264,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
                   "invalid local address: %s: %s", t, errmsg);
                 reply_error(cmd, ECODE_INVLARG_1);
-                goto err_undo_1;
+                return (NULL);
             }
             t[len] = c;
             cp--;
@@ -288,7 +276,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
             if (len == -1) {
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "command syntax error");
                 reply_error(cmd, ECODE_PARSE_16);
-                goto err_undo_1;
+                return (NULL);
             }
             c = t[len];
             t[len] = '\0';
@@ -298,20 +286,20 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
                   "invalid remote address: %s: %s", t, gai_strerror(n));
                 reply_error(cmd, ECODE_INVLARG_2);
-                goto err_undo_1;
+                return (NULL);
             }
             if (local4remote(ulop->local_addr, satoss(ulop->local_addr)) == -1) {
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
                   "can't find local address for remote address: %s", t);
                 reply_error(cmd, ECODE_INVLARG_3);
-                goto err_undo_1;
+                return (NULL);
             }
             ulop->local_addr = addr2bindaddr(cf, ulop->local_addr, &errmsg);
             if (ulop->local_addr == NULL) {
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
                   "invalid local address: %s", errmsg);
                 reply_error(cmd, ECODE_INVLARG_4);
-                goto err_undo_1;
+                return (NULL);
             }
             t[len] = c;
             cp--;
@@ -329,7 +317,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
             if (n <= 0) {
                 RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "command syntax error");
                 reply_error(cmd, ECODE_PARSE_13);
-                goto err_undo_1;
+                return (NULL);
             }
             if (c == 't')
                 ulop->requested_sttl = n;
@@ -356,7 +344,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
             RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "cannot match local "
               "address for the %s session", AF2STR(ulop->pf));
             reply_error(cmd, ECODE_INVLARG_6);
-            goto err_undo_1;
+            return (NULL);
         }
     }
     if (ulop->addr != NULL && ulop->port != NULL && IS_IPSTR_VALID(ulop->addr, ulop->pf)) {
@@ -364,11 +352,7 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
         if (n == 0) {
             if (!ishostnull(sstosa(&tia))) {
                 for (i = 0; i < 2; i++) {
-                    ulop->ia[i] = malloc(SS_LEN(&tia));
-                    if (ulop->ia[i] == NULL) {
-                        reply_error(cmd, ECODE_NOMEM_3);
-                        goto err_undo_1;
-                    }
+                    ulop->ia[i] = sstosa(&ulop->ia_s[i]);
                     memcpy(ulop->ia[i], &tia, SS_LEN(&tia));
                 }
                 /* Set port for RTCP, will work both for IPv4 and IPv6 */
@@ -383,11 +367,6 @@ rtpp_command_ul_opts_parse(struct cfg *cf, struct rtpp_command *cmd)
         }
     }
     return (ulop);
-
-err_undo_1:
-    rtpp_command_ul_opts_free(ulop);
-err_undo_0:
-    return (NULL);
 }
 
 static void
@@ -395,7 +374,6 @@ handle_nomem(struct rtpp_command *cmd, int ecode, struct rtpp_session *spa)
 {
 
     RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "can't allocate memory");
-    rtpp_command_ul_opts_free(cmd->cca.opts.ul);
     if (spa != NULL) {
         CALL_SMETHOD(spa->rcnt, decref);
     }
@@ -411,6 +389,7 @@ rtpp_command_ul_handle(struct cfg *cf, struct rtpp_command *cmd, int sidx)
     struct rtpp_session *spa, *spb;
     struct rtpp_socket *fd;
     struct ul_opts *ulop;
+    char htkey[RTPP_SESS_HTKEY_LEN];
 
     pidx = 1;
     lport = 0;
@@ -521,14 +500,15 @@ rtpp_command_ul_handle(struct cfg *cf, struct rtpp_command *cmd, int sidx)
             return (-1);
         }
 
-        hte = CALL_METHOD(cf->stable->sessions_ht, append_refcnt, spa->call_id,
+        rtpp_session_htkey(htkey, sizeof(htkey), spa->call_id, spa->tag);
+        hte = CALL_METHOD(cf->stable->sessions_ht, append_refcnt, htkey,
           spa->rcnt);
         if (hte == NULL) {
             handle_nomem(cmd, ECODE_NOMEM_5, spa);
             return (-1);
         }
         if (CALL_METHOD(cf->stable->sessions_wrt, reg, spa->rcnt, spa->seuid) != 0) {
-            CALL_METHOD(cf->stable->sessions_ht, remove, spa->call_id, hte);
+            CALL_METHOD(cf->stable->sessions_ht, remove, htkey, hte);
             handle_nomem(cmd, ECODE_NOMEM_8, spa);
             return (-1);
         }
@@ -569,7 +549,8 @@ rtpp_command_ul_handle(struct cfg *cf, struct rtpp_command *cmd, int sidx)
     if (cmd->cca.op == UPDATE) {
         if (!CALL_METHOD(cf->stable->rtpp_tnset_cf, isenabled) && ulop->notify_socket != NULL)
             RTPP_LOG(spa->log, RTPP_LOG_ERR, "must permit notification socket with -n");
-        if (spa->timeout_data.notify_tag != NULL) {
+        if (spa->timeout_data.notify_tag != NULL && (ulop->notify_socket == NULL ||
+          strcmp(spa->timeout_data.notify_tag, ulop->notify_tag) != 0)) {
             free(spa->timeout_data.notify_tag);
             spa->timeout_data.notify_tag = NULL;
         }
@@ -584,7 +565,15 @@ rtpp_command_ul_handle(struct cfg *cf, struct rtpp_command *cmd, int sidx)
             } else {
                 RTPP_LOG(spa->log, RTPP_LOG_INFO, "setting timeout handler");
                 spa->timeout_data.notify_target = rttp;
-                spa->timeout_data.notify_tag = strdup(ulop->notify_tag);
+                if (spa->timeout_data.notify_tag == NULL) {
+                    spa->timeout_data.notify_tag = strdup(ulop->notify_tag);
+                    if (spa->timeout_data.notify_tag == NULL) {
+                        spa->timeout_data.notify_target = NULL;
+                        handle_nomem(cmd, ECODE_NOMEM_6, NULL);
+                        goto err_undo_0;
+                    }
+                    RTPC_CNT_ALLOC(cmd->csp);
+                }
             }
         } else if (spa->timeout_data.notify_target != NULL) {
             spa->timeout_data.notify_target = NULL;
@@ -607,13 +596,18 @@ rtpp_command_ul_handle(struct cfg *cf, struct rtpp_command *cmd, int sidx)
         CALL_SMETHOD(spa->rtp->stream[pidx], locklatch);
         CALL_SMETHOD(spa->rtcp->stream[pidx], locklatch);
     }
-    if (spa->rtp->stream[pidx]->codecs != NULL) {
+    if (spa->rtp->stream[pidx]->codecs != NULL && (ulop->codecs == NULL ||
+      strcmp(spa->rtp->stream[pidx]->codecs, ulop->codecs) != 0)) {
         free(spa->rtp->stream[pidx]->codecs);
         spa->rtp->stream[pidx]->codecs = NULL;
     }
-    if (ulop->codecs != NULL) {
-        spa->rtp->stream[pidx]->codecs = ulop->codecs;
-        ulop->codecs = NULL;
+    if (ulop->codecs != NULL && spa->rtp->stream[pidx]->codecs == NULL) {
+        spa->rtp->stream[pidx]->codecs = strdup(ulop->codecs);
+        if (spa->rtp->stream[pidx]->codecs == NULL) {
+            handle_nomem(cmd, ECODE_NOMEM_7, NULL);
+            goto err_undo_0;
+        }
+        RTPC_CNT_ALLOC(cmd->csp);
     }
     spa->rtp->stream[NOT(pidx)]->ptime = ulop->requested_ptime;
     actor = CALL_SMETHOD(spa->rtp->stream[pidx], get_actor);
@@ -647,10 +641,8 @@ rtpp_command_ul_handle(struct cfg *cf, struct rtpp_command *cmd, int sidx)
         }
     }
     ul_reply_port(cmd, &ulop->reply);
-    rtpp_command_ul_opts_free(ulop);
     return (0);
 
 err_undo_0:
-    rtpp_command_ul_opts_free(ulop);
     return (-1);
 }
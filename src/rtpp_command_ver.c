@@ -61,6 +61,12 @@ static struct proto_cap proto_caps[] = {
     { "20150420", "Support for SEQ tracking and new rtpa_ counters; Q command extended" },
     { "20150617", "Support for the wildcard %%CC_SELF%% as a disconnect notify target" },
     { "20170313", "Support for changing session's ttl" },
+    { "20261019", "Support for per-command latency histograms (\"T\" command)" },
+    { "20261020", "Support for RTP loop timing histograms (\"It\" command)" },
+    { "20261021", "Support for bulk session dump (\"J\" command)" },
+    { "20261022", "Support for forwarding latency counters (\"fwlat_*\" in \"Q\" command)" },
+    { "20261023", "Support for thread CPU affinity report (\"Ia\" command)" },
+    { "20261024", "Support for unlatched stream rate limiting (\"nignored\"/\"nrlimited\" in \"Q\" command)" },
     { NULL, NULL }
 };
 
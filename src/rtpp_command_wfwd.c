@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtpp_types.h"
+#include "rtpp_list.h"
+#include "rtpp_log.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_log_obj.h"
+#include "rtpp_controlfd.h"
+#include "rtpp_command_wfwd.h"
+#include "rtpp_network.h"
+
+#include "config_pp.h"
+
+#if !defined(NO_ERR_H)
+#include <err.h>
+#endif
+
+#define RTPP_WFWD_MAGIC 0x52574644    /* "RWFD" */
+
+/* Prepended to each command forwarded between the workers */
+struct rtpp_wfwd_hdr {
+    uint32_t magic;
+    uint32_t rlen;
+    uint32_t flags;
+    struct sockaddr_storage raddr;
+};
+
+/*
+ * Worker N listens for the forwarded commands on the loopback at the port
+ * number N + 1 above the UDP control port it shares with the other workers.
+ */
+static int
+rtpp_wfwd_addr(struct rtpp_ctrl_sock *ucsp, int widx, struct sockaddr_storage *sp)
+{
+    int port;
+
+    port = ucsp->port_ctl + 1 + widx;
+    if (!IS_VALID_PORT(port))
+        return (-1);
+    memset(sp, '\0', sizeof(*sp));
+    if (ucsp->type == RTPC_UDP6) {
+        satosin6(sp)->sin6_family = AF_INET6;
+        satosin6(sp)->sin6_addr = in6addr_loopback;
+        satosin6(sp)->sin6_port = htons(port);
+    } else {
+        satosin(sp)->sin_family = AF_INET;
+        satosin(sp)->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        satosin(sp)->sin_port = htons(port);
+    }
+    return (port);
+}
+
+int
+rtpp_wfwd_init(struct rtpp_cfg_stable *cfs, struct rtpp_ctrl_sock *csp)
+{
+    struct rtpp_ctrl_sock *ucsp;
+    int controlfd;
+
+    ucsp = csp->wfwd_pair;
+    csp->port_ctl = rtpp_wfwd_addr(ucsp, cfs->worker_id, &csp->bindaddr);
+    if (csp->port_ctl < 0)
+        errx(1, "%s: no room for the worker forwarding port above the "
+          "control port %d", ucsp->cmd_sock, ucsp->port_ctl);
+    controlfd = socket(sstosa(&csp->bindaddr)->sa_family, SOCK_DGRAM, 0);
+    if (controlfd == -1)
+        err(1, "can't create socket");
+    if (bind(controlfd, sstosa(&csp->bindaddr), SA_LEN(sstosa(&csp->bindaddr))) < 0)
+        err(1, "can't bind to a worker forwarding port %d", csp->port_ctl);
+
+    return (controlfd);
+}
+
+/*
+ * Work out which worker the command in the buf belongs to, by the hash of
+ * its call-id. Returns RTPP_WFWD_LOCAL if the command should be handled
+ * locally, either because it is ours or because it's not specific to any
+ * worker (V). Commands that act on all sessions (X) are handled locally
+ * and then broadcast to everyone else (RTPP_WFWD_BCAST). Commands that
+ * report on all sessions or on the process as a whole (I, G, T, J) can't
+ * be answered by a single worker, so those are refused (RTPP_WFWD_REFUSE)
+ * rather than silently giving out a partial picture. Only the cookie, the
+ * command and the call-id are looked at, the rest is left to the owner's
+ * parser.
+ */
+int
+rtpp_wfwd_owner(struct rtpp_cfg_stable *cfs, const char *buf, size_t len)
+{
+    static const char cmds_with_cid[] = "UuLlDdPpRrCcSsQq";
+    static const char cmds_bcast[] = "Xx";
+    static const char cmds_refuse[] = "IiGgTtJj";
+    const char *cp, *ep, *tp[3];
+    size_t tl[3];
+    uint32_t h;
+    int i, owner;
+
+    cp = buf;
+    ep = buf + len;
+    for (i = 0; i < 3; i++) {
+        while (cp < ep && strchr("\r\n\t ", *cp) != NULL && *cp != '\0')
+            cp++;
+        if (cp == ep || *cp == '\0')
+            break;
+        tp[i] = cp;
+        while (cp < ep && strchr("\r\n\t ", *cp) == NULL)
+            cp++;
+        tl[i] = cp - tp[i];
+    }
+    if (i < 2)
+        return (RTPP_WFWD_LOCAL);
+    if (memchr(cmds_bcast, tp[1][0], sizeof(cmds_bcast) - 1) != NULL)
+        return (RTPP_WFWD_BCAST);
+    if (memchr(cmds_refuse, tp[1][0], sizeof(cmds_refuse) - 1) != NULL)
+        return (RTPP_WFWD_REFUSE);
+    if (i < 3 || memchr(cmds_with_cid, tp[1][0], sizeof(cmds_with_cid) - 1) == NULL)
+        return (RTPP_WFWD_LOCAL);
+    /* FNV-1a, has to give the same answer in every worker */
+    h = 2166136261U;
+    for (i = 0; i < tl[2]; i++) {
+        h ^= (uint8_t)tp[2][i];
+        h *= 16777619U;
+    }
+    owner = h % cfs->nworkers;
+    return ((owner == cfs->worker_id) ? RTPP_WFWD_LOCAL : owner);
+}
+
+int
+rtpp_wfwd_send(struct rtpp_cfg_stable *cfs, struct rtpp_ctrl_sock *ucsp,
+  int owner, const char *buf, size_t len, const struct sockaddr *raddr,
+  socklen_t rlen, int flags)
+{
+    struct rtpp_wfwd_hdr hdr;
+    struct sockaddr_storage paddr;
+    struct iovec v[2];
+    struct msghdr mh;
+
+    if (rlen > sizeof(hdr.raddr) || rtpp_wfwd_addr(ucsp, owner, &paddr) < 0)
+        return (-1);
+    memset(&hdr, '\0', sizeof(hdr));
+    hdr.magic = RTPP_WFWD_MAGIC;
+    hdr.rlen = rlen;
+    hdr.flags = flags;
+    memcpy(&hdr.raddr, raddr, rlen);
+    v[0].iov_base = &hdr;
+    v[0].iov_len = sizeof(hdr);
+    v[1].iov_base = (void *)buf;
+    v[1].iov_len = len;
+    memset(&mh, '\0', sizeof(mh));
+    mh.msg_name = &paddr;
+    mh.msg_namelen = SA_LEN(sstosa(&paddr));
+    mh.msg_iov = v;
+    mh.msg_iovlen = 2;
+    if (sendmsg(ucsp->wfwd_pair->controlfd_in, &mh, 0) < 0)
+        return (-1);
+    return (0);
+}
+
+/*
+ * Forwarded commands are only accepted from the forwarding sockets of the
+ * other workers, i.e. from the loopback address at one of the ports right
+ * above the shared control port. Those are bound by the workers and can't
+ * come from off the box, so anything else is treated as an attempt to
+ * inject commands with a spoofed client address and dropped.
+ */
+static int
+rtpp_wfwd_peer_ok(struct rtpp_cfg_stable *cfs, struct rtpp_ctrl_sock *ucsp,
+  const struct sockaddr_storage *saddr, socklen_t slen)
+{
+    struct sockaddr_storage paddr;
+    int widx;
+
+    if (slen == 0 || slen > sizeof(*saddr))
+        return (0);
+    if (sstosa(saddr)->sa_family != sstosa(&ucsp->bindaddr)->sa_family)
+        return (0);
+    widx = (int)getport(sstosa(saddr)) - ucsp->port_ctl - 1;
+    if (widx < 0 || widx >= cfs->nworkers || widx == cfs->worker_id)
+        return (0);
+    if (rtpp_wfwd_addr(ucsp, widx, &paddr) < 0)
+        return (0);
+    return (isaddrseq(sstosa(saddr), sstosa(&paddr)));
+}
+
+/*
+ * Receive a command forwarded by another worker into the buf, with the
+ * address of the client that has originally sent it into the raddr and
+ * the RTPP_WFWD_F_* flags into the flagsp. Returns length of the command,
+ * or -1 on error, with errno set to EAGAIN if the datagram has been
+ * malformed or has not come from one of the workers and got discarded.
+ */
+int
+rtpp_wfwd_recv(struct rtpp_cfg_stable *cfs, struct rtpp_ctrl_sock *csp,
+  int controlfd, char *buf, size_t blen, struct sockaddr_storage *raddr,
+  socklen_t *rlen, int *flagsp)
+{
+    struct rtpp_wfwd_hdr hdr;
+    struct sockaddr_storage saddr;
+    struct iovec v[2];
+    struct msghdr mh;
+    ssize_t len;
+
+    v[0].iov_base = &hdr;
+    v[0].iov_len = sizeof(hdr);
+    v[1].iov_base = buf;
+    v[1].iov_len = blen;
+    memset(&mh, '\0', sizeof(mh));
+    mh.msg_name = &saddr;
+    mh.msg_namelen = sizeof(saddr);
+    mh.msg_iov = v;
+    mh.msg_iovlen = 2;
+    len = recvmsg(controlfd, &mh, 0);
+    if (len < 0)
+        return (-1);
+    if (!rtpp_wfwd_peer_ok(cfs, csp->wfwd_pair, &saddr, mh.msg_namelen)) {
+        RTPP_LOG(cfs->glog, RTPP_LOG_ERR, "%s: discarding forwarded command "
+          "that has not come from a worker", csp->cmd_sock);
+        errno = EAGAIN;
+        return (-1);
+    }
+    if (len < sizeof(hdr) || hdr.magic != RTPP_WFWD_MAGIC ||
+      hdr.rlen > sizeof(hdr.raddr)) {
+        errno = EAGAIN;
+        return (-1);
+    }
+    memcpy(raddr, &hdr.raddr, hdr.rlen);
+    *rlen = hdr.rlen;
+    *flagsp = hdr.flags;
+    return (len - sizeof(hdr));
+}
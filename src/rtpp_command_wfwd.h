@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_COMMAND_WFWD_H_
+#define _RTPP_COMMAND_WFWD_H_
+
+/*
+ * Support for running several rtpproxy processes ("workers") behind the
+ * same UDP control port bound with SO_REUSEPORT. Each worker owns a
+ * share of call-ids and a slice of the RTP port range. A command that
+ * the kernel hands to a worker not owning its call-id is passed to the
+ * owner over the loopback, and the owner replies to the client via its
+ * own copy of the shared control socket. X is executed by every worker,
+ * while I, G, T and J are refused with E98 since none of the workers has
+ * the complete picture.
+ */
+
+/* rtpp_wfwd_owner() return values other than the index of the owner */
+#define RTPP_WFWD_LOCAL		(-1)
+#define RTPP_WFWD_BCAST		(-2)
+#define RTPP_WFWD_REFUSE	(-3)
+
+/* The command is to be executed, but the client is not to be replied to */
+#define RTPP_WFWD_F_NOREPLY	0x1
+
+struct rtpp_cfg_stable;
+struct rtpp_ctrl_sock;
+struct sockaddr;
+struct sockaddr_storage;
+
+int rtpp_wfwd_init(struct rtpp_cfg_stable *, struct rtpp_ctrl_sock *);
+int rtpp_wfwd_owner(struct rtpp_cfg_stable *, const char *, size_t);
+int rtpp_wfwd_send(struct rtpp_cfg_stable *, struct rtpp_ctrl_sock *, int,
+  const char *, size_t, const struct sockaddr *, socklen_t, int);
+int rtpp_wfwd_recv(struct rtpp_cfg_stable *, struct rtpp_ctrl_sock *, int,
+  char *, size_t, struct sockaddr_storage *, socklen_t *, int *);
+
+#endif
@@ -44,6 +44,7 @@
 #include "rtpp_log_obj.h"
 #include "rtpp_cfg_stable.h"
 #include "rtpp_controlfd.h"
+#include "rtpp_command_wfwd.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_network.h"
 
@@ -136,6 +137,15 @@ controlfd_init_udp(struct cfg *cf, struct rtpp_ctrl_sock *csp)
     so_rcvbuf = 16 * 1024;
     if (setsockopt(controlfd, SOL_SOCKET, SO_RCVBUF, &so_rcvbuf, sizeof(so_rcvbuf)) == -1)
         RTPP_ELOG(cf->stable->glog, RTPP_LOG_ERR, "unable to set 16K receive buffer size on controlfd");
+    if (cf->stable->nworkers > 1) {
+#if defined(SO_REUSEPORT)
+        i = 1;
+        if (setsockopt(controlfd, SOL_SOCKET, SO_REUSEPORT, &i, sizeof(i)) == -1)
+            err(1, "can't set SO_REUSEPORT on the control socket");
+#else
+        errx(1, "SO_REUSEPORT is not supported on this system");
+#endif
+    }
     if (bind(controlfd, ifsin, SA_LEN(ifsin)) < 0)
         err(1, "can't bind to a socket");
 
@@ -207,6 +217,12 @@ rtpp_controlfd_init(struct cfg *cf)
             controlfd_in = fileno(stdin);
             controlfd_out = fileno(stdout);
             break;
+
+        case RTPC_WFWD:
+            /* Replies go out via the shared UDP socket, it's set up by now */
+            controlfd_in = rtpp_wfwd_init(cf->stable, ctrl_sock);
+            controlfd_out = ctrl_sock->wfwd_pair->controlfd_out;
+            break;
         }
         if (controlfd_in < 0 || controlfd_out < 0) {
             return (-1);
@@ -237,6 +253,9 @@ rtpp_csock_addrlen(struct rtpp_ctrl_sock *ctrl_sock)
     case RTPC_TCP6:
         return (sizeof(struct sockaddr_in6));
 
+    case RTPC_WFWD:
+        return (rtpp_csock_addrlen(ctrl_sock->wfwd_pair));
+
     default:
         break;
     }
@@ -330,6 +349,9 @@ rtpp_ctrl_sock_describe(struct rtpp_ctrl_sock *rcsp)
     case RTPC_TCP6:
         return "tcp6";
 
+    case RTPC_WFWD:
+        return "wfwd";
+
     default:
         abort();
     }
@@ -26,8 +26,10 @@
  *
  */
 
+struct cfg;
+
 enum rtpp_ctrl_type {RTPC_IFSUN, RTPC_UDP4, RTPC_UDP6, RTPC_SYSD, RTPC_STDIO,
-  RTPC_IFSUN_C, RTPC_TCP4, RTPC_TCP6};
+  RTPC_IFSUN_C, RTPC_TCP4, RTPC_TCP6, RTPC_WFWD};
 
 struct rtpp_ctrl_sock {
     struct rtpp_type_linkable t;
@@ -38,9 +40,15 @@ struct rtpp_ctrl_sock {
     int port_ctl;                   /* Port number for UDP control, 0 for Unix domain */
     int exit_on_close;
     struct sockaddr_storage bindaddr;
+    /*
+     * In the multi-worker mode each UDP control socket is paired with
+     * a RTPC_WFWD one, that receives commands forwarded by other workers.
+     */
+    struct rtpp_ctrl_sock *wfwd_pair;
 };
 
-#define RTPP_CTRL_ISDG(rcsp) ((rcsp)->type == RTPC_UDP4 || (rcsp)->type == RTPC_UDP6)
+#define RTPP_CTRL_ISDG(rcsp) ((rcsp)->type == RTPC_UDP4 || (rcsp)->type == RTPC_UDP6 \
+  || (rcsp)->type == RTPC_WFWD)
 #define RTPP_CTRL_ISUNIX(rcsp) ((rcsp)->type == RTPC_IFSUN || (rcsp)->type == RTPC_IFSUN_C)
 #define RTPP_CTRL_ISSTREAM(rcsp) ((rcsp)->type == RTPC_IFSUN_C || (rcsp)->type == RTPC_STDIO \
   || (rcsp)->type == RTPC_TCP4 || (rcsp)->type == RTPC_TCP6)
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#if defined(LINUX_XXX) && !defined(_GNU_SOURCE)
+/* Needed for the CPU_SET(3) and pthread_setaffinity_np(3) */
+#define _GNU_SOURCE
+#endif
+
+#include <sys/types.h>
+#if defined(__FreeBSD__)
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#include <pthread_np.h>
+#endif
+#if defined(__linux__)
+#include <dirent.h>
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtpp_cpuset.h"
+
+#if defined(__FreeBSD__)
+typedef cpuset_t rtpp_cpu_set_t;
+#define RTPP_HAVE_AFFINITY 1
+#elif defined(__linux__)
+typedef cpu_set_t rtpp_cpu_set_t;
+#define RTPP_HAVE_AFFINITY 1
+#endif
+
+#define RTPP_CPUSET_MAXNODES 64
+
+struct rtpp_cpuset_class {
+    const char *name;
+#if defined(RTPP_HAVE_AFFINITY)
+    int configured;
+    rtpp_cpu_set_t set;
+    uint64_t nodes;
+    unsigned int nbound;
+    unsigned int nfailed;
+#endif
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct rtpp_cpuset_class cls[RTPP_THR_NCLASSES];
+} rtpp_cpusets = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cls = {
+        [RTPP_THR_RTP] = {.name = "rtp"},
+        [RTPP_THR_NET] = {.name = "net"},
+        [RTPP_THR_CMD] = {.name = "cmd"},
+        [RTPP_THR_TIMED] = {.name = "timed"},
+        [RTPP_THR_NOTIFY] = {.name = "notify"},
+        [RTPP_THR_SYSLOG] = {.name = "syslog"},
+        [RTPP_THR_MODULE] = {.name = "module"}
+    }
+};
+
+#if defined(RTPP_HAVE_AFFINITY)
+static int
+rtpp_cpuset_parse_list(const char *cp, rtpp_cpu_set_t *setp)
+{
+    unsigned long lo, hi, i;
+    char *ep;
+
+    CPU_ZERO(setp);
+    for (;;) {
+        lo = strtoul(cp, &ep, 10);
+        if (ep == cp)
+            return (-1);
+        hi = lo;
+        if (*ep == '-') {
+            cp = ep + 1;
+            hi = strtoul(cp, &ep, 10);
+            if (ep == cp)
+                return (-1);
+        }
+        if (lo > hi || hi >= CPU_SETSIZE)
+            return (-1);
+        for (i = lo; i <= hi; i++)
+            CPU_SET(i, setp);
+        if (*ep == '\0')
+            break;
+        if (*ep != ',')
+            return (-1);
+        cp = ep + 1;
+    }
+    return (0);
+}
+
+static int
+rtpp_cpuset_fmt(char *buf, size_t blen, const rtpp_cpu_set_t *setp)
+{
+    int i, j, len;
+    const char *sep;
+
+    len = 0;
+    sep = "";
+    buf[0] = '\0';
+    for (i = 0; i < CPU_SETSIZE && len < (int)blen; i++) {
+        if (!CPU_ISSET(i, setp))
+            continue;
+        for (j = i; j + 1 < CPU_SETSIZE && CPU_ISSET(j + 1, setp); j++)
+            continue;
+        if (j == i) {
+            len += snprintf(buf + len, blen - len, "%s%d", sep, i);
+        } else {
+            len += snprintf(buf + len, blen - len, "%s%d-%d", sep, i, j);
+        }
+        sep = ",";
+        i = j;
+    }
+    return (len < (int)blen ? len : (int)blen - 1);
+}
+
+/*
+ * Find out which NUMA nodes the CPUs in the set belong to, only used for
+ * reporting. Returns 0 if the topology is not known.
+ */
+static uint64_t
+rtpp_cpuset_nodes(const rtpp_cpu_set_t *setp)
+{
+    uint64_t nodes;
+#if defined(__linux__)
+    char path[64];
+    DIR *dp;
+    struct dirent *dep;
+    unsigned long node;
+    char *ep;
+    int i;
+
+    nodes = 0;
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (!CPU_ISSET(i, setp))
+            continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", i);
+        dp = opendir(path);
+        if (dp == NULL)
+            continue;
+        while ((dep = readdir(dp)) != NULL) {
+            if (strncmp(dep->d_name, "node", 4) != 0)
+                continue;
+            node = strtoul(dep->d_name + 4, &ep, 10);
+            if (ep == dep->d_name + 4 || *ep != '\0' ||
+              node >= RTPP_CPUSET_MAXNODES)
+                continue;
+            nodes |= (uint64_t)1 << node;
+        }
+        closedir(dp);
+    }
+#else
+    nodes = 0;
+#endif
+    return (nodes);
+}
+
+static int
+rtpp_cpuset_getproc(rtpp_cpu_set_t *setp)
+{
+
+#if defined(__FreeBSD__)
+    return (cpuset_getaffinity(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1,
+      sizeof(*setp), setp));
+#else
+    return (sched_getaffinity(0, sizeof(*setp), setp));
+#endif
+}
+#endif
+
+int
+rtpp_cpuset_parse(const char *spec)
+{
+#if defined(RTPP_HAVE_AFFINITY)
+    rtpp_cpu_set_t set, pset;
+    const char *cp;
+    size_t nlen;
+    int i, all;
+    uint64_t nodes;
+
+    cp = strchr(spec, ':');
+    if (cp == NULL || rtpp_cpuset_parse_list(cp + 1, &set) != 0)
+        return (-1);
+    /* Refuse sets that no thread would be allowed to run on */
+    if (rtpp_cpuset_getproc(&pset) == 0) {
+        for (i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &set) && CPU_ISSET(i, &pset))
+                break;
+        }
+        if (i == CPU_SETSIZE)
+            return (-1);
+    }
+    nlen = cp - spec;
+    all = (nlen == 3 && strncmp(spec, "all", nlen) == 0);
+    nodes = rtpp_cpuset_nodes(&set);
+    for (i = 0; i < RTPP_THR_NCLASSES; i++) {
+        if (!all && (strlen(rtpp_cpusets.cls[i].name) != nlen ||
+          strncmp(spec, rtpp_cpusets.cls[i].name, nlen) != 0))
+            continue;
+        rtpp_cpusets.cls[i].set = set;
+        rtpp_cpusets.cls[i].nodes = nodes;
+        rtpp_cpusets.cls[i].configured = 1;
+        if (!all)
+            return (0);
+    }
+    return (all ? 0 : -1);
+#else
+    return (-1);
+#endif
+}
+
+void
+rtpp_cpuset_bind(enum rtpp_thr_class tclass)
+{
+#if defined(RTPP_HAVE_AFFINITY)
+    struct rtpp_cpuset_class *cp;
+    int r;
+
+    cp = &rtpp_cpusets.cls[tclass];
+    if (cp->configured == 0)
+        return;
+    r = pthread_setaffinity_np(pthread_self(), sizeof(cp->set), &cp->set);
+    pthread_mutex_lock(&rtpp_cpusets.lock);
+    if (r == 0) {
+        cp->nbound += 1;
+    } else {
+        cp->nfailed += 1;
+    }
+    pthread_mutex_unlock(&rtpp_cpusets.lock);
+#endif
+}
+
+int
+rtpp_cpuset_info(char *buf, size_t blen, int all)
+{
+    int i, len;
+#if defined(RTPP_HAVE_AFFINITY)
+    struct rtpp_cpuset_class *cp;
+    rtpp_cpu_set_t pset;
+    char sbuf[256], nbuf[256];
+    unsigned int nbound, nfailed;
+    int j, nlen;
+#endif
+
+    len = 0;
+    for (i = 0; i < RTPP_THR_NCLASSES && len < (int)blen; i++) {
+#if defined(RTPP_HAVE_AFFINITY)
+        cp = &rtpp_cpusets.cls[i];
+        if (cp->configured == 0) {
+            if (all == 0)
+                continue;
+            if (rtpp_cpuset_getproc(&pset) != 0) {
+                CPU_ZERO(&pset);
+            }
+            rtpp_cpuset_fmt(sbuf, sizeof(sbuf), &pset);
+            len += snprintf(buf + len, blen - len, "cpu affinity %s: %s "
+              "(not pinned)\n", cp->name, sbuf);
+            continue;
+        }
+        rtpp_cpuset_fmt(sbuf, sizeof(sbuf), &cp->set);
+        nlen = 0;
+        nbuf[0] = '\0';
+        for (j = 0; j < RTPP_CPUSET_MAXNODES && nlen < (int)sizeof(nbuf); j++) {
+            if ((cp->nodes & ((uint64_t)1 << j)) == 0)
+                continue;
+            nlen += snprintf(nbuf + nlen, sizeof(nbuf) - nlen, "%s%d",
+              (nlen > 0) ? "," : "", j);
+        }
+        pthread_mutex_lock(&rtpp_cpusets.lock);
+        nbound = cp->nbound;
+        nfailed = cp->nfailed;
+        pthread_mutex_unlock(&rtpp_cpusets.lock);
+        len += snprintf(buf + len, blen - len, "cpu affinity %s: %s "
+          "(numa nodes: %s), threads bound: %u, failed: %u\n", cp->name, sbuf,
+          (nbuf[0] != '\0') ? nbuf : "unknown", nbound, nfailed);
+#else
+        if (all == 0)
+            continue;
+        len += snprintf(buf + len, blen - len, "cpu affinity %s: "
+          "not supported\n", rtpp_cpusets.cls[i].name);
+#endif
+    }
+    return (len < (int)blen ? len : (int)blen - 1);
+}
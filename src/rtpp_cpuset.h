@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_CPUSET_H_
+#define _RTPP_CPUSET_H_
+
+/*
+ * Placement of the worker threads onto CPU sets. Each thread class can be
+ * pinned to its own set from the command line; threads bind themselves
+ * on start-up, before they allocate any per-thread state, so that with
+ * the default first-touch policy that memory ends up on the local NUMA
+ * node. Objects coming from the arena pools (--hugepages), packet buffers
+ * included, are handed out from the chunks of the node the allocating
+ * thread runs on and go back to that node when freed elsewhere.
+ */
+
+enum rtpp_thr_class {
+    RTPP_THR_RTP = 0,
+    RTPP_THR_NET,
+    RTPP_THR_CMD,
+    RTPP_THR_TIMED,
+    RTPP_THR_NOTIFY,
+    RTPP_THR_SYSLOG,
+    RTPP_THR_MODULE,
+    RTPP_THR_NCLASSES
+};
+
+int rtpp_cpuset_parse(const char *);
+void rtpp_cpuset_bind(enum rtpp_thr_class);
+int rtpp_cpuset_info(char *, size_t, int);
+
+#endif
@@ -45,6 +45,8 @@
 #define	MAX_RTP_RATE	100
 #define	POLL_RATE	(MAX_RTP_RATE * 2)	/* target number of poll(2) calls per second */
 #define	LOG_LEVEL	RTPP_LOG_DBUG
+#define	LOG_RL_RATE	10.0	/* log messages per second per call site */
+#define	LOG_RL_BURST	50
 #define	UPDATE_WINDOW	10.0	/* in seconds */
 #define	PCAP_FORMAT	DLT_EN10MB
 
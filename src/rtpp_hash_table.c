@@ -34,13 +34,23 @@
 #include "rtpp_debug.h"
 #include "rtpp_types.h"
 #include "rtpp_hash_table.h"
-#include "rtpp_pearson.h"
 #include "rtpp_refcnt.h"
 #include "rtpp_mallocs.h"
 
 enum rtpp_hte_types {rtpp_hte_naive_t = 0, rtpp_hte_refcnt_t};
 
-#define	RTPP_HT_LEN	256
+#define	RTPP_HT_LEN_INIT	256
+#define	RTPP_HT_LEN_MAX		(1 << 24)
+/*
+ * Bucket array is grown once average chain length exceeds LOAD_MAX and
+ * shrunk back when it falls below 1/LOAD_MIN_INV. Entries are moved to
+ * the new array incrementally, MIGRATE_STEP old buckets with every
+ * modification of the table, so that no single call has to rehash all
+ * of them while holding the lock.
+ */
+#define	RTPP_HT_LOAD_MAX	2
+#define	RTPP_HT_LOAD_MIN_INV	8
+#define	RTPP_HT_MIGRATE_STEP	16
 
 struct rtpp_hash_table_entry {
     struct rtpp_hash_table_entry *prev;
@@ -52,15 +62,23 @@ struct rtpp_hash_table_entry {
         uint32_t u32;
         uint16_t u16;
     } key;
-    uint8_t hash;
+    uint64_t hash;
     enum rtpp_hte_types hte_type;
     char chstor[0];
 };
 
 struct rtpp_hash_table_priv
 {
-    struct rtpp_pearson rp;
-    struct rtpp_hash_table_entry *hash_table[RTPP_HT_LEN];
+    uint64_t seed;
+    struct rtpp_hash_table_entry **hash_table;
+    size_t ht_len;
+    /*
+     * Array being migrated to, if any. Old buckets below mig_idx have
+     * already been moved over.
+     */
+    struct rtpp_hash_table_entry **nhash_table;
+    size_t nht_len;
+    size_t mig_idx;
     pthread_mutex_t hash_table_lock;
     int hte_num;
     enum rtpp_ht_key_types key_type;
@@ -85,6 +103,7 @@ static void hash_table_foreach(struct rtpp_hash_table *self, rtpp_hash_table_mat
 static void hash_table_foreach_key(struct rtpp_hash_table *, const void *,
   rtpp_hash_table_match_t, void *);
 static void hash_table_dtor(struct rtpp_hash_table *self);
+static struct rtpp_hash_table_entry **hash_table_alloc(size_t);
 static int hash_table_get_length(struct rtpp_hash_table *self);
 static int hash_table_purge(struct rtpp_hash_table *self);
 
@@ -100,6 +119,12 @@ rtpp_hash_table_ctor(enum rtpp_ht_key_types key_type, int flags)
         return (NULL);
     }
     pvt = &(rp->pvt);
+    pvt->hash_table = hash_table_alloc(RTPP_HT_LEN_INIT);
+    if (pvt->hash_table == NULL) {
+        free(rp);
+        return (NULL);
+    }
+    pvt->ht_len = RTPP_HT_LEN_INIT;
     pvt->key_type = key_type;
     pvt->flags = flags;
     pub = &(rp->pub);
@@ -117,32 +142,42 @@ rtpp_hash_table_ctor(enum rtpp_ht_key_types key_type, int flags)
     pub->get_length = &hash_table_get_length;
     pub->purge = &hash_table_purge;
     pthread_mutex_init(&pvt->hash_table_lock, NULL);
-    rtpp_pearson_shuffle(&pvt->rp);
+    pvt->seed = ((uint64_t)random() << 33) ^ ((uint64_t)random() << 11) ^
+      (uint64_t)random();
     pub->pvt = pvt;
     return (pub);
 }
 
 static void
-hash_table_dtor(struct rtpp_hash_table *self)
+hash_table_free_chains(struct rtpp_hash_table_priv *pvt,
+  struct rtpp_hash_table_entry **ht, size_t ht_len)
 {
     struct rtpp_hash_table_entry *sp, *sp_next;
-    struct rtpp_hash_table_priv *pvt;
-    int i;
+    size_t i;
 
-    pvt = self->pvt;
-    for (i = 0; i < RTPP_HT_LEN; i++) {
-        sp = pvt->hash_table[i];
-        if (sp == NULL)
-            continue;
-        do {
+    for (i = 0; i < ht_len; i++) {
+        for (sp = ht[i]; sp != NULL; sp = sp_next) {
             sp_next = sp->next;
             if (sp->hte_type == rtpp_hte_refcnt_t) {
                 CALL_SMETHOD((struct rtpp_refcnt *)sp->sptr, decref);
             }
             free(sp);
-            sp = sp_next;
             pvt->hte_num -= 1;
-        } while (sp != NULL);
+        }
+    }
+    free(ht);
+}
+
+static void
+hash_table_dtor(struct rtpp_hash_table *self)
+{
+    struct rtpp_hash_table_priv *pvt;
+
+    pvt = self->pvt;
+    /* Migrated buckets of the old array are all empty */
+    hash_table_free_chains(pvt, pvt->hash_table, pvt->ht_len);
+    if (pvt->nhash_table != NULL) {
+        hash_table_free_chains(pvt, pvt->nhash_table, pvt->nht_len);
     }
     pthread_mutex_destroy(&pvt->hash_table_lock);
     RTPP_DBG_ASSERT(pvt->hte_num == 0);
@@ -150,32 +185,153 @@ hash_table_dtor(struct rtpp_hash_table *self)
     free(self);
 }
 
-static inline uint8_t
+static inline uint64_t
+rtpp_ht_fmix64(uint64_t k)
+{
+
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return (k);
+}
+
+/*
+ * Full-width seeded hash: FNV-1a over the string keys, integer keys are
+ * used directly; both are run through the 64-bit finalizer so that the
+ * low bits used for the bucket index are well mixed. The full value is
+ * stored in each entry and compared before the key itself.
+ */
+static inline uint64_t
 rtpp_ht_hashkey(struct rtpp_hash_table_priv *pvt, const void *key)
 {
+    const unsigned char *cp;
+    uint64_t h;
 
     switch (pvt->key_type) {
     case rtpp_ht_key_str_t:
-        return rtpp_pearson_hash8(&pvt->rp, key, NULL);
+        h = 0xcbf29ce484222325ULL ^ pvt->seed;
+        for (cp = key; *cp != '\0'; cp++) {
+            h ^= *cp;
+            h *= 0x100000001b3ULL;
+        }
+        return (rtpp_ht_fmix64(h));
 
     case rtpp_ht_key_u16_t:
-        return rtpp_pearson_hash8b(&pvt->rp, key, sizeof(uint16_t));
+        return (rtpp_ht_fmix64(pvt->seed ^ *(const uint16_t *)key));
 
     case rtpp_ht_key_u32_t:
-        return rtpp_pearson_hash8b(&pvt->rp, key, sizeof(uint32_t));
+        return (rtpp_ht_fmix64(pvt->seed ^ *(const uint32_t *)key));
 
     case rtpp_ht_key_u64_t:
-        return rtpp_pearson_hash8b(&pvt->rp, key, sizeof(uint64_t));
+        return (rtpp_ht_fmix64(pvt->seed ^ *(const uint64_t *)key));
 
     default:
 	abort();
     }
 }
 
+static struct rtpp_hash_table_entry **
+hash_table_alloc(size_t len)
+{
+
+    return (rtpp_zmalloc(len * sizeof(struct rtpp_hash_table_entry *)));
+}
+
+/*
+ * While the migration is in progress the entry is in the new array if
+ * its bucket in the old one has already been moved, in the old one
+ * otherwise.
+ */
+static inline struct rtpp_hash_table_entry **
+hash_table_bucketp(struct rtpp_hash_table_priv *pvt, uint64_t hash)
+{
+    size_t i;
+
+    i = hash & (pvt->ht_len - 1);
+    if (pvt->nhash_table == NULL || i >= pvt->mig_idx)
+        return (&pvt->hash_table[i]);
+    return (&pvt->nhash_table[hash & (pvt->nht_len - 1)]);
+}
+
+#define RTPP_HT_BUCKET(pvt, h) (*hash_table_bucketp((pvt), (h)))
+
+static void
+hash_table_migrate_locked(struct rtpp_hash_table_priv *pvt, int nbuckets)
+{
+    struct rtpp_hash_table_entry **nbp, *sp, *sp_next, *tsp;
+
+    for (; nbuckets > 0 && pvt->mig_idx < pvt->ht_len; nbuckets--) {
+        /*
+         * Entries are re-linked at the tail of the new chains so that the
+         * relative insertion order of the entries with the same key is
+         * retained.
+         */
+        for (sp = pvt->hash_table[pvt->mig_idx]; sp != NULL; sp = sp_next) {
+            sp_next = sp->next;
+            nbp = &pvt->nhash_table[sp->hash & (pvt->nht_len - 1)];
+            for (tsp = *nbp; tsp != NULL && tsp->next != NULL; tsp = tsp->next)
+                continue;
+            sp->next = NULL;
+            sp->prev = tsp;
+            if (tsp == NULL) {
+                *nbp = sp;
+            } else {
+                tsp->next = sp;
+            }
+        }
+        pvt->hash_table[pvt->mig_idx] = NULL;
+        pvt->mig_idx++;
+    }
+    if (pvt->mig_idx == pvt->ht_len) {
+        free(pvt->hash_table);
+        pvt->hash_table = pvt->nhash_table;
+        pvt->ht_len = pvt->nht_len;
+        pvt->nhash_table = NULL;
+        pvt->nht_len = 0;
+        pvt->mig_idx = 0;
+    }
+}
+
+/*
+ * Must not be called while walking the chains, i.e. from within the
+ * foreach loops, only once the walk is done.
+ */
+static void
+hash_table_rebalance_locked(struct rtpp_hash_table_priv *pvt)
+{
+    size_t nlen, hte_num;
+
+    if (pvt->nhash_table == NULL) {
+        hte_num = pvt->hte_num;
+        nlen = pvt->ht_len;
+        if (hte_num > nlen * RTPP_HT_LOAD_MAX) {
+            if (nlen < RTPP_HT_LEN_MAX)
+                nlen *= 2;
+        } else {
+            while (nlen > RTPP_HT_LEN_INIT &&
+              hte_num < nlen / RTPP_HT_LOAD_MIN_INV)
+                nlen /= 2;
+        }
+        if (nlen == pvt->ht_len)
+            return;
+        /* Allocation failure is not fatal, the old array remains in use */
+        pvt->nhash_table = hash_table_alloc(nlen);
+        if (pvt->nhash_table == NULL)
+            return;
+        pvt->nht_len = nlen;
+        pvt->mig_idx = 0;
+    }
+    hash_table_migrate_locked(pvt, RTPP_HT_MIGRATE_STEP);
+}
+
 static inline int
 rtpp_ht_cmpkey(struct rtpp_hash_table_priv *pvt,
-  struct rtpp_hash_table_entry *sp, const void *key)
+  struct rtpp_hash_table_entry *sp, const void *key, uint64_t hash)
 {
+    if (sp->hash != hash)
+        return (0);
     switch (pvt->key_type) {
     case rtpp_ht_key_str_t:
         return (strcmp(sp->key.ch, key) == 0);
@@ -198,6 +354,8 @@ static inline int
 rtpp_ht_cmpkey2(struct rtpp_hash_table_priv *pvt,
   struct rtpp_hash_table_entry *sp1, struct rtpp_hash_table_entry *sp2)
 {
+    if (sp1->hash != sp2->hash)
+        return (0);
     switch (pvt->key_type) {
     case rtpp_ht_key_str_t:
         return (strcmp(sp1->key.ch, sp2->key.ch) == 0);
@@ -260,9 +418,9 @@ hash_table_append_raw(struct rtpp_hash_table *self, const void *key,
     }
 
     pthread_mutex_lock(&pvt->hash_table_lock);
-    tsp = pvt->hash_table[sp->hash];
+    tsp = RTPP_HT_BUCKET(pvt, sp->hash);
     if (tsp == NULL) {
-       	pvt->hash_table[sp->hash] = sp;
+       	RTPP_HT_BUCKET(pvt, sp->hash) = sp;
     } else {
         for (tsp1 = tsp; tsp1 != NULL; tsp1 = tsp1->next) {
             tsp = tsp1;
@@ -284,6 +442,7 @@ hash_table_append_raw(struct rtpp_hash_table *self, const void *key,
         sp->prev = tsp;
     }
     pvt->hte_num += 1;
+    hash_table_rebalance_locked(pvt);
     pthread_mutex_unlock(&pvt->hash_table_lock);
     return (sp);
 }
@@ -312,7 +471,7 @@ hash_table_append_refcnt(struct rtpp_hash_table *self, const void *key,
 
 static inline void
 hash_table_remove_locked(struct rtpp_hash_table_priv *pvt,
-  struct rtpp_hash_table_entry *sp, uint8_t hash)
+  struct rtpp_hash_table_entry *sp)
 {
 
     if (sp->prev != NULL) {
@@ -322,8 +481,8 @@ hash_table_remove_locked(struct rtpp_hash_table_priv *pvt,
         }
     } else {
         /* Make sure we are removing the right session */
-        RTPP_DBG_ASSERT(pvt->hash_table[hash] == sp);
-        pvt->hash_table[hash] = sp->next;
+        RTPP_DBG_ASSERT(RTPP_HT_BUCKET(pvt, sp->hash) == sp);
+        RTPP_HT_BUCKET(pvt, sp->hash) = sp->next;
         if (sp->next != NULL) {
             sp->next->prev = NULL;
         }
@@ -335,13 +494,13 @@ static void
 hash_table_remove(struct rtpp_hash_table *self, const void *key,
   struct rtpp_hash_table_entry * sp)
 {
-    uint8_t hash;
     struct rtpp_hash_table_priv *pvt;
 
     pvt = self->pvt;
-    hash = rtpp_ht_hashkey(pvt, key);
+    RTPP_DBG_ASSERT(sp->hash == rtpp_ht_hashkey(pvt, key));
     pthread_mutex_lock(&pvt->hash_table_lock);
-    hash_table_remove_locked(pvt, sp, hash);
+    hash_table_remove_locked(pvt, sp);
+    hash_table_rebalance_locked(pvt);
     pthread_mutex_unlock(&pvt->hash_table_lock);
     if (sp->hte_type == rtpp_hte_refcnt_t) {
         CALL_SMETHOD((struct rtpp_refcnt *)sp->sptr, decref);
@@ -356,7 +515,8 @@ hash_table_remove_nc(struct rtpp_hash_table *self, struct rtpp_hash_table_entry
 
     pvt = self->pvt;
     pthread_mutex_lock(&pvt->hash_table_lock);
-    hash_table_remove_locked(pvt, sp, sp->hash);
+    hash_table_remove_locked(pvt, sp);
+    hash_table_rebalance_locked(pvt);
     pthread_mutex_unlock(&pvt->hash_table_lock);
     if (sp->hte_type == rtpp_hte_refcnt_t) {
         CALL_SMETHOD((struct rtpp_refcnt *)sp->sptr, decref);
@@ -367,7 +527,7 @@ hash_table_remove_nc(struct rtpp_hash_table *self, struct rtpp_hash_table_entry
 static struct rtpp_refcnt *
 hash_table_remove_by_key(struct rtpp_hash_table *self, const void *key)
 {
-    uint8_t hash;
+    uint64_t hash;
     struct rtpp_hash_table_entry *sp;
     struct rtpp_hash_table_priv *pvt;
     struct rtpp_refcnt *rptr;
@@ -375,8 +535,8 @@ hash_table_remove_by_key(struct rtpp_hash_table *self, const void *key)
     pvt = self->pvt;
     hash = rtpp_ht_hashkey(pvt, key);
     pthread_mutex_lock(&pvt->hash_table_lock);
-    for (sp = pvt->hash_table[hash]; sp != NULL; sp = sp->next) {
-        if (rtpp_ht_cmpkey(pvt, sp, key)) {
+    for (sp = RTPP_HT_BUCKET(pvt, hash); sp != NULL; sp = sp->next) {
+        if (rtpp_ht_cmpkey(pvt, sp, key, hash)) {
             break;
         }
     }
@@ -384,7 +544,8 @@ hash_table_remove_by_key(struct rtpp_hash_table *self, const void *key)
         pthread_mutex_unlock(&pvt->hash_table_lock);
         return (NULL);
     }
-    hash_table_remove_locked(pvt, sp, hash);
+    hash_table_remove_locked(pvt, sp);
+    hash_table_rebalance_locked(pvt);
     pthread_mutex_unlock(&pvt->hash_table_lock);
     if (sp->hte_type == rtpp_hte_refcnt_t) {
         CALL_SMETHOD((struct rtpp_refcnt *)sp->sptr, decref);
@@ -397,15 +558,15 @@ hash_table_remove_by_key(struct rtpp_hash_table *self, const void *key)
 static struct rtpp_hash_table_entry *
 hash_table_findfirst(struct rtpp_hash_table *self, const void *key, void **sptrp)
 {
-    uint8_t hash;
+    uint64_t hash;
     struct rtpp_hash_table_entry *sp;
     struct rtpp_hash_table_priv *pvt;
 
     pvt = self->pvt;
     hash = rtpp_ht_hashkey(pvt, key);
     pthread_mutex_lock(&pvt->hash_table_lock);
-    for (sp = pvt->hash_table[hash]; sp != NULL; sp = sp->next) {
-	if (rtpp_ht_cmpkey(pvt, sp, key)) {
+    for (sp = RTPP_HT_BUCKET(pvt, hash); sp != NULL; sp = sp->next) {
+	if (rtpp_ht_cmpkey(pvt, sp, key, hash)) {
             *sptrp = sp->sptr;
 	    break;
 	}
@@ -438,13 +599,13 @@ hash_table_find(struct rtpp_hash_table *self, const void *key)
     struct rtpp_refcnt *rptr;
     struct rtpp_hash_table_priv *pvt;
     struct rtpp_hash_table_entry *sp;
-    uint8_t hash;
+    uint64_t hash;
 
     pvt = self->pvt;
     hash = rtpp_ht_hashkey(pvt, key);
     pthread_mutex_lock(&pvt->hash_table_lock);
-    for (sp = pvt->hash_table[hash]; sp != NULL; sp = sp->next) {
-        if (rtpp_ht_cmpkey(pvt, sp, key)) {
+    for (sp = RTPP_HT_BUCKET(pvt, hash); sp != NULL; sp = sp->next) {
+        if (rtpp_ht_cmpkey(pvt, sp, key, hash)) {
             break;
         }
     }
@@ -465,10 +626,11 @@ static void
 hash_table_foreach(struct rtpp_hash_table *self,
   rtpp_hash_table_match_t hte_ematch, void *marg)
 {
-    struct rtpp_hash_table_entry *sp, *sp_next;
+    struct rtpp_hash_table_entry **ht, *sp, *sp_next;
     struct rtpp_hash_table_priv *pvt;
     struct rtpp_refcnt *rptr;
-    int i, mval;
+    size_t i, ht_len;
+    int mval;
 
     pvt = self->pvt;
     pthread_mutex_lock(&pvt->hash_table_lock);
@@ -476,23 +638,35 @@ hash_table_foreach(struct rtpp_hash_table *self,
         pthread_mutex_unlock(&pvt->hash_table_lock);
         return;
     }
-    for (i = 0; i < RTPP_HT_LEN; i++) {
-        for (sp = pvt->hash_table[i]; sp != NULL; sp = sp_next) {
-            RTPP_DBG_ASSERT(sp->hte_type == rtpp_hte_refcnt_t);
-            rptr = (struct rtpp_refcnt *)sp->sptr;
-            sp_next = sp->next;
-            mval = hte_ematch(CALL_SMETHOD(rptr, getdata), marg);
-            RTPP_DBG_ASSERT(VDTE_MVAL(mval));
-            if (mval & RTPP_HT_MATCH_DEL) {
-                hash_table_remove_locked(pvt, sp, sp->hash);
-                CALL_SMETHOD(rptr, decref);
-                free(sp);
-            }
-            if (mval & RTPP_HT_MATCH_BRK) {
-                break;
+    /* Not yet migrated part of the old array first, then the new one */
+    ht = pvt->hash_table;
+    ht_len = pvt->ht_len;
+    i = (pvt->nhash_table != NULL) ? pvt->mig_idx : 0;
+    for (;;) {
+        for (; i < ht_len; i++) {
+            for (sp = ht[i]; sp != NULL; sp = sp_next) {
+                RTPP_DBG_ASSERT(sp->hte_type == rtpp_hte_refcnt_t);
+                rptr = (struct rtpp_refcnt *)sp->sptr;
+                sp_next = sp->next;
+                mval = hte_ematch(CALL_SMETHOD(rptr, getdata), marg);
+                RTPP_DBG_ASSERT(VDTE_MVAL(mval));
+                if (mval & RTPP_HT_MATCH_DEL) {
+                    hash_table_remove_locked(pvt, sp);
+                    CALL_SMETHOD(rptr, decref);
+                    free(sp);
+                }
+                if (mval & RTPP_HT_MATCH_BRK) {
+                    break;
+                }
             }
         }
+        if (pvt->nhash_table == NULL || ht == pvt->nhash_table)
+            break;
+        ht = pvt->nhash_table;
+        ht_len = pvt->nht_len;
+        i = 0;
     }
+    hash_table_rebalance_locked(pvt);
     pthread_mutex_unlock(&pvt->hash_table_lock);
 }
 
@@ -504,18 +678,18 @@ hash_table_foreach_key(struct rtpp_hash_table *self, const void *key,
     struct rtpp_hash_table_priv *pvt;
     struct rtpp_refcnt *rptr;
     int mval;
-    uint8_t hash;
+    uint64_t hash;
 
     pvt = self->pvt;
     hash = rtpp_ht_hashkey(pvt, key);
     pthread_mutex_lock(&pvt->hash_table_lock);
-    if (pvt->hte_num == 0 || pvt->hash_table[hash] == NULL) {
+    if (pvt->hte_num == 0 || RTPP_HT_BUCKET(pvt, hash) == NULL) {
         pthread_mutex_unlock(&pvt->hash_table_lock);
         return;
     }
-    for (sp = pvt->hash_table[hash]; sp != NULL; sp = sp_next) {
+    for (sp = RTPP_HT_BUCKET(pvt, hash); sp != NULL; sp = sp_next) {
         sp_next = sp->next;
-        if (!rtpp_ht_cmpkey(pvt, sp, key)) {
+        if (!rtpp_ht_cmpkey(pvt, sp, key, hash)) {
             continue;
         }
         RTPP_DBG_ASSERT(sp->hte_type == rtpp_hte_refcnt_t);
@@ -523,7 +697,7 @@ hash_table_foreach_key(struct rtpp_hash_table *self, const void *key,
         mval = hte_ematch(CALL_SMETHOD(rptr, getdata), marg);
         RTPP_DBG_ASSERT(VDTE_MVAL(mval));
         if (mval & RTPP_HT_MATCH_DEL) {
-            hash_table_remove_locked(pvt, sp, sp->hash);
+            hash_table_remove_locked(pvt, sp);
             CALL_SMETHOD(rptr, decref);
             free(sp);
         }
@@ -531,6 +705,7 @@ hash_table_foreach_key(struct rtpp_hash_table *self, const void *key,
             break;
         }
     }
+    hash_table_rebalance_locked(pvt);
     pthread_mutex_unlock(&pvt->hash_table_lock);
 }
 
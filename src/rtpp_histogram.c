@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rtpp_histogram.h"
+
+void
+rtpp_histogram_init(struct rtpp_histogram *hp)
+{
+
+    memset(hp, '\0', sizeof(*hp));
+    hp->min = UINT64_MAX;
+}
+
+static int
+rtpp_histogram_bidx(uint64_t v)
+{
+    int mag, sub;
+
+    if (v < RTPP_HIST_NLINEAR)
+        return (v);
+    mag = 63 - __builtin_clzll(v);
+    if (mag >= RTPP_HIST_MAXMAG)
+        return (RTPP_HIST_NBUCKETS - 1);
+    sub = (v >> (mag - RTPP_HIST_SUBBITS)) & (RTPP_HIST_NSUB - 1);
+    return (RTPP_HIST_NLINEAR + (mag - (RTPP_HIST_SUBBITS + 1)) *
+      RTPP_HIST_NSUB + sub);
+}
+
+/* Highest value that falls into the bucket */
+static uint64_t
+rtpp_histogram_bval(int bidx)
+{
+    int mag, sub;
+
+    if (bidx < RTPP_HIST_NLINEAR)
+        return (bidx);
+    mag = (bidx - RTPP_HIST_NLINEAR) / RTPP_HIST_NSUB + RTPP_HIST_SUBBITS + 1;
+    sub = (bidx - RTPP_HIST_NLINEAR) % RTPP_HIST_NSUB;
+    return (((uint64_t)(RTPP_HIST_NSUB + sub + 1) <<
+      (mag - RTPP_HIST_SUBBITS)) - 1);
+}
+
+void
+rtpp_histogram_record_us(struct rtpp_histogram *hp, uint64_t v)
+{
+
+    if (hp->nsamples == 0 || v < hp->min)
+        hp->min = v;
+    if (v > hp->max)
+        hp->max = v;
+    hp->nsamples++;
+    hp->sum += v;
+    hp->buckets[rtpp_histogram_bidx(v)]++;
+}
+
+void
+rtpp_histogram_record(struct rtpp_histogram *hp, double ival)
+{
+
+    rtpp_histogram_record_us(hp, (ival > 0.0) ? (uint64_t)(ival * 1e6) : 0);
+}
+
+void
+rtpp_histogram_record_atomic(struct rtpp_histogram *hp, double ival)
+{
+    uint64_t v, ov;
+
+    v = (ival > 0.0) ? (uint64_t)(ival * 1e6) : 0;
+    /*
+     * Relies on min being preset by rtpp_histogram_init(). Bump nsamples
+     * last, so that a reader never sees a sample counted without its
+     * min/max in place.
+     */
+    for (ov = hp->min; v < ov; ov = hp->min) {
+        if (__sync_bool_compare_and_swap(&hp->min, ov, v))
+            break;
+    }
+    for (ov = hp->max; v > ov; ov = hp->max) {
+        if (__sync_bool_compare_and_swap(&hp->max, ov, v))
+            break;
+    }
+    __sync_fetch_and_add(&hp->buckets[rtpp_histogram_bidx(v)], 1);
+    __sync_fetch_and_add(&hp->sum, v);
+    __sync_fetch_and_add(&hp->nsamples, 1);
+}
+
+void
+rtpp_histogram_merge(struct rtpp_histogram *dhp,
+  const struct rtpp_histogram *shp)
+{
+    int i;
+
+    if (shp->nsamples == 0)
+        return;
+    if (dhp->nsamples == 0 || shp->min < dhp->min)
+        dhp->min = shp->min;
+    if (shp->max > dhp->max)
+        dhp->max = shp->max;
+    dhp->nsamples += shp->nsamples;
+    dhp->sum += shp->sum;
+    for (i = 0; i < RTPP_HIST_NBUCKETS; i++) {
+        dhp->buckets[i] += shp->buckets[i];
+    }
+}
+
+uint64_t
+rtpp_histogram_pctl(const struct rtpp_histogram *hp, double pct)
+{
+    uint64_t target, acc, bval;
+    int i;
+
+    if (hp->nsamples == 0)
+        return (0);
+    target = (uint64_t)((double)hp->nsamples * pct / 100.0 + 0.5);
+    if (target == 0)
+        target = 1;
+    acc = 0;
+    for (i = 0; i < RTPP_HIST_NBUCKETS; i++) {
+        acc += hp->buckets[i];
+        if (acc >= target)
+            break;
+    }
+    bval = rtpp_histogram_bval(i);
+    return (bval > hp->max ? hp->max : bval);
+}
+
+int
+rtpp_histogram_nstr(const struct rtpp_histogram *hp, char *buf, int len)
+{
+
+    return (snprintf(buf, len, "n=%llu min=%llu avg=%.1f p50=%llu p90=%llu "
+      "p99=%llu p999=%llu max=%llu", (unsigned long long)hp->nsamples,
+      (unsigned long long)(hp->nsamples > 0 ? hp->min : 0),
+      hp->nsamples > 0 ? (double)hp->sum / (double)hp->nsamples : 0.0,
+      (unsigned long long)rtpp_histogram_pctl(hp, 50.0),
+      (unsigned long long)rtpp_histogram_pctl(hp, 90.0),
+      (unsigned long long)rtpp_histogram_pctl(hp, 99.0),
+      (unsigned long long)rtpp_histogram_pctl(hp, 99.9),
+      (unsigned long long)hp->max));
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_HISTOGRAM_H_
+#define _RTPP_HISTOGRAM_H_
+
+/*
+ * Log-linear (HDR-style) histogram of time intervals with microsecond
+ * resolution. Values below RTPP_HIST_NLINEAR usec get a bucket each, above
+ * that every power of two is split into RTPP_HIST_NSUB sub-buckets, which
+ * gives 12.5% worst-case precision all the way up to 2^35 usec (~9.5 hours).
+ *
+ * The structure does no locking, it's up to the caller to serialize access.
+ * The only exception is rtpp_histogram_record_atomic(), which can be used
+ * by several writers at once as long as all of them use it. Readers of
+ * a histogram updated that way may see a sample partially recorded.
+ */
+#define RTPP_HIST_NLINEAR  16
+#define RTPP_HIST_SUBBITS  3
+#define RTPP_HIST_NSUB     (1 << RTPP_HIST_SUBBITS)
+#define RTPP_HIST_MAXMAG   35
+#define RTPP_HIST_NBUCKETS (RTPP_HIST_NLINEAR + \
+  (RTPP_HIST_MAXMAG - RTPP_HIST_SUBBITS) * RTPP_HIST_NSUB)
+
+struct rtpp_histogram {
+    uint64_t nsamples;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+    uint64_t buckets[RTPP_HIST_NBUCKETS];
+};
+
+void rtpp_histogram_init(struct rtpp_histogram *);
+void rtpp_histogram_record(struct rtpp_histogram *, double);
+void rtpp_histogram_record_us(struct rtpp_histogram *, uint64_t);
+void rtpp_histogram_record_atomic(struct rtpp_histogram *, double);
+void rtpp_histogram_merge(struct rtpp_histogram *, const struct rtpp_histogram *);
+uint64_t rtpp_histogram_pctl(const struct rtpp_histogram *, double);
+int rtpp_histogram_nstr(const struct rtpp_histogram *, char *, int);
+
+#endif
@@ -0,0 +1,896 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_pp.h"
+
+#if defined(HAVE_LINUX_BPF_H)
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/netlink.h>
+#include <linux/pkt_cls.h>
+#include <linux/rtnetlink.h>
+#include <unistd.h>
+#endif
+
+#include "rtpp_types.h"
+#include "rtpp_log.h"
+#include "rtpp_log_obj.h"
+#include "rtpp_analyzer.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_hash_table.h"
+#include "rtpp_kfwd.h"
+#include "rtpp_mallocs.h"
+#include "rtpp_module_if.h"
+#include "rtpp_netaddr.h"
+#include "rtpp_network.h"
+#include "rtpp_pcount.h"
+#include "rtpp_pcnt_strm.h"
+#include "rtpp_pipe.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_session.h"
+#include "rtpp_stats.h"
+#include "rtpp_stream.h"
+#include "rtpp_time.h"
+#include "rtpp_timed.h"
+#include "rtpp_ttl.h"
+#include "rtpp_weakref.h"
+#include "rtp.h"
+#include "rtp_packet.h"
+
+#if !defined(HAVE_LINUX_BPF_H)
+struct rtpp_kfwd *
+rtpp_kfwd_ctor(struct rtpp_cfg_stable *cfsp, const char *ifnames)
+{
+
+    RTPP_LOG(cfsp->glog, RTPP_LOG_ERR, "in-kernel forwarding is not "
+      "supported on this platform");
+    return (NULL);
+}
+#else
+
+#define	RTPP_KFWD_MAXFLOWS	16384
+#define	RTPP_KFWD_MAXIFS	8
+#define	RTPP_KFWD_SPERD		1.0
+/* How long a flow found unsuitable for offloading is left alone */
+#define	RTPP_KFWD_NRETRY	5.0
+#define	RTPP_KFWD_VLOGSIZE	(64 * 1024)
+
+/* Not in the older <linux/bpf.h>, requires Linux 6.6+ to attach */
+#define	RTPP_KFWD_TCX_INGRESS	46
+
+/* Offsets of the fields in the Ethernet + IPv4 (no options) + UDP frame */
+#define	KFWD_IP_OFF	ETH_HLEN
+#define	KFWD_IP_FRAG	(KFWD_IP_OFF + 6)
+#define	KFWD_IP_PROTO	(KFWD_IP_OFF + 9)
+#define	KFWD_IP_CSUM	(KFWD_IP_OFF + 10)
+#define	KFWD_IP_SADDR	(KFWD_IP_OFF + 12)
+#define	KFWD_IP_DADDR	(KFWD_IP_OFF + 16)
+#define	KFWD_UDP_OFF	(KFWD_IP_OFF + 20)
+#define	KFWD_UDP_CSUM	(KFWD_UDP_OFF + 6)
+#define	KFWD_HDRS_LEN	(KFWD_UDP_OFF + 8)
+
+/*
+ * Map layout shared with the classifier. Addresses and ports are in the
+ * network byte order, the rest is in the host one.
+ */
+struct rtpp_kfwd_key {
+    uint32_t saddr;
+    uint32_t daddr;
+    uint16_t sport;
+    uint16_t dport;
+};
+
+struct rtpp_kfwd_val {
+    uint32_t saddr;
+    uint32_t daddr;
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t ifindex;
+    uint64_t npkts;
+};
+
+struct rtpp_kfwd_flow {
+    struct rtpp_refcnt *rcnt;
+    uint64_t stuid_in;
+    uint64_t stuid_out;
+    int pipe_type;
+    int map_fd;
+    int installed;
+    /* When the flow has been looked at, to retry the unsuitable ones */
+    double ctime;
+    struct rtpp_kfwd_key key;
+    struct sockaddr_in src;
+    struct sockaddr_in dst;
+    /* Packets already accounted for */
+    uint64_t npkts;
+};
+
+struct rtpp_kfwd_priv {
+    struct rtpp_kfwd pub;
+    struct rtpp_log *log;
+    struct rtpp_stats *rtpp_stats;
+    struct rtpp_weakref_obj *rtp_streams_wrt;
+    struct rtpp_weakref_obj *rtcp_streams_wrt;
+    struct rtpp_hash_table *flows;
+    pthread_mutex_t nl_lock;
+    int nl_fd;
+    uint32_t nl_seq;
+    int map_fd;
+    int prog_fd;
+    int nlinks;
+    int link_fds[RTPP_KFWD_MAXIFS];
+    struct rtpp_timed_task *sync_task;
+    int sync_rval;
+    int npkts_rcvd_idx;
+    int npkts_relayed_idx;
+    int npkts_kfwd_idx;
+};
+
+struct rtpp_kfwd_sync_args {
+    struct rtpp_kfwd_priv *pvt;
+    double dtime;
+    uint64_t npkts;
+};
+
+#define PUB2PVT(pubp) \
+  ((struct rtpp_kfwd_priv *)((char *)(pubp) - offsetof(struct rtpp_kfwd_priv, pub)))
+
+static void rtpp_kfwd_dtor(struct rtpp_kfwd_priv *);
+static void rtpp_kfwd_offload(struct rtpp_kfwd *, struct rtpp_stream *,
+  struct rtpp_stream *, const struct rtp_packet *);
+static void rtpp_kfwd_unload(struct rtpp_kfwd *, struct rtpp_stream *);
+static void rtpp_kfwd_unload_sess(struct rtpp_kfwd *, struct rtpp_session *);
+static int rtpp_kfwd_start(struct rtpp_kfwd *, struct rtpp_timed *);
+static void rtpp_kfwd_shutdown(struct rtpp_kfwd *);
+
+/*
+ * Minimal eBPF assembler, enough to spell out the classifier below.
+ * Forward jumps to the common exits are encoded with the KFWD_L_*
+ * placeholders and resolved once the program is complete.
+ */
+#define	KFWD_L_PASS	0x7ff0
+#define	KFWD_L_SHOT	0x7ff1
+
+#define	BI(c, d, s, o, i)	((struct bpf_insn){.code = (c), \
+  .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i)})
+#define	BI_MOV_REG(d, s)	BI(BPF_ALU64 | BPF_MOV | BPF_X, d, s, 0, 0)
+#define	BI_MOV_IMM(d, i)	BI(BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, i)
+#define	BI_ADD_IMM(d, i)	BI(BPF_ALU64 | BPF_ADD | BPF_K, d, 0, 0, i)
+#define	BI_AND_IMM(d, i)	BI(BPF_ALU64 | BPF_AND | BPF_K, d, 0, 0, i)
+#define	BI_LDX(sz, d, s, o)	BI(BPF_LDX | BPF_MEM | (sz), d, s, o, 0)
+#define	BI_STX(sz, d, s, o)	BI(BPF_STX | BPF_MEM | (sz), d, s, o, 0)
+#define	BI_XADD_DW(d, s, o)	BI(BPF_STX | BPF_ATOMIC | BPF_DW, d, s, o, \
+  BPF_ADD)
+#define	BI_JEQ_IMM(d, i, l)	BI(BPF_JMP | BPF_JEQ | BPF_K, d, 0, l, i)
+#define	BI_JNE_IMM(d, i, l)	BI(BPF_JMP | BPF_JNE | BPF_K, d, 0, l, i)
+#define	BI_JGT_REG(d, s, l)	BI(BPF_JMP | BPF_JGT | BPF_X, d, s, l, 0)
+#define	BI_CALL(f)		BI(BPF_JMP | BPF_CALL, 0, 0, 0, f)
+#define	BI_EXIT()		BI(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+#define	BI_LD_MAPFD(d, fd)	BI(BPF_LD | BPF_DW | BPF_IMM, d, \
+  BPF_PSEUDO_MAP_FD, 0, fd), BI(0, 0, 0, 0, 0)
+
+/* Replace 32-bit value at fp[so] with the one at value[vo] in checksum */
+#define	BI_CSUM(f, co, so, vo, flg) \
+  BI_MOV_REG(BPF_REG_1, BPF_REG_6), \
+  BI_MOV_IMM(BPF_REG_2, co), \
+  BI_LDX(BPF_W, BPF_REG_3, BPF_REG_10, so), \
+  BI_LDX(BPF_W, BPF_REG_4, BPF_REG_7, vo), \
+  BI_MOV_IMM(BPF_REG_5, (flg) | 4), \
+  BI_CALL(f), \
+  BI_JNE_IMM(BPF_REG_0, 0, KFWD_L_SHOT)
+
+static int
+rtpp_kfwd_bpf(int cmd, union bpf_attr *attr)
+{
+
+    return (syscall(__NR_bpf, cmd, attr, sizeof(*attr)));
+}
+
+static int
+rtpp_kfwd_mkprog(struct rtpp_kfwd_priv *pvt)
+{
+    struct bpf_insn prog[] = {
+        /* r6 = skb, bail out unless it's a non-fragmented IPv4/UDP */
+        BI_MOV_REG(BPF_REG_6, BPF_REG_1),
+        BI_LDX(BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct __sk_buff, data)),
+        BI_LDX(BPF_W, BPF_REG_3, BPF_REG_6,
+          offsetof(struct __sk_buff, data_end)),
+        BI_MOV_REG(BPF_REG_4, BPF_REG_2),
+        BI_ADD_IMM(BPF_REG_4, KFWD_HDRS_LEN),
+        BI_JGT_REG(BPF_REG_4, BPF_REG_3, KFWD_L_PASS),
+        BI_LDX(BPF_H, BPF_REG_4, BPF_REG_2, ETH_HLEN - 2),
+        BI_JNE_IMM(BPF_REG_4, htons(ETH_P_IP), KFWD_L_PASS),
+        BI_LDX(BPF_B, BPF_REG_4, BPF_REG_2, KFWD_IP_OFF),
+        BI_JNE_IMM(BPF_REG_4, 0x45, KFWD_L_PASS),
+        BI_LDX(BPF_B, BPF_REG_4, BPF_REG_2, KFWD_IP_PROTO),
+        BI_JNE_IMM(BPF_REG_4, IPPROTO_UDP, KFWD_L_PASS),
+        BI_LDX(BPF_H, BPF_REG_4, BPF_REG_2, KFWD_IP_FRAG),
+        BI_AND_IMM(BPF_REG_4, htons(0x3fff)),
+        BI_JNE_IMM(BPF_REG_4, 0, KFWD_L_PASS),
+        /* fp[-16] = {saddr, daddr, sport, dport} key */
+        BI_LDX(BPF_W, BPF_REG_4, BPF_REG_2, KFWD_IP_SADDR),
+        BI_STX(BPF_W, BPF_REG_10, BPF_REG_4, -16),
+        BI_LDX(BPF_W, BPF_REG_4, BPF_REG_2, KFWD_IP_DADDR),
+        BI_STX(BPF_W, BPF_REG_10, BPF_REG_4, -12),
+        BI_LDX(BPF_W, BPF_REG_4, BPF_REG_2, KFWD_UDP_OFF),
+        BI_STX(BPF_W, BPF_REG_10, BPF_REG_4, -8),
+        /* r7 = value */
+        BI_LD_MAPFD(BPF_REG_1, pvt->map_fd),
+        BI_MOV_REG(BPF_REG_2, BPF_REG_10),
+        BI_ADD_IMM(BPF_REG_2, -16),
+        BI_CALL(BPF_FUNC_map_lookup_elem),
+        BI_JEQ_IMM(BPF_REG_0, 0, KFWD_L_PASS),
+        BI_MOV_REG(BPF_REG_7, BPF_REG_0),
+        /* Fix up checksums and rewrite addresses and ports */
+        BI_CSUM(BPF_FUNC_l3_csum_replace, KFWD_IP_CSUM, -16, 0, 0),
+        BI_CSUM(BPF_FUNC_l3_csum_replace, KFWD_IP_CSUM, -12, 4, 0),
+        BI_CSUM(BPF_FUNC_l4_csum_replace, KFWD_UDP_CSUM, -16, 0,
+          BPF_F_PSEUDO_HDR | BPF_F_MARK_MANGLED_0),
+        BI_CSUM(BPF_FUNC_l4_csum_replace, KFWD_UDP_CSUM, -12, 4,
+          BPF_F_PSEUDO_HDR | BPF_F_MARK_MANGLED_0),
+        BI_CSUM(BPF_FUNC_l4_csum_replace, KFWD_UDP_CSUM, -8, 8,
+          BPF_F_MARK_MANGLED_0),
+        BI_MOV_REG(BPF_REG_1, BPF_REG_6),
+        BI_MOV_IMM(BPF_REG_2, KFWD_IP_SADDR),
+        BI_MOV_REG(BPF_REG_3, BPF_REG_7),
+        BI_MOV_IMM(BPF_REG_4, 8),
+        BI_MOV_IMM(BPF_REG_5, 0),
+        BI_CALL(BPF_FUNC_skb_store_bytes),
+        BI_JNE_IMM(BPF_REG_0, 0, KFWD_L_SHOT),
+        BI_MOV_REG(BPF_REG_1, BPF_REG_6),
+        BI_MOV_IMM(BPF_REG_2, KFWD_UDP_OFF),
+        BI_MOV_REG(BPF_REG_3, BPF_REG_7),
+        BI_ADD_IMM(BPF_REG_3, 8),
+        BI_MOV_IMM(BPF_REG_4, 4),
+        BI_MOV_IMM(BPF_REG_5, 0),
+        BI_CALL(BPF_FUNC_skb_store_bytes),
+        BI_JNE_IMM(BPF_REG_0, 0, KFWD_L_SHOT),
+        /* value->npkts++ and out it goes */
+        BI_MOV_IMM(BPF_REG_1, 1),
+        BI_XADD_DW(BPF_REG_7, BPF_REG_1,
+          offsetof(struct rtpp_kfwd_val, npkts)),
+        BI_LDX(BPF_W, BPF_REG_1, BPF_REG_7,
+          offsetof(struct rtpp_kfwd_val, ifindex)),
+        BI_MOV_IMM(BPF_REG_2, 0),
+        BI_MOV_IMM(BPF_REG_3, 0),
+        BI_MOV_IMM(BPF_REG_4, 0),
+        BI_CALL(BPF_FUNC_redirect_neigh),
+        BI_EXIT(),
+        /* KFWD_L_PASS: not ours, let the stack have it */
+        BI_MOV_IMM(BPF_REG_0, TC_ACT_UNSPEC),
+        BI_EXIT(),
+        /* KFWD_L_SHOT: mangled halfway, has to go */
+        BI_MOV_IMM(BPF_REG_0, TC_ACT_SHOT),
+        BI_EXIT()
+    };
+    const int plen = sizeof(prog) / sizeof(prog[0]);
+    union bpf_attr attr;
+    char *vlog, *cp, *ep;
+    int i;
+
+    for (i = 0; i < plen; i++) {
+        if (BPF_CLASS(prog[i].code) != BPF_JMP)
+            continue;
+        switch (prog[i].off) {
+        case KFWD_L_PASS:
+            prog[i].off = (plen - 4) - i - 1;
+            break;
+
+        case KFWD_L_SHOT:
+            prog[i].off = (plen - 2) - i - 1;
+            break;
+        }
+    }
+    memset(&attr, '\0', sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_SCHED_CLS;
+    attr.insns = (uintptr_t)prog;
+    attr.insn_cnt = plen;
+    attr.license = (uintptr_t)"Dual BSD/GPL";
+    strncpy(attr.prog_name, "rtpp_kfwd", sizeof(attr.prog_name) - 1);
+    pvt->prog_fd = rtpp_kfwd_bpf(BPF_PROG_LOAD, &attr);
+    if (pvt->prog_fd >= 0)
+        return (0);
+    RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't load BPF program");
+    /* Try again with the verifier log enabled to see what it didn't like */
+    vlog = rtpp_zmalloc(RTPP_KFWD_VLOGSIZE);
+    if (vlog == NULL)
+        return (-1);
+    attr.log_buf = (uintptr_t)vlog;
+    attr.log_size = RTPP_KFWD_VLOGSIZE;
+    attr.log_level = 1;
+    pvt->prog_fd = rtpp_kfwd_bpf(BPF_PROG_LOAD, &attr);
+    if (pvt->prog_fd >= 0) {
+        free(vlog);
+        return (0);
+    }
+    for (cp = vlog; *cp != '\0'; cp = ep + 1) {
+        ep = strchr(cp, '\n');
+        if (ep == NULL)
+            ep = cp + strlen(cp) - 1;
+        else
+            *ep = '\0';
+        RTPP_LOG(pvt->log, RTPP_LOG_DBUG, "verifier: %s", cp);
+    }
+    free(vlog);
+    return (-1);
+}
+
+static int
+rtpp_kfwd_mkmap(struct rtpp_kfwd_priv *pvt)
+{
+    union bpf_attr attr;
+
+    memset(&attr, '\0', sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_HASH;
+    attr.key_size = sizeof(struct rtpp_kfwd_key);
+    attr.value_size = sizeof(struct rtpp_kfwd_val);
+    attr.max_entries = RTPP_KFWD_MAXFLOWS;
+    strncpy(attr.map_name, "rtpp_kfwd", sizeof(attr.map_name) - 1);
+    pvt->map_fd = rtpp_kfwd_bpf(BPF_MAP_CREATE, &attr);
+    if (pvt->map_fd < 0) {
+        RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't create BPF map");
+        return (-1);
+    }
+    return (0);
+}
+
+static int
+rtpp_kfwd_attach(struct rtpp_kfwd_priv *pvt, const char *ifnames)
+{
+    union bpf_attr attr;
+    char *ifs, *ifname, *last;
+    unsigned int ifindex;
+    int fd;
+
+    ifs = strdup(ifnames);
+    if (ifs == NULL)
+        return (-1);
+    for (ifname = strtok_r(ifs, ",", &last); ifname != NULL;
+      ifname = strtok_r(NULL, ",", &last)) {
+        if (pvt->nlinks == RTPP_KFWD_MAXIFS) {
+            RTPP_LOG(pvt->log, RTPP_LOG_ERR, "too many interfaces, at most "
+              "%d are supported", RTPP_KFWD_MAXIFS);
+            goto e0;
+        }
+        ifindex = if_nametoindex(ifname);
+        if (ifindex == 0) {
+            RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "%s: unknown interface",
+              ifname);
+            goto e0;
+        }
+        memset(&attr, '\0', sizeof(attr));
+        attr.link_create.prog_fd = pvt->prog_fd;
+        attr.link_create.target_ifindex = ifindex;
+        attr.link_create.attach_type = RTPP_KFWD_TCX_INGRESS;
+        fd = rtpp_kfwd_bpf(BPF_LINK_CREATE, &attr);
+        if (fd < 0) {
+            RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "%s: can't attach BPF program",
+              ifname);
+            goto e0;
+        }
+        pvt->link_fds[pvt->nlinks++] = fd;
+        RTPP_LOG(pvt->log, RTPP_LOG_INFO, "%s: in-kernel forwarding enabled",
+          ifname);
+    }
+    free(ifs);
+    if (pvt->nlinks == 0) {
+        RTPP_LOG(pvt->log, RTPP_LOG_ERR, "no interfaces to attach to");
+        return (-1);
+    }
+    return (0);
+e0:
+    free(ifs);
+    while (pvt->nlinks > 0) {
+        close(pvt->link_fds[--pvt->nlinks]);
+    }
+    return (-1);
+}
+
+/*
+ * Ask the kernel which interface and preferred source address it would
+ * use to reach the daddr.
+ */
+static int
+rtpp_kfwd_getroute(struct rtpp_kfwd_priv *pvt, uint32_t daddr,
+  uint32_t *ifindex, uint32_t *prefsrc)
+{
+    struct {
+        struct nlmsghdr nh;
+        struct rtmsg rtm;
+        struct rtattr rta;
+        uint32_t dst;
+    } req;
+    union {
+        struct nlmsghdr nh;
+        char buf[4096];
+    } resp;
+    struct nlmsghdr *nh;
+    struct rtmsg *rtm;
+    struct rtattr *rta;
+    int len, alen, rval;
+
+    memset(&req, '\0', sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg)) +
+      RTA_LENGTH(sizeof(uint32_t));
+    req.nh.nlmsg_type = RTM_GETROUTE;
+    req.nh.nlmsg_flags = NLM_F_REQUEST;
+    req.rtm.rtm_family = AF_INET;
+    req.rtm.rtm_dst_len = 32;
+    req.rta.rta_type = RTA_DST;
+    req.rta.rta_len = RTA_LENGTH(sizeof(uint32_t));
+    req.dst = daddr;
+
+    rval = -1;
+    *ifindex = *prefsrc = 0;
+    pthread_mutex_lock(&pvt->nl_lock);
+    req.nh.nlmsg_seq = ++pvt->nl_seq;
+    if (send(pvt->nl_fd, &req, req.nh.nlmsg_len, 0) < 0)
+        goto out;
+    do {
+        len = recv(pvt->nl_fd, &resp, sizeof(resp), 0);
+        if (len < 0)
+            goto out;
+        nh = &resp.nh;
+    } while (NLMSG_OK(nh, len) && nh->nlmsg_seq != pvt->nl_seq);
+    if (!NLMSG_OK(nh, len) || nh->nlmsg_type != RTM_NEWROUTE)
+        goto out;
+    rtm = NLMSG_DATA(nh);
+    if (rtm->rtm_type != RTN_UNICAST && rtm->rtm_type != RTN_LOCAL)
+        goto out;
+    alen = RTM_PAYLOAD(nh);
+    for (rta = RTM_RTA(rtm); RTA_OK(rta, alen); rta = RTA_NEXT(rta, alen)) {
+        switch (rta->rta_type) {
+        case RTA_OIF:
+            memcpy(ifindex, RTA_DATA(rta), sizeof(*ifindex));
+            break;
+
+        case RTA_PREFSRC:
+            memcpy(prefsrc, RTA_DATA(rta), sizeof(*prefsrc));
+            break;
+        }
+    }
+    if (*ifindex != 0)
+        rval = 0;
+out:
+    pthread_mutex_unlock(&pvt->nl_lock);
+    return (rval);
+}
+
+struct rtpp_kfwd *
+rtpp_kfwd_ctor(struct rtpp_cfg_stable *cfsp, const char *ifnames)
+{
+    struct rtpp_kfwd_priv *pvt;
+    struct rtpp_refcnt *rcnt;
+
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_kfwd_priv), &rcnt);
+    if (pvt == NULL) {
+        goto e0;
+    }
+    pvt->pub.rcnt = rcnt;
+    pvt->log = cfsp->glog;
+    pvt->flows = rtpp_hash_table_ctor(rtpp_ht_key_u64_t, RTPP_HT_NODUPS);
+    if (pvt->flows == NULL) {
+        goto e1;
+    }
+    if (pthread_mutex_init(&pvt->nl_lock, NULL) != 0) {
+        goto e2;
+    }
+    pvt->nl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (pvt->nl_fd < 0) {
+        RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't create netlink socket");
+        goto e3;
+    }
+    if (rtpp_kfwd_mkmap(pvt) != 0) {
+        goto e4;
+    }
+    if (rtpp_kfwd_mkprog(pvt) != 0) {
+        goto e5;
+    }
+    if (rtpp_kfwd_attach(pvt, ifnames) != 0) {
+        goto e6;
+    }
+    CALL_SMETHOD(pvt->log->rcnt, incref);
+    pvt->rtpp_stats = cfsp->rtpp_stats;
+    pvt->rtp_streams_wrt = cfsp->rtp_streams_wrt;
+    pvt->rtcp_streams_wrt = cfsp->rtcp_streams_wrt;
+    pvt->npkts_rcvd_idx = CALL_METHOD(pvt->rtpp_stats, getidxbyname,
+      "npkts_rcvd");
+    pvt->npkts_relayed_idx = CALL_METHOD(pvt->rtpp_stats, getidxbyname,
+      "npkts_relayed");
+    pvt->npkts_kfwd_idx = CALL_METHOD(pvt->rtpp_stats, getidxbyname,
+      "npkts_kfwd");
+    pvt->pub.offload = &rtpp_kfwd_offload;
+    pvt->pub.unload = &rtpp_kfwd_unload;
+    pvt->pub.unload_sess = &rtpp_kfwd_unload_sess;
+    pvt->pub.start = &rtpp_kfwd_start;
+    pvt->pub.shutdown = &rtpp_kfwd_shutdown;
+    CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_kfwd_dtor,
+      pvt);
+    return ((&pvt->pub));
+
+e6:
+    close(pvt->prog_fd);
+e5:
+    close(pvt->map_fd);
+e4:
+    close(pvt->nl_fd);
+e3:
+    pthread_mutex_destroy(&pvt->nl_lock);
+e2:
+    CALL_METHOD(pvt->flows, dtor);
+e1:
+    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_kfwd_dtor(struct rtpp_kfwd_priv *pvt)
+{
+    int i;
+
+    /* Flow dtors need the map, so drop them first */
+    CALL_METHOD(pvt->flows, dtor);
+    for (i = 0; i < pvt->nlinks; i++) {
+        close(pvt->link_fds[i]);
+    }
+    close(pvt->prog_fd);
+    close(pvt->map_fd);
+    close(pvt->nl_fd);
+    pthread_mutex_destroy(&pvt->nl_lock);
+    CALL_SMETHOD(pvt->log->rcnt, decref);
+    free(pvt);
+}
+
+static void
+rtpp_kfwd_flow_dtor(struct rtpp_kfwd_flow *fp)
+{
+    union bpf_attr attr;
+
+    if (fp->installed) {
+        memset(&attr, '\0', sizeof(attr));
+        attr.map_fd = fp->map_fd;
+        attr.key = (uintptr_t)&fp->key;
+        rtpp_kfwd_bpf(BPF_MAP_DELETE_ELEM, &attr);
+    }
+    free(fp);
+}
+
+/*
+ * Account packets forwarded by the classifier since the last call,
+ * returns -1 if the map entry has disappeared.
+ */
+static int
+rtpp_kfwd_flow_sync(struct rtpp_kfwd_flow *fp, struct rtpp_stream *stp,
+  double dtime, uint64_t *npkts)
+{
+    struct rtpp_kfwd_val val;
+    union bpf_attr attr;
+    uint64_t delta;
+
+    if (!fp->installed)
+        return (0);
+    memset(&attr, '\0', sizeof(attr));
+    attr.map_fd = fp->map_fd;
+    attr.key = (uintptr_t)&fp->key;
+    attr.value = (uintptr_t)&val;
+    if (rtpp_kfwd_bpf(BPF_MAP_LOOKUP_ELEM, &attr) != 0)
+        return (-1);
+    delta = val.npkts - fp->npkts;
+    if (delta == 0)
+        return (0);
+    fp->npkts = val.npkts;
+    CALL_METHOD(stp->pcnt_strm, add_pktin, delta, dtime);
+    CALL_METHOD(stp->pcount, add_reld, delta);
+    CALL_METHOD(stp->ttl, reset);
+    if (stp->analyzer != NULL)
+        CALL_METHOD(stp->analyzer, reg_kfwd, delta);
+    *npkts += delta;
+    return (0);
+}
+
+/*
+ * Packets forwarded in kernel are not seen by anything in the userland,
+ * so the flow has to stay there as long as something wants to look at
+ * them: recording, resizer, packet hooks of the modules or the player.
+ * The analyzer is not one of those, it's only told how many packets have
+ * gone by, see rtpp_kfwd_flow_sync().
+ */
+static int
+rtpp_kfwd_nconsumers(struct rtpp_stream *stp_in, struct rtpp_stream *stp_out)
+{
+
+    if (stp_in->rrc != NULL || stp_in->resizer != NULL)
+        return (1);
+    if (stp_in->modules_cf != NULL && stp_in->modules_cf->has_pkts_hook)
+        return (1);
+    if (CALL_SMETHOD(stp_out, isplayer_active))
+        return (1);
+    return (0);
+}
+
+static int
+rtpp_kfwd_flow_isvalid(struct rtpp_kfwd_flow *fp, struct rtpp_stream *stp_in,
+  struct rtpp_stream *stp_out)
+{
+    struct rtpp_netaddr *rem_addr;
+    int rval;
+
+    if (rtpp_kfwd_nconsumers(stp_in, stp_out))
+        return (0);
+    rem_addr = CALL_SMETHOD(stp_in, get_rem_addr, 0);
+    if (rem_addr == NULL)
+        return (0);
+    rval = CALL_SMETHOD(rem_addr, cmp, sstosa(&fp->src), sizeof(fp->src));
+    CALL_SMETHOD(rem_addr->rcnt, decref);
+    if (rval != 0)
+        return (0);
+    rem_addr = CALL_SMETHOD(stp_out, get_rem_addr, 0);
+    if (rem_addr == NULL)
+        return (0);
+    rval = CALL_SMETHOD(rem_addr, cmp, sstosa(&fp->dst), sizeof(fp->dst));
+    CALL_SMETHOD(rem_addr->rcnt, decref);
+    return (rval == 0);
+}
+
+#define FLUSH_KFSTAT(pvt, idx, cnt)    { \
+    if ((cnt) > 0) { \
+        CALL_METHOD((pvt)->rtpp_stats, updatebyidx, (idx), (cnt)); \
+    } \
+}
+
+static void
+rtpp_kfwd_flush_stats(struct rtpp_kfwd_priv *pvt, uint64_t npkts)
+{
+
+    FLUSH_KFSTAT(pvt, pvt->npkts_rcvd_idx, npkts);
+    FLUSH_KFSTAT(pvt, pvt->npkts_relayed_idx, npkts);
+    FLUSH_KFSTAT(pvt, pvt->npkts_kfwd_idx, npkts);
+}
+
+static void
+rtpp_kfwd_offload(struct rtpp_kfwd *self, struct rtpp_stream *stp_in,
+  struct rtpp_stream *stp_out, const struct rtp_packet *pkt)
+{
+    struct rtpp_kfwd_priv *pvt;
+    struct rtpp_kfwd_flow *fp;
+    struct rtpp_refcnt *rcnt;
+    struct rtpp_netaddr *rem_addr;
+    struct rtpp_kfwd_val val;
+    union bpf_attr attr;
+    uint32_t oif, prefsrc;
+    size_t alen;
+
+    if (pkt->raddr.ss_family != AF_INET || pkt->laddr->sa_family != AF_INET ||
+      stp_out->laddr->sa_family != AF_INET)
+        return;
+    if (rtpp_kfwd_nconsumers(stp_in, stp_out))
+        return;
+    if (!CALL_SMETHOD(stp_in, issettled, pkt->rtime) ||
+      !CALL_SMETHOD(stp_out, issettled, pkt->rtime))
+        return;
+    pvt = PUB2PVT(self);
+    rcnt = CALL_METHOD(pvt->flows, find, &stp_in->stuid);
+    if (rcnt != NULL) {
+        /* Already in the kernel, or found unsuitable for it */
+        CALL_SMETHOD(rcnt, decref);
+        return;
+    }
+    fp = rtpp_rzmalloc(sizeof(struct rtpp_kfwd_flow), &rcnt);
+    if (fp == NULL)
+        return;
+    fp->rcnt = rcnt;
+    fp->stuid_in = stp_in->stuid;
+    fp->stuid_out = stp_out->stuid;
+    fp->pipe_type = stp_in->pipe_type;
+    fp->map_fd = pvt->map_fd;
+    fp->ctime = pkt->rtime;
+    memcpy(&fp->src, &pkt->raddr, sizeof(fp->src));
+    fp->key.saddr = fp->src.sin_addr.s_addr;
+    fp->key.daddr = satosin(pkt->laddr)->sin_addr.s_addr;
+    fp->key.sport = fp->src.sin_port;
+    fp->key.dport = htons(stp_in->port);
+    CALL_SMETHOD(rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_kfwd_flow_dtor, fp);
+
+    /*
+     * The classifier sees all traffic on the interface, so without the
+     * exact local address in the key it would grab transit packets too.
+     */
+    if (fp->key.daddr == htonl(INADDR_ANY))
+        goto record;
+
+    rem_addr = CALL_SMETHOD(stp_out, get_rem_addr, 0);
+    if (rem_addr == NULL)
+        goto record;
+    alen = CALL_SMETHOD(rem_addr, get, sstosa(&fp->dst), sizeof(fp->dst));
+    CALL_SMETHOD(rem_addr->rcnt, decref);
+    if (alen != sizeof(fp->dst) || fp->dst.sin_family != AF_INET)
+        goto record;
+    if (rtpp_kfwd_getroute(pvt, fp->dst.sin_addr.s_addr, &oif, &prefsrc) != 0)
+        goto record;
+    memset(&val, '\0', sizeof(val));
+    val.saddr = satosin(stp_out->laddr)->sin_addr.s_addr;
+    if (val.saddr == htonl(INADDR_ANY))
+        val.saddr = prefsrc;
+    if (val.saddr == htonl(INADDR_ANY))
+        goto record;
+    val.daddr = fp->dst.sin_addr.s_addr;
+    val.sport = htons(stp_out->port);
+    val.dport = fp->dst.sin_port;
+    val.ifindex = oif;
+
+    memset(&attr, '\0', sizeof(attr));
+    attr.map_fd = pvt->map_fd;
+    attr.key = (uintptr_t)&fp->key;
+    attr.value = (uintptr_t)&val;
+    attr.flags = BPF_NOEXIST;
+    if (rtpp_kfwd_bpf(BPF_MAP_UPDATE_ELEM, &attr) != 0) {
+        RTPP_ELOG(stp_in->log, RTPP_LOG_ERR, "can't offload %s's %s stream "
+          "to the kernel", CALL_SMETHOD(stp_in, get_actor),
+          CALL_SMETHOD(stp_in, get_proto));
+        goto record;
+    }
+    fp->installed = 1;
+    RTPP_LOG(stp_in->log, RTPP_LOG_INFO, "%s's %s stream is now forwarded "
+      "in kernel", CALL_SMETHOD(stp_in, get_actor),
+      CALL_SMETHOD(stp_in, get_proto));
+record:
+    CALL_METHOD(pvt->flows, append_refcnt, &fp->stuid_in, rcnt);
+    CALL_SMETHOD(rcnt, decref);
+}
+
+static void
+rtpp_kfwd_unload(struct rtpp_kfwd *self, struct rtpp_stream *stp)
+{
+    struct rtpp_kfwd_priv *pvt;
+    struct rtpp_kfwd_flow *fp;
+    struct rtpp_refcnt *rcnt;
+    uint64_t npkts;
+
+    pvt = PUB2PVT(self);
+    rcnt = CALL_METHOD(pvt->flows, find, &stp->stuid);
+    if (rcnt == NULL)
+        return;
+    CALL_METHOD(pvt->flows, remove_by_key, &stp->stuid);
+    fp = CALL_SMETHOD(rcnt, getdata);
+    npkts = 0;
+    rtpp_kfwd_flow_sync(fp, stp, getdtime(), &npkts);
+    rtpp_kfwd_flush_stats(pvt, npkts);
+    if (fp->installed) {
+        RTPP_LOG(stp->log, RTPP_LOG_INFO, "%s's %s stream is back to userland "
+          "forwarding", CALL_SMETHOD(stp, get_actor),
+          CALL_SMETHOD(stp, get_proto));
+    }
+    CALL_SMETHOD(rcnt, decref);
+}
+
+static void
+rtpp_kfwd_unload_sess(struct rtpp_kfwd *self, struct rtpp_session *sp)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        rtpp_kfwd_unload(self, sp->rtp->stream[i]);
+        rtpp_kfwd_unload(self, sp->rtcp->stream[i]);
+    }
+}
+
+static int
+rtpp_kfwd_sync_flow(void *dp, void *ap)
+{
+    struct rtpp_kfwd_flow *fp;
+    struct rtpp_kfwd_sync_args *sap;
+    struct rtpp_weakref_obj *wrt;
+    struct rtpp_stream *stp_in, *stp_out;
+    int rval;
+
+    fp = (struct rtpp_kfwd_flow *)dp;
+    sap = (struct rtpp_kfwd_sync_args *)ap;
+    if (fp->pipe_type == PIPE_RTP) {
+        wrt = sap->pvt->rtp_streams_wrt;
+    } else {
+        wrt = sap->pvt->rtcp_streams_wrt;
+    }
+    stp_in = CALL_METHOD(wrt, get_by_idx, fp->stuid_in);
+    if (stp_in == NULL)
+        return (RTPP_HT_MATCH_DEL);
+    stp_out = CALL_METHOD(wrt, get_by_idx, fp->stuid_out);
+    if (stp_out == NULL) {
+        CALL_SMETHOD(stp_in->rcnt, decref);
+        return (RTPP_HT_MATCH_DEL);
+    }
+    rval = RTPP_HT_MATCH_CONT;
+    if (!fp->installed) {
+        /* Give it another chance, things might have changed since */
+        if (sap->dtime - fp->ctime >= RTPP_KFWD_NRETRY)
+            rval = RTPP_HT_MATCH_DEL;
+    } else if (rtpp_kfwd_flow_sync(fp, stp_in, sap->dtime,
+      &sap->npkts) != 0 || !rtpp_kfwd_flow_isvalid(fp, stp_in, stp_out)) {
+        /* Let the userland handle it and re-offload once it settles */
+        RTPP_LOG(stp_in->log, RTPP_LOG_INFO, "%s's %s stream is back to "
+          "userland forwarding", CALL_SMETHOD(stp_in, get_actor),
+          CALL_SMETHOD(stp_in, get_proto));
+        rval = RTPP_HT_MATCH_DEL;
+    }
+    CALL_SMETHOD(stp_out->rcnt, decref);
+    CALL_SMETHOD(stp_in->rcnt, decref);
+    return (rval);
+}
+
+static enum rtpp_timed_cb_rvals
+rtpp_kfwd_sync(double ctime, void *p)
+{
+    struct rtpp_kfwd_sync_args sargs;
+
+    sargs.pvt = (struct rtpp_kfwd_priv *)p;
+    sargs.dtime = ctime;
+    sargs.npkts = 0;
+    CALL_METHOD(sargs.pvt->flows, foreach, rtpp_kfwd_sync_flow, &sargs);
+    rtpp_kfwd_flush_stats(sargs.pvt, sargs.npkts);
+    return (sargs.pvt->sync_rval);
+}
+
+static int
+rtpp_kfwd_start(struct rtpp_kfwd *self, struct rtpp_timed *rtpp_timed_cf)
+{
+    struct rtpp_kfwd_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    pvt->sync_rval = CB_MORE;
+    pvt->sync_task = CALL_METHOD(rtpp_timed_cf, schedule_rc, RTPP_KFWD_SPERD,
+      pvt->pub.rcnt, rtpp_kfwd_sync, NULL, pvt);
+    if (pvt->sync_task == NULL)
+        return (-1);
+    return (0);
+}
+
+static void
+rtpp_kfwd_shutdown(struct rtpp_kfwd *self)
+{
+    struct rtpp_kfwd_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    if (pvt->sync_task == NULL)
+        return;
+    pvt->sync_rval = CB_LAST;
+    CALL_METHOD(pvt->sync_task, cancel);
+    CALL_SMETHOD(pvt->sync_task->rcnt, decref);
+    pvt->sync_task = NULL;
+}
+#endif
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_KFWD_H_
+#define _RTPP_KFWD_H_
+
+/*
+ * In-kernel forwarding of the settled streams. A small TC classifier is
+ * attached to the ingress of the specified interfaces and rewrites and
+ * redirects packets for flows listed in a BPF hash map, which is filled
+ * once both streams of a flow have settled and no userland processing
+ * (recording, resizing, module packet hooks, playback) is required. The
+ * RTP analyzer only gets the packet counts of an offloaded flow, jitter
+ * and loss are measured over the packets seen in the userland. Flows
+ * found unsuitable are looked at again every few seconds.
+ */
+
+struct rtpp_kfwd;
+struct rtpp_cfg_stable;
+struct rtpp_refcnt;
+struct rtpp_session;
+struct rtpp_stream;
+struct rtpp_timed;
+struct rtp_packet;
+
+DEFINE_METHOD(rtpp_kfwd, rtpp_kfwd_offload, void, struct rtpp_stream *,
+  struct rtpp_stream *, const struct rtp_packet *);
+DEFINE_METHOD(rtpp_kfwd, rtpp_kfwd_unload, void, struct rtpp_stream *);
+DEFINE_METHOD(rtpp_kfwd, rtpp_kfwd_unload_sess, void, struct rtpp_session *);
+DEFINE_METHOD(rtpp_kfwd, rtpp_kfwd_start, int, struct rtpp_timed *);
+DEFINE_METHOD(rtpp_kfwd, rtpp_kfwd_shutdown, void);
+
+struct rtpp_kfwd {
+    struct rtpp_refcnt *rcnt;
+    METHOD_ENTRY(rtpp_kfwd_offload, offload);
+    METHOD_ENTRY(rtpp_kfwd_unload, unload);
+    METHOD_ENTRY(rtpp_kfwd_unload_sess, unload_sess);
+    METHOD_ENTRY(rtpp_kfwd_start, start);
+    METHOD_ENTRY(rtpp_kfwd_shutdown, shutdown);
+};
+
+struct rtpp_kfwd *rtpp_kfwd_ctor(struct rtpp_cfg_stable *, const char *);
+
+#endif
@@ -26,6 +26,8 @@
  *
  */
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -33,16 +35,40 @@
 
 #include "rtpp_types.h"
 #include "rtpp_log.h"
+#include "rtpp_cfg_stable.h"
 #include "rtpp_log_obj.h"
 #include "rtpp_log_obj_fin.h"
 #include "rtpp_genuid_singlet.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_refcnt.h"
+#include "rtpp_time.h"
+
+#define RTPP_LOG_RL_NSETS 8
+#define RTPP_LOG_RL_NWAYS 4
+
+/*
+ * Token bucket of a single call site. Call sites are told apart by their
+ * format string and hashed into a small set-associative table. When all
+ * ways of a set are taken the least recently used site gives up its slot,
+ * but not the tokens, so sites fighting over a set share one bucket
+ * rather than get a fresh burst each time round.
+ */
+struct rtpp_log_rlsite {
+    const char *fmt;
+    double tokens;
+    double lastupd;
+    unsigned long nsupp;
+};
 
 struct rtpp_log_priv
 {
     struct rtpp_log pub;
     rtpp_log_t log;
+    int level;
+    double rl_rate;
+    double rl_burst;
+    pthread_mutex_t rl_lock;
+    struct rtpp_log_rlsite rl_sites[RTPP_LOG_RL_NSETS * RTPP_LOG_RL_NWAYS];
 };
 
 #define PUB2PVT(pubp) \
@@ -65,7 +91,17 @@ rtpp_log_ctor(struct rtpp_cfg_stable *cfs, const char *app,
         return (NULL);
     }
     pvt->pub.rcnt = rcnt;
+    if (pthread_mutex_init(&pvt->rl_lock, NULL) != 0) {
+        goto e0;
+    }
     pvt->log = rtpp_log_open(cfs, app, call_id, flags);
+    if (cfs->log_level == -1) {
+        pvt->level = (cfs->nodaemon != 0) ? RTPP_LOG_DBUG : RTPP_LOG_WARN;
+    } else {
+        pvt->level = cfs->log_level;
+    }
+    pvt->rl_rate = cfs->log_rl_rate;
+    pvt->rl_burst = cfs->log_rl_burst;
     rtpp_gen_uid(&pvt->pub.lguid);
     pvt->pub.setlevel = &rtpp_log_obj_setlevel;
     pvt->pub.write = rtpp_log_obj_write;
@@ -73,6 +109,10 @@ rtpp_log_ctor(struct rtpp_cfg_stable *cfs, const char *app,
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_log_obj_dtor,
       pvt);
     return (&pvt->pub);
+e0:
+    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    free(pvt);
+    return (NULL);
 }
 
 static void
@@ -81,6 +121,7 @@ rtpp_log_obj_dtor(struct rtpp_log_priv *pvt)
 
     rtpp_log_fin(&pvt->pub);
     rtpp_log_close(pvt->log);
+    pthread_mutex_destroy(&pvt->rl_lock);
     free(pvt);
 }
 
@@ -90,11 +131,73 @@ rtpp_log_obj_setlevel(struct rtpp_log *self, int log_level)
     struct rtpp_log_priv *pvt;
 
     pvt = PUB2PVT(self);
-    if (log_level != -1) {
-        rtpp_log_setlevel(pvt->log, log_level);
+    if (log_level == -1) {
+        log_level = RTPP_LOG_ERR;
+    }
+    rtpp_log_setlevel(pvt->log, log_level);
+    pvt->level = log_level;
+}
+
+/*
+ * Returns 0 if the message has to be suppressed, otherwise 1 and the
+ * number of messages suppressed from the same call site since the last
+ * one that went through.
+ */
+static int
+rtpp_log_obj_ratelimit(struct rtpp_log_priv *pvt, const char *fmt,
+  unsigned long *nsuppp)
+{
+    struct rtpp_log_rlsite *setp, *rlsp;
+    double dtime;
+    int i, rval;
+
+    *nsuppp = 0;
+    if (pvt->rl_rate <= 0)
+        return (1);
+    setp = &pvt->rl_sites[(((uintptr_t)fmt >> 3) % RTPP_LOG_RL_NSETS) *
+      RTPP_LOG_RL_NWAYS];
+    dtime = getdtime();
+    pthread_mutex_lock(&pvt->rl_lock);
+    rlsp = &setp[0];
+    for (i = 0; i < RTPP_LOG_RL_NWAYS; i++) {
+        if (setp[i].fmt == fmt) {
+            rlsp = &setp[i];
+            break;
+        }
+        if (setp[i].lastupd < rlsp->lastupd)
+            rlsp = &setp[i];
+    }
+    if (rlsp->fmt != fmt) {
+        /* Unused slots have lastupd of 0, so they start with a full burst */
+        rlsp->fmt = fmt;
+        rlsp->nsupp = 0;
+    }
+    rlsp->tokens += (dtime - rlsp->lastupd) * pvt->rl_rate;
+    if (rlsp->tokens > pvt->rl_burst)
+        rlsp->tokens = pvt->rl_burst;
+    rlsp->lastupd = dtime;
+    if (rlsp->tokens < 1.0) {
+        rlsp->nsupp++;
+        rval = 0;
     } else {
-        rtpp_log_setlevel(pvt->log, RTPP_LOG_ERR);
+        rlsp->tokens -= 1.0;
+        *nsuppp = rlsp->nsupp;
+        rlsp->nsupp = 0;
+        rval = 1;
     }
+    pthread_mutex_unlock(&pvt->rl_lock);
+    return (rval);
+}
+
+static void
+rtpp_log_obj_emit(struct rtpp_log_priv *pvt, const char *fname, int level,
+  const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    _rtpp_log_write_va(pvt->log, level, fname, fmt, ap);
+    va_end(ap);
 }
 
 static void
@@ -103,8 +206,17 @@ rtpp_log_obj_write(struct rtpp_log *self, const char *fname, int level,
 {
     va_list ap;
     struct rtpp_log_priv *pvt;
+    unsigned long nsupp;
 
     pvt = PUB2PVT(self);
+    if (level > pvt->level)
+        return;
+    if (rtpp_log_obj_ratelimit(pvt, fmt, &nsupp) == 0)
+        return;
+    if (nsupp > 0) {
+        rtpp_log_obj_emit(pvt, fname, level, "suppressed %lu similar "
+          "messages", nsupp);
+    }
     va_start(ap, fmt);
     _rtpp_log_write_va(pvt->log, level, fname, fmt, ap);
     va_end(ap);
@@ -117,8 +229,20 @@ rtpp_log_obj_ewrite(struct rtpp_log *self, const char *fname, int level,
 {
     va_list ap;
     struct rtpp_log_priv *pvt;
+    unsigned long nsupp;
+    int serrno;
 
     pvt = PUB2PVT(self);
+    if (level > pvt->level)
+        return;
+    if (rtpp_log_obj_ratelimit(pvt, fmt, &nsupp) == 0)
+        return;
+    if (nsupp > 0) {
+        serrno = errno;
+        rtpp_log_obj_emit(pvt, fname, level, "suppressed %lu similar "
+          "messages", nsupp);
+        errno = serrno;
+    }
     va_start(ap, fmt);
     _rtpp_log_ewrite_va(pvt->log, level, fname, fmt, ap);
     va_end(ap);
@@ -66,6 +66,7 @@ _rtpp_log_open(struct rtpp_cfg_stable *cf, const char *app, const char *call_id)
     const char *tform;
     char *se;
     struct rtpp_log_inst *rli;
+    size_t cidlen;
 #ifdef RTPP_LOG_ADVANCED
     int facility;
 
@@ -78,7 +79,9 @@ _rtpp_log_open(struct rtpp_cfg_stable *cf, const char *app, const char *call_id)
 	    syslog_async_opened = 1;
     }
 #endif
-    rli = rtpp_zmalloc(sizeof(struct rtpp_log_inst));
+    /* Call-id is stored at the end of the same allocation */
+    cidlen = (call_id != NULL) ? strlen(call_id) + 1 : 0;
+    rli = rtpp_zmalloc(sizeof(struct rtpp_log_inst) + cidlen);
     if (rli == NULL) {
         return (NULL);
     }
@@ -95,7 +98,8 @@ _rtpp_log_open(struct rtpp_cfg_stable *cf, const char *app, const char *call_id)
         }
     }
     if (call_id != NULL) {
-        rli->call_id = strdup(call_id);
+        rli->call_id = (char *)(rli + 1);
+        memcpy(rli->call_id, call_id, cidlen);
     }
     if (cf->log_level == -1) {
 	rli->level = (cf->nodaemon != 0) ? RTPP_LOG_DBUG : RTPP_LOG_WARN;
@@ -112,9 +116,6 @@ _rtpp_log_open(struct rtpp_cfg_stable *cf, const char *app, const char *call_id)
 void
 _rtpp_log_close(struct rtpp_log_inst *rli)
 {
-    if (rli->call_id != NULL) {
-        free(rli->call_id);
-    }
     free(rli);
     return;
 }
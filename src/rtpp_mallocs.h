@@ -40,6 +40,12 @@ void *rtpp_zmalloc(size_t);
 
 struct rtpp_refcnt;
 
+/*
+ * Round size up so that an object placed right after the block of that
+ * size is suitably aligned, used when co-allocating several objects.
+ */
+#define RTPP_MALIGN(s) (((s) + 15) & ~(size_t)15)
+
 #if defined(RTPP_CHECK_LEAKS)
 #define rtpp_rzmalloc(args...) rtpp_rzmalloc_memdeb(__FILE__, __LINE__, __func__, ## args)
 void *rtpp_rzmalloc_memdeb(const char *, int, const char *, size_t,
@@ -106,6 +106,9 @@ struct rtpp_memdeb_priv {
     struct rtpp_log *_md_glog;
 };
 
+/* Number of blocks allocated by the current thread, all instances */
+static __thread uint64_t memdeb_tnalloc;
+
 void *
 rtpp_memdeb_init()
 {
@@ -245,6 +248,7 @@ rtpp_memdeb_malloc(size_t size, void *p, const char *fname, int linen, const cha
     mnp->mstats.balloc += size;
     mpf->magic = MEMDEB_SIGNATURE_ALLOC(mpf);
     pthread_mutex_unlock(&pvt->mutex);
+    memdeb_tnalloc++;
     mpf->asize = size;
     mpf->mnp = mnp;
     gp = (unsigned char *)mpf->real_data + size;
@@ -345,6 +349,7 @@ rtpp_memdeb_realloc(void *ptr, size_t size, void *p, const char *fname, int line
     new_mpf->mnp->mstats.brealloc += size;
     new_mpf->mnp->mstats.balloc += size - new_mpf->asize;
     pthread_mutex_unlock(&pvt->mutex);
+    memdeb_tnalloc++;
     new_mpf->asize = size;
     gp = (unsigned char *)new_mpf->real_data + size;
     guard = MEMDEB_SIGNATURE_ALLOC(gp);
@@ -375,6 +380,7 @@ rtpp_memdeb_strdup(const char *ptr, void *p, const char *fname, int linen, \
     mnp->mstats.nalloc++;
     mnp->mstats.balloc += size;
     pthread_mutex_unlock(&pvt->mutex);
+    memdeb_tnalloc++;
     mpf->mnp = mnp;
     mpf->asize = size;
     memcpy(mpf->real_data, ptr, size);
@@ -537,3 +543,15 @@ rtpp_memdeb_get_stats(void *p, const char *fname, const char *funcn,
     pthread_mutex_unlock(&pvt->mutex);
     return (nmatches);
 }
+
+/*
+ * Number of blocks allocated (or reallocated) by the calling thread since
+ * it has started, so that the callers can attribute allocations to what
+ * the thread was doing in between two calls.
+ */
+uint64_t
+rtpp_memdeb_tnalloc(void)
+{
+
+    return (memdeb_tnalloc);
+}
@@ -76,3 +76,4 @@ struct memdeb_stats {
      ((a)->afails == (b)->afails)) ? 0 : 1)
 
 int rtpp_memdeb_get_stats(void *, const char *, const char *, struct memdeb_stats *);
+uint64_t rtpp_memdeb_tnalloc(void);
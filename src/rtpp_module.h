@@ -1,4 +1,4 @@
-#define MODULE_API_REVISION 2
+#define MODULE_API_REVISION 3
 
 struct rtpp_cfg_stable;
 struct rtpp_module_priv;
@@ -6,13 +6,53 @@ struct rtpp_acct;
 
 #if !defined(MODULE_IF_CODE)
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <stdint.h>
 #include "rtpp_types.h"
 #endif
 
+enum rtpp_mod_sev_type {RTPP_MOD_SEV_CREATE = 0, RTPP_MOD_SEV_LATCH,
+  RTPP_MOD_SEV_DESTROY};
+
+/*
+ * Stream lifecycle event. Delivered asynchronously from the module's own
+ * thread, so the module is free to block in the handler. The raddr is
+ * only filled in for the RTPP_MOD_SEV_LATCH, ss_family is AF_UNSPEC
+ * otherwise.
+ */
+struct rtpp_mod_sev {
+    enum rtpp_mod_sev_type type;
+    uint64_t stuid;
+    uint64_t seuid;
+    int pipe_type;
+    int side;
+    double dtime;
+    struct sockaddr_storage raddr;
+};
+
+/*
+ * Read-only view of the received packet. In the inline mode all pointers
+ * reference the packet buffers of the core directly and are only valid
+ * for the duration of the call. The pipe_type is PIPE_RTP or PIPE_RTCP
+ * of the stream that has received the packet.
+ */
+struct rtpp_mod_pktview {
+    uint64_t stuid;
+    int pipe_type;
+    const unsigned char *data;
+    size_t size;
+    const struct sockaddr *raddr;
+    double rtime;
+};
+
 DEFINE_METHOD(rtpp_cfg_stable, rtpp_module_ctor, struct rtpp_module_priv *);
 DEFINE_METHOD(rtpp_module_priv, rtpp_module_dtor, void);
 DEFINE_METHOD(rtpp_module_priv, rtpp_module_on_session_end, void,
   struct rtpp_acct *);
+DEFINE_METHOD(rtpp_module_priv, rtpp_module_on_stream_event, void,
+  const struct rtpp_mod_sev *);
+DEFINE_METHOD(rtpp_module_priv, rtpp_module_on_packets, void,
+  const struct rtpp_mod_pktview *, int);
 
 #include <stdarg.h>
 
@@ -64,6 +104,35 @@ struct api_on_sess_end {
    rtpp_module_on_session_end_t func;
 };
 
+struct api_on_stream_event {
+   int rev;
+   size_t argsize;
+   rtpp_module_on_stream_event_t func;
+};
+
+/*
+ * Per-packet observation hook. In the inline mode (default) the func is
+ * called from the RTP and RTCP processing threads with a batch of
+ * zero-copy views and the core stops calling it for the rest of the
+ * current second once the module has used more than budget_us
+ * microseconds of it, counting skipped packets. The core serializes the
+ * inline calls, so on_packets never runs concurrently with itself, but
+ * it does run concurrently with the other hooks, which are called from
+ * the module's own thread: any state shared with them needs locking. In
+ * the RTPP_MOD_PKTS_DEFERRED mode the batch is copied and handed off to
+ * the module's thread, batches are dropped when the module falls behind.
+ */
+#define RTPP_MOD_PKTS_DEFERRED  0x1
+#define RTPP_MOD_PKTS_BUDGET    200     /* default budget, us/s */
+
+struct api_on_packets {
+   int rev;
+   size_t argsize;
+   rtpp_module_on_packets_t func;
+   int flags;
+   int budget_us;
+};
+
 struct rtpp_minfo {
     /* Upper half, filled by the module */
     struct api_version ver;
@@ -74,6 +143,8 @@ struct rtpp_minfo {
     rtpp_module_ctor_t ctor;
     rtpp_module_dtor_t dtor;
     struct api_on_sess_end on_session_end;
+    struct api_on_stream_event on_stream_event;
+    struct api_on_packets on_packets;
     /* Lower half, filled by the core */
     rtpp_module_malloc_t _malloc;
     rtpp_module_zmalloc_t _zmalloc;
@@ -29,6 +29,8 @@
 #define _GNU_SOURCE
 #endif
 
+#include <sys/types.h>
+#include <sys/socket.h>
 #include <dlfcn.h>
 #include <pthread.h>
 #include <signal.h>
@@ -54,7 +56,11 @@
 #include "rtpp_module_if_fin.h"
 #include "rtpp_queue.h"
 #include "rtpp_refcnt.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_stats.h"
+#include "rtpp_time.h"
 #include "rtpp_wi.h"
+#include "rtpp_cpuset.h"
 #ifdef RTPP_CHECK_LEAKS
 #include "rtpp_memdeb_internal.h"
 #endif
@@ -68,6 +74,19 @@ struct rtpp_module_if_priv {
     struct rtpp_wi *sigterm;
     pthread_t thread_id;
     struct rtpp_queue *req_q;
+    struct rtpp_stats *rtpp_stats;
+    /*
+     * Inline packet hook budget accounting. Both the RTP and the RTCP
+     * threads call in, the pkts_lock serializes them, so that the module
+     * never sees two concurrent on_packets calls.
+     */
+    pthread_mutex_t pkts_lock;
+    double pkts_budget;
+    double pkts_bwin_start;
+    double pkts_bwin_used;
+    int pkts_overbudget;
+    /* Deferred packet batches queued but not yet consumed */
+    int pkts_nbatches;
     /* Privary version of the module's memdeb_p, store it here */
     /* just in case module screws it up                        */
     void *memdeb_p;
@@ -82,11 +101,25 @@ static int rtpp_module_vasprintf(char **, const char *, void *, const char *,
 #endif
 static void rtpp_mif_run(void *);
 static void rtpp_mif_do_acct(struct rtpp_module_if *, struct rtpp_acct *);
+static void rtpp_mif_do_sev(struct rtpp_module_if *,
+  const struct rtpp_mod_sev *);
+static void rtpp_mif_do_pkts(struct rtpp_module_if *,
+  const struct rtpp_mod_pktview *, int);
+
+/* Max number of the deferred packet batches in flight */
+#define MIF_PKTS_NBATCHES_MAX 64
+
+struct rtpp_mif_pbatch {
+    int n;
+    struct rtpp_mod_pktview pvs[0];
+};
 
 #define PUB2PVT(pubp) \
   ((struct rtpp_module_if_priv *)((char *)(pubp) - offsetof(struct rtpp_module_if_priv, pub)))
 
 static const char *do_acct_aname = "do_acct";
+static const char *do_sev_aname = "do_sev";
+static const char *do_pkts_aname = "do_pkts";
 
 struct rtpp_module_if *
 rtpp_module_if_ctor(struct rtpp_cfg_stable *cfsp, struct rtpp_log *log,
@@ -171,20 +204,40 @@ rtpp_module_if_ctor(struct rtpp_cfg_stable *cfsp, struct rtpp_log *log,
             goto e5;
         }
     }
-    if (pvt->mip->on_session_end.argsize != rtpp_acct_OSIZE()) {
+    if ((pvt->mip->on_session_end.func != NULL &&
+      pvt->mip->on_session_end.argsize != rtpp_acct_OSIZE()) ||
+      (pvt->mip->on_stream_event.func != NULL &&
+      pvt->mip->on_stream_event.argsize != sizeof(struct rtpp_mod_sev)) ||
+      (pvt->mip->on_packets.func != NULL &&
+      pvt->mip->on_packets.argsize != sizeof(struct rtpp_mod_pktview))) {
         RTPP_LOG(log, RTPP_LOG_ERR, "incompatible API version in the %s, "
           "consider recompiling the module", mpath);
         goto e6;
     }
+    pvt->rtpp_stats = cfsp->rtpp_stats;
+    if (pvt->mip->on_packets.budget_us > 0) {
+        pvt->pkts_budget = (double)pvt->mip->on_packets.budget_us / 1000000.0;
+    } else {
+        pvt->pkts_budget = (double)RTPP_MOD_PKTS_BUDGET / 1000000.0;
+    }
+    if (pthread_mutex_init(&pvt->pkts_lock, NULL) != 0) {
+        goto e6;
+    }
 
     if (pthread_create(&pvt->thread_id, NULL,
       (void *(*)(void *))&rtpp_mif_run, pvt) != 0) {
-        goto e6;
+        goto e7;
     }
     pvt->pub.do_acct = &rtpp_mif_do_acct;
+    pvt->pub.do_sev = &rtpp_mif_do_sev;
+    pvt->pub.do_pkts = &rtpp_mif_do_pkts;
+    pvt->pub.has_sev_hook = (pvt->mip->on_stream_event.func != NULL);
+    pvt->pub.has_pkts_hook = (pvt->mip->on_packets.func != NULL);
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_mif_dtor,
       pvt);
     return ((&pvt->pub));
+e7:
+    pthread_mutex_destroy(&pvt->pkts_lock);
 e6:
     if (pvt->mip->dtor != NULL) {
         pvt->mip->dtor(pvt->mpvt);
@@ -222,6 +275,7 @@ rtpp_mif_dtor(struct rtpp_module_if_priv *pvt)
     rtpp_queue_put_item(pvt->sigterm, pvt->req_q);
     pthread_join(pvt->thread_id, NULL);
     rtpp_queue_destroy(pvt->req_q);
+    pthread_mutex_destroy(&pvt->pkts_lock);
 
     /* Then run module destructor (if any) */
     if (pvt->mip->dtor != NULL) {
@@ -249,8 +303,11 @@ rtpp_mif_run(void *argp)
     struct rtpp_wi *wi;
     int signum;
     const char *aname;
+    void *wargp;
     struct rtpp_acct *rap;
+    struct rtpp_mif_pbatch *pbp;
 
+    rtpp_cpuset_bind(RTPP_THR_MODULE);
     pvt = (struct rtpp_module_if_priv *)argp;
     for (;;) {
         wi = rtpp_queue_get_item(pvt->req_q, 0);
@@ -262,11 +319,20 @@ rtpp_mif_run(void *argp)
             }
             continue;
         }
-        aname = rtpp_wi_apis_getnamearg(wi, (void **)&rap, sizeof(rap));
+        aname = rtpp_wi_apis_getnamearg(wi, (void **)&wargp, sizeof(wargp));
         if (aname == do_acct_aname) {
+            rap = (struct rtpp_acct *)wargp;
             pvt->mip->on_session_end.func(pvt->mpvt, rap);
+            CALL_SMETHOD(rap->rcnt, decref);
+        } else if (aname == do_sev_aname) {
+            pvt->mip->on_stream_event.func(pvt->mpvt, wargp);
+            free(wargp);
+        } else if (aname == do_pkts_aname) {
+            pbp = (struct rtpp_mif_pbatch *)wargp;
+            pvt->mip->on_packets.func(pvt->mpvt, pbp->pvs, pbp->n);
+            free(pbp);
+            __sync_fetch_and_sub(&pvt->pkts_nbatches, 1);
         }
-        CALL_SMETHOD(rap->rcnt, decref);
         rtpp_wi_free(wi);
     }
 }
@@ -278,6 +344,9 @@ rtpp_mif_do_acct(struct rtpp_module_if *self, struct rtpp_acct *acct)
     struct rtpp_wi *wi;
 
     pvt = PUB2PVT(self);
+    if (pvt->mip->on_session_end.func == NULL) {
+        return;
+    }
     wi = rtpp_wi_malloc_apis(do_acct_aname, &acct, sizeof(acct));
     if (wi == NULL) {
         RTPP_LOG(pvt->mip->log, RTPP_LOG_ERR, "module '%s': cannot allocate "
@@ -288,6 +357,113 @@ rtpp_mif_do_acct(struct rtpp_module_if *self, struct rtpp_acct *acct)
     rtpp_queue_put_item(wi, pvt->req_q);
 }
 
+static void
+rtpp_mif_do_sev(struct rtpp_module_if *self, const struct rtpp_mod_sev *sevp)
+{
+    struct rtpp_module_if_priv *pvt;
+    struct rtpp_mod_sev *sevcp;
+    struct rtpp_wi *wi;
+
+    pvt = PUB2PVT(self);
+    sevcp = malloc(sizeof(*sevcp));
+    if (sevcp == NULL) {
+        goto e0;
+    }
+    memcpy(sevcp, sevp, sizeof(*sevcp));
+    wi = rtpp_wi_malloc_apis(do_sev_aname, &sevcp, sizeof(sevcp));
+    if (wi == NULL) {
+        goto e1;
+    }
+    rtpp_queue_put_item(wi, pvt->req_q);
+    return;
+e1:
+    free(sevcp);
+e0:
+    RTPP_LOG(pvt->mip->log, RTPP_LOG_ERR, "module '%s': cannot allocate "
+      "memory", pvt->mip->name);
+}
+
+/*
+ * Make a private copy of the batch, so that the module can look at it
+ * at its own pace from the worker thread.
+ */
+static void
+rtpp_mif_defer_pkts(struct rtpp_module_if_priv *pvt,
+  const struct rtpp_mod_pktview *pvs, int n)
+{
+    struct rtpp_mif_pbatch *pbp;
+    struct rtpp_wi *wi;
+    size_t dlen;
+    unsigned char *dp;
+    int i;
+
+    if (__sync_add_and_fetch(&pvt->pkts_nbatches, 1) > MIF_PKTS_NBATCHES_MAX) {
+        goto e0;
+    }
+    dlen = sizeof(*pbp) + (n * sizeof(pbp->pvs[0]));
+    for (i = 0; i < n; i++) {
+        dlen += sizeof(struct sockaddr_storage) + pvs[i].size;
+    }
+    pbp = malloc(dlen);
+    if (pbp == NULL) {
+        goto e0;
+    }
+    pbp->n = n;
+    dp = (unsigned char *)&pbp->pvs[n];
+    for (i = 0; i < n; i++) {
+        pbp->pvs[i] = pvs[i];
+        memcpy(dp, pvs[i].raddr, sizeof(struct sockaddr_storage));
+        pbp->pvs[i].raddr = (struct sockaddr *)dp;
+        dp += sizeof(struct sockaddr_storage);
+        memcpy(dp, pvs[i].data, pvs[i].size);
+        pbp->pvs[i].data = dp;
+        dp += pvs[i].size;
+    }
+    wi = rtpp_wi_malloc_apis(do_pkts_aname, &pbp, sizeof(pbp));
+    if (wi == NULL) {
+        goto e1;
+    }
+    rtpp_queue_put_item(wi, pvt->req_q);
+    return;
+e1:
+    free(pbp);
+e0:
+    __sync_fetch_and_sub(&pvt->pkts_nbatches, 1);
+    CALL_METHOD(pvt->rtpp_stats, updatebyname, "npkts_mod_dropped", n);
+}
+
+static void
+rtpp_mif_do_pkts(struct rtpp_module_if *self,
+  const struct rtpp_mod_pktview *pvs, int n)
+{
+    struct rtpp_module_if_priv *pvt;
+    double stime;
+
+    pvt = PUB2PVT(self);
+    if (pvt->mip->on_packets.flags & RTPP_MOD_PKTS_DEFERRED) {
+        rtpp_mif_defer_pkts(pvt, pvs, n);
+        return;
+    }
+    pthread_mutex_lock(&pvt->pkts_lock);
+    stime = getdtime();
+    if (stime - pvt->pkts_bwin_start >= 1.0) {
+        pvt->pkts_bwin_start = stime;
+        pvt->pkts_bwin_used = 0.0;
+    } else if (pvt->pkts_bwin_used > pvt->pkts_budget) {
+        if (pvt->pkts_overbudget == 0) {
+            RTPP_LOG(pvt->mip->log, RTPP_LOG_ERR, "module '%s': packet hook "
+              "is over its CPU budget, skipping packets", pvt->mip->name);
+            pvt->pkts_overbudget = 1;
+        }
+        pthread_mutex_unlock(&pvt->pkts_lock);
+        CALL_METHOD(pvt->rtpp_stats, updatebyname, "npkts_mod_skipped", n);
+        return;
+    }
+    pvt->mip->on_packets.func(pvt->mpvt, pvs, n);
+    pvt->pkts_bwin_used += getdtime() - stime;
+    pthread_mutex_unlock(&pvt->pkts_lock);
+}
+
 #if !RTPP_CHECK_LEAKS
 static int
 rtpp_module_asprintf(char **pp, const char *fmt, void *p, const char *fname,
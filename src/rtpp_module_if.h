@@ -30,13 +30,25 @@ struct rtpp_refcnt;
 struct rtpp_acct;
 struct rtpp_log;
 struct rtpp_cfg_stable;
+struct rtpp_mod_sev;
+struct rtpp_mod_pktview;
 
 DEFINE_METHOD(rtpp_module_if, rtpp_module_if_do_acct, void,
   struct rtpp_acct *);
+DEFINE_METHOD(rtpp_module_if, rtpp_module_if_do_sev, void,
+  const struct rtpp_mod_sev *);
+DEFINE_METHOD(rtpp_module_if, rtpp_module_if_do_pkts, void,
+  const struct rtpp_mod_pktview *, int);
 
 struct rtpp_module_if {
     struct rtpp_refcnt *rcnt;
+    /* Module wants stream events, read-only */
+    int has_sev_hook;
+    /* Module wants to observe packets, read-only */
+    int has_pkts_hook;
     METHOD_ENTRY(rtpp_module_if_do_acct, do_acct);
+    METHOD_ENTRY(rtpp_module_if_do_sev, do_sev);
+    METHOD_ENTRY(rtpp_module_if_do_pkts, do_pkts);
 };
 
 struct rtpp_module_if *rtpp_module_if_ctor(struct rtpp_cfg_stable *,
@@ -74,6 +74,18 @@ static const struct rtpp_netaddr_smethods rtpp_netaddr_smethods = {
     .sip_print = &rtpp_netaddr_sip_print
 };
 
+static int
+rtpp_netaddr_init(struct rtpp_netaddr_priv *pvt, struct rtpp_refcnt *rcnt)
+{
+
+    pvt->pub.rcnt = rcnt;
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        return (-1);
+    }
+    pvt->pub.smethods = &rtpp_netaddr_smethods;
+    return (0);
+}
+
 struct rtpp_netaddr *
 rtpp_netaddr_ctor(void)
 {
@@ -84,22 +96,54 @@ rtpp_netaddr_ctor(void)
     if (pvt == NULL) {
         goto e0;
     }
-    pvt->pub.rcnt = rcnt;
-    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+    if (rtpp_netaddr_init(pvt, rcnt) != 0) {
         goto e1;
     }
-    pvt->pub.smethods = &rtpp_netaddr_smethods;
     CALL_SMETHOD(pvt->pub.rcnt, attach,
       (rtpp_refcnt_dtor_t)&rtpp_netaddr_dtor, pvt);
     return ((&pvt->pub));
 
 e1:
-    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    CALL_SMETHOD(rcnt, decref);
     free(pvt);
 e0:
     return (NULL);
 }
 
+size_t
+rtpp_netaddr_osize(void)
+{
+
+    return (sizeof(struct rtpp_netaddr_priv));
+}
+
+/*
+ * Construct object in the (zeroed) memory provided by the owner, sharing
+ * the owner's refcounter. The owner is responsible for calling
+ * rtpp_netaddr_dtor_pa() from its own destructor.
+ */
+struct rtpp_netaddr *
+rtpp_netaddr_ctor_pa(void *pap, struct rtpp_refcnt *rcnt)
+{
+    struct rtpp_netaddr_priv *pvt;
+
+    pvt = (struct rtpp_netaddr_priv *)pap;
+    if (rtpp_netaddr_init(pvt, rcnt) != 0) {
+        return (NULL);
+    }
+    return (&pvt->pub);
+}
+
+void
+rtpp_netaddr_dtor_pa(struct rtpp_netaddr *self)
+{
+    struct rtpp_netaddr_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    rtpp_netaddr_fin(self);
+    pthread_mutex_destroy(&pvt->lock);
+}
+
 static void
 rtpp_netaddr_set(struct rtpp_netaddr *self, const struct sockaddr *addr, size_t alen)
 {
@@ -118,8 +162,7 @@ static void
 rtpp_netaddr_dtor(struct rtpp_netaddr_priv *pvt)
 {
 
-    rtpp_netaddr_fin(&(pvt->pub));
-    pthread_mutex_destroy(&pvt->lock);
+    rtpp_netaddr_dtor_pa(&(pvt->pub));
     free(pvt);
 }
 
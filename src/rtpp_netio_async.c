@@ -27,6 +27,9 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <errno.h>
 #include <pthread.h>
 #include <sched.h>
@@ -34,6 +37,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "rtpp_log.h"
 #include "rtpp_cfg_stable.h"
@@ -50,7 +54,11 @@
 #include "rtpp_netio_async.h"
 #include "rtpp_time.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_histogram.h"
+#include "rtpp_pcnt_strm.h"
+#include "rtpp_stats.h"
 #include "rtpp_debug.h"
+#include "rtpp_cpuset.h"
 #ifdef RTPP_DEBUG
 #include "rtpp_math.h"
 #endif
@@ -59,10 +67,15 @@ struct sthread_args {
     struct rtpp_queue *out_q;
     struct rtpp_log *glog;
     int dmode;
+    int gso;
 #if RTPP_DEBUG_timers
     struct recfilter average_load;
 #endif
     struct rtpp_wi *sigterm;
+    struct rtpp_stats *rtpp_stats;
+    pthread_mutex_t lstats_lock;
+    struct rtpp_histogram send_time;
+    struct rtpp_histogram fwd_lat;
 };
 
 #define SEND_THREADS 1
@@ -74,90 +87,284 @@ struct rtpp_anetio_cf {
 
 #define RTPP_ANETIO_MAX_RETRY 3
 
+/* Limits for the UDP GSO batches, see udp_send_skb() in Linux */
+#define RTPP_ANETIO_GSO_MAXSEGS  64
+#define RTPP_ANETIO_GSO_MAXSEGSZ 1400
+#define RTPP_ANETIO_GSO_MAXLEN   65000
+
+static int
+rtpp_anetio_send_wi(struct rtpp_wi *wi)
+{
+    int n, send_errno, nretry;
+
+    nretry = 0;
+    do {
+        n = sendto(wi->sock, wi->msg, wi->msg_len, wi->flags,
+          wi->sendto, wi->tolen);
+        send_errno = (n < 0) ? errno : 0;
+#if RTPP_DEBUG_netio >= 1
+        if (wi->debug != 0) {
+            char daddr[MAX_AP_STRBUF];
+
+            if (wi->sendto != NULL) {
+                addrport2char_r(wi->sendto, daddr, sizeof(daddr), ':');
+            } else {
+                strcpy(daddr, "connected");
+            }
+            if (n < 0) {
+                RTPP_ELOG(wi->log, RTPP_LOG_DBUG,
+                  "sendto(%d, %p, %lld, %d, %p (%s), %d) = %d",
+                  wi->sock, wi->msg, (long long)wi->msg_len, wi->flags,
+                  wi->sendto, daddr, wi->tolen, n);
+            } else if (n < wi->msg_len) {
+                RTPP_LOG(wi->log, RTPP_LOG_DBUG,
+                  "sendto(%d, %p, %lld, %d, %p (%s), %d) = %d: short write",
+                  wi->sock, wi->msg, (long long)wi->msg_len, wi->flags,
+                  wi->sendto, daddr, wi->tolen, n);
+#if RTPP_DEBUG_netio >= 2
+            } else {
+                RTPP_LOG(wi->log, RTPP_LOG_DBUG,
+                  "sendto(%d, %p, %d, %d, %p (%s), %d) = %d",
+                  wi->sock, wi->msg, wi->msg_len, wi->flags, wi->sendto, daddr,
+                  wi->tolen, n);
+#endif
+            }
+        }
+#endif
+        if (n >= 0) {
+            wi->nsend--;
+        } else {
+            /* "EPERM" is Linux thing, yield and retry */
+            if ((send_errno == EPERM || send_errno == ENOBUFS)
+              && nretry < RTPP_ANETIO_MAX_RETRY) {
+                sched_yield();
+                nretry++;
+            } else {
+                break;
+            }
+        }
+    } while (wi->nsend > 0);
+    return (n);
+}
+
+#if defined(UDP_SEGMENT)
+/*
+ * Return how many work items starting from wis[0] can be handed to the
+ * kernel in one go as a GSO super-datagram: same socket, destination and
+ * segment size, with only the very last segment allowed to be shorter.
+ */
+static int
+rtpp_anetio_gso_span(struct rtpp_wi **wis, int nwis, int *nsegsp)
+{
+    struct rtpp_wi *wi, *wi0;
+    int i, nsegs;
+    size_t tlen;
+
+    wi0 = wis[0];
+    if (wi0->wi_type != RTPP_WI_TYPE_OPKT || wi0->debug != 0 ||
+      wi0->msg_len > RTPP_ANETIO_GSO_MAXSEGSZ) {
+        *nsegsp = 1;
+        return (1);
+    }
+    nsegs = wi0->nsend;
+    tlen = wi0->msg_len * wi0->nsend;
+    for (i = 1; i < nwis; i++) {
+        wi = wis[i];
+        if (wi->wi_type != RTPP_WI_TYPE_OPKT || wi->sock != wi0->sock ||
+          wi->flags != wi0->flags || wi->tolen != wi0->tolen ||
+          wi->debug != 0)
+            break;
+        if (wi->tolen > 0 && memcmp(wi->sendto, wi0->sendto, wi->tolen) != 0)
+            break;
+        if (wi->msg_len > wi0->msg_len ||
+          (wi->msg_len < wi0->msg_len && wi->nsend > 1))
+            break;
+        if (nsegs + wi->nsend > RTPP_ANETIO_GSO_MAXSEGS ||
+          tlen + (wi->msg_len * wi->nsend) > RTPP_ANETIO_GSO_MAXLEN)
+            break;
+        nsegs += wi->nsend;
+        tlen += wi->msg_len * wi->nsend;
+        if (wi->msg_len < wi0->msg_len) {
+            /* Short one terminates the train */
+            i++;
+            break;
+        }
+    }
+    *nsegsp = nsegs;
+    return (i);
+}
+
+static int
+rtpp_anetio_send_gso(struct rtpp_wi **wis, int nwis)
+{
+    struct iovec iov[RTPP_ANETIO_GSO_MAXSEGS];
+    union {
+        struct cmsghdr hdr;
+        unsigned char buf[CMSG_SPACE(sizeof(uint16_t))];
+    } cmsgbuf;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct rtpp_wi *wi0;
+    int i, j, niov, nretry;
+
+    wi0 = wis[0];
+    niov = 0;
+    for (i = 0; i < nwis; i++) {
+        for (j = 0; j < wis[i]->nsend; j++) {
+            iov[niov].iov_base = wis[i]->msg;
+            iov[niov].iov_len = wis[i]->msg_len;
+            niov++;
+        }
+    }
+    memset(&msg, '\0', sizeof(msg));
+    msg.msg_name = wi0->sendto;
+    msg.msg_namelen = wi0->tolen;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = niov;
+    msg.msg_control = cmsgbuf.buf;
+    msg.msg_controllen = sizeof(cmsgbuf.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    *(uint16_t *)CMSG_DATA(cmsg) = wi0->msg_len;
+
+    for (nretry = 0; sendmsg(wi0->sock, &msg, wi0->flags) < 0; nretry++) {
+        if ((errno != EPERM && errno != ENOBUFS) ||
+          nretry == RTPP_ANETIO_MAX_RETRY) {
+            return (-1);
+        }
+        sched_yield();
+    }
+    for (i = 0; i < nwis; i++) {
+        wis[i]->nsend = 0;
+    }
+    return (niov);
+}
+
+/* Check if the kernel knows about UDP_SEGMENT at all */
+static int
+rtpp_anetio_gso_probe(void)
+{
+    int fd, sval, rval;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return (0);
+    sval = RTPP_ANETIO_GSO_MAXSEGSZ;
+    rval = setsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &sval, sizeof(sval));
+    close(fd);
+    return (rval == 0);
+}
+#endif
+
 static void
 rtpp_anetio_sthread(struct sthread_args *args)
 {
-    int n, nsend, i, send_errno, nretry;
+    int n, nsend, i, j, nwis, nsegs;
     struct rtpp_wi *wi, *wis[100];
+    double tp[3], runtime, sleeptime, fwlat, fwlat_total;
+    unsigned long nfwlat, npkts_gso, nfwlat_batch;
+    struct rtpp_histogram fwd_lat;
 #if RTPP_DEBUG_timers
-    double tp[3], runtime, sleeptime;
     long run_n;
 
-    runtime = sleeptime = 0.0;
     run_n = 0;
-    tp[0] = getdtime();
 #endif
+    rtpp_cpuset_bind(RTPP_THR_NET);
+    runtime = sleeptime = fwlat_total = 0.0;
+    nfwlat = npkts_gso = 0;
+    rtpp_histogram_init(&fwd_lat);
+    tp[0] = getdtime();
     for (;;) {
         nsend = rtpp_queue_get_items(args->out_q, wis, 100, 0);
-#if RTPP_DEBUG_timers
         tp[1] = getdtime();
-#endif
+        nfwlat_batch = 0;
 
-        for (i = 0; i < nsend; i++) {
+        for (i = 0; i < nsend; i += nwis) {
 	    wi = wis[i];
             if (wi->wi_type == RTPP_WI_TYPE_SGNL) {
                 rtpp_wi_free(wi);
                 goto out;
             }
-            nretry = 0;
-            do {
-                n = sendto(wi->sock, wi->msg, wi->msg_len, wi->flags,
-                  wi->sendto, wi->tolen);
-                send_errno = (n < 0) ? errno : 0;
-#if RTPP_DEBUG_netio >= 1
-                if (wi->debug != 0) {
-                    char daddr[MAX_AP_STRBUF];
-
-                    addrport2char_r(wi->sendto, daddr, sizeof(daddr), ':');
-                    if (n < 0) {
-                        RTPP_ELOG(wi->log, RTPP_LOG_DBUG,
-                          "sendto(%d, %p, %lld, %d, %p (%s), %d) = %d",
-                          wi->sock, wi->msg, (long long)wi->msg_len, wi->flags,
-                          wi->sendto, daddr, wi->tolen, n);
-                    } else if (n < wi->msg_len) {
-                        RTPP_LOG(wi->log, RTPP_LOG_DBUG,
-                          "sendto(%d, %p, %lld, %d, %p (%s), %d) = %d: short write",
-                          wi->sock, wi->msg, (long long)wi->msg_len, wi->flags,
-                          wi->sendto, daddr, wi->tolen, n);
-#if RTPP_DEBUG_netio >= 2
-                    } else {
-                        RTPP_LOG(wi->log, RTPP_LOG_DBUG,
-                          "sendto(%d, %p, %d, %d, %p (%s), %d) = %d",
-                          wi->sock, wi->msg, wi->msg_len, wi->flags, wi->sendto, daddr,
-                          wi->tolen, n);
-#endif
-                    }
+            nwis = nsegs = 1;
+#if defined(UDP_SEGMENT)
+            if (args->gso != 0) {
+                nwis = rtpp_anetio_gso_span(wis + i, nsend - i, &nsegs);
+            }
+            if (nsegs > 1) {
+                n = rtpp_anetio_send_gso(wis + i, nwis);
+                if (n > 0) {
+                    npkts_gso += n;
                 }
+            }
 #endif
-                if (n >= 0) {
-                    wi->nsend--;
+            for (j = i; j < i + nwis; j++) {
+                wi = wis[j];
+                if (wi->nsend > 0) {
+                    /* Not batched or the kernel has refused the batch */
+                    n = rtpp_anetio_send_wi(wi);
                 } else {
-                    /* "EPERM" is Linux thing, yield and retry */
-                    if ((send_errno == EPERM || send_errno == ENOBUFS)
-                      && nretry < RTPP_ANETIO_MAX_RETRY) {
-                        sched_yield();
-                        nretry++;
-                    } else {
-                        break;
-                    }
+                    /* Went out as a part of the GSO batch above */
+                    n = 0;
+                }
+                if (wi->fwl_pcs != NULL && n >= 0) {
+                    fwlat = getdtime() - wi->fwl_rtime;
+                    CALL_METHOD(wi->fwl_pcs, reg_fwlat, fwlat);
+                    /* Folded into args->fwd_lat once per batch below */
+                    rtpp_histogram_record(&fwd_lat, fwlat);
+                    fwlat_total += fwlat;
+                    nfwlat++;
+                    nfwlat_batch++;
                 }
-            } while (wi->nsend > 0);
-            rtpp_wi_free(wi);
+                rtpp_wi_free(wi);
+            }
+        }
+        tp[2] = getdtime();
+        if (nsend > 0) {
+            pthread_mutex_lock(&args->lstats_lock);
+            rtpp_histogram_record(&args->send_time, tp[2] - tp[1]);
+            if (nfwlat_batch > 0) {
+                rtpp_histogram_merge(&args->fwd_lat, &fwd_lat);
+            }
+            pthread_mutex_unlock(&args->lstats_lock);
+            if (nfwlat_batch > 0) {
+                rtpp_histogram_init(&fwd_lat);
+            }
         }
-#if RTPP_DEBUG_timers
         sleeptime += tp[1] - tp[0];
-        tp[0] = getdtime();
-        runtime += tp[0] - tp[1];
+        runtime += tp[2] - tp[1];
+        tp[0] = tp[2];
+#if RTPP_DEBUG_timers
         if ((run_n % 10000) == 0) {
             RTPP_LOG(args->glog, RTPP_LOG_DBUG, "rtpp_anetio_sthread(%p): run %ld aload = %f filtered = %f", \
               args, run_n, runtime / (runtime + sleeptime), args->average_load.lastval);
         }
+        run_n += 1;
+#endif
         if (runtime + sleeptime > 1.0) {
+#if RTPP_DEBUG_timers
             recfilter_apply(&args->average_load, runtime / (runtime + sleeptime));
+#endif
+            CALL_METHOD(args->rtpp_stats, updatebyname_d, "anetio_run_time",
+              runtime);
+            CALL_METHOD(args->rtpp_stats, updatebyname_d, "anetio_sleep_time",
+              sleeptime);
+            if (nfwlat > 0) {
+                CALL_METHOD(args->rtpp_stats, updatebyname, "npkts_fwlat",
+                  nfwlat);
+                CALL_METHOD(args->rtpp_stats, updatebyname_d, "fwlat_total",
+                  fwlat_total);
+                nfwlat = 0;
+                fwlat_total = 0.0;
+            }
+            if (npkts_gso > 0) {
+                CALL_METHOD(args->rtpp_stats, updatebyname, "npkts_gso",
+                  npkts_gso);
+                npkts_gso = 0;
+            }
             runtime = sleeptime = 0.0;
         }
-        run_n += 1;
-#endif
     }
 out:
     return;
@@ -297,6 +504,26 @@ rtpp_anetio_pick_sender(struct rtpp_anetio_cf *netio_cf)
     return (sender);
 }
 
+void
+rtpp_anetio_get_lstats(struct rtpp_anetio_cf *netio_cf,
+  struct rtpp_histogram *hp, struct rtpp_histogram *fwlp, int reset)
+{
+    struct sthread_args *args;
+    int i;
+
+    for (i = 0; i < SEND_THREADS; i++) {
+        args = &netio_cf->args[i];
+        pthread_mutex_lock(&args->lstats_lock);
+        rtpp_histogram_merge(hp, &args->send_time);
+        rtpp_histogram_merge(fwlp, &args->fwd_lat);
+        if (reset != 0) {
+            rtpp_histogram_init(&args->send_time);
+            rtpp_histogram_init(&args->fwd_lat);
+        }
+        pthread_mutex_unlock(&args->lstats_lock);
+    }
+}
+
 struct rtpp_anetio_cf *
 rtpp_netio_async_init(struct cfg *cf, int qlen)
 {
@@ -308,21 +535,35 @@ rtpp_netio_async_init(struct cfg *cf, int qlen)
         return (NULL);
 
     for (i = 0; i < SEND_THREADS; i++) {
+        if (pthread_mutex_init(&netio_cf->args[i].lstats_lock, NULL) != 0) {
+            break;
+        }
         netio_cf->args[i].out_q = rtpp_queue_init(qlen, "RTPP->NET%.2d", i);
         if (netio_cf->args[i].out_q == NULL) {
-            for (ri = i - 1; ri >= 0; ri--) {
-                rtpp_queue_destroy(netio_cf->args[ri].out_q);
-                CALL_SMETHOD(netio_cf->args[ri].glog->rcnt, decref);
-            }
-            goto e0;
+            pthread_mutex_destroy(&netio_cf->args[i].lstats_lock);
+            break;
         }
         CALL_SMETHOD(cf->stable->glog->rcnt, incref);
         netio_cf->args[i].glog = cf->stable->glog;
         netio_cf->args[i].dmode = cf->stable->dmode;
+#if defined(UDP_SEGMENT)
+        netio_cf->args[i].gso = rtpp_anetio_gso_probe();
+#endif
+        netio_cf->args[i].rtpp_stats = cf->stable->rtpp_stats;
+        rtpp_histogram_init(&netio_cf->args[i].send_time);
+        rtpp_histogram_init(&netio_cf->args[i].fwd_lat);
 #if RTPP_DEBUG_timers
         recfilter_init(&netio_cf->args[i].average_load, 0.9, 0.0, 0);
 #endif
     }
+    if (i < SEND_THREADS) {
+        for (ri = i - 1; ri >= 0; ri--) {
+            rtpp_queue_destroy(netio_cf->args[ri].out_q);
+            CALL_SMETHOD(netio_cf->args[ri].glog->rcnt, decref);
+            pthread_mutex_destroy(&netio_cf->args[ri].lstats_lock);
+        }
+        goto e0;
+    }
 
     for (i = 0; i < SEND_THREADS; i++) {
         netio_cf->args[i].sigterm = rtpp_wi_malloc_sgnl(SIGTERM, NULL, 0);
@@ -360,6 +601,7 @@ e1:
     for (i = 0; i < SEND_THREADS; i++) {
         rtpp_queue_destroy(netio_cf->args[i].out_q);
         CALL_SMETHOD(netio_cf->args[i].glog->rcnt, decref);
+        pthread_mutex_destroy(&netio_cf->args[i].lstats_lock);
     }
 e0:
     free(netio_cf);
@@ -378,6 +620,7 @@ rtpp_netio_async_destroy(struct rtpp_anetio_cf *netio_cf)
         pthread_join(netio_cf->thread_id[i], NULL);
         rtpp_queue_destroy(netio_cf->args[i].out_q);
         CALL_SMETHOD(netio_cf->args[i].glog->rcnt, decref);
+        pthread_mutex_destroy(&netio_cf->args[i].lstats_lock);
     }
     free(netio_cf);
 }
@@ -34,6 +34,7 @@ struct rtpp_queue;
 struct sthread_args;
 struct rtpp_log;
 struct rtpp_netaddr;
+struct rtpp_histogram;
 
 int rtpp_anetio_sendto(struct rtpp_anetio_cf *, int, const void *, \
   size_t, int, const struct sockaddr *, socklen_t);
@@ -46,6 +47,8 @@ int rtpp_anetio_send_pkt_na(struct sthread_args *, int, \
 void rtpp_anetio_pump(struct rtpp_anetio_cf *);
 void rtpp_anetio_pump_q(struct sthread_args *);
 struct sthread_args *rtpp_anetio_pick_sender(struct rtpp_anetio_cf *);
+void rtpp_anetio_get_lstats(struct rtpp_anetio_cf *, struct rtpp_histogram *,
+  struct rtpp_histogram *, int);
 
 struct rtpp_anetio_cf *rtpp_netio_async_init(struct cfg *cf, int);
 void rtpp_netio_async_destroy(struct rtpp_anetio_cf *);
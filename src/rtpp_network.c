@@ -211,6 +211,50 @@ addrport2char_r(struct sockaddr *ia, char *buf, int size, char portsep)
     return (buf);
 }
 
+/*
+ * Fast path for the numeric address / numeric port case, which is what we
+ * get in the vast majority of the control commands. Returns -1 if the
+ * input is not a plain numeric literal, so the caller can fall back to
+ * getaddrinfo(3).
+ */
+static int
+resolve_numeric(struct sockaddr *ia, int pf, const char *host,
+  const char *servname)
+{
+    long port;
+    char *ep;
+
+    if (host == NULL || servname == NULL || *servname == '\0')
+        return (-1);
+    port = strtol(servname, &ep, 10);
+    if (*ep != '\0' || port < 0 || port > 65535)
+        return (-1);
+    switch (pf) {
+    case AF_INET:
+        memset(ia, '\0', sizeof(struct sockaddr_in));
+        if (inet_pton(AF_INET, host, &satosin(ia)->sin_addr) != 1)
+            return (-1);
+        satosin(ia)->sin_port = htons(port);
+        break;
+
+    case AF_INET6:
+        memset(ia, '\0', sizeof(struct sockaddr_in6));
+        if (inet_pton(AF_INET6, host, &satosin6(ia)->sin6_addr) != 1)
+            return (-1);
+        satosin6(ia)->sin6_port = htons(port);
+        break;
+
+    default:
+        return (-1);
+    }
+    ia->sa_family = pf;
+#if defined(__FreeBSD__) || defined(__APPLE__)
+    ia->sa_len = (pf == AF_INET) ? sizeof(struct sockaddr_in) :
+      sizeof(struct sockaddr_in6);
+#endif
+    return (0);
+}
+
 int
 resolve(struct sockaddr *ia, int pf, const char *host,
   const char *servname, int flags)
@@ -218,6 +262,9 @@ resolve(struct sockaddr *ia, int pf, const char *host,
     int n;
     struct addrinfo hints, *res;
 
+    if (resolve_numeric(ia, pf, host, servname) == 0)
+        return (0);
+
     memset(&hints, 0, sizeof(hints));
     hints.ai_flags = flags;	     /* We create listening sockets */
     hints.ai_family = pf;	       /* Protocol family */
@@ -34,6 +34,8 @@
 #include <netinet/in.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
@@ -49,10 +51,19 @@
 #include "rtpp_network.h"
 #include "rtpp_notify.h"
 #include "rtpp_queue.h"
+#include "rtpp_stats.h"
+#include "rtpp_time.h"
 #include "rtpp_tnotify_tgt.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_wi.h"
 #include "rtpp_wi_private.h"
+#include "rtpp_cpuset.h"
+
+/* Per-target output buffer, notifications that don't fit are dropped */
+#define RTPP_NOTIFY_OBUF_LEN (64 * 1024)
+/* Reconnect back-off, doubled on every consecutive failure */
+#define RTPP_NOTIFY_BACKOFF_MIN 0.5
+#define RTPP_NOTIFY_BACKOFF_MAX 16.0
 
 struct rtpp_notify_wi
 {
@@ -61,12 +72,34 @@ struct rtpp_notify_wi
     char notify_buf[0];
 };
 
+/*
+ * State of a single target, only ever touched by the notification thread.
+ * The fd and connected flag live in the rttp itself.
+ */
+struct rtpp_notify_tstate {
+    struct rtpp_tnotify_target *rttp;
+    int connecting;
+    double next_attempt;
+    double backoff;
+    unsigned long ndropped;
+    /* Bytes of the head notification that have already been written out */
+    size_t ooff;
+    size_t olen;
+    char obuf[RTPP_NOTIFY_OBUF_LEN];
+};
+
 struct rtpp_notify_priv {
     struct rtpp_notify pub;
     struct rtpp_queue *nqueue;
     struct rtpp_wi *sigterm;
     pthread_t thread_id;
     struct rtpp_log *glog;
+    struct rtpp_stats *rtpp_stats;
+    int wakefd[2];
+    int wpending;
+    pthread_mutex_t wlock;
+    struct rtpp_notify_tstate *tstates[RTPP_TNOTIFY_TARGETS_MAX];
+    int ntstates;
 };
 
 #define PUB2PVT(pubp)      ((struct rtpp_notify_priv *)((char *)(pubp) - offsetof(struct rtpp_notify_priv, pub)))
@@ -74,36 +107,129 @@ struct rtpp_notify_priv {
 static int rtpp_notify_schedule(struct rtpp_notify *,
   struct rtpp_tnotify_target *, const char *);
 static void rtpp_notify_dtor(struct rtpp_notify *);
-static void do_timeout_notification(struct rtpp_notify_wi *, int, struct rtpp_log *);
+static void rtpp_notify_enqueue(struct rtpp_notify_priv *,
+  struct rtpp_notify_wi *);
+static void rtpp_notify_tgt_poll(struct rtpp_notify_priv *,
+  struct rtpp_notify_tstate *, short, double);
+static void rtpp_notify_tgt_run(struct rtpp_notify_priv *,
+  struct rtpp_notify_tstate *, double);
+static void rtpp_notify_tgt_close(struct rtpp_notify_tstate *);
+
+static int
+rtpp_notify_get_timeout(struct rtpp_notify_priv *pvt, double dtime)
+{
+    struct rtpp_notify_tstate *tsp;
+    double tmin;
+    int i;
+
+    tmin = -1;
+    for (i = 0; i < pvt->ntstates; i++) {
+        tsp = pvt->tstates[i];
+        if (tsp->olen == 0 || tsp->rttp->fd != -1)
+            continue;
+        if (tmin < 0 || tsp->next_attempt < tmin)
+            tmin = tsp->next_attempt;
+    }
+    if (tmin < 0)
+        return (-1);
+    if (tmin <= dtime)
+        return (0);
+    return ((int)((tmin - dtime) * 1000.0) + 1);
+}
 
 static void
 rtpp_notify_queue_run(void *arg)
 {
-    struct rtpp_wi *wi;
+    struct rtpp_wi *wi, *wis[64];
     struct rtpp_notify_wi *wi_data;
     struct rtpp_notify_priv *pvt;
-
+    struct rtpp_notify_tstate *tsp;
+    struct pollfd pfds[1 + RTPP_TNOTIFY_TARGETS_MAX];
+    struct rtpp_notify_tstate *ptsps[1 + RTPP_TNOTIFY_TARGETS_MAX];
+    char dbuf[64];
+    double dtime;
+    int i, nfds, nwis, done;
+
+    rtpp_cpuset_bind(RTPP_THR_NOTIFY);
     pvt = (struct rtpp_notify_priv *)arg;
+    done = 0;
     for (;;) {
-        wi = rtpp_queue_get_item(pvt->nqueue, 0);
-        if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
-            rtpp_wi_free(wi);
+        pfds[0].fd = pvt->wakefd[0];
+        pfds[0].events = POLLIN;
+        nfds = 1;
+        for (i = 0; i < pvt->ntstates; i++) {
+            tsp = pvt->tstates[i];
+            if (tsp->rttp->fd == -1)
+                continue;
+            pfds[nfds].fd = tsp->rttp->fd;
+            if (tsp->connecting) {
+                pfds[nfds].events = POLLOUT;
+            } else {
+                /* POLLIN is only there to catch the remote end going away */
+                pfds[nfds].events = POLLIN | (tsp->olen > 0 ? POLLOUT : 0);
+            }
+            ptsps[nfds] = tsp;
+            nfds++;
+        }
+        if (poll(pfds, nfds, rtpp_notify_get_timeout(pvt, getdtime())) < 0) {
+            if (errno == EINTR)
+                continue;
+            RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "poll() failed");
             break;
         }
-        wi_data = rtpp_wi_data_get_ptr(wi, sizeof(struct rtpp_notify_wi), 0);
-
-        /* main work here */
-        do_timeout_notification(wi_data, 3, wi->log);
-
-        /* deallocate wi */
-        rtpp_wi_free(wi);
+        dtime = getdtime();
+        for (i = 1; i < nfds; i++) {
+            if (pfds[i].revents != 0) {
+                rtpp_notify_tgt_poll(pvt, ptsps[i], pfds[i].revents, dtime);
+            }
+        }
+        if (pfds[0].revents != 0) {
+            pthread_mutex_lock(&pvt->wlock);
+            while (read(pvt->wakefd[0], dbuf, sizeof(dbuf)) > 0)
+                continue;
+            pvt->wpending = 0;
+            pthread_mutex_unlock(&pvt->wlock);
+        }
+        while (rtpp_queue_get_length(pvt->nqueue) > 0) {
+            nwis = rtpp_queue_get_items(pvt->nqueue, wis, 64, 0);
+            for (i = 0; i < nwis; i++) {
+                wi = wis[i];
+                if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
+                    done = 1;
+                } else {
+                    wi_data = rtpp_wi_data_get_ptr(wi,
+                      sizeof(struct rtpp_notify_wi), 0);
+                    rtpp_notify_enqueue(pvt, wi_data);
+                }
+                /* deallocate wi */
+                rtpp_wi_free(wi);
+            }
+        }
+        /* Everything queued for a target goes out in a single write */
+        for (i = 0; i < pvt->ntstates; i++) {
+            rtpp_notify_tgt_run(pvt, pvt->tstates[i], dtime);
+        }
+        if (done)
+            break;
     }
+    for (i = 0; i < pvt->ntstates; i++) {
+        tsp = pvt->tstates[i];
+        if (tsp->olen > 0) {
+            RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "%s: %lu bytes of timeout "
+              "notifications have not been delivered", tsp->rttp->socket_name,
+              (unsigned long)tsp->olen);
+        }
+        rtpp_notify_tgt_close(tsp);
+        free(tsp);
+    }
+    pvt->ntstates = 0;
 }
 
 struct rtpp_notify *
-rtpp_notify_ctor(struct rtpp_log *glog)
+rtpp_notify_ctor(struct rtpp_log *glog, struct rtpp_stats *rtpp_stats)
 {
     struct rtpp_notify_priv *pvt;
+    int i;
 
     pvt = rtpp_zmalloc(sizeof(struct rtpp_notify_priv));
     if (pvt == NULL) {
@@ -120,17 +246,37 @@ rtpp_notify_ctor(struct rtpp_log *glog)
         goto e2;
     }
 
-    if (pthread_create(&pvt->thread_id, NULL, (void *(*)(void *))&rtpp_notify_queue_run, pvt) != 0) {
+    /* The thread sleeps in poll(), so the queue needs a way to wake it up */
+    if (pipe(pvt->wakefd) != 0) {
         goto e3;
     }
+    for (i = 0; i < 2; i++) {
+        if (fcntl(pvt->wakefd[i], F_SETFL, O_NONBLOCK) != 0 ||
+          fcntl(pvt->wakefd[i], F_SETFD, FD_CLOEXEC) != 0) {
+            goto e4;
+        }
+    }
+    if (pthread_mutex_init(&pvt->wlock, NULL) != 0) {
+        goto e4;
+    }
 
-    CALL_SMETHOD(glog->rcnt, incref);
     pvt->glog = glog;
+    pvt->rtpp_stats = rtpp_stats;
+    if (pthread_create(&pvt->thread_id, NULL, (void *(*)(void *))&rtpp_notify_queue_run, pvt) != 0) {
+        goto e5;
+    }
+
+    CALL_SMETHOD(glog->rcnt, incref);
     pvt->pub.schedule = &rtpp_notify_schedule;
     pvt->pub.dtor = &rtpp_notify_dtor;
 
     return (&pvt->pub);
 
+e5:
+    pthread_mutex_destroy(&pvt->wlock);
+e4:
+    close(pvt->wakefd[0]);
+    close(pvt->wakefd[1]);
 e3:
     rtpp_wi_free(pvt->sigterm);
 e2:
@@ -141,6 +287,19 @@ e0:
     return (NULL);
 }
 
+static void
+rtpp_notify_wakeup(struct rtpp_notify_priv *pvt)
+{
+
+    pthread_mutex_lock(&pvt->wlock);
+    if (pvt->wpending == 0) {
+        if (write(pvt->wakefd[1], "", 1) == 1) {
+            pvt->wpending = 1;
+        }
+    }
+    pthread_mutex_unlock(&pvt->wlock);
+}
+
 static void
 rtpp_notify_dtor(struct rtpp_notify *pub)
 {
@@ -149,8 +308,12 @@ rtpp_notify_dtor(struct rtpp_notify *pub)
     pvt = PUB2PVT(pub);
 
     rtpp_queue_put_item(pvt->sigterm, pvt->nqueue);
+    rtpp_notify_wakeup(pvt);
     pthread_join(pvt->thread_id, NULL);
     rtpp_queue_destroy(pvt->nqueue);
+    close(pvt->wakefd[0]);
+    close(pvt->wakefd[1]);
+    pthread_mutex_destroy(&pvt->wlock);
     CALL_SMETHOD(pvt->glog->rcnt, decref);
     free(pvt);
 }
@@ -185,70 +348,206 @@ rtpp_notify_schedule(struct rtpp_notify *pub,
     wi->log = pvt->glog;
 
     rtpp_queue_put_item(wi, pvt->nqueue);
+    rtpp_notify_wakeup(pvt);
     return (0);
 }
 
+static struct rtpp_notify_tstate *
+rtpp_notify_get_tstate(struct rtpp_notify_priv *pvt,
+  struct rtpp_tnotify_target *rttp)
+{
+    struct rtpp_notify_tstate *tsp;
+    int i;
+
+    for (i = 0; i < pvt->ntstates; i++) {
+        if (pvt->tstates[i]->rttp == rttp)
+            return (pvt->tstates[i]);
+    }
+    if (pvt->ntstates == RTPP_TNOTIFY_TARGETS_MAX)
+        return (NULL);
+    tsp = rtpp_zmalloc(sizeof(struct rtpp_notify_tstate));
+    if (tsp == NULL)
+        return (NULL);
+    tsp->rttp = rttp;
+    tsp->backoff = RTPP_NOTIFY_BACKOFF_MIN;
+    pvt->tstates[pvt->ntstates] = tsp;
+    pvt->ntstates += 1;
+    return (tsp);
+}
+
 static void
-reconnect_timeout_handler(struct rtpp_log *log, struct rtpp_tnotify_target *rttp)
+rtpp_notify_enqueue(struct rtpp_notify_priv *pvt, struct rtpp_notify_wi *wi)
 {
+    struct rtpp_notify_tstate *tsp;
+    size_t len;
+
+    len = wi->len - 1;
+    tsp = rtpp_notify_get_tstate(pvt, wi->rttp);
+    if (tsp == NULL || tsp->olen + len > sizeof(tsp->obuf)) {
+        if (tsp != NULL && tsp->ndropped++ == 0) {
+            RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "%s: timeout notification "
+              "target is not keeping up, dropping notifications",
+              wi->rttp->socket_name);
+        }
+        CALL_METHOD(pvt->rtpp_stats, updatebyname, "nnotify_dropped", 1);
+        return;
+    }
+    memcpy(tsp->obuf + tsp->olen, wi->notify_buf, len);
+    tsp->olen += len;
+}
 
-    assert (rttp->connected == 0);
+static void
+rtpp_notify_tgt_close(struct rtpp_notify_tstate *tsp)
+{
 
-    if (rttp->fd == -1) {
-        RTPP_LOG(log, RTPP_LOG_DBUG, "connecting timeout socket");
-    } else {
-        RTPP_LOG(log, RTPP_LOG_DBUG, "reconnecting timeout socket");
-        close(rttp->fd);
+    if (tsp->rttp->fd != -1) {
+        close(tsp->rttp->fd);
+        tsp->rttp->fd = -1;
     }
+    tsp->rttp->connected = 0;
+    tsp->connecting = 0;
+    /* Partially sent notification is sent again in full */
+    tsp->ooff = 0;
+}
+
+static void
+rtpp_notify_tgt_fail(struct rtpp_notify_tstate *tsp, double dtime)
+{
+
+    rtpp_notify_tgt_close(tsp);
+    tsp->next_attempt = dtime + tsp->backoff;
+    tsp->backoff *= 2;
+    if (tsp->backoff > RTPP_NOTIFY_BACKOFF_MAX)
+        tsp->backoff = RTPP_NOTIFY_BACKOFF_MAX;
+}
+
+static void
+rtpp_notify_tgt_connect(struct rtpp_notify_priv *pvt,
+  struct rtpp_notify_tstate *tsp, double dtime)
+{
+    struct rtpp_tnotify_target *rttp;
+
+    rttp = tsp->rttp;
+    assert(rttp->connected == 0 && rttp->fd == -1);
+
+    RTPP_LOG(pvt->glog, RTPP_LOG_DBUG, "connecting timeout socket");
     rttp->fd = socket(rttp->socket_type, SOCK_STREAM, 0);
     if (rttp->fd == -1) {
-        RTPP_ELOG(log, RTPP_LOG_ERR, "can't create timeout socket");
-        return;
+        RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't create timeout socket");
+        goto e0;
     }
+    fcntl(rttp->fd, F_SETFL, fcntl(rttp->fd, F_GETFL) | O_NONBLOCK);
     if (rttp->local != NULL) {
         if (bind(rttp->fd, rttp->local, SA_LEN(rttp->local)) < 0) {
-            RTPP_ELOG(log, RTPP_LOG_ERR, "can't bind timeout socket");
+            RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't bind timeout socket");
             goto e0;
         }
     }
     if (connect(rttp->fd, (struct sockaddr *)&(rttp->remote), rttp->remote_len) == -1) {
-        RTPP_ELOG(log, RTPP_LOG_ERR, "can't connect to timeout socket");
-        goto e0;
-    } else {
-        rttp->connected = 1;
+        if (errno != EINPROGRESS && errno != EINTR) {
+            RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't connect to timeout socket");
+            goto e0;
+        }
+        tsp->connecting = 1;
+        return;
     }
+    rttp->connected = 1;
+    tsp->backoff = RTPP_NOTIFY_BACKOFF_MIN;
     return;
 
 e0:
-    close(rttp->fd);
-    rttp->fd = -1;
+    rtpp_notify_tgt_fail(tsp, dtime);
     return;
 }
 
 static void
-do_timeout_notification(struct rtpp_notify_wi *wi, int retries,
-  struct rtpp_log *log)
+rtpp_notify_tgt_poll(struct rtpp_notify_priv *pvt,
+  struct rtpp_notify_tstate *tsp, short revents, double dtime)
 {
-    int result;
+    char dbuf[256];
+    socklen_t slen;
+    ssize_t rlen;
+    int serr;
+
+    if (tsp->connecting) {
+        serr = 0;
+        slen = sizeof(serr);
+        if (getsockopt(tsp->rttp->fd, SOL_SOCKET, SO_ERROR, &serr, &slen) != 0)
+            serr = errno;
+        if (serr != 0) {
+            errno = serr;
+            RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't connect to timeout socket");
+            rtpp_notify_tgt_fail(tsp, dtime);
+            return;
+        }
+        tsp->connecting = 0;
+        tsp->rttp->connected = 1;
+        tsp->backoff = RTPP_NOTIFY_BACKOFF_MIN;
+        return;
+    }
+    if ((revents & (POLLIN | POLLERR | POLLHUP)) == 0)
+        return;
+    /* Nothing is expected from the other side, just look for EOF */
+    do {
+        rlen = recv(tsp->rttp->fd, dbuf, sizeof(dbuf), 0);
+    } while (rlen > 0);
+    if (rlen == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+      errno != EINTR)) {
+        RTPP_LOG(pvt->glog, RTPP_LOG_DBUG, "timeout socket has been "
+          "closed by the other side");
+        rtpp_notify_tgt_close(tsp);
+        tsp->next_attempt = dtime;
+    }
+}
 
-    if (wi->rttp->connected == 0) {
-        reconnect_timeout_handler(log, wi->rttp);
+static void
+rtpp_notify_tgt_run(struct rtpp_notify_priv *pvt,
+  struct rtpp_notify_tstate *tsp, double dtime)
+{
+    ssize_t result;
+    size_t nsent, nmsgs, i;
 
-        /* If connect fails, no notification will be sent */
-        if (wi->rttp->connected == 0) {
-            RTPP_LOG(log, RTPP_LOG_ERR, "unable to send timeout notification");
+    if (tsp->olen == 0)
+        return;
+    if (tsp->rttp->fd == -1) {
+        if (dtime < tsp->next_attempt)
             return;
-        }
+        rtpp_notify_tgt_connect(pvt, tsp, dtime);
     }
+    if (tsp->rttp->connected == 0)
+        return;
 
     do {
-        result = send(wi->rttp->fd, wi->notify_buf, wi->len - 1, 0);
+        result = send(tsp->rttp->fd, tsp->obuf + tsp->ooff,
+          tsp->olen - tsp->ooff, 0);
     } while (result == -1 && errno == EINTR);
 
     if (result < 0) {
-        wi->rttp->connected = 0;
-        RTPP_ELOG(log, RTPP_LOG_ERR, "failed to send timeout notification");
-        if (retries > 0)
-            do_timeout_notification(wi, retries - 1, log);
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return;
+        RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "failed to send timeout notification");
+        rtpp_notify_tgt_fail(tsp, dtime);
+        return;
+    }
+    tsp->ooff += result;
+    /* Only retire notifications that went out completely */
+    nsent = nmsgs = 0;
+    for (i = 0; i < tsp->ooff; i++) {
+        if (tsp->obuf[i] == '\n') {
+            nsent = i + 1;
+            nmsgs++;
+        }
+    }
+    if (nmsgs == 0)
+        return;
+    memmove(tsp->obuf, tsp->obuf + nsent, tsp->olen - nsent);
+    tsp->olen -= nsent;
+    tsp->ooff -= nsent;
+    CALL_METHOD(pvt->rtpp_stats, updatebyname, "nnotify_sent", nmsgs);
+    if (tsp->ndropped > 0 && tsp->olen == 0) {
+        RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "%s: timeout notification target "
+          "has caught up, %lu notifications have been dropped",
+          tsp->rttp->socket_name, tsp->ndropped);
+        tsp->ndropped = 0;
     }
 }
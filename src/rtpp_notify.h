@@ -30,6 +30,7 @@
 
 struct rtpp_notify;
 struct rtpp_tnotify_target;
+struct rtpp_stats;
 
 DEFINE_METHOD(rtpp_notify, rtpp_notify_schedule, int,
   struct rtpp_tnotify_target *, const char *);
@@ -40,6 +41,6 @@ struct rtpp_notify {
     rtpp_notify_dtor_t dtor;
 };
 
-struct rtpp_notify *rtpp_notify_ctor(struct rtpp_log *);
+struct rtpp_notify *rtpp_notify_ctor(struct rtpp_log *, struct rtpp_stats *);
 
 #endif
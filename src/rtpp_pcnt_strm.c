@@ -42,11 +42,20 @@
 #include "rtpp_endian.h"
 #include "rtp.h"
 #include "rtp_packet.h"
+#include "rtpp_histogram.h"
+#include "rtpp_wi.h"
 
 struct rtpp_pcnt_strm_priv {
     struct rtpp_pcnt_strm pub;
     struct rtpp_pcnts_strm cnt;
     pthread_mutex_t lock;
+    /*
+     * Both are updated without the lock, from the RTP thread and from
+     * the senders respectively.
+     */
+    unsigned long nfwd;
+    /* Allocated on the first forwarding latency sample */
+    struct rtpp_histogram *fwlat;
 };
 
 static void rtpp_pcnt_strm_dtor(struct rtpp_pcnt_strm_priv *);
@@ -54,10 +63,34 @@ static void rtpp_pcnt_strm_get_stats(struct rtpp_pcnt_strm *,
   struct rtpp_pcnts_strm *);
 static void rtpp_pcnt_strm_reg_pktin(struct rtpp_pcnt_strm *,
   struct rtp_packet *);
+static void rtpp_pcnt_strm_add_pktin(struct rtpp_pcnt_strm *, unsigned long,
+  double);
+static void rtpp_pcnt_strm_fwlat_sample(struct rtpp_pcnt_strm *,
+  struct rtp_packet *);
+static void rtpp_pcnt_strm_reg_fwlat(struct rtpp_pcnt_strm *, double);
+static void rtpp_pcnt_strm_get_fwlat(struct rtpp_pcnt_strm *,
+  struct rtpp_histogram *);
 
 #define PUB2PVT(pubp) \
   ((struct rtpp_pcnt_strm_priv *)((char *)(pubp) - offsetof(struct rtpp_pcnt_strm_priv, pub)))
 
+static int
+rtpp_pcnt_strm_init(struct rtpp_pcnt_strm_priv *pvt, struct rtpp_refcnt *rcnt)
+{
+
+    pvt->pub.rcnt = rcnt;
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        return (-1);
+    }
+    pvt->pub.get_stats = &rtpp_pcnt_strm_get_stats;
+    pvt->pub.reg_pktin = &rtpp_pcnt_strm_reg_pktin;
+    pvt->pub.add_pktin = &rtpp_pcnt_strm_add_pktin;
+    pvt->pub.fwlat_sample = &rtpp_pcnt_strm_fwlat_sample;
+    pvt->pub.reg_fwlat = &rtpp_pcnt_strm_reg_fwlat;
+    pvt->pub.get_fwlat = &rtpp_pcnt_strm_get_fwlat;
+    return (0);
+}
+
 struct rtpp_pcnt_strm *
 rtpp_pcnt_strm_ctor(void)
 {
@@ -68,29 +101,61 @@ rtpp_pcnt_strm_ctor(void)
     if (pvt == NULL) {
         goto e0;
     }
-    pvt->pub.rcnt = rcnt;
-    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+    if (rtpp_pcnt_strm_init(pvt, rcnt) != 0) {
         goto e1;
     }
-    pvt->pub.get_stats = &rtpp_pcnt_strm_get_stats;
-    pvt->pub.reg_pktin = &rtpp_pcnt_strm_reg_pktin;
     CALL_SMETHOD(pvt->pub.rcnt, attach,
       (rtpp_refcnt_dtor_t)&rtpp_pcnt_strm_dtor, pvt);
     return ((&pvt->pub));
 
 e1:
-    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    CALL_SMETHOD(rcnt, decref);
     free(pvt);
 e0:
     return (NULL);
 }
 
+size_t
+rtpp_pcnt_strm_osize(void)
+{
+
+    return (sizeof(struct rtpp_pcnt_strm_priv));
+}
+
+/*
+ * Same as rtpp_netaddr_ctor_pa(): the object lives in the owner's memory
+ * and shares owner's refcounter, rtpp_pcnt_strm_dtor_pa() is to be called
+ * by the owner's destructor.
+ */
+struct rtpp_pcnt_strm *
+rtpp_pcnt_strm_ctor_pa(void *pap, struct rtpp_refcnt *rcnt)
+{
+    struct rtpp_pcnt_strm_priv *pvt;
+
+    pvt = (struct rtpp_pcnt_strm_priv *)pap;
+    if (rtpp_pcnt_strm_init(pvt, rcnt) != 0) {
+        return (NULL);
+    }
+    return (&pvt->pub);
+}
+
+void
+rtpp_pcnt_strm_dtor_pa(struct rtpp_pcnt_strm *self)
+{
+    struct rtpp_pcnt_strm_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    rtpp_pcnt_strm_fin(self);
+    pthread_mutex_destroy(&pvt->lock);
+    if (pvt->fwlat != NULL)
+        free(pvt->fwlat);
+}
+
 static void
 rtpp_pcnt_strm_dtor(struct rtpp_pcnt_strm_priv *pvt)
 {
 
-    rtpp_pcnt_strm_fin(&(pvt->pub));
-    pthread_mutex_destroy(&pvt->lock);
+    rtpp_pcnt_strm_dtor_pa(&(pvt->pub));
     free(pvt);
 }
 
@@ -129,3 +194,69 @@ rtpp_pcnt_strm_reg_pktin(struct rtpp_pcnt_strm *self,
     }
     pthread_mutex_unlock(&pvt->lock);
 }
+
+/* Packets that have not been seen individually, i.e. relayed in kernel */
+static void
+rtpp_pcnt_strm_add_pktin(struct rtpp_pcnt_strm *self, unsigned long cnt,
+  double rtime)
+{
+    struct rtpp_pcnt_strm_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    pthread_mutex_lock(&pvt->lock);
+    pvt->cnt.npkts_in += cnt;
+    if (pvt->cnt.last_pkt_rcv < rtime) {
+        pvt->cnt.last_pkt_rcv = rtime;
+    }
+    pthread_mutex_unlock(&pvt->lock);
+}
+
+static void
+rtpp_pcnt_strm_fwlat_sample(struct rtpp_pcnt_strm *self,
+  struct rtp_packet *pkt)
+{
+    struct rtpp_pcnt_strm_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    if ((__sync_fetch_and_add(&pvt->nfwd, 1) % RTPP_FWLAT_SRATE) == 0) {
+        rtpp_wi_pkt_set_fwlat(pkt, self);
+    }
+}
+
+static void
+rtpp_pcnt_strm_reg_fwlat(struct rtpp_pcnt_strm *self, double lat)
+{
+    struct rtpp_pcnt_strm_priv *pvt;
+    struct rtpp_histogram *hp;
+
+    pvt = PUB2PVT(self);
+    hp = pvt->fwlat;
+    if (hp == NULL) {
+        hp = rtpp_zmalloc(sizeof(struct rtpp_histogram));
+        if (hp == NULL)
+            return;
+        rtpp_histogram_init(hp);
+        if (!__sync_bool_compare_and_swap(&pvt->fwlat, NULL, hp)) {
+            /* Another sender got there first */
+            free(hp);
+            hp = pvt->fwlat;
+        }
+    }
+    rtpp_histogram_record_atomic(hp, lat);
+}
+
+static void
+rtpp_pcnt_strm_get_fwlat(struct rtpp_pcnt_strm *self,
+  struct rtpp_histogram *ohp)
+{
+    struct rtpp_pcnt_strm_priv *pvt;
+    struct rtpp_histogram *hp;
+
+    pvt = PUB2PVT(self);
+    hp = pvt->fwlat;
+    if (hp != NULL) {
+        memcpy(ohp, hp, sizeof(struct rtpp_histogram));
+    } else {
+        rtpp_histogram_init(ohp);
+    }
+}
@@ -33,11 +33,26 @@ struct rtpp_pcnt_strm;
 struct rtpp_refcnt;
 struct rtp_packet;
 struct rtpp_pcnts_strm;
+struct rtpp_histogram;
 
 DEFINE_METHOD(rtpp_pcnt_strm, rtpp_pcnt_strm_get_stats, void,
   struct rtpp_pcnts_strm *);
 DEFINE_METHOD(rtpp_pcnt_strm, rtpp_pcnt_strm_reg_pktin, void,
   struct rtp_packet *);
+DEFINE_METHOD(rtpp_pcnt_strm, rtpp_pcnt_strm_add_pktin, void,
+  unsigned long, double);
+DEFINE_METHOD(rtpp_pcnt_strm, rtpp_pcnt_strm_fwlat_sample, void,
+  struct rtp_packet *);
+DEFINE_METHOD(rtpp_pcnt_strm, rtpp_pcnt_strm_reg_fwlat, void, double);
+DEFINE_METHOD(rtpp_pcnt_strm, rtpp_pcnt_strm_get_fwlat, void,
+  struct rtpp_histogram *);
+
+/*
+ * One out of every RTPP_FWLAT_SRATE packets relayed is tagged to have its
+ * forwarding latency (receive timestamp to the sendto(2) completion in
+ * the sender thread) measured.
+ */
+#define RTPP_FWLAT_SRATE 8
 
 struct rtpp_pcnts_strm {
     /* Number of packets received */
@@ -54,7 +69,14 @@ struct rtpp_pcnt_strm {
     struct rtpp_refcnt *rcnt;
     METHOD_ENTRY(rtpp_pcnt_strm_get_stats, get_stats);
     METHOD_ENTRY(rtpp_pcnt_strm_reg_pktin, reg_pktin);
+    METHOD_ENTRY(rtpp_pcnt_strm_add_pktin, add_pktin);
+    METHOD_ENTRY(rtpp_pcnt_strm_fwlat_sample, fwlat_sample);
+    METHOD_ENTRY(rtpp_pcnt_strm_reg_fwlat, reg_fwlat);
+    METHOD_ENTRY(rtpp_pcnt_strm_get_fwlat, get_fwlat);
 };
 
 struct rtpp_pcnt_strm *rtpp_pcnt_strm_ctor(void);
+size_t rtpp_pcnt_strm_osize(void);
+struct rtpp_pcnt_strm *rtpp_pcnt_strm_ctor_pa(void *, struct rtpp_refcnt *);
+void rtpp_pcnt_strm_dtor_pa(struct rtpp_pcnt_strm *);
 #endif
@@ -45,13 +45,32 @@ struct rtpp_pcount_priv {
 
 static void rtpp_pcount_dtor(struct rtpp_pcount_priv *);
 static void rtpp_pcount_reg_reld(struct rtpp_pcount *);
+static void rtpp_pcount_add_reld(struct rtpp_pcount *, unsigned long);
 static void rtpp_pcount_reg_drop(struct rtpp_pcount *);
 static void rtpp_pcount_reg_ignr(struct rtpp_pcount *);
+static void rtpp_pcount_reg_rlim(struct rtpp_pcount *);
 static void rtpp_pcount_get_stats(struct rtpp_pcount *, struct rtpps_pcount *);
 
 #define PUB2PVT(pubp) \
   ((struct rtpp_pcount_priv *)((char *)(pubp) - offsetof(struct rtpp_pcount_priv, pub)))
 
+static int
+rtpp_pcount_init(struct rtpp_pcount_priv *pvt, struct rtpp_refcnt *rcnt)
+{
+
+    pvt->pub.rcnt = rcnt;
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        return (-1);
+    }
+    pvt->pub.reg_reld = &rtpp_pcount_reg_reld;
+    pvt->pub.add_reld = &rtpp_pcount_add_reld;
+    pvt->pub.reg_drop = &rtpp_pcount_reg_drop;
+    pvt->pub.reg_ignr = &rtpp_pcount_reg_ignr;
+    pvt->pub.reg_rlim = &rtpp_pcount_reg_rlim;
+    pvt->pub.get_stats = &rtpp_pcount_get_stats;
+    return (0);
+}
+
 struct rtpp_pcount *
 rtpp_pcount_ctor(void)
 {
@@ -62,31 +81,59 @@ rtpp_pcount_ctor(void)
     if (pvt == NULL) {
         goto e0;
     }
-    pvt->pub.rcnt = rcnt;
-    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+    if (rtpp_pcount_init(pvt, rcnt) != 0) {
         goto e1;
     }
-    pvt->pub.reg_reld = &rtpp_pcount_reg_reld;
-    pvt->pub.reg_drop = &rtpp_pcount_reg_drop;
-    pvt->pub.reg_ignr = &rtpp_pcount_reg_ignr;
-    pvt->pub.get_stats = &rtpp_pcount_get_stats;
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_pcount_dtor,
       pvt);
     return ((&pvt->pub));
 
 e1:
-    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    CALL_SMETHOD(rcnt, decref);
     free(pvt);
 e0:
     return (NULL);
 }
 
+size_t
+rtpp_pcount_osize(void)
+{
+
+    return (sizeof(struct rtpp_pcount_priv));
+}
+
+/*
+ * Same as rtpp_netaddr_ctor_pa(): the object lives in the owner's memory
+ * and shares owner's refcounter, rtpp_pcount_dtor_pa() is to be called
+ * by the owner's destructor.
+ */
+struct rtpp_pcount *
+rtpp_pcount_ctor_pa(void *pap, struct rtpp_refcnt *rcnt)
+{
+    struct rtpp_pcount_priv *pvt;
+
+    pvt = (struct rtpp_pcount_priv *)pap;
+    if (rtpp_pcount_init(pvt, rcnt) != 0) {
+        return (NULL);
+    }
+    return (&pvt->pub);
+}
+
+void
+rtpp_pcount_dtor_pa(struct rtpp_pcount *self)
+{
+    struct rtpp_pcount_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    rtpp_pcount_fin(self);
+    pthread_mutex_destroy(&pvt->lock);
+}
+
 static void
 rtpp_pcount_dtor(struct rtpp_pcount_priv *pvt)
 {
 
-    rtpp_pcount_fin(&(pvt->pub));
-    pthread_mutex_destroy(&pvt->lock);
+    rtpp_pcount_dtor_pa(&(pvt->pub));
     free(pvt);
 }
 
@@ -101,6 +148,17 @@ rtpp_pcount_reg_reld(struct rtpp_pcount *self)
     pthread_mutex_unlock(&pvt->lock);
 }
 
+static void
+rtpp_pcount_add_reld(struct rtpp_pcount *self, unsigned long cnt)
+{
+    struct rtpp_pcount_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    pthread_mutex_lock(&pvt->lock);
+    pvt->cnt.nrelayed += cnt;
+    pthread_mutex_unlock(&pvt->lock);
+}
+
 static void
 rtpp_pcount_reg_drop(struct rtpp_pcount *self)
 {
@@ -123,6 +181,17 @@ rtpp_pcount_reg_ignr(struct rtpp_pcount *self)
     pthread_mutex_unlock(&pvt->lock);
 }
 
+static void
+rtpp_pcount_reg_rlim(struct rtpp_pcount *self)
+{
+    struct rtpp_pcount_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    pthread_mutex_lock(&pvt->lock);
+    pvt->cnt.nrlimited++;
+    pthread_mutex_unlock(&pvt->lock);
+}
+
 static void
 rtpp_pcount_get_stats(struct rtpp_pcount *self, struct rtpps_pcount *ocnt)
 {
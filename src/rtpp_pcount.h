@@ -34,8 +34,10 @@ struct rtpp_refcnt;
 struct rtpps_pcount;
 
 DEFINE_METHOD(rtpp_pcount, rtpp_pcount_reg_reld, void);
+DEFINE_METHOD(rtpp_pcount, rtpp_pcount_add_reld, void, unsigned long);
 DEFINE_METHOD(rtpp_pcount, rtpp_pcount_reg_drop, void);
 DEFINE_METHOD(rtpp_pcount, rtpp_pcount_reg_ignr, void);
+DEFINE_METHOD(rtpp_pcount, rtpp_pcount_reg_rlim, void);
 DEFINE_METHOD(rtpp_pcount, rtpp_pcount_get_stats, void,
   struct rtpps_pcount *);
 
@@ -43,15 +45,21 @@ struct rtpps_pcount {
     unsigned long nrelayed;
     unsigned long ndropped;
     unsigned long nignored;
+    unsigned long nrlimited;
 };
 
 struct rtpp_pcount {
     struct rtpp_refcnt *rcnt;
     METHOD_ENTRY(rtpp_pcount_reg_reld, reg_reld);
+    METHOD_ENTRY(rtpp_pcount_add_reld, add_reld);
     METHOD_ENTRY(rtpp_pcount_reg_drop, reg_drop);
     METHOD_ENTRY(rtpp_pcount_reg_ignr, reg_ignr);
+    METHOD_ENTRY(rtpp_pcount_reg_rlim, reg_rlim);
     METHOD_ENTRY(rtpp_pcount_get_stats, get_stats);
 };
 
 struct rtpp_pcount *rtpp_pcount_ctor(void);
+size_t rtpp_pcount_osize(void);
+struct rtpp_pcount *rtpp_pcount_ctor_pa(void *, struct rtpp_refcnt *);
+void rtpp_pcount_dtor_pa(struct rtpp_pcount *);
 #endif
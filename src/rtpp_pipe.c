@@ -46,6 +46,7 @@
 #include "rtpp_pcnt_strm.h"
 #include "rtpp_stats.h"
 #include "rtpp_monotime.h"
+#include "rtpp_netaddr.h"
 
 struct rtpp_pipe_priv
 {
@@ -99,14 +100,11 @@ rtpp_pipe_ctor(uint64_t seuid, struct rtpp_weakref_obj *streams_wrt,
     }
     pvt->pub.stream[0]->stuid_sendr = pvt->pub.stream[1]->stuid;
     pvt->pub.stream[1]->stuid_sendr = pvt->pub.stream[0]->stuid;
-    pvt->pub.pcount = rtpp_pcount_ctor();
-    if (pvt->pub.pcount == NULL) {
-        goto e2;
-    }
-    for (i = 0; i < 2; i++) {
-        CALL_SMETHOD(pvt->pub.pcount->rcnt, incref);
-        pvt->pub.stream[i]->pcount = pvt->pub.pcount;
-    }
+    /* Per-pipe counters live in the callee stream, see rtpp_stream_ctor() */
+    pvt->pub.pcount = pvt->pub.stream[0]->pcount;
+    CALL_SMETHOD(pvt->pub.pcount->rcnt, incref);
+    pvt->pub.stream[1]->pcount = pvt->pub.pcount;
+    CALL_SMETHOD(pvt->pub.pcount->rcnt, incref);
     pvt->pipe_type = pipe_type;
     pvt->pub.rtpp_stats = rtpp_stats;
     pvt->pub.log = log;
@@ -118,7 +116,6 @@ rtpp_pipe_ctor(uint64_t seuid, struct rtpp_weakref_obj *streams_wrt,
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_pipe_dtor, pvt);
     return (&pvt->pub);
 
-e2:
 e1:
     for (i = 0; i < 2; i++) {
         if (pvt->pub.stream[i] != NULL) {
@@ -165,6 +162,18 @@ rtpp_pipe_decr_ttl(struct rtpp_pipe *self)
     CALL_METHOD(self->stream[1]->ttl, decr);
 }
 
+static void
+rtpp_pipe_copy_rem_addr(struct rtpp_stream *stp, struct rtpp_netaddr *dst)
+{
+    struct rtpp_netaddr *rem_addr;
+
+    rem_addr = CALL_SMETHOD(stp, get_rem_addr, 0);
+    if (rem_addr == NULL)
+        return;
+    CALL_SMETHOD(dst, copy, rem_addr);
+    CALL_SMETHOD(rem_addr->rcnt, decref);
+}
+
 static void
 rtpp_pipe_get_stats(struct rtpp_pipe *self, struct rtpp_acct_pipe *rapp)
 {
@@ -177,8 +186,8 @@ rtpp_pipe_get_stats(struct rtpp_pipe *self, struct rtpp_acct_pipe *rapp)
     CALL_SMETHOD(self->stream[1], get_stats, &rapp->a.hld_stat);
     CALL_METHOD(self->stream[0]->pcnt_strm, get_stats, rapp->o.ps);
     CALL_METHOD(self->stream[1]->pcnt_strm, get_stats, rapp->a.ps);
-    rapp->o.rem_addr = CALL_SMETHOD(self->stream[0], get_rem_addr, 1);
-    rapp->a.rem_addr = CALL_SMETHOD(self->stream[1], get_rem_addr, 1);
+    rtpp_pipe_copy_rem_addr(self->stream[0], rapp->o.rem_addr);
+    rtpp_pipe_copy_rem_addr(self->stream[1], rapp->a.rem_addr);
     RTPP_LOG(self->log, RTPP_LOG_INFO, "%s stats: %lu in from callee, %lu "
       "in from caller, %lu relayed, %lu dropped, %lu ignored",
       PP_NAME(pvt->pipe_type), rapp->o.ps->npkts_in,
@@ -39,12 +39,17 @@
 #include "rtp_resizer.h"
 #include "rtpp_cfg_stable.h"
 #include "rtpp_defines.h"
+#include "rtpp_kfwd.h"
+#include "rtpp_module.h"
+#include "rtpp_module_if.h"
+#include "rtpp_network.h"
 #include "rtpp_proc.h"
 #include "rtpp_record.h"
 #include "rtpp_refcnt.h"
 #include "rtpp_sessinfo.h"
 #include "rtpp_stream.h"
 #include "rtpp_pcount.h"
+#include "rtpp_pcnt_strm.h"
 #include "rtpp_session.h"
 #include "rtpp_ttl.h"
 #include "rtpp_pipe.h"
@@ -54,16 +59,49 @@ struct rtpp_proc_ready_lst {
     struct rtpp_stream *stp;
 };
 
+/* Max number of packets handed to the module packet hook at once */
+#define MOD_PKTS_BATCH 32
+
 static void send_packet(struct cfg *, struct rtpp_stream *,
   struct rtp_packet *, struct sthread_args *, struct rtpp_proc_rstats *);
 
+static void
+mod_observe_packets(struct cfg *cf, struct rtpp_module_if *mif,
+  struct rtpp_stream *stp, struct rtp_packet **pkts, int npkts,
+  struct sthread_args *sender, struct rtpp_proc_rstats *rsp)
+{
+    struct rtpp_mod_pktview pvs[MOD_PKTS_BATCH];
+    int i;
+
+    for (i = 0; i < npkts; i++) {
+        pvs[i].stuid = stp->stuid;
+        pvs[i].pipe_type = stp->pipe_type;
+        pvs[i].data = pkts[i]->data.buf;
+        pvs[i].size = pkts[i]->size;
+        pvs[i].raddr = sstosa(&pkts[i]->raddr);
+        pvs[i].rtime = pkts[i]->rtime;
+    }
+    CALL_METHOD(mif, do_pkts, pvs, npkts);
+    for (i = 0; i < npkts; i++) {
+        send_packet(cf, stp, pkts[i], sender, rsp);
+    }
+}
+
 static void
 rxmit_packets(struct cfg *cf, struct rtpp_stream *stp,
-  double dtime, int drain_repeat, struct sthread_args *sender,
-  struct rtpp_proc_rstats *rsp)
+  struct rtpp_socket *skt, double dtime, int drain_repeat,
+  struct sthread_args *sender, struct rtpp_proc_rstats *rsp)
 {
-    int ndrain;
+    int ndrain, npkts;
     struct rtp_packet *packet = NULL;
+    struct rtp_packet *pkts[MOD_PKTS_BATCH];
+    struct rtpp_module_if *mif;
+
+    mif = cf->stable->modules_cf;
+    if (mif != NULL && mif->has_pkts_hook == 0) {
+        mif = NULL;
+    }
+    npkts = 0;
 
     /* Repeat since we may have several packets queued on the same socket */
     ndrain = -1;
@@ -74,18 +112,29 @@ rxmit_packets(struct cfg *cf, struct rtpp_stream *stp,
             ndrain -= 1;
         }
 
-	packet = CALL_SMETHOD(stp, rx, cf->stable->rtcp_streams_wrt, dtime,
-          rsp);
+	packet = CALL_SMETHOD(stp, rx, skt, cf->stable->rtcp_streams_wrt,
+          dtime, rsp);
 	if (packet == NULL) {
             /* Move on to the next session */
-            return;
+            break;
         }
         if (packet == RTPP_S_RX_DCONT) {
             ndrain += 1;
             continue;
         }
-        send_packet(cf, stp, packet, sender, rsp);
-    } while (ndrain > 0);
+        if (mif == NULL) {
+            send_packet(cf, stp, packet, sender, rsp);
+            continue;
+        }
+        pkts[npkts++] = packet;
+        if (npkts == MOD_PKTS_BATCH) {
+            mod_observe_packets(cf, mif, stp, pkts, npkts, sender, rsp);
+            npkts = 0;
+        }
+    } while (ndrain > 0 || CALL_SMETHOD(stp, rx_pending, skt));
+    if (npkts > 0) {
+        mod_observe_packets(cf, mif, stp, pkts, npkts, sender, rsp);
+    }
     return;
 }
 
@@ -127,6 +176,13 @@ send_packet(struct cfg *cf, struct rtpp_stream *stp_in,
     if (!CALL_SMETHOD(stp_out, issendable) || CALL_SMETHOD(stp_out, isplayer_active)) {
         goto e1;
     } else {
+        if (stp_in->pipe_type == PIPE_RTP) {
+            CALL_METHOD(stp_in->pcnt_strm, fwlat_sample, packet);
+        }
+        if (cf->stable->rtpp_kfwd_cf != NULL) {
+            CALL_METHOD(cf->stable->rtpp_kfwd_cf, offload, stp_in, stp_out,
+              packet);
+        }
         CALL_SMETHOD(stp_out, send_pkt, sender, packet);
         CALL_METHOD(stp_in->pcount, reg_reld);
         rsp->npkts_relayed.cnt++;
@@ -146,25 +202,34 @@ void
 process_rtp_only(struct cfg *cf, struct rtpp_polltbl *ptbl, double dtime,
   int drain_repeat, struct sthread_args *sender, struct rtpp_proc_rstats *rsp)
 {
-    int readyfd, ndrained;
+    int readyfd, ndrained, revents;
     struct rtpp_session *sp;
     struct rtpp_stream *stp;
     struct rtp_packet *packet;
 
     for (readyfd = 0; readyfd < ptbl->curlen; readyfd++) {
-        if ((ptbl->pfds[readyfd].revents & POLLIN) == 0)
+        revents = ptbl->pfds[readyfd].revents;
+        if ((revents & (POLLIN | POLLERR | POLLHUP)) == 0)
             continue;
         stp = CALL_METHOD(ptbl->streams_wrt, get_by_idx,
           ptbl->mds[readyfd].stuid);
         if (stp == NULL)
             continue;
+        if ((revents & (POLLERR | POLLHUP)) != 0) {
+            CALL_SMETHOD(stp, sock_err);
+            if ((revents & POLLIN) == 0) {
+                CALL_SMETHOD(stp->rcnt, decref);
+                continue;
+            }
+        }
         sp = CALL_METHOD(cf->stable->sessions_wrt, get_by_idx, stp->seuid);
         if (sp == NULL) {
             CALL_SMETHOD(stp->rcnt, decref);
             continue;
         }
         if (sp->complete != 0) {
-            rxmit_packets(cf, stp, dtime, drain_repeat, sender, rsp);
+            rxmit_packets(cf, stp, ptbl->mds[readyfd].skt, dtime,
+              drain_repeat, sender, rsp);
             CALL_SMETHOD(sp->rcnt, decref);
             if (stp->resizer != NULL) {
                 while ((packet = rtp_resizer_get(stp->resizer, dtime)) != NULL) {
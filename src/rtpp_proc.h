@@ -45,6 +45,8 @@ struct rtpp_proc_rstats {
     struct rtpp_proc_stat npkts_resizer_out;
     struct rtpp_proc_stat npkts_resizer_discard;
     struct rtpp_proc_stat npkts_discard;
+    struct rtpp_proc_stat npkts_foreign;
+    struct rtpp_proc_stat npkts_rlimited;
 };
 
 void process_rtp_servers(struct cfg *, double, struct sthread_args *,
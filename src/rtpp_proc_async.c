@@ -32,6 +32,7 @@
 #include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -48,6 +49,7 @@
 #endif
 #include "rtpp_netio_async.h"
 #include "rtpp_proc.h"
+#include "rtpp_histogram.h"
 #include "rtpp_proc_async.h"
 #include "rtpp_proc_servers.h"
 #include "rtpp_proc_ttl.h"
@@ -58,22 +60,41 @@
 #include "rtpp_stats.h"
 #include "rtpp_time.h"
 #include "rtpp_pipe.h"
+#include "rtpp_util.h"
+#include "rtpp_cpuset.h"
 
 struct rtpp_proc_async_cf {
     struct rtpp_proc_async pub;
     pthread_t thread_id;
+    pthread_t rtcp_thread_id;
     long long clock_tick;
     long long ncycles_ref;
     struct rtpp_anetio_cf *op;
     struct rtpp_queue *time_q;
+    struct rtpp_queue *rtcp_q;
 #if RTPP_DEBUG_timers
     struct recfilter sleep_time;
     struct recfilter poll_time;
     struct recfilter proc_time;
 #endif
     struct rtpp_proc_rstats rstats;
+    struct rtpp_proc_rstats rtcp_rstats;
     struct rtpp_wi *sigterm;
+    struct rtpp_wi *rtcp_sigterm;
     struct cfg *cf_save;
+    pthread_mutex_t lstats_lock;
+    struct rtpp_proc_lstats lstats;
+};
+
+/* Running totals, flushed into rtpp_stats roughly once a second */
+struct rtpp_proc_ltotals {
+    int ncycles_idx;
+    int novrn_idx;
+    uint64_t ncycles;
+    uint64_t novrn;
+    double poll_time;
+    double proc_time;
+    double last_flush;
 };
 
 struct sign_arg {
@@ -83,6 +104,8 @@ struct sign_arg {
 
 static void rtpp_proc_async_dtor(struct rtpp_proc_async *);
 static void rtpp_proc_async_wakeup(struct rtpp_proc_async *, long long, long long);
+static void rtpp_proc_async_get_lstats(struct rtpp_proc_async *,
+  struct rtpp_proc_lstats *, int);
 
 #define PUB2PVT(pubp)      ((struct rtpp_proc_async_cf *)((char *)(pubp) - offsetof(struct rtpp_proc_async_cf, pub)))
 
@@ -104,6 +127,8 @@ flush_rstats(struct rtpp_stats *sobj, struct rtpp_proc_rstats *rsp)
     FLUSH_STAT(sobj, rsp->npkts_resizer_out);
     FLUSH_STAT(sobj, rsp->npkts_resizer_discard);
     FLUSH_STAT(sobj, rsp->npkts_discard);
+    FLUSH_STAT(sobj, rsp->npkts_foreign);
+    FLUSH_STAT(sobj, rsp->npkts_rlimited);
 }
 
 static void
@@ -117,6 +142,57 @@ init_rstats(struct rtpp_stats *sobj, struct rtpp_proc_rstats *rsp)
     rsp->npkts_resizer_out.cnt_idx = CALL_METHOD(sobj, getidxbyname, "npkts_resizer_out");
     rsp->npkts_resizer_discard.cnt_idx = CALL_METHOD(sobj, getidxbyname, "npkts_resizer_discard");
     rsp->npkts_discard.cnt_idx = CALL_METHOD(sobj, getidxbyname, "npkts_discard");
+    rsp->npkts_foreign.cnt_idx = CALL_METHOD(sobj, getidxbyname, "npkts_foreign");
+    rsp->npkts_rlimited.cnt_idx = CALL_METHOD(sobj, getidxbyname, "npkts_rlimited");
+}
+
+static void
+flush_ltotals(struct rtpp_stats *sobj, struct rtpp_proc_ltotals *ltp,
+  double dtime)
+{
+
+    if (ltp->last_flush + 1.0 > dtime)
+        return;
+    CALL_METHOD(sobj, updatebyidx, ltp->ncycles_idx, ltp->ncycles);
+    if (ltp->novrn > 0) {
+        CALL_METHOD(sobj, updatebyidx, ltp->novrn_idx, ltp->novrn);
+    }
+    CALL_METHOD(sobj, updatebyname_d, "rtpproc_poll_time", ltp->poll_time);
+    CALL_METHOD(sobj, updatebyname_d, "rtpproc_proc_time", ltp->proc_time);
+    ltp->ncycles = ltp->novrn = 0;
+    ltp->poll_time = ltp->proc_time = 0.0;
+    ltp->last_flush = dtime;
+}
+
+static void
+record_ltimes(struct rtpp_proc_async_cf *proc_cf, struct rtpp_proc_ltotals *ltp,
+  const double *tp, double last_wake, int ndrain)
+{
+    struct rtpp_proc_lstats *lsp;
+    double tick_ovr;
+
+    lsp = &proc_cf->lstats;
+    tick_ovr = 0.0;
+    if (last_wake != 0.0) {
+        tick_ovr = tp[1] - last_wake - 1.0 / proc_cf->cf_save->stable->target_pfreq;
+        if (tick_ovr < 0.0)
+            tick_ovr = 0.0;
+    }
+    pthread_mutex_lock(&proc_cf->lstats_lock);
+    if (last_wake != 0.0) {
+        rtpp_histogram_record(&lsp->tick_ovr, tick_ovr);
+    }
+    rtpp_histogram_record_us(&lsp->ndrain, ndrain);
+    rtpp_histogram_record(&lsp->poll_time, tp[2] - tp[1]);
+    rtpp_histogram_record(&lsp->proc_time, tp[3] - tp[2]);
+    pthread_mutex_unlock(&proc_cf->lstats_lock);
+
+    ltp->ncycles++;
+    if (ndrain > 1) {
+        ltp->novrn++;
+    }
+    ltp->poll_time += tp[2] - tp[1];
+    ltp->proc_time += tp[3] - tp[2];
 }
 
 static void
@@ -124,8 +200,8 @@ rtpp_proc_async_run(void *arg)
 {
     struct cfg *cf;
     double last_tick_time;
-    int alarm_tick, i, ndrain, rtp_only, j;
-    int nready_rtp, nready_rtcp;
+    int alarm_tick, i, ndrain, j;
+    int nready_rtp;
     struct rtpp_proc_async_cf *proc_cf;
     long long ncycles_ref;
 #if RTPP_DEBUG_timers
@@ -141,15 +217,21 @@ rtpp_proc_async_run(void *arg)
     struct rtpp_proc_rstats *rstats;
     struct rtpp_stats *stats_cf;
     struct rtpp_polltbl ptbl_rtp;
-    struct rtpp_polltbl ptbl_rtcp;
+    struct rtpp_proc_ltotals ltotals;
+    double last_wake;
 
+    rtpp_cpuset_bind(RTPP_THR_RTP);
     proc_cf = (struct rtpp_proc_async_cf *)arg;
     cf = proc_cf->cf_save;
     stats_cf = cf->stable->rtpp_stats;
     rstats = &proc_cf->rstats;
 
+    memset(&ltotals, '\0', sizeof(ltotals));
+    ltotals.ncycles_idx = CALL_METHOD(stats_cf, getidxbyname, "rtpproc_ncycles");
+    ltotals.novrn_idx = CALL_METHOD(stats_cf, getidxbyname, "rtpproc_novrn");
+    last_wake = 0.0;
+
     memset(&ptbl_rtp, '\0', sizeof(struct rtpp_polltbl));
-    memset(&ptbl_rtcp, '\0', sizeof(struct rtpp_polltbl));
 
     last_tick_time = 0;
     wi = rtpp_queue_get_item(proc_cf->time_q, 0);
@@ -178,7 +260,6 @@ rtpp_proc_async_run(void *arg)
                 i -= 1;
             }
             rtpp_polltbl_free(&ptbl_rtp);
-            rtpp_polltbl_free(&ptbl_rtcp);
             return;
         }   
         i -= 1;
@@ -225,31 +306,9 @@ rtpp_proc_async_run(void *arg)
             last_tick_time = tp[1];
         }
 
-        if (alarm_tick || (ncycles_ref % 7) == 0) {
-            rtp_only = 0;
-        } else {
-            rtp_only = 1;
-        }
-
         CALL_METHOD(cf->stable->sessinfo, sync_polltbl, &ptbl_rtp, PIPE_RTP);
-        nready_rtp = nready_rtcp = 0;
+        nready_rtp = 0;
         if (ptbl_rtp.curlen > 0) {
-            if (rtp_only == 0) {
-                CALL_METHOD(cf->stable->sessinfo, sync_polltbl, &ptbl_rtcp, PIPE_RTCP);
-#if RTPP_DEBUG_netio > 1
-                RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "run %lld " \
-                  "polling for %d RTCP file descriptors", \
-                  last_ctick, ptbl_rtcp.curlen);
-#endif
-                nready_rtcp = poll(ptbl_rtcp.pfds, ptbl_rtcp.curlen, 0);
-#if RTPP_DEBUG_netio
-                if (RTPP_DEBUG_netio > 1 || nready_rtcp > 0) {
-                    RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "run %lld " \
-                      "polling for %d RTCP file descriptors: %d descriptors are ready", \
-                      last_ctick, ptbl_rtcp.curlen, nready_rtcp);
-                }
-#endif
-            }
 #if RTPP_DEBUG_netio > 1
            RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "run %lld " \
               "polling for %d RTP file descriptors", \
@@ -276,9 +335,6 @@ rtpp_proc_async_run(void *arg)
         if (nready_rtp > 0) {
             process_rtp_only(cf, &ptbl_rtp, tp[2], ndrain, sender, rstats);
         }
-        if (nready_rtcp > 0 && rtp_only == 0) {
-            process_rtp_only(cf, &ptbl_rtcp, tp[2], ndrain, sender, rstats);
-        }
         if (alarm_tick != 0) {
             rtpp_proc_ttl(cf->stable->sessions_ht, cf->stable->sessions_wrt,
               cf->stable->rtpp_notify_cf, cf->stable->rtpp_stats);
@@ -292,6 +348,9 @@ rtpp_proc_async_run(void *arg)
         CALL_METHOD(cf->stable->rtpp_cmd_cf, wakeup);
         tp[3] = getdtime();
         flush_rstats(stats_cf, rstats);
+        record_ltimes(proc_cf, &ltotals, tp, last_wake, ndrain);
+        flush_ltotals(stats_cf, &ltotals, tp[3]);
+        last_wake = tp[1];
 
 #if RTPP_DEBUG_timers
         recfilter_apply(&proc_cf->sleep_time, tp[1] - tp[0]);
@@ -314,6 +373,181 @@ rtpp_proc_async_run(void *arg)
 
 }
 
+/*
+ * Event-driven flavour of the loop above, used with --evloop. Rather than
+ * being clocked by the main thread at target_pfreq and poll(2)ing with
+ * zero timeout, it blocks in poll(2) until either some RTP socket becomes
+ * readable, the set of sessions changes, or the next timer is due: the
+ * once-a-TIMETICK TTL processing or, while there are players active,
+ * the next player tick. The command thread does not get
+ * its clock from here in this mode, see wait_next_clock().
+ */
+static void
+rtpp_proc_async_run_ev(void *arg)
+{
+    struct cfg *cf;
+    struct rtpp_proc_async_cf *proc_cf;
+    struct rtpp_wi *wi;
+    struct sthread_args *sender;
+    struct rtpp_proc_rstats *rstats;
+    struct rtpp_stats *stats_cf;
+    struct rtpp_polltbl ptbl_rtp;
+    struct rtpp_proc_ltotals ltotals;
+    double tp[4], tick, next_ttl, deadline;
+    int nready_rtp, nplrs, timeout;
+
+    rtpp_cpuset_bind(RTPP_THR_RTP);
+    proc_cf = (struct rtpp_proc_async_cf *)arg;
+    cf = proc_cf->cf_save;
+    stats_cf = cf->stable->rtpp_stats;
+    rstats = &proc_cf->rstats;
+
+    memset(&ltotals, '\0', sizeof(ltotals));
+    ltotals.ncycles_idx = CALL_METHOD(stats_cf, getidxbyname, "rtpproc_ncycles");
+    ltotals.novrn_idx = CALL_METHOD(stats_cf, getidxbyname, "rtpproc_novrn");
+
+    memset(&ptbl_rtp, '\0', sizeof(struct rtpp_polltbl));
+
+    tick = 1.0 / cf->stable->target_pfreq;
+    tp[0] = getdtime();
+    next_ttl = tp[0] + (double)TIMETICK;
+    for (;;) {
+        while (rtpp_queue_get_length(proc_cf->time_q) > 0) {
+            wi = rtpp_queue_get_item(proc_cf->time_q, 0);
+            if (rtpp_wi_sgnl_get_signum(wi) == SIGTERM) {
+                rtpp_wi_free(wi);
+                goto out;
+            }
+            rtpp_wi_free(wi);
+        }
+
+        CALL_METHOD(cf->stable->sessinfo, sync_polltbl, &ptbl_rtp, PIPE_RTP);
+        nplrs = CALL_METHOD(cf->stable->servers_wrt, get_length);
+        deadline = next_ttl;
+        if (nplrs > 0 && tp[0] + tick < deadline)
+            deadline = tp[0] + tick;
+        timeout = (deadline > tp[0]) ? (int)((deadline - tp[0]) * 1000.0) + 1 : 0;
+
+        nready_rtp = 0;
+        if (ptbl_rtp.aloclen > 0) {
+            nready_rtp = poll(ptbl_rtp.pfds, ptbl_rtp.curlen + 1, timeout);
+        } else {
+            nready_rtp = poll(NULL, 0, timeout);
+        }
+        if (nready_rtp < 0) {
+            if (errno != EINTR) {
+                RTPP_ELOG(cf->stable->glog, RTPP_LOG_ERR, "poll() failed");
+            }
+            tp[0] = getdtime();
+            continue;
+        }
+        tp[1] = tp[2] = getdtime();
+
+        sender = rtpp_anetio_pick_sender(proc_cf->op);
+        if (nready_rtp > 0) {
+            process_rtp_only(cf, &ptbl_rtp, tp[2], 1, sender, rstats);
+        }
+        if (tp[2] >= next_ttl) {
+            rtpp_proc_ttl(cf->stable->sessions_ht, cf->stable->sessions_wrt,
+              cf->stable->rtpp_notify_cf, cf->stable->rtpp_stats);
+            next_ttl = tp[2] + (double)TIMETICK;
+        }
+        if (nplrs > 0) {
+            rtpp_proc_servers(cf, tp[2], sender, rstats);
+        }
+
+        rtpp_anetio_pump_q(sender);
+        tp[3] = getdtime();
+        flush_rstats(stats_cf, rstats);
+        record_ltimes(proc_cf, &ltotals, tp, 0.0, 1);
+        flush_ltotals(stats_cf, &ltotals, tp[3]);
+        tp[0] = tp[3];
+    }
+out:
+    rtpp_polltbl_free(&ptbl_rtp);
+}
+
+/*
+ * RTCP accounts for a tiny fraction of the traffic, so instead of having
+ * the RTP loop sample all RTCP sockets every few ticks it is served by a
+ * thread of its own, which sleeps in poll(2) until some RTCP socket becomes
+ * readable or the set of RTCP sockets changes. This is used in both the
+ * clocked and --evloop modes.
+ */
+static void
+rtpp_proc_async_run_rtcp(void *arg)
+{
+    struct cfg *cf;
+    struct rtpp_proc_async_cf *proc_cf;
+    struct rtpp_wi *wi;
+    struct sthread_args *sender;
+    struct rtpp_proc_rstats *rstats;
+    struct rtpp_stats *stats_cf;
+    struct rtpp_polltbl ptbl_rtcp;
+    int nready_rtcp;
+
+    rtpp_cpuset_bind(RTPP_THR_RTP);
+    proc_cf = (struct rtpp_proc_async_cf *)arg;
+    cf = proc_cf->cf_save;
+    stats_cf = cf->stable->rtpp_stats;
+    rstats = &proc_cf->rtcp_rstats;
+
+    memset(&ptbl_rtcp, '\0', sizeof(struct rtpp_polltbl));
+
+    for (;;) {
+        if (rtpp_queue_get_length(proc_cf->rtcp_q) > 0) {
+            wi = rtpp_queue_get_item(proc_cf->rtcp_q, 0);
+            rtpp_wi_free(wi);
+            break;
+        }
+
+        CALL_METHOD(cf->stable->sessinfo, sync_polltbl, &ptbl_rtcp, PIPE_RTCP);
+        if (ptbl_rtcp.aloclen == 0) {
+            /* Out of memory, nothing to wait on, try again a bit later */
+            poll(NULL, 0, (int)(TIMETICK * 1000));
+            continue;
+        }
+        nready_rtcp = poll(ptbl_rtcp.pfds, ptbl_rtcp.curlen + 1, INFTIM);
+        if (nready_rtcp < 0) {
+            if (errno != EINTR) {
+                RTPP_ELOG(cf->stable->glog, RTPP_LOG_ERR, "poll() failed");
+            }
+            continue;
+        }
+        if (nready_rtcp == 0 || ptbl_rtcp.curlen == 0) {
+            continue;
+        }
+
+        sender = rtpp_anetio_pick_sender(proc_cf->op);
+        process_rtp_only(cf, &ptbl_rtcp, getdtime(), 1, sender, rstats);
+        rtpp_anetio_pump_q(sender);
+        flush_rstats(stats_cf, rstats);
+    }
+    rtpp_polltbl_free(&ptbl_rtcp);
+}
+
+static void
+rtpp_proc_async_get_lstats(struct rtpp_proc_async *pub,
+  struct rtpp_proc_lstats *lsp, int reset)
+{
+    struct rtpp_proc_async_cf *proc_cf;
+
+    proc_cf = PUB2PVT(pub);
+    pthread_mutex_lock(&proc_cf->lstats_lock);
+    *lsp = proc_cf->lstats;
+    if (reset != 0) {
+        rtpp_histogram_init(&proc_cf->lstats.tick_ovr);
+        rtpp_histogram_init(&proc_cf->lstats.ndrain);
+        rtpp_histogram_init(&proc_cf->lstats.poll_time);
+        rtpp_histogram_init(&proc_cf->lstats.proc_time);
+    }
+    pthread_mutex_unlock(&proc_cf->lstats_lock);
+    rtpp_histogram_init(&lsp->send_time);
+    rtpp_histogram_init(&lsp->fwd_lat);
+    rtpp_anetio_get_lstats(proc_cf->op, &lsp->send_time, &lsp->fwd_lat,
+      reset);
+}
+
 static void
 rtpp_proc_async_wakeup(struct rtpp_proc_async *pub, long long clock,
   long long ncycles_ref)
@@ -343,6 +577,14 @@ rtpp_proc_async_ctor(struct cfg *cf)
         return (NULL);
 
     init_rstats(cf->stable->rtpp_stats, &proc_cf->rstats);
+    init_rstats(cf->stable->rtpp_stats, &proc_cf->rtcp_rstats);
+    rtpp_histogram_init(&proc_cf->lstats.tick_ovr);
+    rtpp_histogram_init(&proc_cf->lstats.ndrain);
+    rtpp_histogram_init(&proc_cf->lstats.poll_time);
+    rtpp_histogram_init(&proc_cf->lstats.proc_time);
+    if (pthread_mutex_init(&proc_cf->lstats_lock, NULL) != 0) {
+        goto e0;
+    }
 
 #if RTPP_DEBUG_timers
     recfilter_init(&proc_cf->sleep_time, 0.999, 0.0, 0);
@@ -352,34 +594,61 @@ rtpp_proc_async_ctor(struct cfg *cf)
 
     proc_cf->time_q = rtpp_queue_init(1, "RTP_PROC(time)");
     if (proc_cf->time_q == NULL) {
-        goto e0;
+        goto e1;
+    }
+
+    proc_cf->rtcp_q = rtpp_queue_init(1, "RTP_PROC(rtcp)");
+    if (proc_cf->rtcp_q == NULL) {
+        goto e2;
     }
 
     proc_cf->op = rtpp_netio_async_init(cf, 1);
     if (proc_cf->op == NULL) {
-        goto e1;
+        goto e3;
     }
 
     proc_cf->sigterm = rtpp_wi_malloc_sgnl(SIGTERM, NULL, 0);
     if (proc_cf->sigterm == NULL) {
-        goto e2;
+        goto e4;
+    }
+    proc_cf->rtcp_sigterm = rtpp_wi_malloc_sgnl(SIGTERM, NULL, 0);
+    if (proc_cf->rtcp_sigterm == NULL) {
+        goto e5;
     }
 
     proc_cf->cf_save = cf;
 
-    if (pthread_create(&proc_cf->thread_id, NULL, (void *(*)(void *))&rtpp_proc_async_run, proc_cf) != 0) {
-        goto e3;
+    if (pthread_create(&proc_cf->rtcp_thread_id, NULL, (void *(*)(void *))
+      &rtpp_proc_async_run_rtcp, proc_cf) != 0) {
+        goto e6;
+    }
+    if (pthread_create(&proc_cf->thread_id, NULL, (void *(*)(void *))
+      ((cf->stable->evloop != 0) ? &rtpp_proc_async_run_ev :
+      &rtpp_proc_async_run), proc_cf) != 0) {
+        goto e7;
     }
     proc_cf->pub.dtor = &rtpp_proc_async_dtor;
     proc_cf->pub.wakeup = &rtpp_proc_async_wakeup;
+    proc_cf->pub.get_lstats = &rtpp_proc_async_get_lstats;
     return (&proc_cf->pub);
 
-e3:
+e7:
+    rtpp_queue_put_item(proc_cf->rtcp_sigterm, proc_cf->rtcp_q);
+    CALL_METHOD(cf->stable->sessinfo, wakeup, PIPE_RTCP);
+    pthread_join(proc_cf->rtcp_thread_id, NULL);
+    goto e5;
+e6:
+    rtpp_wi_free(proc_cf->rtcp_sigterm);
+e5:
     rtpp_wi_free(proc_cf->sigterm);
-e2:
+e4:
     rtpp_netio_async_destroy(proc_cf->op);
-e1:
+e3:
+    rtpp_queue_destroy(proc_cf->rtcp_q);
+e2:
     rtpp_queue_destroy(proc_cf->time_q);
+e1:
+    pthread_mutex_destroy(&proc_cf->lstats_lock);
 e0:
     free(proc_cf);
     return (NULL);
@@ -392,8 +661,16 @@ rtpp_proc_async_dtor(struct rtpp_proc_async *pub)
 
     proc_cf = PUB2PVT(pub);
     rtpp_queue_put_item(proc_cf->sigterm, proc_cf->time_q);
+    if (proc_cf->cf_save->stable->evloop != 0) {
+        CALL_METHOD(proc_cf->cf_save->stable->sessinfo, wakeup, PIPE_RTP);
+    }
     pthread_join(proc_cf->thread_id, NULL);
+    rtpp_queue_put_item(proc_cf->rtcp_sigterm, proc_cf->rtcp_q);
+    CALL_METHOD(proc_cf->cf_save->stable->sessinfo, wakeup, PIPE_RTCP);
+    pthread_join(proc_cf->rtcp_thread_id, NULL);
     rtpp_netio_async_destroy(proc_cf->op);
+    rtpp_queue_destroy(proc_cf->rtcp_q);
     rtpp_queue_destroy(proc_cf->time_q);
+    pthread_mutex_destroy(&proc_cf->lstats_lock);
     free(proc_cf);
 }
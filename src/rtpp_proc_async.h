@@ -30,13 +30,32 @@
 
 struct rtpp_proc_async;
 
+/*
+ * Always-on timing of the RTP processing loop: how late each tick was
+ * compared to the nominal period, how many ticks had to be drained at
+ * once, time spent in poll(2) and time spent processing packets, plus
+ * the time the sender thread spends pushing each batch out and the
+ * receive-to-send latency of the sampled relayed packets.
+ */
+struct rtpp_proc_lstats {
+    struct rtpp_histogram tick_ovr;
+    struct rtpp_histogram ndrain;
+    struct rtpp_histogram poll_time;
+    struct rtpp_histogram proc_time;
+    struct rtpp_histogram send_time;
+    struct rtpp_histogram fwd_lat;
+};
+
 DEFINE_METHOD(rtpp_proc_async, rtpp_proc_async_dtor, void);
 DEFINE_METHOD(rtpp_proc_async, rtpp_proc_async_wakeup, void, long long,
   long long);
+DEFINE_METHOD(rtpp_proc_async, rtpp_proc_async_get_lstats, void,
+  struct rtpp_proc_lstats *, int);
 
 struct rtpp_proc_async {
     rtpp_proc_async_dtor_t dtor;
     rtpp_proc_async_wakeup_t wakeup;
+    rtpp_proc_async_get_lstats_t get_lstats;
 };
 
 struct rtpp_proc_async *rtpp_proc_async_ctor(struct cfg *);
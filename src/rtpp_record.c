@@ -43,6 +43,7 @@
 #include <limits.h>
 #include <netdb.h>
 #include <stddef.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -84,9 +85,12 @@ struct rtpp_record_channel {
     int record_single_file;
     const char *proto;
     struct rtpp_log *log;
+    /* Same channel can be fed by RTP and RTCP threads */
+    pthread_mutex_t lock;
 };
 
 static void rtpp_record_write(struct rtpp_record *, struct rtpp_stream *, struct rtp_packet *);
+static void rtpp_record_write_locked(struct rtpp_record_channel *, struct rtpp_stream *, struct rtp_packet *);
 static void rtpp_record_close(struct rtpp_record_channel *);
 static int get_hdr_size(const struct sockaddr *);
 
@@ -169,6 +173,9 @@ rtpp_record_open(struct cfg *cf, struct rtpp_session *sp, char *rname, int orig,
 	goto e0;
     }
     rrc->pub.rcnt = rcnt;
+    if (pthread_mutex_init(&rrc->lock, NULL) != 0) {
+        goto e1;
+    }
 
     rrc->record_single_file = (record_type == RECORD_BOTH) ? 1 : 0;
     if (rrc->record_single_file != 0) {
@@ -261,6 +268,8 @@ e3:
     close(rrc->fd);
 e2:
     CALL_SMETHOD(rrc->log->rcnt, decref);
+    pthread_mutex_destroy(&rrc->lock);
+e1:
     CALL_SMETHOD(rrc->pub.rcnt, decref);
     free(rrc);
 e0:
@@ -518,6 +527,19 @@ get_hdr_size(const struct sockaddr *raddr)
 
 static void
 rtpp_record_write(struct rtpp_record *self, struct rtpp_stream *stp, struct rtp_packet *packet)
+{
+    struct rtpp_record_channel *rrc;
+
+    rrc = PUB2PVT(self);
+
+    pthread_mutex_lock(&rrc->lock);
+    rtpp_record_write_locked(rrc, stp, packet);
+    pthread_mutex_unlock(&rrc->lock);
+}
+
+static void
+rtpp_record_write_locked(struct rtpp_record_channel *rrc, struct rtpp_stream *stp,
+  struct rtp_packet *packet)
 {
     struct iovec v[2];
     union {
@@ -531,12 +553,9 @@ rtpp_record_write(struct rtpp_record *self, struct rtpp_stream *stp, struct rtp_
     struct sockaddr_storage daddr;
     struct sockaddr *ldaddr;
     int ldport, face;
-    struct rtpp_record_channel *rrc;
     struct rtpp_netaddr *rem_addr;
     size_t dalen;
 
-    rrc = PUB2PVT(self);
-
     if (rrc->fd == -1)
 	return;
 
@@ -632,6 +651,7 @@ rtpp_record_close(struct rtpp_record_channel *rrc)
     }
 done:
     CALL_SMETHOD(rrc->log->rcnt, decref);
+    pthread_mutex_destroy(&rrc->lock);
 
     free(rrc);
 }
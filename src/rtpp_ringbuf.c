@@ -60,15 +60,14 @@ rtpp_ringbuf_ctor(size_t el_size, int nelements)
     struct rtpp_ringbuf_priv *pvt;
     struct rtpp_refcnt *rcnt;
 
-    pvt = rtpp_rzmalloc(sizeof(struct rtpp_ringbuf_priv), &rcnt);
+    /* Elements are stored right after the object */
+    pvt = rtpp_rzmalloc(RTPP_MALIGN(sizeof(struct rtpp_ringbuf_priv)) +
+      el_size * nelements, &rcnt);
     if (pvt == NULL) {
         goto e0;
     }
     pvt->pub.rcnt = rcnt;
-    pvt->elements = rtpp_zmalloc(el_size * nelements);
-    if (pvt->elements == NULL) {
-        goto e1;
-    }
+    pvt->elements = (char *)pvt + RTPP_MALIGN(sizeof(struct rtpp_ringbuf_priv));
     pvt->el_size = el_size;
     pvt->nelements = nelements;
     pvt->pub.push = rtpp_ringbuf_push;
@@ -77,9 +76,6 @@ rtpp_ringbuf_ctor(size_t el_size, int nelements)
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_ringbuf_dtor,
       pvt);
     return (&pvt->pub);
-e1:
-    CALL_SMETHOD(pvt->pub.rcnt, decref);
-    free(pvt);
 e0:
     return (NULL);
 }
@@ -89,7 +85,6 @@ rtpp_ringbuf_dtor(struct rtpp_ringbuf_priv *pvt)
 {
 
     rtpp_ringbuf_fin(&(pvt->pub));
-    free(pvt->elements);
     free(pvt);
 }
 
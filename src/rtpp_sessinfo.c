@@ -28,12 +28,15 @@
 
 #include <sys/stat.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <poll.h>
 #include <pthread.h>
+#include <unistd.h>
 
 #include "rtpp_types.h"
 #include "rtpp_refcnt.h"
@@ -60,6 +63,8 @@ struct rtpp_polltbl_hst {
    int ilen;	/* Minimum number of entries to be allocated when need to extend */
    struct rtpp_polltbl_hst_ent *clog;
    struct rtpp_weakref_obj *streams_wrt;
+   int wakefd[2];	/* Wakeup pipe, see struct rtpp_polltbl */
+   int wpending;	/* Wakeup pipe has been written into */
 };
 
 struct rtpp_sessinfo_priv {
@@ -77,6 +82,7 @@ static void rtpp_sinfo_remove(struct rtpp_sessinfo *, struct rtpp_session *,
   int);
 static int rtpp_sinfo_sync_polltbl(struct rtpp_sessinfo *, struct rtpp_polltbl *,
   int);
+static void rtpp_sinfo_wakeup(struct rtpp_sessinfo *, int);
 static void rtpp_sessinfo_dtor(struct rtpp_sessinfo_priv *);
 
 #define PUB2PVT(pubp) \
@@ -86,12 +92,31 @@ static int
 rtpp_polltbl_hst_alloc(struct rtpp_polltbl_hst *hp, int alen)
 {
 
+    int i;
+
     hp->clog = rtpp_zmalloc(sizeof(struct rtpp_polltbl_hst_ent) * alen);
     if (hp->clog == NULL) {
-        return (-1);
+        goto e0;
+    }
+    if (pipe(hp->wakefd) != 0) {
+        goto e1;
+    }
+    for (i = 0; i < 2; i++) {
+        if (fcntl(hp->wakefd[i], F_SETFL, O_NONBLOCK) != 0 ||
+          fcntl(hp->wakefd[i], F_SETFD, FD_CLOEXEC) != 0) {
+            goto e2;
+        }
     }
     hp->alen = hp->ilen = alen;
     return (0);
+
+e2:
+    close(hp->wakefd[0]);
+    close(hp->wakefd[1]);
+e1:
+    free(hp->clog);
+e0:
+    return (-1);
 }
 
 static void
@@ -108,9 +133,37 @@ rtpp_polltbl_hst_dtor(struct rtpp_polltbl_hst *hp)
     }
     if (hp->alen > 0) {
         free(hp->clog);
+        close(hp->wakefd[0]);
+        close(hp->wakefd[1]);
+    }
+}
+
+static void
+rtpp_polltbl_hst_wakeup(struct rtpp_polltbl_hst *hp)
+{
+
+    if (hp->wpending == 0) {
+        if (write(hp->wakefd[1], "", 1) == 1) {
+            hp->wpending = 1;
+        }
     }
 }
 
+static void
+rtpp_polltbl_hst_drain(struct rtpp_polltbl_hst *hp)
+{
+    char buf[16];
+    ssize_t n;
+
+    if (hp->wpending == 0) {
+        return;
+    }
+    do {
+        n = read(hp->wakefd[0], buf, sizeof(buf));
+    } while (n > 0 || (n < 0 && errno == EINTR));
+    hp->wpending = 0;
+}
+
 static int
 rtpp_polltbl_hst_extend(struct rtpp_polltbl_hst *hp)
 {
@@ -132,6 +185,9 @@ rtpp_polltbl_hst_record(struct rtpp_polltbl_hst *hp, enum polltbl_hst_ops op,
 {
     struct rtpp_polltbl_hst_ent *hpe;
 
+    if (hp->ulen == 0) {
+        rtpp_polltbl_hst_wakeup(hp);
+    }
     hpe = hp->clog + hp->ulen;
     hpe->op = op;
     hpe->stuid = stuid;
@@ -171,13 +227,14 @@ rtpp_sessinfo_ctor(struct rtpp_cfg_stable *cfsp)
     sessinfo->update = &rtpp_sinfo_update;
     sessinfo->remove = &rtpp_sinfo_remove;
     sessinfo->sync_polltbl = &rtpp_sinfo_sync_polltbl;
+    sessinfo->wakeup = &rtpp_sinfo_wakeup;
 
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_sessinfo_dtor,
       pvt);
     return (sessinfo);
 
 e7:
-    free(pvt->hst_rtp.clog);
+    rtpp_polltbl_hst_dtor(&pvt->hst_rtp);
 e6:
     pthread_mutex_destroy(&pvt->lock);
 e5:
@@ -350,13 +407,14 @@ rtpp_sinfo_sync_polltbl(struct rtpp_sessinfo *sessinfo,
     pthread_mutex_lock(&pvt->lock);
     hp = (pipe_type == PIPE_RTP) ? &pvt->hst_rtp : &pvt->hst_rtcp;
 
-    if (hp->ulen == 0) {
+    rtpp_polltbl_hst_drain(hp);
+    if (hp->ulen == 0 && ptbl->aloclen > 0) {
         pthread_mutex_unlock(&pvt->lock);
         return (0);
     }
 
-    if (hp->ulen > ptbl->aloclen - ptbl->curlen) {
-        int alen = hp->ulen + ptbl->curlen;
+    if (hp->ulen >= ptbl->aloclen - ptbl->curlen) {
+        int alen = hp->ulen + ptbl->curlen + 1;
 
         pfds = realloc(ptbl->pfds, (alen * sizeof(struct pollfd)));
         mds = realloc(ptbl->mds, (alen * sizeof(struct rtpp_polltbl_mdata)));
@@ -420,7 +478,22 @@ rtpp_sinfo_sync_polltbl(struct rtpp_sessinfo *sessinfo,
     }
     hp->ulen = 0;
 
+    ptbl->pfds[ptbl->curlen].fd = hp->wakefd[0];
+    ptbl->pfds[ptbl->curlen].events = POLLIN;
+    ptbl->pfds[ptbl->curlen].revents = 0;
     ptbl->streams_wrt = hp->streams_wrt;
     pthread_mutex_unlock(&pvt->lock);
     return (1);
 }
+
+static void
+rtpp_sinfo_wakeup(struct rtpp_sessinfo *sessinfo, int pipe_type)
+{
+    struct rtpp_sessinfo_priv *pvt;
+
+    pvt = PUB2PVT(sessinfo);
+    pthread_mutex_lock(&pvt->lock);
+    rtpp_polltbl_hst_wakeup((pipe_type == PIPE_RTP) ? &pvt->hst_rtp :
+      &pvt->hst_rtcp);
+    pthread_mutex_unlock(&pvt->lock);
+}
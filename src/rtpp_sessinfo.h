@@ -42,6 +42,7 @@ DEFINE_METHOD(rtpp_sessinfo, rtpp_si_remove, void, struct rtpp_session *,
   int);
 DEFINE_METHOD(rtpp_sessinfo, rtpp_si_sync_polltbl, int, struct rtpp_polltbl *,
   int);
+DEFINE_METHOD(rtpp_sessinfo, rtpp_si_wakeup, void, int);
 
 struct rtpp_polltbl_mdata;
 
@@ -50,6 +51,13 @@ struct rtpp_polltbl_mdata {
     struct rtpp_socket *skt;
 };
 
+/*
+ * Once allocated, pfds always has one spare entry right after the last
+ * curlen ones. It watches a pipe that becomes readable when there are
+ * changes pending for the next sync_polltbl() or when somebody calls
+ * wakeup(), so that a thread blocked in poll(2) over curlen + 1 entries
+ * does not need to time out to pick up new sessions.
+ */
 struct rtpp_polltbl {
     struct pollfd *pfds;
     struct rtpp_polltbl_mdata *mds;
@@ -65,6 +73,7 @@ struct rtpp_sessinfo {
     METHOD_ENTRY(rtpp_si_update, update);
     METHOD_ENTRY(rtpp_si_remove, remove);
     METHOD_ENTRY(rtpp_si_sync_polltbl, sync_polltbl);
+    METHOD_ENTRY(rtpp_si_wakeup, wakeup);
 };
 
 struct rtpp_sessinfo *rtpp_sessinfo_ctor(struct rtpp_cfg_stable *);
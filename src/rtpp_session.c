@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -44,6 +45,7 @@
 #include "rtpp_command_private.h"
 #include "rtpp_genuid_singlet.h"
 #include "rtpp_hash_table.h"
+#include "rtpp_kfwd.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_module_if.h"
 #include "rtpp_pipe.h"
@@ -60,6 +62,7 @@ struct rtpp_session_priv
     struct rtpp_session pub;
     struct rtpp_sessinfo *sessinfo;
     struct rtpp_module_if *modules_cf;
+    struct rtpp_kfwd *kfwd;
     struct rtpp_acct *acct;
 };
 
@@ -79,8 +82,15 @@ rtpp_session_ctor(struct rtpp_cfg_stable *cfs, struct common_cmd_args *ccap,
     struct rtpp_refcnt *rcnt;
     int i;
     char *cp;
-
-    pvt = rtpp_rzmalloc(sizeof(struct rtpp_session_priv), &rcnt);
+    size_t taglen;
+
+    /*
+     * Call-id and tag live in the accounting record, which is held until
+     * the session is gone, the tag without medianum is stored in the same
+     * allocation as the session.
+     */
+    taglen = strlen(ccap->from_tag) + 1;
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_session_priv) + taglen, &rcnt);
     if (pvt == NULL) {
         goto e0;
     }
@@ -105,29 +115,23 @@ rtpp_session_ctor(struct rtpp_cfg_stable *cfs, struct common_cmd_args *ccap,
     if (pub->rtcp == NULL) {
         goto e3;
     }
-    pvt->acct = rtpp_acct_ctor(pub->seuid);
+    pvt->acct = rtpp_acct_ctor(pub->seuid, ccap->call_id, ccap->from_tag);
     if (pvt->acct == NULL) {
         goto e4;
     }
     pvt->acct->init_ts = dtime;
-    pub->call_id = strdup(ccap->call_id);
-    if (pub->call_id == NULL) {
-        goto e5;
-    }
-    pub->tag = strdup(ccap->from_tag);
-    if (pub->tag == NULL) {
-        goto e6;
-    }
-    pub->tag_nomedianum = strdup(ccap->from_tag);
-    if (pub->tag_nomedianum == NULL) {
-        goto e7;
-    }
+    pub->call_id = pvt->acct->call_id;
+    pub->tag = pvt->acct->from_tag;
+    pub->tag_nomedianum = (char *)(pvt + 1);
+    memcpy(pub->tag_nomedianum, ccap->from_tag, taglen);
     cp = strrchr(pub->tag_nomedianum, ';');
     if (cp != NULL)
         *cp = '\0';
     for (i = 0; i < 2; i++) {
         pub->rtp->stream[i]->laddr = lia[i];
         pub->rtcp->stream[i]->laddr = lia[i];
+        pub->rtp->stream[i]->connect_latched = cfs->connect_latched;
+        pub->rtcp->stream[i]->connect_latched = cfs->connect_latched;
     }
     if (weak) {
         pub->rtp->stream[0]->weak = 1;
@@ -138,10 +142,14 @@ rtpp_session_ctor(struct rtpp_cfg_stable *cfs, struct common_cmd_args *ccap,
     pub->rtp->stream[0]->port = lport;
     pub->rtcp->stream[0]->port = lport + 1;
     for (i = 0; i < 2; i++) {
-        if (i == 0 || cfs->ttl_mode == TTL_INDEPENDENT) {
+        if (i == 0) {
+            /* Lives in the RTP callee stream, see rtpp_stream_ctor() */
+            CALL_METHOD(pub->rtp->stream[0]->ttl, reset_with,
+              cfs->max_setup_ttl);
+        } else if (cfs->ttl_mode == TTL_INDEPENDENT) {
             pub->rtp->stream[i]->ttl = rtpp_ttl_ctor(cfs->max_setup_ttl);
             if (pub->rtp->stream[i]->ttl == NULL) {
-                goto e8;
+                goto e5;
             }
         } else {
             pub->rtp->stream[i]->ttl = pub->rtp->stream[0]->ttl;
@@ -163,6 +171,19 @@ rtpp_session_ctor(struct rtpp_cfg_stable *cfs, struct common_cmd_args *ccap,
         CALL_SMETHOD(cfs->modules_cf->rcnt, incref);
         pvt->modules_cf = cfs->modules_cf;
     }
+    if (cfs->rtpp_kfwd_cf != NULL) {
+        CALL_SMETHOD(cfs->rtpp_kfwd_cf->rcnt, incref);
+        pvt->kfwd = cfs->rtpp_kfwd_cf;
+    }
+
+    if (cfs->modules_cf != NULL && cfs->modules_cf->has_sev_hook) {
+        for (i = 0; i < 2; i++) {
+            CALL_SMETHOD(pub->rtp->stream[i], reg_modules, cfs->modules_cf,
+              dtime);
+            CALL_SMETHOD(pub->rtcp->stream[i], reg_modules, cfs->modules_cf,
+              dtime);
+        }
+    }
 
     CALL_METHOD(cfs->sessinfo, append, pub, 0, fds);
 
@@ -170,12 +191,6 @@ rtpp_session_ctor(struct rtpp_cfg_stable *cfs, struct common_cmd_args *ccap,
       pvt);
     return (&pvt->pub);
 
-e8:
-    free(pub->tag_nomedianum);
-e7:
-    free(pub->tag);
-e6:
-    free(pub->call_id);
 e5:
     CALL_SMETHOD(pvt->acct->rcnt, decref);
 e4:
@@ -205,6 +220,11 @@ rtpp_session_dtor(struct rtpp_session_priv *pvt)
     pvt->acct->destroy_ts = getdtime();
     session_time = pvt->acct->destroy_ts - pvt->acct->init_ts;
 
+    if (pvt->kfwd != NULL) {
+        /* Pull flows out of the kernel and collect their counters */
+        CALL_METHOD(pvt->kfwd, unload_sess, pub);
+        CALL_SMETHOD(pvt->kfwd->rcnt, decref);
+    }
     CALL_METHOD(pub->rtp, get_stats, &pvt->acct->rtp);
     CALL_METHOD(pub->rtcp, get_stats, &pvt->acct->rtcp);
     if (pub->complete != 0) {
@@ -220,10 +240,6 @@ rtpp_session_dtor(struct rtpp_session_priv *pvt)
     CALL_METHOD(pub->rtpp_stats, updatebyname_d, "total_duration",
       session_time);
     if (pvt->modules_cf != NULL) {
-        pvt->acct->call_id = pvt->pub.call_id;
-        pvt->pub.call_id = NULL;
-        pvt->acct->from_tag = pvt->pub.tag;
-        pvt->pub.tag = NULL;
         CALL_METHOD(pub->rtp->stream[0]->analyzer, get_stats, \
           pvt->acct->rasto);
         CALL_METHOD(pub->rtp->stream[1]->analyzer, get_stats, \
@@ -241,12 +257,6 @@ rtpp_session_dtor(struct rtpp_session_priv *pvt)
     CALL_SMETHOD(pvt->pub.log->rcnt, decref);
     if (pvt->pub.timeout_data.notify_tag != NULL)
         free(pvt->pub.timeout_data.notify_tag);
-    if (pvt->pub.call_id != NULL)
-        free(pvt->pub.call_id);
-    if (pvt->pub.tag != NULL)
-        free(pvt->pub.tag);
-    if (pvt->pub.tag_nomedianum != NULL)
-        free(pvt->pub.tag_nomedianum);
 
     CALL_SMETHOD(pvt->pub.rtcp->rcnt, decref);
     CALL_SMETHOD(pvt->pub.rtp->rcnt, decref);
@@ -271,6 +281,24 @@ compare_session_tags(const char *tag1, const char *tag0, unsigned *medianum_p)
     return 0;
 }
 
+/*
+ * Sessions are indexed by the call-id plus the part of the tag up to the
+ * first ';', so that the medianum suffix (if any) is not taken into
+ * account. Any tag that compare_session_tags() can match maps into the
+ * same key, which confines the lookup to the sessions of a single call
+ * leg. Overly long keys are truncated, which is harmless since the
+ * truncation is the same on insertion and on lookup and the actual
+ * matching is done by the ematch functions.
+ */
+const char *
+rtpp_session_htkey(char *buf, size_t blen, const char *call_id,
+  const char *tag)
+{
+
+    snprintf(buf, blen, "%s %.*s", call_id, (int)strcspn(tag, ";"), tag);
+    return (buf);
+}
+
 struct session_match_args {
     const char *from_tag;
     const char *to_tag;
@@ -330,14 +358,23 @@ find_stream(struct cfg *cf, const char *call_id, const char *from_tag,
   const char *to_tag, struct rtpp_session **spp)
 {
     struct session_match_args ma;
+    char fkey[RTPP_SESS_HTKEY_LEN], tkey[RTPP_SESS_HTKEY_LEN];
 
     memset(&ma, '\0', sizeof(ma));
     ma.from_tag = from_tag;
     ma.to_tag = to_tag;
     ma.rval = -1;
 
-    CALL_METHOD(cf->stable->sessions_ht, foreach_key, call_id,
+    rtpp_session_htkey(fkey, sizeof(fkey), call_id, from_tag);
+    CALL_METHOD(cf->stable->sessions_ht, foreach_key, fkey,
       rtpp_session_ematch, &ma);
+    if (ma.rval == -1 && to_tag != NULL) {
+        rtpp_session_htkey(tkey, sizeof(tkey), call_id, to_tag);
+        if (strcmp(fkey, tkey) != 0) {
+            CALL_METHOD(cf->stable->sessions_ht, foreach_key, tkey,
+              rtpp_session_ematch, &ma);
+        }
+    }
     if (ma.rval != -1) {
         *spp = ma.sp;
     }
@@ -64,7 +64,11 @@ struct rtpp_session {
 struct cfg;
 struct cfg_stable;
 
+/* Size of the buffer for the rtpp_session_htkey() */
+#define RTPP_SESS_HTKEY_LEN 256
+
 int compare_session_tags(const char *, const char *, unsigned *);
+const char *rtpp_session_htkey(char *, size_t, const char *, const char *);
 int find_stream(struct cfg *, const char *, const char *, const char *,
   struct rtpp_session **);
 
@@ -28,7 +28,10 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -41,6 +44,7 @@
 #include "rtpp_socket_fin.h"
 #include "rtpp_netio_async.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_math.h"
 #include "rtpp_monotime.h"
 #include "rtpp_time.h"
 #include "rtpp_network.h"
@@ -50,8 +54,13 @@
 struct rtpp_socket_priv {
     struct rtpp_socket pub;
     int fd;
+    /* Rest of the last GRO-coalesced datagram, not yet consumed */
+    struct rtp_packet *gro_pending;
 };
 
+/* Largest GRO super-datagram the kernel can hand us */
+#define RTPP_GRO_BUFSIZE 65536
+
 static void rtpp_socket_dtor(struct rtpp_socket_priv *);
 static int rtpp_socket_bind(struct rtpp_socket *, const struct sockaddr *,
   int);
@@ -59,6 +68,7 @@ static int rtpp_socket_settos(struct rtpp_socket *, int);
 static int rtpp_socket_setrbuf(struct rtpp_socket *, int);
 static int rtpp_socket_setnonblock(struct rtpp_socket *);
 static int rtpp_socket_settimestamp(struct rtpp_socket *);
+static int rtpp_socket_setgro(struct rtpp_socket *);
 static int rtpp_socket_send_pkt(struct rtpp_socket *, struct sthread_args *,
   const struct sockaddr *, int, struct rtp_packet *, struct rtpp_log *);
 static int rtpp_socket_send_pkt_na(struct rtpp_socket *, struct sthread_args *,
@@ -67,7 +77,14 @@ static struct rtp_packet * rtpp_socket_rtp_recv_simple(struct rtpp_socket *,
   double, struct sockaddr *, int);
 static struct rtp_packet *rtpp_socket_rtp_recv(struct rtpp_socket *, double,
   struct sockaddr *, int);
+#if defined(UDP_GRO)
+static struct rtp_packet *rtpp_socket_rtp_recv_gro(struct rtpp_socket *,
+  double, struct sockaddr *, int);
+#endif
+static int rtpp_socket_rtp_pending(struct rtpp_socket *);
 static int rtpp_socket_getfd(struct rtpp_socket *);
+static int rtpp_socket_connect(struct rtpp_socket *, const struct sockaddr *,
+  int);
 
 #define PUB2PVT(pubp) \
   ((struct rtpp_socket_priv *)((char *)(pubp) - offsetof(struct rtpp_socket_priv, pub)))
@@ -98,10 +115,13 @@ rtpp_socket_ctor(int domain, int type)
     pvt->pub.setrbuf = &rtpp_socket_setrbuf;
     pvt->pub.setnonblock = &rtpp_socket_setnonblock;
     pvt->pub.settimestamp = &rtpp_socket_settimestamp;
+    pvt->pub.setgro = &rtpp_socket_setgro;
     pvt->pub.send_pkt = &rtpp_socket_send_pkt;
     pvt->pub.send_pkt_na = &rtpp_socket_send_pkt_na;
     pvt->pub.rtp_recv = &rtpp_socket_rtp_recv_simple;
+    pvt->pub.rtp_pending = &rtpp_socket_rtp_pending;
     pvt->pub.getfd = &rtpp_socket_getfd;
+    pvt->pub.connect = &rtpp_socket_connect;
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_socket_dtor,
       pvt);
     return (&pvt->pub);
@@ -116,7 +136,14 @@ static void
 rtpp_socket_dtor(struct rtpp_socket_priv *pvt)
 {
 
+    struct rtp_packet *packet;
+
     rtpp_socket_fin(&pvt->pub);
+    while (pvt->gro_pending != NULL) {
+        packet = pvt->gro_pending;
+        pvt->gro_pending = packet->next;
+        rtp_packet_free(packet);
+    }
     shutdown(pvt->fd, SHUT_RDWR);
     close(pvt->fd);
     free(pvt);
@@ -179,6 +206,30 @@ rtpp_socket_settimestamp(struct rtpp_socket *self)
     return (0);
 }
 
+/*
+ * Let the kernel coalesce back-to-back datagrams from the same peer, the
+ * rtp_recv() then splits them back into individual packets.
+ */
+static int
+rtpp_socket_setgro(struct rtpp_socket *self)
+{
+#if defined(UDP_GRO)
+    struct rtpp_socket_priv *pvt;
+    int sval;
+
+    pvt = PUB2PVT(self);
+    sval = 1;
+    if (setsockopt(pvt->fd, IPPROTO_UDP, UDP_GRO, &sval, sizeof(sval)) != 0) {
+        return (-1);
+    }
+    pvt->pub.rtp_recv = &rtpp_socket_rtp_recv_gro;
+    return (0);
+#else
+    errno = ENOPROTOOPT;
+    return (-1);
+#endif
+}
+
 static int 
 rtpp_socket_send_pkt(struct rtpp_socket *self, struct sthread_args *str,
   const struct sockaddr *daddr, int addrlen, struct rtp_packet *pkt,
@@ -275,6 +326,127 @@ rtpp_socket_rtp_recv(struct rtpp_socket *self, double dtime,
     return (packet);
 }
 
+#if defined(UDP_GRO)
+static void
+rtpp_socket_gro_copy(unsigned char *dst, const struct iovec *iov, size_t off,
+  size_t len)
+{
+    size_t clen;
+
+    if (off < iov[0].iov_len) {
+        clen = MIN(len, iov[0].iov_len - off);
+        memcpy(dst, (unsigned char *)iov[0].iov_base + off, clen);
+        dst += clen;
+        len -= clen;
+        off += clen;
+    }
+    if (len > 0) {
+        memcpy(dst, (unsigned char *)iov[1].iov_base + off - iov[0].iov_len,
+          len);
+    }
+}
+
+static struct rtp_packet *
+rtpp_socket_rtp_recv_gro(struct rtpp_socket *self, double dtime,
+  struct sockaddr *laddr, int port)
+{
+    struct rtpp_socket_priv *pvt;
+    struct rtp_packet *packet, *sp, **spp;
+    unsigned char rbuf[RTPP_GRO_BUFSIZE - sizeof(packet->data.buf)];
+    union {
+        struct cmsghdr hdr;
+        unsigned char buf[CMSG_SPACE(256)];
+    } cmsgbuf;
+    struct iovec iov[2];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct timeval rtime;
+    ssize_t rlen;
+    size_t off, segsize;
+    int gso_size;
+
+    pvt = PUB2PVT(self);
+    if (pvt->gro_pending != NULL) {
+        packet = pvt->gro_pending;
+        pvt->gro_pending = packet->next;
+        packet->next = NULL;
+        return (packet);
+    }
+
+    packet = rtp_packet_alloc();
+    if (packet == NULL) {
+        return NULL;
+    }
+    /* Receive straight into the packet, spill the rest into rbuf */
+    iov[0].iov_base = packet->data.buf;
+    iov[0].iov_len = sizeof(packet->data.buf);
+    iov[1].iov_base = rbuf;
+    iov[1].iov_len = sizeof(rbuf);
+    memset(&msg, '\0', sizeof(msg));
+    msg.msg_name = &packet->raddr;
+    msg.msg_namelen = sizeof(packet->raddr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = cmsgbuf.buf;
+    msg.msg_controllen = sizeof(cmsgbuf.buf);
+    rlen = recvmsg(pvt->fd, &msg, 0);
+    if (rlen < 0) {
+        rtp_packet_free(packet);
+        return (NULL);
+    }
+    gso_size = 0;
+    memset(&rtime, '\0', sizeof(rtime));
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+      cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET &&
+          cmsg->cmsg_type == SCM_TIMESTAMP) {
+            memcpy(&rtime, CMSG_DATA(cmsg), sizeof(rtime));
+        } else if (cmsg->cmsg_level == IPPROTO_UDP &&
+          cmsg->cmsg_type == UDP_GRO) {
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+        }
+    }
+    packet->rlen = msg.msg_namelen;
+    packet->laddr = laddr;
+    packet->lport = port;
+    if (!timevaliszero(&rtime)) {
+        packet->rtime = rtimeval2dtime(&rtime);
+    } else {
+        packet->rtime = dtime;
+    }
+    segsize = (gso_size > 0 && gso_size < rlen) ? gso_size : rlen;
+    packet->size = MIN(segsize, sizeof(packet->data.buf));
+
+    spp = &pvt->gro_pending;
+    for (off = segsize; off < rlen; off += segsize) {
+        sp = rtp_packet_alloc();
+        if (sp == NULL) {
+            break;
+        }
+        sp->size = MIN(MIN(segsize, rlen - off), sizeof(sp->data.buf));
+        rtpp_socket_gro_copy(sp->data.buf, iov, off, sp->size);
+        memcpy(&sp->raddr, &packet->raddr, packet->rlen);
+        sp->rlen = packet->rlen;
+        sp->laddr = laddr;
+        sp->lport = port;
+        sp->rtime = packet->rtime;
+        *spp = sp;
+        spp = &sp->next;
+    }
+
+    return (packet);
+}
+#endif
+
+static int
+rtpp_socket_rtp_pending(struct rtpp_socket *self)
+{
+    struct rtpp_socket_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    return (pvt->gro_pending != NULL);
+}
+
 static int
 rtpp_socket_getfd(struct rtpp_socket *self)
 {
@@ -283,3 +455,25 @@ rtpp_socket_getfd(struct rtpp_socket *self)
     pvt = PUB2PVT(self);
     return (pvt->fd);
 }
+
+/*
+ * Associate socket with the remote address, so that only packets from that
+ * address are received and send_pkt() can be called with NULL destination.
+ * Passing NULL address dissolves the association.
+ */
+static int
+rtpp_socket_connect(struct rtpp_socket *self, const struct sockaddr *addr,
+  int addrlen)
+{
+    struct rtpp_socket_priv *pvt;
+    struct sockaddr unspec;
+
+    pvt = PUB2PVT(self);
+    if (addr == NULL) {
+        memset(&unspec, '\0', sizeof(unspec));
+        unspec.sa_family = AF_UNSPEC;
+        addr = &unspec;
+        addrlen = sizeof(unspec);
+    }
+    return (connect(pvt->fd, addr, addrlen));
+}
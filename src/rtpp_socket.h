@@ -40,6 +40,7 @@ DEFINE_METHOD(rtpp_socket, rtpp_socket_settos, int, int);
 DEFINE_METHOD(rtpp_socket, rtpp_socket_setrbuf, int, int);
 DEFINE_METHOD(rtpp_socket, rtpp_socket_setnonblock, int);
 DEFINE_METHOD(rtpp_socket, rtpp_socket_settimestamp, int);
+DEFINE_METHOD(rtpp_socket, rtpp_socket_setgro, int);
 DEFINE_METHOD(rtpp_socket, rtpp_socket_send_pkt, int,
   struct sthread_args *, const struct sockaddr *, int, struct rtp_packet *,
   struct rtpp_log *);
@@ -48,7 +49,10 @@ DEFINE_METHOD(rtpp_socket, rtpp_socket_send_pkt_na, int,
   struct rtpp_log *);
 DEFINE_METHOD(rtpp_socket, rtpp_socket_rtp_recv, struct rtp_packet *,
   double, struct sockaddr *, int);
+DEFINE_METHOD(rtpp_socket, rtpp_socket_rtp_pending, int);
 DEFINE_METHOD(rtpp_socket, rtpp_socket_getfd, int);
+DEFINE_METHOD(rtpp_socket, rtpp_socket_connect, int, const struct sockaddr *,
+  int);
 
 struct rtpp_socket {
     struct rtpp_refcnt *rcnt;
@@ -58,10 +62,13 @@ struct rtpp_socket {
     METHOD_ENTRY(rtpp_socket_setrbuf, setrbuf);
     METHOD_ENTRY(rtpp_socket_setnonblock, setnonblock);
     METHOD_ENTRY(rtpp_socket_settimestamp, settimestamp);
+    METHOD_ENTRY(rtpp_socket_setgro, setgro);
     METHOD_ENTRY(rtpp_socket_send_pkt, send_pkt);
     METHOD_ENTRY(rtpp_socket_send_pkt_na, send_pkt_na);
     METHOD_ENTRY(rtpp_socket_rtp_recv, rtp_recv);
+    METHOD_ENTRY(rtpp_socket_rtp_pending, rtp_pending);
     METHOD_ENTRY(rtpp_socket_getfd, getfd);
+    METHOD_ENTRY(rtpp_socket_connect, connect);
 };
 
 struct rtpp_socket *rtpp_socket_ctor(int, int);
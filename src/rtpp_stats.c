@@ -79,6 +79,8 @@ static struct rtpp_stat_descr default_stats[] = {
     {.name = "nsess_created",        .descr = "Number of RTP sessions created", .type = RTPP_CNT_U64},
     {.name = "nsess_destroyed",      .descr = "Number of RTP sessions destroyed", .type = RTPP_CNT_U64},
     {.name = "nsess_timeout",        .descr = "Number of RTP sessions ended due to media timeout", .type = RTPP_CNT_U64},
+    {.name = "nnotify_sent",         .descr = "Number of timeout notifications delivered to the notify targets", .type = RTPP_CNT_U64},
+    {.name = "nnotify_dropped",      .descr = "Number of timeout notifications dropped due to the notify target being too slow or unreachable", .type = RTPP_CNT_U64},
     {.name = "nsess_complete",       .descr = "Number of RTP sessions fully setup", .type = RTPP_CNT_U64},
     {.name = "nsess_nortp",          .descr = "Number of sessions that had no RTP neither in nor out", .type = RTPP_CNT_U64},
     {.name = "nsess_owrtp",          .descr = "Number of sessions that had one-way RTP only", .type = RTPP_CNT_U64},
@@ -86,19 +88,45 @@ static struct rtpp_stat_descr default_stats[] = {
     {.name = "nsess_owrtcp",         .descr = "Number of sessions that had one-way RTCP only", .type = RTPP_CNT_U64}, 
     {.name = "nplrs_created",        .descr = "Number of RTP players created", .type = RTPP_CNT_U64},
     {.name = "nplrs_destroyed",      .descr = "Number of RTP players destroyed", .type = RTPP_CNT_U64},
+    {.name = "nstrm_connected",      .descr = "Number of times latched stream has been switched to a connected socket", .type = RTPP_CNT_U64},
+    {.name = "nstrm_connerr",        .descr = "Number of times connected stream has been switched back after a socket error", .type = RTPP_CNT_U64},
     {.name = "npkts_rcvd",           .descr = "Total number of RTP/RTPC packets received", .type = RTPP_CNT_U64},
     {.name = "npkts_played",         .descr = "Total number of RTP packets locally generated (played out)", .type = RTPP_CNT_U64},
     {.name = "npkts_relayed",        .descr = "Total number of RTP/RTPC packets relayed", .type = RTPP_CNT_U64},
+    {.name = "npkts_kfwd",           .descr = "Total number of RTP/RTPC packets relayed in kernel, included into npkts_relayed", .type = RTPP_CNT_U64},
     {.name = "npkts_resizer_in",     .descr = "Total number of RTP packets ingress into resizer (re-packetizer)", .type = RTPP_CNT_U64},
     {.name = "npkts_resizer_out",    .descr = "Total number of RTP packets egress out of resizer (re-packetizer)", .type = RTPP_CNT_U64},
     {.name = "npkts_resizer_discard",.descr = "Total number of RTP packets dropped by the resizer (re-packetizer)", .type = RTPP_CNT_U64},
     {.name = "npkts_discard",        .descr = "Total number of RTP/RTPC packets discarded", .type = RTPP_CNT_U64},
+    {.name = "npkts_foreign",        .descr = "Total number of RTP/RTPC packets from foreign source addresses dropped", .type = RTPP_CNT_U64},
+    {.name = "npkts_rlimited",       .descr = "Total number of RTP/RTPC packets dropped by the unlatched stream rate limiter", .type = RTPP_CNT_U64},
     {.name = "total_duration",       .descr = "Cumulative duration of all sessions", .type = RTPP_CNT_DBL},
     {.name = "ncmds_rcvd",           .descr = "Total number of control commands received", .type = RTPP_CNT_U64},
     {.name = "ncmds_rcvd_ndups",     .descr = "Total number of duplicate control commands received", .type = RTPP_CNT_U64},
     {.name = "ncmds_succd",          .descr = "Total number of control commands successfully processed", .type = RTPP_CNT_U64},
     {.name = "ncmds_errs",           .descr = "Total number of control commands ended up with an error", .type = RTPP_CNT_U64},
     {.name = "ncmds_repld",          .descr = "Total number of control commands that had a reply generated", .type = RTPP_CNT_U64},
+    {.name = "ncmds_allocs",         .descr = "Total number of heap allocations made while processing control commands (all blocks allocated by the command thread in the memdeb builds, only command objects, their overflow buffers and the notify tag/codecs copies otherwise)", .type = RTPP_CNT_U64},
+    {.name = "ncmds_fwdd",           .descr = "Total number of control commands forwarded to other workers", .type = RTPP_CNT_U64},
+    {.name = "rcache_hits",          .descr = "Total number of control commands answered from the reply cache", .type = RTPP_CNT_U64},
+    {.name = "rcache_misses",        .descr = "Total number of reply cache lookups that found no entry", .type = RTPP_CNT_U64},
+    {.name = "rcache_evicts",        .descr = "Total number of reply cache entries evicted before expiration", .type = RTPP_CNT_U64},
+    {.name = "rtpproc_ncycles",      .descr = "Total number of RTP processing loop iterations", .type = RTPP_CNT_U64},
+    {.name = "rtpproc_novrn",        .descr = "Number of RTP processing loop iterations that had to drain more than one tick", .type = RTPP_CNT_U64},
+    {.name = "rtpproc_poll_time",    .descr = "Cumulative time RTP processing loop spent polling sockets (seconds)", .type = RTPP_CNT_DBL},
+    {.name = "rtpproc_proc_time",    .descr = "Cumulative time RTP processing loop spent processing packets (seconds)", .type = RTPP_CNT_DBL},
+    {.name = "anetio_run_time",      .descr = "Cumulative time sender thread spent sending packets (seconds)", .type = RTPP_CNT_DBL},
+    {.name = "anetio_sleep_time",    .descr = "Cumulative time sender thread spent waiting for packets (seconds)", .type = RTPP_CNT_DBL},
+    {.name = "npkts_gso",            .descr = "Number of packets handed to the kernel in UDP GSO batches by the sender thread", .type = RTPP_CNT_U64},
+    {.name = "npkts_fwlat",          .descr = "Number of relayed RTP packets sampled for forwarding latency", .type = RTPP_CNT_U64},
+    {.name = "fwlat_total",          .descr = "Cumulative forwarding latency of the sampled RTP packets (seconds)", .type = RTPP_CNT_DBL},
+    {.name = "npkts_mod_skipped",    .descr = "Number of packets not shown to the module packet hook due to it being over its CPU budget", .type = RTPP_CNT_U64},
+    {.name = "npkts_mod_dropped",    .descr = "Number of packets not shown to the deferred module packet hook due to it falling behind", .type = RTPP_CNT_U64},
+    {.name = "arena_nchunks",        .descr = "Number of 2MB chunks mapped by the arena allocator", .type = RTPP_CNT_U64},
+    {.name = "arena_nchunks_htlb",   .descr = "Number of arena allocator chunks backed by explicit huge pages", .type = RTPP_CNT_U64},
+    {.name = "arena_nallocs",        .descr = "Total number of objects handed out by the arena allocator", .type = RTPP_CNT_U64},
+    {.name = "arena_nfrees",         .descr = "Total number of objects returned to the arena allocator", .type = RTPP_CNT_U64},
+    {.name = "arena_nfrees_xnode",   .descr = "Number of arena objects freed on a NUMA node other than their own", .type = RTPP_CNT_U64},
     {.name = "rtpa_nsent",           .descr = "Total number of uniqie RTP packets sent to us based on SEQ tracking", .type = RTPP_CNT_U64},
     {.name = "rtpa_nrcvd",           .descr = "Total number of unique RTP packets received by us based on SEQ tracking", .type = RTPP_CNT_U64},
     {.name = "rtpa_ndups",           .descr = "Total number of duplicate RTP packets received by us based on SEQ tracking", .type = RTPP_CNT_U64},
@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <errno.h>
 #include <pthread.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -51,6 +52,7 @@
 #include "rtp_info.h"
 #include "rtp_packet.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_arena.h"
 #include "rtpp_refcnt.h"
 #include "rtpp_network.h"
 #include "rtpp_pcount.h"
@@ -69,8 +71,11 @@
 #include "rtpp_debug.h"
 #include "rtpp_acct_pipe.h"
 #include "rtpp_time.h"
+#include "rtpp_module.h"
+#include "rtpp_module_if.h"
 
 #define  SEQ_SYNC_IVAL   1.0    /* in seconds */
+#define  SETTLE_HOLDOFF   2.0    /* in seconds */
 
 struct rtpps_latch {
     int latched;
@@ -79,11 +84,48 @@ struct rtpps_latch {
     double last_sync;
 };
 
+/*
+ * Copy of the latch state published for the receive path, which checks it
+ * before taking the stream lock. Only written with the lock held, readers
+ * retry via the lock whenever the generation is odd or has changed.
+ */
+struct rtpps_lsnap {
+    volatile unsigned int gen;
+    int latched;
+    struct rtpp_ssrc ssrc;
+    size_t alen;
+    /* Remote addresses are IP ones, no need for the sockaddr_storage */
+    union {
+        struct sockaddr_in in4;
+        struct sockaddr_in6 in6;
+    } addr;
+};
+
 struct rtps {
     uint64_t uid;
     int inact;
 };
 
+/*
+ * Token bucket capping the rate of packets accepted by streams that have
+ * not latched yet, burst allowance is one second worth of packets.
+ */
+struct rtpp_stream_tbkt {
+    double tokens;
+    double lastupd;
+};
+
+struct rtpp_stream_ulrl {
+    pthread_mutex_t lock;
+    double strm_rate;
+    double glob_rate;
+    struct rtpp_stream_tbkt glob;
+};
+
+static struct rtpp_stream_ulrl rtpp_stream_ulrl = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
 struct rtpp_stream_priv
 {
     struct rtpp_stream pub;
@@ -107,6 +149,17 @@ struct rtpp_stream_priv
     struct rtpp_socket *fd;
     /* Remote source address */
     struct rtpp_netaddr *rem_addr;
+    /* Timestamp of the last change to the remote address or latch */
+    double last_latch;
+    /* Flag that indicates whether or not fd is connected to rem_addr */
+    int connected;
+    /* Rate limiter for packets received while not latched */
+    struct rtpp_stream_tbkt ulrl;
+    /* Latch state as seen by the lock-free part of the rtpp_stream_rx() */
+    struct rtpps_lsnap lsnap;
+    /* Pipe counters and ttl hosted by this stream, if any */
+    struct rtpp_pcount *pcount_pa;
+    struct rtpp_ttl *ttl_pa;
 };
 
 #define PUB2PVT(pubp) \
@@ -126,6 +179,7 @@ static int _rtpp_stream_check_latch_override(struct rtpp_stream_priv *,
   struct rtp_packet *);
 static void __rtpp_stream_fill_addr(struct rtpp_stream_priv *,
   struct rtp_packet *);
+static void _rtpp_stream_lsnap_publish(struct rtpp_stream_priv *);
 static int rtpp_stream_guess_addr(struct rtpp_stream *,
   struct rtp_packet *);
 static void rtpp_stream_prefill_addr(struct rtpp_stream *,
@@ -137,15 +191,30 @@ static struct rtpp_socket *rtpp_stream_update_skt(struct rtpp_stream *,
 static int rtpp_stream_drain_skt(struct rtpp_stream *);
 static int rtpp_stream_send_pkt(struct rtpp_stream *, struct sthread_args *,
   struct rtp_packet *);
-static struct rtp_packet *_rtpp_stream_recv_pkt(struct rtpp_stream_priv *, double);
 static int rtpp_stream_issendable(struct rtpp_stream *);
 static int _rtpp_stream_islatched(struct rtpp_stream_priv *);
 static void rtpp_stream_locklatch(struct rtpp_stream *);
+static int rtpp_stream_issettled(struct rtpp_stream *, double);
 static void rtpp_stream_reg_onhold(struct rtpp_stream *);
 void rtpp_stream_get_stats(struct rtpp_stream *, struct rtpp_acct_hold *);
 static struct rtp_packet *rtpp_stream_rx(struct rtpp_stream *,
-  struct rtpp_weakref_obj *, double, struct rtpp_proc_rstats *);
+  struct rtpp_socket *, struct rtpp_weakref_obj *, double,
+  struct rtpp_proc_rstats *);
 static struct rtpp_netaddr *rtpp_stream_get_rem_addr(struct rtpp_stream *, int);
+static int rtpp_stream_rx_pending(struct rtpp_stream *, struct rtpp_socket *);
+static void rtpp_stream_reg_modules(struct rtpp_stream *,
+  struct rtpp_module_if *, double);
+static void rtpp_stream_sock_err(struct rtpp_stream *);
+static void _rtpp_stream_mod_event(struct rtpp_stream_priv *,
+  enum rtpp_mod_sev_type, const struct sockaddr_storage *, double);
+
+static struct rtpp_arena_pool rtpp_stream_pools[] = {
+    RTPP_ARENA_POOL_INITIALIZER("rtpp_stream(RTP)"),
+    RTPP_ARENA_POOL_INITIALIZER("rtpp_stream(RTCP)")
+};
+
+#define RTPP_STREAM_POOL(pipe_type) \
+  (&rtpp_stream_pools[(pipe_type) == PIPE_RTP ? 0 : 1])
 
 static const struct rtpp_stream_smethods rtpp_stream_smethods = {
     .handle_play = &rtpp_stream_handle_play,
@@ -163,10 +232,14 @@ static const struct rtpp_stream_smethods rtpp_stream_smethods = {
     .guess_addr = &rtpp_stream_guess_addr,
     .issendable = &rtpp_stream_issendable,
     .locklatch = &rtpp_stream_locklatch,
+    .issettled = &rtpp_stream_issettled,
     .reg_onhold = &rtpp_stream_reg_onhold,
     .get_stats = &rtpp_stream_get_stats,
     .rx = &rtpp_stream_rx,
-    .get_rem_addr = &rtpp_stream_get_rem_addr
+    .get_rem_addr = &rtpp_stream_get_rem_addr,
+    .rx_pending = &rtpp_stream_rx_pending,
+    .reg_modules = &rtpp_stream_reg_modules,
+    .sock_err = &rtpp_stream_sock_err
 };
 
 struct rtpp_stream *
@@ -176,8 +249,29 @@ rtpp_stream_ctor(struct rtpp_log *log, struct rtpp_weakref_obj *servers_wrt,
 {
     struct rtpp_stream_priv *pvt;
     struct rtpp_refcnt *rcnt;
+    size_t asize;
+    char *cp;
 
-    pvt = rtpp_rzmalloc(sizeof(struct rtpp_stream_priv), &rcnt);
+    /*
+     * Packet counters, remote addresses and the analyzer are private to
+     * the stream, so they are co-allocated with it and share its
+     * refcounter instead of being separate objects. The callee stream
+     * also hosts the per-pipe counters and, for RTP, the session ttl: the
+     * other streams that use them hold a reference to it, which does not
+     * create a loop since streams never reference the pipe or the session.
+     */
+    asize = RTPP_MALIGN(sizeof(struct rtpp_stream_priv)) +
+      RTPP_MALIGN(rtpp_pcnt_strm_osize()) + 2 * RTPP_MALIGN(rtpp_netaddr_osize());
+    if (side == RTPP_SSIDE_CALLEE) {
+        asize += RTPP_MALIGN(rtpp_pcount_osize());
+        if (pipe_type == PIPE_RTP) {
+            asize += RTPP_MALIGN(rtpp_ttl_osize());
+        }
+    }
+    if (pipe_type == PIPE_RTP) {
+        asize += rtpp_analyzer_osize();
+    }
+    pvt = rtpp_arena_rzalloc(RTPP_STREAM_POOL(pipe_type), asize, &rcnt);
     if (pvt == NULL) {
         goto e0;
     }
@@ -185,23 +279,43 @@ rtpp_stream_ctor(struct rtpp_log *log, struct rtpp_weakref_obj *servers_wrt,
     if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
         goto e1;
     }
-    if (pipe_type == PIPE_RTP) {
-        pvt->pub.analyzer = rtpp_analyzer_ctor(log);
-        if (pvt->pub.analyzer == NULL) {
-            goto e3;
-        }
-    }
-    pvt->pub.pcnt_strm = rtpp_pcnt_strm_ctor();
+    cp = (char *)pvt + RTPP_MALIGN(sizeof(struct rtpp_stream_priv));
+    pvt->pub.pcnt_strm = rtpp_pcnt_strm_ctor_pa(cp, rcnt);
     if (pvt->pub.pcnt_strm == NULL) {
-        goto e4;
+        goto e3;
     }
-    pvt->raddr_prev = rtpp_netaddr_ctor();
+    cp += RTPP_MALIGN(rtpp_pcnt_strm_osize());
+    pvt->raddr_prev = rtpp_netaddr_ctor_pa(cp, rcnt);
     if (pvt->raddr_prev == NULL) {
-        goto e5;
+        goto e4;
     }
-    pvt->rem_addr = rtpp_netaddr_ctor();
+    cp += RTPP_MALIGN(rtpp_netaddr_osize());
+    pvt->rem_addr = rtpp_netaddr_ctor_pa(cp, rcnt);
     if (pvt->rem_addr == NULL) {
-        goto e6;
+        goto e5;
+    }
+    cp += RTPP_MALIGN(rtpp_netaddr_osize());
+    if (side == RTPP_SSIDE_CALLEE) {
+        pvt->pcount_pa = rtpp_pcount_ctor_pa(cp, rcnt);
+        if (pvt->pcount_pa == NULL) {
+            goto e6;
+        }
+        pvt->pub.pcount = pvt->pcount_pa;
+        cp += RTPP_MALIGN(rtpp_pcount_osize());
+        if (pipe_type == PIPE_RTP) {
+            pvt->ttl_pa = rtpp_ttl_ctor_pa(cp, rcnt, 0);
+            if (pvt->ttl_pa == NULL) {
+                goto e7;
+            }
+            pvt->pub.ttl = pvt->ttl_pa;
+            cp += RTPP_MALIGN(rtpp_ttl_osize());
+        }
+    }
+    if (pipe_type == PIPE_RTP) {
+        pvt->pub.analyzer = rtpp_analyzer_ctor_pa(cp, rcnt, log);
+        if (pvt->pub.analyzer == NULL) {
+            goto e8;
+        }
     }
     pvt->servers_wrt = servers_wrt;
     pvt->rtpp_stats = rtpp_stats;
@@ -217,19 +331,23 @@ rtpp_stream_ctor(struct rtpp_log *log, struct rtpp_weakref_obj *servers_wrt,
       pvt);
     return (&pvt->pub);
 
+e8:
+    if (pvt->ttl_pa != NULL)
+        rtpp_ttl_dtor_pa(pvt->ttl_pa);
+e7:
+    if (pvt->pcount_pa != NULL)
+        rtpp_pcount_dtor_pa(pvt->pcount_pa);
 e6:
-    CALL_SMETHOD(pvt->raddr_prev->rcnt, decref);
+    rtpp_netaddr_dtor_pa(pvt->rem_addr);
 e5:
-    CALL_SMETHOD(pvt->pub.pcnt_strm->rcnt, decref);
+    rtpp_netaddr_dtor_pa(pvt->raddr_prev);
 e4:
-    if (pipe_type == PIPE_RTP) {
-         CALL_SMETHOD(pvt->pub.analyzer->rcnt, decref);
-    }
+    rtpp_pcnt_strm_dtor_pa(pvt->pub.pcnt_strm);
 e3:
     pthread_mutex_destroy(&pvt->lock);
 e1:
     CALL_SMETHOD(pvt->pub.rcnt, decref);
-    free(pvt);
+    rtpp_arena_free(RTPP_STREAM_POOL(pipe_type), pvt);
 e0:
     return (NULL);
 }
@@ -298,7 +416,7 @@ rtpp_stream_dtor(struct rtpp_stream_priv *pvt)
          if (rst.pecount > 0) {
              CALL_METHOD(pvt->rtpp_stats, updatebyname, "rtpa_perrs", rst.pecount);
          }
-         CALL_SMETHOD(pvt->pub.analyzer->rcnt, decref);
+         rtpp_analyzer_dtor_pa(pvt->pub.analyzer);
     }
     if (pvt->fd != NULL)
         CALL_SMETHOD(pvt->fd->rcnt, decref);
@@ -310,17 +428,26 @@ rtpp_stream_dtor(struct rtpp_stream_priv *pvt)
         rtp_resizer_free(pvt->rtpp_stats, pub->resizer);
     if (pub->rrc != NULL)
         CALL_SMETHOD(pub->rrc->rcnt, decref);
-    if (pub->pcount != NULL)
+    if (pub->pcount != NULL && pub->pcount != pvt->pcount_pa)
         CALL_SMETHOD(pub->pcount->rcnt, decref);
+    if (pub->modules_cf != NULL) {
+        _rtpp_stream_mod_event(pvt, RTPP_MOD_SEV_DESTROY, NULL, getdtime());
+        CALL_SMETHOD(pub->modules_cf->rcnt, decref);
+    }
 
-    CALL_SMETHOD(pub->ttl->rcnt, decref);
-    CALL_SMETHOD(pub->pcnt_strm->rcnt, decref);
+    if (pub->ttl != NULL && pub->ttl != pvt->ttl_pa)
+        CALL_SMETHOD(pub->ttl->rcnt, decref);
+    if (pvt->ttl_pa != NULL)
+        rtpp_ttl_dtor_pa(pvt->ttl_pa);
+    if (pvt->pcount_pa != NULL)
+        rtpp_pcount_dtor_pa(pvt->pcount_pa);
+    rtpp_pcnt_strm_dtor_pa(pub->pcnt_strm);
     CALL_SMETHOD(pvt->pub.log->rcnt, decref);
-    CALL_SMETHOD(pvt->rem_addr->rcnt, decref);
-    CALL_SMETHOD(pvt->raddr_prev->rcnt, decref);
+    rtpp_netaddr_dtor_pa(pvt->rem_addr);
+    rtpp_netaddr_dtor_pa(pvt->raddr_prev);
 
     pthread_mutex_destroy(&pvt->lock);
-    free(pvt);
+    rtpp_arena_free(RTPP_STREAM_POOL(pub->pipe_type), pvt);
 }
 
 static void
@@ -498,6 +625,11 @@ _rtpp_stream_latch(struct rtpp_stream_priv *pvt, double dtime,
       "%s's address %s: %s (%s), SSRC=%s, Seq=%s", actor, relatch,
       saddr, ptype, ssrc, seq);
     pvt->latch_info.latched = newlatch;
+    pvt->last_latch = dtime;
+    _rtpp_stream_lsnap_publish(pvt);
+    if (pvt->pub.modules_cf != NULL) {
+        _rtpp_stream_mod_event(pvt, RTPP_MOD_SEV_LATCH, &packet->raddr, dtime);
+    }
     return (1);
 }
 
@@ -520,6 +652,79 @@ _rtpp_stream_latch_sync(struct rtpp_stream_priv *pvt, double dtime,
     lip->last_sync = dtime;
 }
 
+/*
+ * Cheap pre-check for packets arriving from other than the latched
+ * address, only looks at the SSRC in the raw header so that a flood of
+ * foreign traffic does not go through the full parser.
+ */
+static int
+_rtpp_stream_isforeign(struct rtpp_stream_priv *pvt,
+  const struct rtpp_ssrc *ssrcp, const struct rtp_packet *packet)
+{
+
+    if (pvt->pub.pipe_type == PIPE_RTCP || ssrcp->inited == 0)
+        return (1);
+    if (packet->size < sizeof(rtp_hdr_t) || packet->data.header.version != 2)
+        return (1);
+    if (ntohl(packet->data.header.ssrc) != ssrcp->val)
+        return (1);
+    return (0);
+}
+
+static void
+_rtpp_stream_lsnap_publish(struct rtpp_stream_priv *pvt)
+{
+    struct rtpps_lsnap *lsp;
+
+    lsp = &pvt->lsnap;
+    lsp->gen++;
+    __sync_synchronize();
+    lsp->latched = pvt->latch_info.latched;
+    lsp->ssrc = pvt->latch_info.ssrc;
+    if (CALL_SMETHOD(pvt->rem_addr, isempty)) {
+        lsp->alen = 0;
+    } else {
+        lsp->alen = CALL_SMETHOD(pvt->rem_addr, get,
+          (struct sockaddr *)&lsp->addr, sizeof(lsp->addr));
+    }
+    __sync_synchronize();
+    lsp->gen++;
+}
+
+/*
+ * Lock-free version of the foreign source test done by the rtpp_stream_rx()
+ * for the latched symmetric streams. Returns 0 whenever the snapshot is
+ * being updated, so that the locked path makes the final decision.
+ */
+static int
+_rtpp_stream_lsnap_isforeign(struct rtpp_stream_priv *pvt,
+  const struct rtp_packet *packet)
+{
+    const struct rtpps_lsnap *lsp;
+    unsigned int gen;
+    int rval;
+
+    if (pvt->pub.asymmetric != 0)
+        return (0);
+    lsp = &pvt->lsnap;
+    gen = lsp->gen;
+    if ((gen & 1) != 0)
+        return (0);
+    __sync_synchronize();
+    if (lsp->latched == 0 || lsp->alen == 0) {
+        rval = 0;
+    } else if (lsp->alen == packet->rlen && memcmp(&lsp->addr, &packet->raddr,
+      packet->rlen) == 0) {
+        rval = 0;
+    } else {
+        rval = _rtpp_stream_isforeign(pvt, &lsp->ssrc, packet);
+    }
+    __sync_synchronize();
+    if (lsp->gen != gen)
+        return (0);
+    return (rval);
+}
+
 static int
 _rtpp_stream_check_latch_override(struct rtpp_stream_priv *pvt,
   struct rtp_packet *packet)
@@ -546,6 +751,11 @@ _rtpp_stream_check_latch_override(struct rtpp_stream_priv *pvt,
 
     pvt->latch_info.seq = packet->parsed->seq;
     pvt->latch_info.last_sync = packet->rtime;
+    pvt->last_latch = packet->rtime;
+    if (pvt->pub.modules_cf != NULL) {
+        _rtpp_stream_mod_event(pvt, RTPP_MOD_SEV_LATCH, &packet->raddr,
+          packet->rtime);
+    }
     return (1);
 }
 
@@ -564,18 +774,126 @@ _rtpp_stream_plr_start(struct rtpp_stream_priv *pvt, double dtime)
     pvt->rtps.inact = 0;
 }
 
+static void
+_rtpp_stream_disconnect(struct rtpp_stream_priv *pvt)
+{
+
+    if (pvt->connected <= 0) {
+        /* Give failed connect another chance with the new address */
+        pvt->connected = 0;
+        return;
+    }
+    if (CALL_METHOD(pvt->fd, connect, NULL, 0) != 0) {
+        RTPP_ELOG(pvt->pub.log, RTPP_LOG_ERR, "can't disconnect %s's %s "
+          "socket", _rtpp_stream_get_actor(pvt), _rtpp_stream_get_proto(pvt));
+    }
+    pvt->connected = 0;
+}
+
+/*
+ * Stream is considered settled when it has been latched, is out of the
+ * update window and the remote address has not changed for a while.
+ */
+static int
+_rtpp_stream_issettled(struct rtpp_stream_priv *pvt, double dtime)
+{
+
+    if (pvt->pub.asymmetric != 0 || !_rtpp_stream_islatched(pvt))
+        return (0);
+    if (pvt->last_update != 0 && dtime - pvt->last_update < UPDATE_WINDOW)
+        return (0);
+    if (dtime - pvt->last_latch < SETTLE_HOLDOFF)
+        return (0);
+    return (1);
+}
+
+/*
+ * Once the stream has settled, connect the socket to the remote address,
+ * so that the kernel can filter out stray packets and outgoing packets
+ * can skip per-packet route lookup. Connected socket only receives from
+ * the latched address, so that NAT rebinding is no longer detected until
+ * the next U/L command.
+ */
+static void
+_rtpp_stream_try_connect(struct rtpp_stream_priv *pvt, double dtime)
+{
+    struct sockaddr_storage raddr;
+    size_t rlen;
+
+    if (pvt->connected != 0 || pvt->fd == NULL)
+        return;
+    if (!_rtpp_stream_issettled(pvt, dtime))
+        return;
+    rlen = CALL_SMETHOD(pvt->rem_addr, get, sstosa(&raddr), sizeof(raddr));
+    if (rlen == 0)
+        return;
+    if (CALL_METHOD(pvt->fd, connect, sstosa(&raddr), rlen) != 0) {
+        RTPP_ELOG(pvt->pub.log, RTPP_LOG_ERR, "can't connect %s's %s socket",
+          _rtpp_stream_get_actor(pvt), _rtpp_stream_get_proto(pvt));
+        /* Don't retry on every packet */
+        pvt->connected = -1;
+        return;
+    }
+    RTPP_LOG(pvt->pub.log, RTPP_LOG_DBUG, "%s's %s address has settled, "
+      "switching to connected socket", _rtpp_stream_get_actor(pvt),
+      _rtpp_stream_get_proto(pvt));
+    pvt->connected = 1;
+    CALL_METHOD(pvt->rtpp_stats, updatebyname, "nstrm_connected", 1);
+}
+
+/*
+ * Called when poll(2) reports an error on the socket, which for the
+ * connected one means an ICMP unreachable from the peer. The error has to
+ * be fetched to be cleared, otherwise the socket stays "ready" and the
+ * I/O thread spins on it. A peer that has gone away is not going to come
+ * back to the same port, so go back to the unconnected socket and don't
+ * reconnect until the address changes.
+ */
+static void
+rtpp_stream_sock_err(struct rtpp_stream *self)
+{
+    struct rtpp_stream_priv *pvt;
+    socklen_t slen;
+    int serr;
+
+    pvt = PUB2PVT(self);
+    pthread_mutex_lock(&pvt->lock);
+    if (pvt->fd == NULL) {
+        pthread_mutex_unlock(&pvt->lock);
+        return;
+    }
+    serr = 0;
+    slen = sizeof(serr);
+    if (getsockopt(CALL_METHOD(pvt->fd, getfd), SOL_SOCKET, SO_ERROR, &serr,
+      &slen) != 0) {
+        serr = errno;
+    }
+    if (pvt->connected > 0) {
+        RTPP_LOG(pvt->pub.log, RTPP_LOG_INFO, "%s's %s socket error: %s, "
+          "switching back to unconnected socket", _rtpp_stream_get_actor(pvt),
+          _rtpp_stream_get_proto(pvt), strerror(serr));
+        _rtpp_stream_disconnect(pvt);
+        pvt->connected = -1;
+        CALL_METHOD(pvt->rtpp_stats, updatebyname, "nstrm_connerr", 1);
+    }
+    pthread_mutex_unlock(&pvt->lock);
+}
+
 static void
 __rtpp_stream_fill_addr(struct rtpp_stream_priv *pvt, struct rtp_packet *packet)
 {
     const char *actor, *ptype;
     char saddr[MAX_AP_STRBUF];
 
+    _rtpp_stream_disconnect(pvt);
+    pvt->last_latch = packet->rtime;
     pvt->untrusted_addr = 1;
     CALL_SMETHOD(pvt->rem_addr, set, sstosa(&packet->raddr), packet->rlen);
     if (CALL_SMETHOD(pvt->raddr_prev, isempty) ||
       CALL_SMETHOD(pvt->raddr_prev, cmp, sstosa(&packet->raddr), packet->rlen) != 0) {
         pvt->latch_info.latched = 1;
     }
+    _rtpp_stream_lsnap_publish(pvt);
     if (pvt->rtps.inact != 0 && pvt->fd != NULL) {
         _rtpp_stream_plr_start(pvt, packet->rtime);
     }
@@ -600,8 +918,10 @@ rtpp_stream_guess_addr(struct rtpp_stream *self,
     RTPP_DBG_ASSERT(self->pipe_type == PIPE_RTCP);
     pvt = PUB2PVT(self);
 
+    pthread_mutex_lock(&pvt->lock);
     if (!CALL_SMETHOD(pvt->rem_addr, isempty) &&
       CALL_SMETHOD(pvt->rem_addr, cmphost, sstosa(&packet->raddr))) {
+        pthread_mutex_unlock(&pvt->lock);
         return (0);
     }
 #if 0
@@ -616,15 +936,20 @@ rtpp_stream_guess_addr(struct rtpp_stream *self,
     ptype = rtpp_stream_get_proto(self);
     rport = ntohs(satosin(&packet->raddr)->sin_port);
     if (IS_LAST_PORT(rport)) {
+        pthread_mutex_unlock(&pvt->lock);
         return (-1);
     }
 
     memcpy(&ta, &packet->raddr, packet->rlen);
     setport(sstosa(&ta), rport + 1);
 
+    _rtpp_stream_disconnect(pvt);
     CALL_SMETHOD(pvt->rem_addr, set, sstosa(&ta), packet->rlen);
+    pvt->last_latch = packet->rtime;
     /* Use guessed value as the only true one for asymmetric clients */
     pvt->latch_info.latched = self->asymmetric;
+    _rtpp_stream_lsnap_publish(pvt);
+    pthread_mutex_unlock(&pvt->lock);
     RTPP_LOG(pvt->pub.log, RTPP_LOG_INFO, "guessing %s port "
       "for %s to be %d", ptype, actor, rport + 1);
 
@@ -652,6 +977,8 @@ rtpp_stream_prefill_addr(struct rtpp_stream *self, struct sockaddr **iapp,
 
     if (!CALL_SMETHOD(pvt->rem_addr, isempty))
         pvt->last_update = dtime;
+    /* Update re-opens the window for re-latching */
+    _rtpp_stream_disconnect(pvt);
 
     /*
      * Unless the address provided by client historically
@@ -677,6 +1004,8 @@ rtpp_stream_prefill_addr(struct rtpp_stream *self, struct sockaddr **iapp,
         }
     }
     CALL_SMETHOD(pvt->rem_addr, set, *iapp, SA_LEN(*iapp));
+    pvt->last_latch = dtime;
+    _rtpp_stream_lsnap_publish(pvt);
     if (pvt->rtps.inact != 0 && pvt->fd != NULL) {
         _rtpp_stream_plr_start(pvt, dtime);
     }
@@ -712,11 +1041,13 @@ rtpp_stream_set_skt(struct rtpp_stream *self, struct rtpp_socket *new_skt)
         RTPP_DBG_ASSERT(pvt->fd != NULL);
         CALL_SMETHOD(pvt->fd->rcnt, decref);
         pvt->fd = NULL;
+        pvt->connected = 0;
         pthread_mutex_unlock(&pvt->lock);
         return;
     }
     RTPP_DBG_ASSERT(pvt->fd == NULL);
     pvt->fd = new_skt;
+    pvt->connected = 0;
     CALL_SMETHOD(pvt->fd->rcnt, incref);
     if (pvt->rtps.inact != 0 && !CALL_SMETHOD(pvt->rem_addr, isempty)) {
         _rtpp_stream_plr_start(pvt, getdtime());
@@ -753,6 +1084,7 @@ rtpp_stream_update_skt(struct rtpp_stream *self, struct rtpp_socket *new_skt)
     pthread_mutex_lock(&pvt->lock);
     old_skt = pvt->fd;
     pvt->fd = new_skt;
+    pvt->connected = 0;
     CALL_SMETHOD(pvt->fd->rcnt, incref);
     if (pvt->rtps.inact != 0 && !CALL_SMETHOD(pvt->rem_addr, isempty)) {
         _rtpp_stream_plr_start(pvt, getdtime());
@@ -807,21 +1139,16 @@ rtpp_stream_send_pkt(struct rtpp_stream *self, struct sthread_args *sap,
 
     pvt = PUB2PVT(self);
     pthread_mutex_lock(&pvt->lock);
-    rval = CALL_METHOD(pvt->fd, send_pkt_na, sap, pvt->rem_addr, pkt,
-      self->log);
+    if (pvt->connected > 0) {
+        rval = CALL_METHOD(pvt->fd, send_pkt, sap, NULL, 0, pkt, self->log);
+    } else {
+        rval = CALL_METHOD(pvt->fd, send_pkt_na, sap, pvt->rem_addr, pkt,
+          self->log);
+    }
     pthread_mutex_unlock(&pvt->lock);
     return (rval);
 }
 
-static struct rtp_packet *
-_rtpp_stream_recv_pkt(struct rtpp_stream_priv *pvt, double dtime)
-{
-    struct rtp_packet *pkt;
-
-    pkt = CALL_METHOD(pvt->fd, rtp_recv, dtime, pvt->pub.laddr, pvt->pub.port);
-    return (pkt);
-}
-
 static int
 rtpp_stream_issendable(struct rtpp_stream *self)
 {
@@ -858,7 +1185,21 @@ rtpp_stream_locklatch(struct rtpp_stream *self)
     pvt = PUB2PVT(self);
     pthread_mutex_lock(&pvt->lock);
     pvt->latch_info.latched = 1;
+    _rtpp_stream_lsnap_publish(pvt);
+    pthread_mutex_unlock(&pvt->lock);
+}
+
+static int
+rtpp_stream_issettled(struct rtpp_stream *self, double dtime)
+{
+    struct rtpp_stream_priv *pvt;
+    int rval;
+
+    pvt = PUB2PVT(self);
+    pthread_mutex_lock(&pvt->lock);
+    rval = _rtpp_stream_issettled(pvt, dtime);
     pthread_mutex_unlock(&pvt->lock);
+    return (rval);
 }
 
 void
@@ -893,35 +1234,116 @@ _rtpp_stream_fill_addr(struct rtpp_stream_priv *pvt,
     return (rval);
 }
 
+int
+rtpp_stream_ulrl_init(double strm_rate, double glob_rate)
+{
+
+    if (strm_rate < 0 || glob_rate < 0)
+        return (-1);
+    pthread_mutex_lock(&rtpp_stream_ulrl.lock);
+    rtpp_stream_ulrl.strm_rate = strm_rate;
+    rtpp_stream_ulrl.glob_rate = glob_rate;
+    pthread_mutex_unlock(&rtpp_stream_ulrl.lock);
+    return (0);
+}
+
+static int
+rtpp_stream_tbkt_take(struct rtpp_stream_tbkt *tbp, double rate,
+  double dtime)
+{
+
+    if (tbp->lastupd == 0) {
+        tbp->tokens = rate;
+    } else {
+        tbp->tokens += (dtime - tbp->lastupd) * rate;
+        if (tbp->tokens > rate)
+            tbp->tokens = rate;
+    }
+    tbp->lastupd = dtime;
+    if (tbp->tokens < 1.0)
+        return (0);
+    tbp->tokens -= 1.0;
+    return (1);
+}
+
+static int
+_rtpp_stream_ulrl_check(struct rtpp_stream_priv *pvt, double dtime)
+{
+    int rval;
+
+    /* Rates are only set at startup, before any of the workers run */
+    if (rtpp_stream_ulrl.strm_rate > 0 && !rtpp_stream_tbkt_take(&pvt->ulrl,
+      rtpp_stream_ulrl.strm_rate, dtime))
+        return (0);
+    if (rtpp_stream_ulrl.glob_rate <= 0)
+        return (1);
+    pthread_mutex_lock(&rtpp_stream_ulrl.lock);
+    rval = rtpp_stream_tbkt_take(&rtpp_stream_ulrl.glob,
+      rtpp_stream_ulrl.glob_rate, dtime);
+    pthread_mutex_unlock(&rtpp_stream_ulrl.lock);
+    return (rval);
+}
+
+/*
+ * Sockets are only ever read by the RTP thread and the one passed in is
+ * held by its poll table, so the packet is received and, if it comes from
+ * a foreign source to a latched stream, dropped before taking the lock.
+ */
 static struct rtp_packet *
-rtpp_stream_rx(struct rtpp_stream *self, struct rtpp_weakref_obj *rtcps_wrt,
-  double dtime, struct rtpp_proc_rstats *rsp)
+rtpp_stream_rx(struct rtpp_stream *self, struct rtpp_socket *skt,
+  struct rtpp_weakref_obj *rtcps_wrt, double dtime,
+  struct rtpp_proc_rstats *rsp)
 {
     struct rtp_packet *packet = NULL;
     struct rtpp_stream_priv *pvt;
+    int rmatch;
 
     pvt = PUB2PVT(self);
-    pthread_mutex_lock(&pvt->lock);
-    packet = _rtpp_stream_recv_pkt(pvt, dtime);
+    packet = CALL_METHOD(skt, rtp_recv, dtime, self->laddr, self->port);
     if (packet == NULL) {
         /* Move on to the next session */
-        pthread_mutex_unlock(&pvt->lock);
         return (NULL);
     }
     rsp->npkts_rcvd.cnt++;
 
+    if (_rtpp_stream_lsnap_isforeign(pvt, packet)) {
+        CALL_METHOD(self->pcount, reg_ignr);
+        rsp->npkts_foreign.cnt++;
+        goto discard;
+    }
+
+    pthread_mutex_lock(&pvt->lock);
+    rmatch = 0;
+    if (self->asymmetric == 0 && !CALL_SMETHOD(pvt->rem_addr, isempty)) {
+        rmatch = (CALL_SMETHOD(pvt->rem_addr, cmp, sstosa(&packet->raddr),
+          packet->rlen) == 0);
+    }
+
+    /*
+     * Asymmetric streams may never latch and packets from the signalled
+     * address are what latches the symmetric ones, only cap the rest.
+     */
+    if (self->asymmetric == 0 && !rmatch && !_rtpp_stream_islatched(pvt) &&
+      !_rtpp_stream_ulrl_check(pvt, dtime)) {
+        CALL_METHOD(self->pcount, reg_rlim);
+        rsp->npkts_rlimited.cnt++;
+        goto discard_and_continue;
+    }
+
     if (!CALL_SMETHOD(pvt->rem_addr, isempty)) {
         /* Check that the packet is authentic, drop if it isn't */
         if (self->asymmetric == 0) {
-            if (CALL_SMETHOD(pvt->rem_addr, cmp, sstosa(&packet->raddr),
-              packet->rlen) != 0) {
+            if (!rmatch) {
                 if (_rtpp_stream_islatched(pvt) && \
-                  _rtpp_stream_check_latch_override(pvt, packet) == 0) {
+                  (_rtpp_stream_isforeign(pvt, &pvt->latch_info.ssrc,
+                  packet) || \
+                  _rtpp_stream_check_latch_override(pvt, packet) == 0)) {
                     /*
                      * Continue, since there could be good packets in
                      * queue.
                      */
                     CALL_METHOD(self->pcount, reg_ignr);
+                    rsp->npkts_foreign.cnt++;
                     goto discard_and_continue;
                 }
                 /* Signal that an address has to be updated */
@@ -940,6 +1362,7 @@ rtpp_stream_rx(struct rtpp_stream *self, struct rtpp_weakref_obj *rtcps_wrt,
                  * queue.
                  */
                 CALL_METHOD(self->pcount, reg_ignr);
+                rsp->npkts_foreign.cnt++;
                 goto discard_and_continue;
             }
         }
@@ -955,10 +1378,21 @@ rtpp_stream_rx(struct rtpp_stream *self, struct rtpp_weakref_obj *rtcps_wrt,
         }
     }
     _rtpp_stream_latch_sync(pvt, dtime, packet);
+    if (self->connect_latched != 0 && pvt->connected == 0) {
+        _rtpp_stream_try_connect(pvt, dtime);
+    }
     if (self->resizer != NULL) {
         rtp_resizer_enqueue(self->resizer, &packet, rsp);
         if (packet == NULL) {
             rsp->npkts_resizer_in.cnt++;
+            if (CALL_METHOD(skt, rtp_pending)) {
+                /*
+                 * Rest of the GRO batch is already off the socket, we
+                 * won't be woken up for it.
+                 */
+                pthread_mutex_unlock(&pvt->lock);
+                return (RTPP_S_RX_DCONT);
+            }
         }
     }
     pthread_mutex_unlock(&pvt->lock);
@@ -966,6 +1400,7 @@ rtpp_stream_rx(struct rtpp_stream *self, struct rtpp_weakref_obj *rtcps_wrt,
 
 discard_and_continue:
     pthread_mutex_unlock(&pvt->lock);
+discard:
     rtp_packet_free(packet);
     rsp->npkts_discard.cnt++;
     return (RTPP_S_RX_DCONT);
@@ -988,3 +1423,47 @@ rtpp_stream_get_rem_addr(struct rtpp_stream *self, int retempty)
     pthread_mutex_unlock(&pvt->lock);
     return (rval);
 }
+
+static int
+rtpp_stream_rx_pending(struct rtpp_stream *self, struct rtpp_socket *skt)
+{
+
+    return (CALL_METHOD(skt, rtp_pending));
+}
+
+static void
+_rtpp_stream_mod_event(struct rtpp_stream_priv *pvt,
+  enum rtpp_mod_sev_type type, const struct sockaddr_storage *raddr,
+  double dtime)
+{
+    struct rtpp_mod_sev sev;
+
+    memset(&sev, '\0', sizeof(sev));
+    sev.type = type;
+    sev.stuid = pvt->pub.stuid;
+    sev.seuid = pvt->pub.seuid;
+    sev.pipe_type = pvt->pub.pipe_type;
+    sev.side = pvt->side;
+    sev.dtime = dtime;
+    if (raddr != NULL) {
+        memcpy(&sev.raddr, raddr, sizeof(sev.raddr));
+    }
+    CALL_METHOD(pvt->pub.modules_cf, do_sev, &sev);
+}
+
+/*
+ * Subscribe loaded modules to the lifecycle events of this stream, must
+ * be called once, before the stream is made visible to other threads.
+ */
+static void
+rtpp_stream_reg_modules(struct rtpp_stream *self,
+  struct rtpp_module_if *modules_cf, double dtime)
+{
+    struct rtpp_stream_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    RTPP_DBG_ASSERT(self->modules_cf == NULL);
+    CALL_SMETHOD(modules_cf->rcnt, incref);
+    self->modules_cf = modules_cf;
+    _rtpp_stream_mod_event(pvt, RTPP_MOD_SEV_CREATE, NULL, dtime);
+}
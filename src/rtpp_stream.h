@@ -44,6 +44,7 @@ struct rtpp_netaddr;
 struct sthread_args;
 struct rtpp_acct_hold;
 struct rtpp_proc_rstats;
+struct rtpp_module_if;
 
 DEFINE_METHOD(rtpp_stream, rtpp_stream_handle_play, int, const char *,
   const char *, int, struct rtpp_command *, int);
@@ -65,13 +66,20 @@ DEFINE_METHOD(rtpp_stream, rtpp_stream_send_pkt, int, struct sthread_args *,
   struct rtp_packet *);
 DEFINE_METHOD(rtpp_stream, rtpp_stream_issendable, int);
 DEFINE_METHOD(rtpp_stream, rtpp_stream_locklatch, void);
+DEFINE_METHOD(rtpp_stream, rtpp_stream_issettled, int, double);
 DEFINE_METHOD(rtpp_stream, rtpp_stream_reg_onhold, void);
 DEFINE_METHOD(rtpp_stream, rtpp_stream_get_stats, void,
   struct rtpp_acct_hold *);
 DEFINE_METHOD(rtpp_stream, rtpp_stream_rx, struct rtp_packet *,
-  struct rtpp_weakref_obj *, double, struct rtpp_proc_rstats *);
+  struct rtpp_socket *, struct rtpp_weakref_obj *, double,
+  struct rtpp_proc_rstats *);
 DEFINE_METHOD(rtpp_stream, rtpp_stream_get_rem_addr, struct rtpp_netaddr *,
   int);
+DEFINE_METHOD(rtpp_stream, rtpp_stream_rx_pending, int,
+  struct rtpp_socket *);
+DEFINE_METHOD(rtpp_stream, rtpp_stream_reg_modules, void,
+  struct rtpp_module_if *, double);
+DEFINE_METHOD(rtpp_stream, rtpp_stream_sock_err, void);
 
 enum rtpp_stream_side {RTPP_SSIDE_CALLER = 1, RTPP_SSIDE_CALLEE = 0};
 
@@ -94,10 +102,14 @@ struct rtpp_stream_smethods {
     METHOD_ENTRY(rtpp_stream_send_pkt, send_pkt);
     METHOD_ENTRY(rtpp_stream_issendable, issendable);
     METHOD_ENTRY(rtpp_stream_locklatch, locklatch);
+    METHOD_ENTRY(rtpp_stream_issettled, issettled);
     METHOD_ENTRY(rtpp_stream_reg_onhold, reg_onhold);
     METHOD_ENTRY(rtpp_stream_get_stats, get_stats);
     METHOD_ENTRY(rtpp_stream_rx, rx);
     METHOD_ENTRY(rtpp_stream_get_rem_addr, get_rem_addr);
+    METHOD_ENTRY(rtpp_stream_rx_pending, rx_pending);
+    METHOD_ENTRY(rtpp_stream_reg_modules, reg_modules);
+    METHOD_ENTRY(rtpp_stream_sock_err, sock_err);
 };
 
 struct rtpp_stream {
@@ -107,6 +119,8 @@ struct rtpp_stream {
     struct sockaddr *laddr;
     int port;
     int asymmetric;
+    /* Use connected socket once the remote address settles, read-only */
+    int connect_latched;
     /* Flags: strong create/delete; weak ones */
     int weak;
     /* Pointer to rtpp_record's opaque data type */
@@ -136,6 +150,8 @@ struct rtpp_stream {
     struct rtpp_pcount *pcount;
     /* Per-stream counters */
     struct rtpp_pcnt_strm *pcnt_strm;
+    /* Modules that want to receive our lifecycle events, read-only */
+    struct rtpp_module_if *modules_cf;
     /* Public methods */
     const struct rtpp_stream_smethods *smethods;
 };
@@ -143,5 +159,6 @@ struct rtpp_stream {
 struct rtpp_stream *rtpp_stream_ctor(struct rtpp_log *,
   struct rtpp_weakref_obj *, struct rtpp_stats *, enum rtpp_stream_side,
   int, uint64_t);
+int rtpp_stream_ulrl_init(double, double);
 
 #endif
@@ -32,99 +32,145 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define SYSLOG_WI_POOL_SIZE     64
-#define SYSLOG_WI_DATA_LEN      2048
+#include "rtpp_cpuset.h"
 
-typedef enum {
-    SYSLOG_ITEM_ASYNC_WRITE,
-    SYSLOG_ITEM_ASYNC_EXIT
-} item_types;
+/*
+ * Bounded multi-producer/single-consumer ring of pre-allocated slots.
+ * Each slot carries a sequence number: a producer may claim slot N only
+ * when its sequence is equal to N, publishes it by setting the sequence
+ * to N + 1, and the consumer gives it back by setting it to
+ * N + SYSLOG_WI_POOL_SIZE. Producers never block: when the ring is full
+ * the message is dropped and accounted for in the per-level counters.
+ */
+#define SYSLOG_WI_POOL_SIZE     1024    /* Must be a power of 2 */
+#define SYSLOG_WI_DATA_LEN      2048
+#define SYSLOG_WI_BATCH_LEN     64
 
 struct syslog_wi
 {
-    item_types item_type;
-    char data[SYSLOG_WI_DATA_LEN];
+    volatile unsigned long seq;
     int len;
     int priority;
-    struct syslog_wi *next;
+    char data[SYSLOG_WI_DATA_LEN];
 };
 
-#define SYSLOG_WI_NOWAIT        0
-#define SYSLOG_WI_WAIT          1
-
 static pthread_mutex_t syslog_init_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int syslog_queue_inited = 0;
 static pthread_t syslog_queue;
 static pthread_cond_t syslog_queue_cond;
 static pthread_mutex_t syslog_queue_mutex;
-static pthread_cond_t syslog_wi_free_cond;
-static pthread_mutex_t syslog_wi_free_mutex;
 
-static int syslog_dropped_items;
+static volatile int syslog_queue_sleeping;
+static volatile int syslog_queue_exiting;
+static volatile unsigned long syslog_dropped_items[LOG_DEBUG + 1];
 
 static struct syslog_wi syslog_wi_pool[SYSLOG_WI_POOL_SIZE];
-static struct syslog_wi *syslog_wi_free;
-static struct syslog_wi *syslog_wi_queue, *syslog_wi_queue_tail;
+static volatile unsigned long syslog_wi_head;
+static unsigned long syslog_wi_tail;
+
+static const char *syslog_lvl_names[LOG_DEBUG + 1] = {
+    "EMERG", "ALERT", "CRIT", "ERR", "WARN", "NOTICE", "INFO", "DBUG"
+};
+
+static int
+syslog_queue_isempty(void)
+{
+
+    return (syslog_wi_pool[syslog_wi_tail % SYSLOG_WI_POOL_SIZE].seq !=
+      syslog_wi_tail + 1);
+}
+
+static void
+syslog_queue_report_drops(void)
+{
+    char buf[256];
+    unsigned long ndrop, ntotal;
+    int i, len;
+
+    len = 0;
+    ntotal = 0;
+    for (i = 0; i <= LOG_DEBUG; i++) {
+        if (syslog_dropped_items[i] == 0)
+            continue;
+        ndrop = __sync_fetch_and_and(&syslog_dropped_items[i], 0);
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%s: %lu",
+          (ntotal > 0) ? ", " : "", syslog_lvl_names[i], ndrop);
+        ntotal += ndrop;
+    }
+    if (ntotal > 0) {
+        syslog(LOG_WARNING, "log queue overflow, %lu messages have been "
+          "dropped (%s)", ntotal, buf);
+    }
+}
 
 static void
 syslog_queue_run(void)
 {
     struct syslog_wi *wi;
+    int i;
 
+    rtpp_cpuset_bind(RTPP_THR_SYSLOG);
     for (;;) {
+        /* Drain a batch without any synchronization with the producers */
+        for (i = 0; i < SYSLOG_WI_BATCH_LEN; i++) {
+            if (syslog_queue_isempty())
+                break;
+            wi = &syslog_wi_pool[syslog_wi_tail % SYSLOG_WI_POOL_SIZE];
+            __sync_synchronize();
+            syslog(wi->priority, "%s", wi->data);
+            __sync_synchronize();
+            wi->seq = syslog_wi_tail + SYSLOG_WI_POOL_SIZE;
+            syslog_wi_tail += 1;
+        }
+        syslog_queue_report_drops();
+        if (i > 0)
+            continue;
+        if (syslog_queue_exiting)
+            return;
+
+        /*
+         * Going to sleep. Producers check the syslog_queue_sleeping after
+         * publishing and we re-check the ring after setting it, so either
+         * we see the new item or they see us sleeping and signal.
+         */
         pthread_mutex_lock(&syslog_queue_mutex);
-        while (syslog_wi_queue == NULL) {
+        syslog_queue_sleeping = 1;
+        __sync_synchronize();
+        while (syslog_queue_isempty() && !syslog_queue_exiting) {
             pthread_cond_wait(&syslog_queue_cond, &syslog_queue_mutex);
         }
-        wi = syslog_wi_queue;
-        syslog_wi_queue = wi->next;
+        syslog_queue_sleeping = 0;
         pthread_mutex_unlock(&syslog_queue_mutex);
+    }
+}
 
-        /* main work here */
-        switch (wi->item_type) {
-            case SYSLOG_ITEM_ASYNC_WRITE:
-                syslog(wi->priority, "%s", wi->data);
-                break;
-
-            case SYSLOG_ITEM_ASYNC_EXIT:
-                return;
-
-            default:
-                break;
-        }
-
-        /* put wi into syslog_wi_free' tail */
-        pthread_mutex_lock(&syslog_wi_free_mutex);
-
-        wi->next = syslog_wi_free;
-        syslog_wi_free = wi;
+static void
+syslog_queue_wakeup(void)
+{
 
-        pthread_cond_signal(&syslog_wi_free_cond);
-        pthread_mutex_unlock(&syslog_wi_free_mutex);
-    }
+    __sync_synchronize();
+    if (syslog_queue_sleeping == 0)
+        return;
+    pthread_mutex_lock(&syslog_queue_mutex);
+    pthread_cond_signal(&syslog_queue_cond);
+    pthread_mutex_unlock(&syslog_queue_mutex);
 }
 
 static int
 syslog_queue_init(void)
 {
-    int i;
+    unsigned long i;
 
     memset(syslog_wi_pool, 0, sizeof(syslog_wi_pool));
-    for (i = 0; i < SYSLOG_WI_POOL_SIZE - 1; i++) {
-        syslog_wi_pool[i].next = &syslog_wi_pool[i + 1];
+    for (i = 0; i < SYSLOG_WI_POOL_SIZE; i++) {
+        syslog_wi_pool[i].seq = i;
     }
-    syslog_wi_pool[SYSLOG_WI_POOL_SIZE - 1].next = NULL;
-
-    syslog_wi_free = syslog_wi_pool;
-    syslog_wi_queue = NULL;
-    syslog_wi_queue_tail = NULL;
-
-    syslog_dropped_items = 0;
+    syslog_wi_head = syslog_wi_tail = 0;
+    memset((void *)syslog_dropped_items, 0, sizeof(syslog_dropped_items));
+    syslog_queue_sleeping = syslog_queue_exiting = 0;
 
     pthread_cond_init(&syslog_queue_cond, NULL);
     pthread_mutex_init(&syslog_queue_mutex, NULL);
-    pthread_cond_init(&syslog_wi_free_cond, NULL);
-    pthread_mutex_init(&syslog_wi_free_mutex, NULL);
 
     if (pthread_create(&syslog_queue, NULL, (void *(*)(void *))&syslog_queue_run, NULL) != 0)
         return -1;
@@ -133,63 +179,47 @@ syslog_queue_init(void)
 }
 
 static struct syslog_wi *
-syslog_queue_get_free_item(int wait)
+syslog_queue_get_free_item(int priority)
 {
     struct syslog_wi *wi;
+    unsigned long pos;
+    long dif;
 
-    pthread_mutex_lock(&syslog_wi_free_mutex);
-    while (syslog_wi_free == NULL) {
-        /* no free work items, return if no wait is requested */
-        if (wait == 0) {
-            syslog_dropped_items++;
-            pthread_mutex_unlock(&syslog_wi_free_mutex);
-            return NULL;
+    for (;;) {
+        pos = syslog_wi_head;
+        wi = &syslog_wi_pool[pos % SYSLOG_WI_POOL_SIZE];
+        dif = (long)(wi->seq - pos);
+        if (dif == 0) {
+            if (__sync_bool_compare_and_swap(&syslog_wi_head, pos, pos + 1))
+                break;
+        } else if (dif < 0) {
+            /* The ring is full, never wait for the consumer */
+            __sync_fetch_and_add(&syslog_dropped_items[LOG_PRI(priority)], 1);
+            return (NULL);
         }
-        pthread_cond_wait(&syslog_wi_free_cond, &syslog_wi_free_mutex);
     }
-
-    wi = syslog_wi_free;
-
-    /* move up syslog_wi_free */
-    syslog_wi_free = syslog_wi_free->next;
-    pthread_mutex_unlock(&syslog_wi_free_mutex);
-
-    return wi;
+    return (wi);
 }
 
 static void
 syslog_queue_put_item(struct syslog_wi *wi)
 {
 
-    pthread_mutex_lock(&syslog_queue_mutex);
-
-    wi->next = NULL;
-    if (syslog_wi_queue == NULL) {
-        syslog_wi_queue = wi;
-        syslog_wi_queue_tail = wi;
-    } else {
-        syslog_wi_queue_tail->next = wi;
-        syslog_wi_queue_tail = wi;
-    }
-
-    /* notify worker thread */
-    pthread_cond_signal(&syslog_queue_cond);
-
-    pthread_mutex_unlock(&syslog_queue_mutex);
+    __sync_synchronize();
+    wi->seq += 1;
+    syslog_queue_wakeup();
 }
 
 static void
 syslog_async_atexit(void)
 {
-    struct syslog_wi *wi;
 
     if (syslog_queue_inited == 0)
         return;
 
-    /* Wait for the worker thread to exit */
-    wi = syslog_queue_get_free_item(SYSLOG_WI_WAIT);
-    wi->item_type = SYSLOG_ITEM_ASYNC_EXIT;
-    syslog_queue_put_item(wi);
+    /* Let the worker thread flush whatever is queued and exit */
+    syslog_queue_exiting = 1;
+    syslog_queue_wakeup();
     pthread_join(syslog_queue, NULL);
 }
 
@@ -220,7 +250,7 @@ vsyslog_async(int priority, const char *format, va_list ap)
     char *p;
     int s1, s2;
 
-    wi = syslog_queue_get_free_item(SYSLOG_WI_NOWAIT);
+    wi = syslog_queue_get_free_item(priority);
     if (wi == NULL)
         return;
 
@@ -234,6 +264,5 @@ vsyslog_async(int priority, const char *format, va_list ap)
     }
     wi->len = s2;
     wi->priority = priority;
-    wi->item_type = SYSLOG_ITEM_ASYNC_WRITE;
     syslog_queue_put_item(wi);
 }
@@ -39,6 +39,7 @@
 #include "rtpp_time.h"
 #include "rtpp_timed.h"
 #include "rtpp_timed_fin.h"
+#include "rtpp_cpuset.h"
 
 #include "elperiodic.h"
 
@@ -91,6 +92,7 @@ rtpp_timed_queue_run(void *argp)
     int signum;
     double ctime;
 
+    rtpp_cpuset_bind(RTPP_THR_TIMED);
     rtcp = (struct rtpp_timed_cf *)argp;
     for (;;) {
         if (rtpp_queue_get_length(rtcp->cmd_q) > 0) {
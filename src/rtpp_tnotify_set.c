@@ -54,7 +54,6 @@
 #include "rtpp_tnotify_tgt.h"
 #include "rtpp_mallocs.h"
 
-#define RTPP_TNOTIFY_TARGETS_MAX 64
 #define RTPP_TNOTIFY_WILDCARDS_MAX 2
 
 #define CC_SELF_STR	"%%CC_SELF%%"
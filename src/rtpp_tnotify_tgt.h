@@ -25,6 +25,8 @@
  *
  */
 
+#define RTPP_TNOTIFY_TARGETS_MAX 64
+
 struct rtpp_tnotify_target {
     char *socket_name;
     int socket_type;
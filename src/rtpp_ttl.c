@@ -52,6 +52,22 @@ static int rtpp_ttl_decr(struct rtpp_ttl *);
 #define PUB2PVT(pubp) \
   ((struct rtpp_ttl_priv *)((char *)(pubp) - offsetof(struct rtpp_ttl_priv, pub)))
 
+static int
+rtpp_ttl_init(struct rtpp_ttl_priv *pvt, struct rtpp_refcnt *rcnt, int max_ttl)
+{
+
+    pvt->pub.rcnt = rcnt;
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        return (-1);
+    }
+    pvt->pub.reset = &rtpp_ttl_reset;
+    pvt->pub.reset_with = &rtpp_ttl_reset_with;
+    pvt->pub.get_remaining = &rtpp_ttl_get_remaining;
+    pvt->pub.decr = &rtpp_ttl_decr;
+    pvt->ttl = pvt->max_ttl = max_ttl;
+    return (0);
+}
+
 struct rtpp_ttl *
 rtpp_ttl_ctor(int max_ttl)
 {
@@ -62,32 +78,59 @@ rtpp_ttl_ctor(int max_ttl)
     if (pvt == NULL) {
         goto e0;
     }
-    pvt->pub.rcnt = rcnt;
-    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+    if (rtpp_ttl_init(pvt, rcnt, max_ttl) != 0) {
         goto e1;
     }
-    pvt->pub.reset = &rtpp_ttl_reset;
-    pvt->pub.reset_with = &rtpp_ttl_reset_with;
-    pvt->pub.get_remaining = &rtpp_ttl_get_remaining;
-    pvt->pub.decr = &rtpp_ttl_decr;
-    pvt->ttl = pvt->max_ttl = max_ttl;
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_ttl_dtor,
       pvt);
     return ((&pvt->pub));
 
 e1:
-    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    CALL_SMETHOD(rcnt, decref);
     free(pvt);
 e0:
     return (NULL);
 }
 
+size_t
+rtpp_ttl_osize(void)
+{
+
+    return (sizeof(struct rtpp_ttl_priv));
+}
+
+/*
+ * Same as rtpp_netaddr_ctor_pa(): the object lives in the owner's memory
+ * and shares owner's refcounter, rtpp_ttl_dtor_pa() is to be called by the
+ * owner's destructor.
+ */
+struct rtpp_ttl *
+rtpp_ttl_ctor_pa(void *pap, struct rtpp_refcnt *rcnt, int max_ttl)
+{
+    struct rtpp_ttl_priv *pvt;
+
+    pvt = (struct rtpp_ttl_priv *)pap;
+    if (rtpp_ttl_init(pvt, rcnt, max_ttl) != 0) {
+        return (NULL);
+    }
+    return (&pvt->pub);
+}
+
+void
+rtpp_ttl_dtor_pa(struct rtpp_ttl *self)
+{
+    struct rtpp_ttl_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    rtpp_ttl_fin(self);
+    pthread_mutex_destroy(&pvt->lock);
+}
+
 static void
 rtpp_ttl_dtor(struct rtpp_ttl_priv *pvt)
 {
 
-    rtpp_ttl_fin(&(pvt->pub));
-    pthread_mutex_destroy(&pvt->lock);
+    rtpp_ttl_dtor_pa(&(pvt->pub));
     free(pvt);
 }
 
@@ -43,3 +43,6 @@ struct rtpp_ttl {
 };
 
 struct rtpp_ttl *rtpp_ttl_ctor(int);
+size_t rtpp_ttl_osize(void);
+struct rtpp_ttl *rtpp_ttl_ctor_pa(void *, struct rtpp_refcnt *, int);
+void rtpp_ttl_dtor_pa(struct rtpp_ttl *);
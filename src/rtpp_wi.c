@@ -41,6 +41,7 @@
 #include "rtpp_wi.h"
 #include "rtpp_wi_private.h"
 #include "rtpp_netaddr.h"
+#include "rtpp_pcnt_strm.h"
 
 struct rtpp_wi_sendto {
     struct rtpp_wi wi;
@@ -91,9 +92,15 @@ rtpp_wi_malloc_pkt(int sock, struct rtp_packet *pkt,
     wi->flags = 0;
     wi->msg = pkt->data.buf;
     wi->msg_len = pkt->size;
-    wi->sendto = sstosa(&pkt->raddr);
+    if (sendto != NULL) {
+        wi->sendto = sstosa(&pkt->raddr);
+        memcpy(wi->sendto, sendto, tolen);
+    } else {
+        /* Connected socket, destination is implied */
+        wi->sendto = NULL;
+        tolen = 0;
+    }
     wi->tolen = tolen;
-    memcpy(wi->sendto, sendto, tolen);
     wi->nsend = nsend;
     return (wi);
 }
@@ -260,6 +267,22 @@ rtpp_wi_apis_getnamearg(struct rtpp_wi *wi, void **datap, size_t datalen)
     return ((const char *)wi->sendto);
 }
 
+/*
+ * Tag packet to have its forwarding latency reported back into the
+ * pcnt_strm once the sender thread is done with it.
+ */
+void
+rtpp_wi_pkt_set_fwlat(struct rtp_packet *pkt, struct rtpp_pcnt_strm *pcs)
+{
+    struct rtpp_wi *wi;
+
+    wi = pkt->wi;
+    assert(wi->fwl_pcs == NULL);
+    CALL_SMETHOD(pcs->rcnt, incref);
+    wi->fwl_pcs = pcs;
+    wi->fwl_rtime = pkt->rtime;
+}
+
 void
 rtpp_wi_free(struct rtpp_wi *wi)
 {
@@ -267,8 +290,16 @@ rtpp_wi_free(struct rtpp_wi *wi)
     if (wi->sock_rcnt != NULL) {
         CALL_SMETHOD(wi->sock_rcnt, decref);
     }
+    if (wi->fwl_pcs != NULL) {
+        CALL_SMETHOD(wi->fwl_pcs->rcnt, decref);
+    }
     if (wi->log != NULL) {
         CALL_SMETHOD(wi->log->rcnt, decref);
     }
+    if (wi->free_ptr != wi && wi->wi_type == RTPP_WI_TYPE_OPKT) {
+        /* Work item embedded into the packet, see rtpp_wi_malloc_pkt() */
+        rtp_packet_free(wi->free_ptr);
+        return;
+    }
     free(wi->free_ptr);
 }
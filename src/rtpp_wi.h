@@ -33,6 +33,7 @@ struct rtp_packet;
 struct rtpp_refcnt;
 struct sockaddr;
 struct rtpp_netaddr;
+struct rtpp_pcnt_strm;
 
 enum rtpp_wi_type {RTPP_WI_TYPE_OPKT = 0, RTPP_WI_TYPE_SGNL = 1,
   RTPP_WI_TYPE_API_STR = 2, RTPP_WI_TYPE_DATA = 3};
@@ -52,6 +53,7 @@ struct rtpp_wi *rtpp_wi_malloc_udata(void **, size_t);
 void *rtpp_wi_data_get_ptr(struct rtpp_wi *, size_t, size_t);
 const char * rtpp_wi_apis_getnamearg(struct rtpp_wi *, void **, size_t);
 
+void rtpp_wi_pkt_set_fwlat(struct rtp_packet *, struct rtpp_pcnt_strm *);
 void rtpp_wi_free(struct rtpp_wi *);
 
 #if defined(RTPP_CHECK_LEAKS)
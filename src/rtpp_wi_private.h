@@ -30,6 +30,7 @@
 
 struct rtpp_refcnt;
 struct rtpp_log;
+struct rtpp_pcnt_strm;
 
 struct rtpp_wi {
     struct rtpp_wi *next;
@@ -45,6 +46,9 @@ struct rtpp_wi {
     int nsend;
     int debug;
     struct rtpp_log *log;
+    /* Set on sampled packets to measure forwarding latency */
+    struct rtpp_pcnt_strm *fwl_pcs;
+    double fwl_rtime;
     char data[0];
 };
 
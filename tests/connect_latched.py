@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+#
+# Helper for the connect_latched test: streams RTP both ways through a
+# session until rtpproxy has connected both sockets, then closes the
+# callee's socket and keeps sending from the caller, so that ICMP port
+# unreachable comes back on the connected socket. Checks that the error
+# is noticed and cleared and that the process is not left spinning on it
+# afterwards, which is what /proc/<pid in argv[2]>/stat is read for.
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+
+from rtpp_testlib import RtppCtl, udp_socket, rtp, drain
+
+ctl = RtppCtl(sys.argv[1])
+pid = int(open(sys.argv[2]).read().strip())
+
+def cpu_ticks():
+    f = open('/proc/%d/stat' % pid).read()
+    f = f[f.rindex(')') + 2:].split()
+    return int(f[11]) + int(f[12])
+
+a = udp_socket()
+b = udp_socket()
+pa = int(ctl.command('U conlatch 127.0.0.1 %d fta' % a.getsockname()[1]))
+pb = int(ctl.command('L conlatch 127.0.0.1 %d fta ftb' %
+  b.getsockname()[1]))
+
+# Stream both ways until both sides have settled and got connected
+seq = 0
+tstop = time.time() + 10
+while ctl.stat('nstrm_connected') < 2 and time.time() < tstop:
+    for i in range(5):
+        seq += 1
+        a.sendto(rtp(seq), ('127.0.0.1', pb))
+        b.sendto(rtp(seq), ('127.0.0.1', pa))
+        time.sleep(0.02)
+    drain(a)
+    drain(b)
+print('connected=%d' % min(ctl.stat('nstrm_connected'), 2))
+
+# The callee goes away, the caller keeps sending
+b.close()
+tstop = time.time() + 5
+while ctl.stat('nstrm_connerr') < 1 and time.time() < tstop:
+    seq += 1
+    a.sendto(rtp(seq), ('127.0.0.1', pb))
+    time.sleep(0.02)
+    drain(a)
+print('connerr=%d' % min(ctl.stat('nstrm_connerr'), 1))
+
+# The error has to be cleared, or the I/O thread spins on the socket
+a.close()
+if os.path.exists('/proc/%d/stat' % pid):
+    t0 = cpu_ticks()
+    time.sleep(2)
+    busy = (cpu_ticks() - t0) > 100
+else:
+    busy = False
+print('busy=%d' % int(busy))
+
+print('delete=%s' % ctl.command('D conlatch fta'))
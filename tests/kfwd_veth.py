@@ -0,0 +1,101 @@
+#!/usr/bin/env python
+#
+# Helper for the kfwd_veth test. The caller and the callee sockets are
+# created in the network namespaces and at the addresses in argv[2-5],
+# rtpproxy listens on argv[6]. Streams RTP and RTCP both ways until the
+# flows settle, then checks that all four settled flows, RTP included,
+# have gone to the kernel without losing anything, that the RTP analyzer
+# has accounted for the packets it has not seen, also once the flows are
+# back to the userland, and that a packet with the same source tuple sent
+# to another local address (argv[7]) is left alone by the classifier.
+
+from __future__ import print_function
+
+import ctypes
+import os
+import socket
+import sys
+import time
+
+from rtpp_testlib import RtppCtl, rtp, rtcp, drain
+
+CLONE_NEWNET = 0x40000000
+
+ctl = RtppCtl(sys.argv[1])
+ns_a, addr_a, ns_b, addr_b, rtpp_addr, other_addr = sys.argv[2:8]
+
+libc = ctypes.CDLL(None, use_errno=True)
+
+def socket_in(ns, addr, port=0):
+    # Sockets stay in the namespace they have been created in
+    self_fd = os.open('/proc/self/ns/net', os.O_RDONLY)
+    ns_fd = os.open('/var/run/netns/%s' % ns, os.O_RDONLY)
+    try:
+        if libc.setns(ns_fd, CLONE_NEWNET) != 0:
+            raise OSError(ctypes.get_errno(), 'setns')
+        s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        s.bind((addr, port))
+        s.setblocking(False)
+    finally:
+        libc.setns(self_fd, CLONE_NEWNET)
+        os.close(ns_fd)
+        os.close(self_fd)
+    return s
+
+def stream(socks, seq0, npkts):
+    # socks: (socket, destination port, packet generator)
+    for seq in range(seq0, seq0 + npkts):
+        for s, port, mkpkt in socks:
+            s.sendto(mkpkt(seq), (rtpp_addr, port))
+        time.sleep(0.02)
+
+rtp_a = socket_in(ns_a, addr_a)
+rtp_b = socket_in(ns_b, addr_b)
+# RTCP goes to/from the RTP port + 1
+rtcp_a = socket_in(ns_a, addr_a, rtp_a.getsockname()[1] + 1)
+rtcp_b = socket_in(ns_b, addr_b, rtp_b.getsockname()[1] + 1)
+
+pa = int(ctl.command('U kfwdveth %s %d fta' % (addr_a,
+  rtp_a.getsockname()[1])).split()[0])
+lcmd = 'L kfwdveth %s %d fta ftb' % (addr_b, rtp_b.getsockname()[1])
+pb = int(ctl.command(lcmd).split()[0])
+
+flows = ((rtp_a, pb, rtp), (rtp_b, pa, rtp), (rtcp_a, pb + 1, rtcp),
+  (rtcp_b, pa + 1, rtcp))
+
+# Let both sides latch and settle
+stream(flows, 0, 150)
+time.sleep(1.5)
+for s, port, mkpkt in flows:
+    drain(s)
+nkfwd = ctl.stat('npkts_kfwd')
+
+# Should now be going around the userland, RTP and RTCP alike
+stream(flows, 150, 100)
+time.sleep(1.5)
+nrcvd = [drain(s) for s, port, mkpkt in flows]
+print('rtp_rcvd=%d,%d' % (nrcvd[1], nrcvd[0]))
+print('rtcp_rcvd=%d,%d' % (nrcvd[3], nrcvd[2]))
+# RTCP alone would only make it 200
+print('kfwd=%d' % int(ctl.stat('npkts_kfwd') - nkfwd == 400))
+def rtpa():
+    for ft in ('fta ftb', 'ftb fta'):
+        print('rtpa=%s' % ctl.command('Q kfwdveth %s rtpa_nrcvd rtpa_nlost' %
+          ft))
+rtpa()
+
+# A command brings the flows back to the userland, where the analyzer
+# should not take the packets it has missed for lost ones
+ctl.command(lcmd)
+stream(flows, 250, 50)
+time.sleep(1.5)
+for s, port, mkpkt in flows:
+    drain(s)
+rtpa()
+
+# Same source address and port, but not to rtpproxy
+rtcp_a.sendto(rtcp(0), (other_addr, pb + 1))
+time.sleep(0.5)
+print('transit=%d' % drain(rtcp_b))
+
+print('delete=%s' % ctl.command('D kfwdveth fta'))
@@ -0,0 +1,76 @@
+#!/usr/bin/env python
+#
+# Bits shared by the python test helpers: a client for the rtpproxy
+# control socket and the few RTP/RTCP packet and UDP socket utilities the
+# helpers use to push media through it.
+
+import socket
+import struct
+
+class RtppCtl(object):
+    # The spec is either host:port of the UDP control socket, or a path
+    # to the unix stream one, which takes one command per connection.
+    def __init__(self, spec, timeout=2):
+        self.timeout = timeout
+        self.ncmd = 0
+        if spec.startswith('/'):
+            self.path = spec
+            self.s = None
+        else:
+            host, port = spec.rsplit(':', 1)
+            self.path = None
+            self.addr = (host, int(port))
+            self.s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            self.s.settimeout(timeout)
+
+    def command(self, c):
+        if self.path is not None:
+            return self._command_stream(c)
+        self.ncmd += 1
+        cookie = 'c%d' % self.ncmd
+        self.s.sendto(('%s %s' % (cookie, c)).encode(), self.addr)
+        while True:
+            r = self.s.recv(8192).decode().strip().split(' ', 1)
+            if r[0] == cookie:
+                return r[1]
+
+    def _command_stream(self, c):
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        s.settimeout(self.timeout)
+        s.connect(self.path)
+        s.sendall((c + '\n').encode())
+        r = b''
+        while not r.endswith(b'\n'):
+            d = s.recv(8192)
+            if not d:
+                break
+            r += d
+        s.close()
+        return r.decode().strip()
+
+    def stat(self, name):
+        return int(self.command('G %s' % name))
+
+def udp_socket(addr='127.0.0.1', port=0):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.bind((addr, port))
+    s.setblocking(False)
+    return s
+
+def rtp(seq, ssrc=0x1234):
+    return struct.pack('!BBHII', 0x80, 0, seq & 0xffff, seq * 160,
+      ssrc) + b'\xd5' * 160
+
+def rtcp(seq, ssrc=0x1234):
+    return struct.pack('!BBHI', 0x80, 201, 1, ssrc) + struct.pack('!I', seq)
+
+# Returns the number of datagrams that were waiting in the socket
+def drain(s):
+    n = 0
+    try:
+        while True:
+            s.recv(2048)
+            n += 1
+    except socket.error:
+        pass
+    return n
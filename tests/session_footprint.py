@@ -0,0 +1,52 @@
+#!/usr/bin/env python
+#
+# Helper for the session_footprint test: creates argv[2] idle sessions
+# (U+L, no media) over the unix control socket in argv[1], taking the
+# number and the total size of the memory blocks they have allocated from
+# the memdeb counters of the debug build, and checks the per-session
+# averages against the budgets below. The time it takes to set up a
+# session (U+L round trip) is reported on the stderr, it is too dependent
+# on the host to be checked. The sessions are deleted at the end, any
+# leaks are reported by the memdeb on exit.
+
+from __future__ import print_function
+
+import sys
+import time
+
+from rtpp_testlib import RtppCtl
+
+ctl = RtppCtl(sys.argv[1])
+nsess = int(sys.argv[2])
+
+# Per-session budgets
+MAX_NALLOC = 26
+MAX_BALLOC = 10 * 1024 + 512
+
+def md_unalloc():
+    return [int(x) for x in ctl.command('G md_nunalloc md_bunalloc').split()]
+
+nb, bb = md_unalloc()
+stimes = []
+for i in range(nsess):
+    t0 = time.time()
+    ctl.command('U sfp%d 127.0.0.1 %d fta%d' % (i, 2000 + i * 2, i))
+    ctl.command('L sfp%d 127.0.0.1 %d fta%d ftb%d' % (i, 4000 + i * 2, i, i))
+    stimes.append(time.time() - t0)
+na, ba = md_unalloc()
+nalloc = float(na - nb) / nsess
+balloc = float(ba - bb) / nsess
+sys.stderr.write('%d sessions: %.2f allocations, %.0f bytes per session\n' %
+  (nsess, nalloc, balloc))
+stimes.sort()
+sys.stderr.write('setup time: avg %.3f ms, p50 %.3f ms, p99 %.3f ms\n' %
+  (1000.0 * sum(stimes) / nsess, 1000.0 * stimes[nsess // 2],
+  1000.0 * stimes[(nsess * 99) // 100]))
+print('nalloc<=%d: %d' % (MAX_NALLOC, int(nalloc <= MAX_NALLOC)))
+print('balloc<=%d: %d' % (MAX_BALLOC, int(balloc <= MAX_BALLOC)))
+
+ndel = 0
+for i in range(nsess):
+    if ctl.command('D sfp%d fta%d' % (i, i)) == '0':
+        ndel += 1
+print('deleted=%d' % ndel)
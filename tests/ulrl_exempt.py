@@ -0,0 +1,58 @@
+#!/usr/bin/env python
+#
+# Helper for the ulrl_exempt test, rtpproxy is capping unlatched streams
+# at 5 packets per second. Streams RTP and RTCP through an asymmetric
+# session whose RTP switches to the (bad) SSRC 0, which unlatches it, and
+# RTP through a symmetric session that has been re-signalled before any
+# media arrived, which keeps it from latching for the UPDATE_WINDOW.
+# Neither may lose packets to the rate limiter.
+
+from __future__ import print_function
+
+import sys
+import time
+
+from rtpp_testlib import RtppCtl, udp_socket, rtp, rtcp, drain
+
+NPKTS = 50
+
+ctl = RtppCtl(sys.argv[1])
+
+def rtp_ssrc0(seq):
+    return rtp(seq, 0x1234 if seq == 0 else 0)
+
+def stream(flows):
+    # flows: (socket, destination port, packet generator)
+    for seq in range(NPKTS):
+        for s, port, mkpkt in flows:
+            s.sendto(mkpkt(seq), ('127.0.0.1', port))
+        time.sleep(0.02)
+    time.sleep(0.5)
+    return [drain(s) for s, port, mkpkt in flows]
+
+# Asymmetric, RTP and RTCP
+a = udp_socket()
+b = udp_socket()
+a_rtcp = udp_socket(port=a.getsockname()[1] + 1)
+b_rtcp = udp_socket(port=b.getsockname()[1] + 1)
+pa = int(ctl.command('Ua ulrlasym 127.0.0.1 %d fta' % a.getsockname()[1]))
+pb = int(ctl.command('La ulrlasym 127.0.0.1 %d fta ftb' %
+  b.getsockname()[1]))
+nrcvd = stream(((a, pb, rtp_ssrc0), (b, pa, rtp_ssrc0), (a_rtcp, pb + 1, rtcp),
+  (b_rtcp, pa + 1, rtcp)))
+print('asym_rtp_rcvd=%d,%d' % (nrcvd[1], nrcvd[0]))
+print('asym_rtcp_rcvd=%d,%d' % (nrcvd[3], nrcvd[2]))
+print('delete=%s' % ctl.command('D ulrlasym fta'))
+
+# Symmetric, answer re-sent with the same addresses before any media
+c = udp_socket()
+d = udp_socket()
+pc = int(ctl.command('U ulrlsym 127.0.0.1 %d ftc' % c.getsockname()[1]))
+pd = int(ctl.command('L ulrlsym 127.0.0.1 %d ftc ftd' % d.getsockname()[1]))
+ctl.command('U ulrlsym 127.0.0.1 %d ftc ftd' % c.getsockname()[1])
+ctl.command('L ulrlsym 127.0.0.1 %d ftc ftd' % d.getsockname()[1])
+nrcvd = stream(((c, pd, rtp), (d, pc, rtp)))
+print('sym_rtp_rcvd=%d,%d' % (nrcvd[1], nrcvd[0]))
+print('delete=%s' % ctl.command('D ulrlsym ftc'))
+
+print('rlimited=%d' % ctl.stat('npkts_rlimited'))